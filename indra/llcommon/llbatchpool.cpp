@@ -0,0 +1,201 @@
+/**
+ * @file llbatchpool.cpp
+ * @brief Runs batches of independent jobs on the calling thread and a few worker threads.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llbatchpool.h"
+#include "lltimer.h"
+
+LLBatchPool* LLBatchPool::sShared = NULL;
+U32 LLBatchPool::sSharedRefs = 0;
+
+LLBatchPool::Worker::Worker(LLBatchPool* pool, U32 index)
+: LLThread(llformat("%s %d", pool->mName.c_str(), index)),
+  mPool(pool),
+  mIndex(index)
+{
+}
+
+void LLBatchPool::Worker::run()
+{
+	LLCondition* signal = mPool->mSignal;
+	signal->lock();
+	U32 serial = mPool->mBatchSerial;
+	while (!isQuitting())
+	{
+		if (mPool->mBatchSerial == serial)
+		{
+			signal->wait();
+			continue;
+		}
+
+		serial = mPool->mBatchSerial;
+		// A worker that wakes up after run() returned finds no batch; it must not touch mNext
+		// anymore, which the next batch resets.
+		if (!mPool->mBatch || mIndex >= mPool->mBatchWorkers)
+		{
+			continue;
+		}
+
+		Batch* batch = mPool->mBatch;
+		U32 count = mPool->mBatchSize;
+		++mPool->mActiveWorkers;
+		signal->unlock();
+
+		mPool->runJobs(batch, count);
+
+		signal->lock();
+		if (!--mPool->mActiveWorkers && mPool->mWaiting)
+		{
+			signal->broadcast();
+		}
+	}
+	signal->unlock();
+}
+
+LLBatchPool::LLBatchPool(const std::string& name, U32 num_workers) :
+	mName(name),
+	mSignal(new LLCondition),
+	mBatch(NULL),
+	mBatchSize(0),
+	mBatchWorkers(0),
+	mBatchSerial(0),
+	mActiveWorkers(0),
+	mWaiting(false),
+	mNext(0)
+{
+	addWorkers(num_workers);
+}
+
+LLBatchPool::~LLBatchPool()
+{
+	mSignal->lock();
+	for (std::vector<Worker*>::iterator iter = mWorkers.begin(); iter != mWorkers.end(); ++iter)
+	{
+		(*iter)->setQuitting();
+	}
+	mSignal->broadcast();
+	mSignal->unlock();
+
+	for (std::vector<Worker*>::iterator iter = mWorkers.begin(); iter != mWorkers.end(); ++iter)
+	{
+		while (!(*iter)->isStopped())
+		{
+			ms_sleep(1);
+		}
+		delete *iter;
+	}
+	mWorkers.clear();
+
+	delete mSignal;
+	mSignal = NULL;
+}
+
+void LLBatchPool::addWorkers(U32 num_workers)
+{
+	for (U32 i = 0; i < num_workers; ++i)
+	{
+		Worker* worker = new Worker(this, mWorkers.size());
+		mWorkers.push_back(worker);
+		worker->start();
+	}
+	if (num_workers)
+	{
+		llinfos << "Started " << num_workers << " " << mName << " thread(s)." << llendl;
+	}
+}
+
+//static
+LLBatchPool* LLBatchPool::getShared(U32 num_workers)
+{
+	if (!sShared)
+	{
+		sShared = new LLBatchPool("batch", num_workers);
+	}
+	else if (num_workers > sShared->getNumWorkers())
+	{
+		// No batch is running; they are only run from the main thread.
+		sShared->addWorkers(num_workers - sShared->getNumWorkers());
+	}
+	++sSharedRefs;
+	return sShared;
+}
+
+//static
+void LLBatchPool::releaseShared()
+{
+	llassert_always(sSharedRefs > 0);
+	if (!--sSharedRefs)
+	{
+		delete sShared;
+		sShared = NULL;
+	}
+}
+
+void LLBatchPool::run(Batch& batch, U32 count, U32 max_workers, U32 min_parallel)
+{
+	U32 num_workers = llmin(max_workers, getNumWorkers());
+	if (!num_workers || count < min_parallel)
+	{
+		for (U32 i = 0; i < count; ++i)
+		{
+			batch.runJob(i);
+		}
+		return;
+	}
+
+	mSignal->lock();
+	mBatch = &batch;
+	mBatchSize = count;
+	mBatchWorkers = num_workers;
+	mNext = 0;
+	++mBatchSerial;
+	mSignal->broadcast();
+	mSignal->unlock();
+
+	runJobs(&batch, count);
+
+	// Every job is claimed now; wait for the workers that are still running one.
+	mSignal->lock();
+	mWaiting = true;
+	while (mActiveWorkers)
+	{
+		mSignal->wait();
+	}
+	mWaiting = false;
+	mBatch = NULL;
+	mBatchSize = 0;
+	mSignal->unlock();
+}
+
+void LLBatchPool::runJobs(Batch* batch, U32 count)
+{
+	U32 index;
+	while ((index = mNext++) < count)
+	{
+		batch->runJob(index);
+	}
+}
@@ -0,0 +1,104 @@
+/**
+ * @file llbatchpool.h
+ * @brief Runs batches of independent jobs on the calling thread and a few worker threads.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLBATCHPOOL_H
+#define LL_LLBATCHPOOL_H
+
+#include <string>
+#include <vector>
+
+#include "llatomic.h"
+#include "llthread.h"
+
+// Splits a batch of jobs between the thread that calls run() and the worker threads,
+// and returns when all of them are done; the jobs may point into the caller's data.
+// Idle workers block on a condition, and so does run() while workers finish their last jobs.
+//
+// Only one thread may call run(), one batch at a time. Code that runs batches from the
+// main thread should use getShared(), so that it doesn't start a set of threads of its own.
+class LL_COMMON_API LLBatchPool
+{
+public:
+	// The jobs of one batch.
+	class Batch
+	{
+	public:
+		virtual ~Batch() { }
+		// Called once for every index below the batch size, on any thread.
+		virtual void runJob(U32 index) = 0;
+	};
+
+	LLBatchPool(const std::string& name, U32 num_workers);
+	~LLBatchPool();
+
+	// Main thread. Returns the pool shared by the main thread batches, with at least num_workers workers.
+	// Every call must be matched by a call to releaseShared(); the workers stop when the last one is released.
+	static LLBatchPool* getShared(U32 num_workers);
+	static void releaseShared();
+
+	U32 getNumWorkers() const { return mWorkers.size(); }
+
+	// Runs batch.runJob() for every index below count on the calling thread and at most max_workers
+	// workers, and returns when all of them are done. Batches of fewer than min_parallel jobs are run
+	// on the calling thread only; waking the workers would cost more.
+	void run(Batch& batch, U32 count, U32 max_workers, U32 min_parallel);
+
+private:
+	class Worker : public LLThread
+	{
+	public:
+		Worker(LLBatchPool* pool, U32 index);
+		/*virtual*/ void run();
+
+	private:
+		LLBatchPool* mPool;
+		U32 mIndex;
+	};
+
+	void addWorkers(U32 num_workers);
+
+	// Claims and runs jobs of the current batch until there are none left.
+	void runJobs(Batch* batch, U32 count);
+
+	std::string mName;
+	std::vector<Worker*> mWorkers;
+
+	// Protected by mSignal.
+	LLCondition* mSignal;
+	Batch* mBatch;
+	U32 mBatchSize;
+	U32 mBatchWorkers;				// Workers with a lower index help with the current batch.
+	U32 mBatchSerial;				// Incremented for every batch that is handed to the workers.
+	U32 mActiveWorkers;				// Workers that are working on the current batch.
+	bool mWaiting;					// run() waits for mActiveWorkers to drop to zero.
+
+	LLAtomicU32 mNext;				// Index of the next job to claim.
+
+	static LLBatchPool* sShared;
+	static U32 sSharedRefs;
+};
+
+#endif // LL_LLBATCHPOOL_H
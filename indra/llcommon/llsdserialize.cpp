@@ -2080,22 +2080,19 @@ std::string zip_llsd(LLSD& data)
 	return result;
 }
 
-//decompress a block of LLSD from provided istream
-// not very efficient -- creats a copy of decompressed LLSD block in memory
-// and deserializes from that copy using LLSDSerialize
-bool unzip_llsd(LLSD& data, std::istream& is, S32 size)
+//inflate a zipped block of size bytes from the provided istream, without parsing it
+// returns a malloc()'d buffer of outsize bytes that the caller must free(), or NULL on error
+U8* unzip_llsd_raw(U32& outsize, std::istream& is, S32 size)
 {
 	U8* result = NULL;
-	U32 cur_size = 0;
+	U32 capacity = 0;
 	z_stream strm;
-		
-	const U32 CHUNK = 65536;
+
+	outsize = 0;
 
 	U8 *in = new U8[size];
 	is.read((char*) in, size); 
 
-	U8 out[CHUNK];
-		
 	strm.zalloc = Z_NULL;
 	strm.zfree = Z_NULL;
 	strm.opaque = Z_NULL;
@@ -2106,15 +2103,21 @@ bool unzip_llsd(LLSD& data, std::istream& is, S32 size)
 	
 	do
 	{
-		strm.avail_out = CHUNK;
-		strm.next_out = out;
+		if (outsize == capacity)
+		{	//inflate straight into the result, growing it as needed (mesh blocks typically compress 3-4x)
+			capacity = capacity ? capacity * 2 : llmax(size * 4, 65536);
+			result = (U8*) realloc(result, capacity);
+		}
+
+		strm.avail_out = capacity - outsize;
+		strm.next_out = result + outsize;
 		ret = inflate(&strm, Z_NO_FLUSH);
 		if (ret == Z_STREAM_ERROR)
 		{
 			inflateEnd(&strm);
 			free(result);
 			delete [] in;
-			return false;
+			return NULL;
 		}
 		
 		switch (ret)
@@ -2126,15 +2129,11 @@ bool unzip_llsd(LLSD& data, std::istream& is, S32 size)
 			inflateEnd(&strm);
 			free(result);
 			delete [] in;
-			return false;
+			return NULL;
 			break;
 		}
 
-		U32 have = CHUNK-strm.avail_out;
-
-		result = (U8*) realloc(result, cur_size + have);
-		memcpy(result+cur_size, out, have);
-		cur_size += have;
+		outsize = capacity - strm.avail_out;
 
 	} while (ret == Z_OK);
 
@@ -2144,6 +2143,18 @@ bool unzip_llsd(LLSD& data, std::istream& is, S32 size)
 	if (ret != Z_STREAM_END)
 	{
 		free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+bool unzip_llsd(LLSD& data, std::istream& is, S32 size)
+{
+	U32 cur_size = 0;
+	U8* result = unzip_llsd_raw(cur_size, is, size);
+	if (!result)
+	{
 		return false;
 	}
 
@@ -794,5 +794,7 @@ public:
 //dirty little zip functions -- yell at davep
 LL_COMMON_API std::string zip_llsd(LLSD& data);
 LL_COMMON_API bool unzip_llsd(LLSD& data, std::istream& is, S32 size);
+// Inflates a zipped block without parsing it. Returns a malloc()'d buffer of outsize bytes, or NULL on error.
+LL_COMMON_API U8* unzip_llsd_raw(U32& outsize, std::istream& is, S32 size);
 LL_COMMON_API U8* unzip_llsdNavMesh( bool& valid, unsigned int& outsize,std::istream& is, S32 size);
 #endif // LL_LLSDSERIALIZE_H
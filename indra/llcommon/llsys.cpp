@@ -66,6 +66,7 @@ using namespace llsd;
 #	include <errno.h>
 #	include <sys/sysctl.h>
 #	include <sys/utsname.h>
+#	include <unistd.h>
 #	include <stdint.h>
 #	include <Carbon/Carbon.h>
 #   include <stdexcept>
@@ -631,6 +632,25 @@ F64 LLCPUInfo::getMHz() const
 	return mCPUMHz;
 }
 
+//static
+U32 LLCPUInfo::getCoreCount()
+{
+#if LL_WINDOWS
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (U32)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (U32)count : 1;
+#endif
+}
+
+//static
+U32 LLCPUInfo::getDefaultWorkerCount()
+{
+	return llclamp(getCoreCount(), 2U, 5U) - 1;
+}
+
 std::string LLCPUInfo::getCPUString() const
 {
 	return mCPUString;
@@ -77,6 +77,13 @@ public:
 	bool hasSSE2() const;
 	F64 getMHz() const;
 
+	// Number of logical CPU cores that are online.
+	static U32 getCoreCount();
+
+	// Number of worker threads for thread pools that leave a core for the main thread:
+	// one less than getCoreCount(), but at least 1 and at most 4.
+	static U32 getDefaultWorkerCount();
+
 	// Family is "AMD Duron" or "Intel Pentium Pro"
 	const std::string& getFamily() const { return mFamily; }
 
@@ -282,13 +282,13 @@ U8* LLImageBase::allocateDataSize(S32 width, S32 height, S32 ncomponents, S32 si
 //---------------------------------------------------------------------------
 
 AIThreadSafeSimpleDC<S32> LLImageRaw::sGlobalRawMemory;
-S32 LLImageRaw::sRawImageCount = 0;
+LLAtomicS32 LLImageRaw::sRawImageCount(0);
 S32 LLImageRaw::sRawImageCachedCount = 0;
 
 LLImageRaw::LLImageRaw()
 	: LLImageBase(), mCacheEntries(0)
 {
-	++sRawImageCount;
+	sRawImageCount++;
 }
 
 LLImageRaw::LLImageRaw(U16 width, U16 height, S8 components)
@@ -296,7 +296,7 @@ LLImageRaw::LLImageRaw(U16 width, U16 height, S8 components)
 {
 	llassert( S32(width) * S32(height) * S32(components) <= MAX_IMAGE_DATA_SIZE );
 	allocateDataSize(width, height, components);
-	++sRawImageCount;
+	sRawImageCount++;
 }
 
 LLImageRaw::LLImageRaw(U8 *data, U16 width, U16 height, S8 components, bool no_copy)
@@ -311,7 +311,7 @@ LLImageRaw::LLImageRaw(U8 *data, U16 width, U16 height, S8 components, bool no_c
 	{
 		memcpy(getData(), data, width*height*components);
 	}
-	++sRawImageCount;
+	sRawImageCount++;
 }
 
 LLImageRaw::LLImageRaw(LLImageRaw const* src, U16 width, U16 height, U16 crop_offset, bool crop_vertically) : mCacheEntries(0)
@@ -336,7 +336,7 @@ LLImageRaw::LLImageRaw(LLImageRaw const* src, U16 width, U16 height, U16 crop_of
 			}
 		}
 	}
-	++sRawImageCount;
+	sRawImageCount++;
 }
 
 //LLImageRaw::LLImageRaw(const std::string& filename, bool j2c_lowest_mip_only)
@@ -258,7 +258,7 @@ protected:
 
 public:
 	static AIThreadSafeSimpleDC<S32> sGlobalRawMemory;
-	static S32 sRawImageCount;
+	static LLAtomicS32 sRawImageCount;	// Updated by all image decode threads.
 
 	static S32 sRawImageCachedCount;
 	S32 mCacheEntries;
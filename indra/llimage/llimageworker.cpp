@@ -28,18 +28,74 @@
 
 #include "llimageworker.h"
 #include "llimagedxt.h"
+#include "llsys.h"		// LLCPUInfo::getCoreCount()
+#include "lltimer.h"	// ms_sleep()
+
+// Upper bound on the number of decode threads, whatever the core count.
+static const U32 MAX_DECODE_THREADS = 8;
 
 //----------------------------------------------------------------------------
 
 // MAIN THREAD
-LLImageDecodeThread::LLImageDecodeThread(bool threaded)
+LLImageDecodeThread::LLImageDecodeThread(bool threaded, U32 num_threads)
 	: LLQueuedThread("imagedecode", threaded)
 {
+	if (!threaded)
+	{
+		return;
+	}
+	if (num_threads == 0)
+	{
+		U32 cores = LLCPUInfo::getCoreCount();
+		num_threads = cores > 1 ? cores - 1 : 1;
+	}
+	num_threads = llclamp(num_threads, (U32)1, MAX_DECODE_THREADS);
+	for (U32 i = 1; i < num_threads; ++i)
+	{
+		DecodeWorker* worker = new DecodeWorker(this, i);
+		worker->start();
+		mWorkers.push_back(worker);
+	}
+	llinfos << "Decoding images with " << num_threads << " thread(s)" << llendl;
 }
 
 //virtual 
 LLImageDecodeThread::~LLImageDecodeThread()
 {
+	// ~LLQueuedThread deletes all remaining requests, the workers must be gone by then.
+	stopWorkers();
+}
+
+// MAIN THREAD
+//virtual
+void LLImageDecodeThread::shutdown()
+{
+	stopWorkers();
+	LLQueuedThread::shutdown();
+}
+
+// MAIN THREAD
+void LLImageDecodeThread::stopWorkers()
+{
+	// Tell all workers to quit first, so that they can finish their current request in parallel.
+	for (worker_list_t::iterator iter = mWorkers.begin(); iter != mWorkers.end(); ++iter)
+	{
+		(*iter)->setQuitting();
+	}
+	for (worker_list_t::iterator iter = mWorkers.begin(); iter != mWorkers.end(); ++iter)
+	{
+		delete *iter;	// Waits for the thread to stop.
+	}
+	mWorkers.clear();
+}
+
+// MAIN THREAD
+void LLImageDecodeThread::wakeWorkers()
+{
+	for (worker_list_t::iterator iter = mWorkers.begin(); iter != mWorkers.end(); ++iter)
+	{
+		(*iter)->wake();
+	}
 }
 
 // MAIN THREAD
@@ -63,6 +119,10 @@ S32 LLImageDecodeThread::update(F32 max_time_ms)
 	}
 	mCreationList.clear();
 	S32 res = LLQueuedThread::update(max_time_ms);
+	if (res > 0)
+	{
+		wakeWorkers();
+	}
 	return res;
 }
 
@@ -90,6 +150,43 @@ LLImageDecodeThread::Responder::~Responder()
 
 //----------------------------------------------------------------------------
 
+LLImageDecodeThread::DecodeWorker::DecodeWorker(LLImageDecodeThread* parent, U32 index)
+	: LLThread(llformat("imagedecode %u", index)),
+	  mParent(parent)
+{
+}
+
+// virtual
+bool LLImageDecodeThread::DecodeWorker::runCondition()
+{
+	// mRunCondition must be locked here.
+	// Follow the pause state of the LLQueuedThread, so that pausing it pauses all decoding.
+	return !mParent->isPaused() && mParent->getPending() > 0;
+}
+
+// virtual
+void LLImageDecodeThread::DecodeWorker::run()
+{
+	while (1)
+	{
+		// Blocks until there are queued requests, or until we're asked to quit.
+		checkPause();
+
+		if (isQuitting())
+		{
+			break;
+		}
+
+		if (mParent->processNextRequest() == 0)
+		{
+			ms_sleep(1);
+		}
+	}
+	llinfos << "LLImageDecodeThread worker " << mName << " EXITING." << llendl;
+}
+
+//----------------------------------------------------------------------------
+
 LLImageDecodeThread::ImageRequest::ImageRequest(handle_t handle, LLImageFormatted* image, 
 												U32 priority, S32 discard, BOOL needs_aux,
 												LLImageDecodeThread::Responder* responder)
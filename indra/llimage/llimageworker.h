@@ -72,8 +72,11 @@ public:
 	};
 	
 public:
-	LLImageDecodeThread(bool threaded = true);
+	// num_threads is the total number of threads that decode requests, including
+	// this one. Zero means one thread per CPU core not used by the main thread.
+	LLImageDecodeThread(bool threaded = true, U32 num_threads = 1);
 	virtual ~LLImageDecodeThread();
+	/*virtual*/ void shutdown();
 
 	handle_t decodeImage(LLImageFormatted* image,
 						 U32 priority, S32 discard, BOOL needs_aux,
@@ -82,8 +85,33 @@ public:
 
 	// Used by unit tests to check the consistency of the thread instance
 	S32 tut_size();
+
+	U32 getNumThreads() const { return mWorkers.size() + 1; }
 	
 private:
+	// Additional decode thread. All workers, and the LLQueuedThread itself, take
+	// the highest priority request from the one shared queue whenever they are idle,
+	// so a long decode on one thread never holds up the rest of the queue.
+	class DecodeWorker : public LLThread
+	{
+	public:
+		DecodeWorker(LLImageDecodeThread* parent, U32 index);
+
+	private:
+		/*virtual*/ bool runCondition(void);
+		/*virtual*/ void run(void);
+
+		LLImageDecodeThread* mParent;
+	};
+	friend class DecodeWorker;
+
+	void wakeWorkers();
+	void stopWorkers();
+
+	typedef std::vector<DecodeWorker*> worker_list_t;
+	worker_list_t mWorkers;
+
+
 	struct creation_info
 	{
 		handle_t handle;
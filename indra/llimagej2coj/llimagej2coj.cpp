@@ -106,14 +106,13 @@ LLImageJ2COJ::~LLImageJ2COJ()
 }
 
 
-BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decode_time, S32 first_channel, S32 max_channel_count)
+// Decode the codestream of base up to its raw discard level.
+// A truncated codestream can't be decoded at full resolution; in that case the
+// resolution levels that the available bytes are good for are decoded instead, and
+// the raw and formatted discard level of base are raised to match.
+// Returns NULL when the codestream could not be decoded.
+opj_image_t* LLImageJ2COJ::decodeCodestream(LLImageJ2C &base)
 {
-	//
-	// FIXME: Get the comment field out of the texture
-	//
-
-	LLTimer decode_timer;
-
 	opj_dparameters_t parameters;	/* decompression parameters */
 	opj_event_mgr_t event_mgr;		/* event manager */
 	opj_image_t *image = NULL;
@@ -146,9 +145,14 @@ BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decod
 		}
 		if(failed)
 		{
-			opj_image_destroy(image);
-			base.decodeFailed();
-			return TRUE;
+			// OpenJPEG decodes a truncated codestream up to where the data ends,
+			// but only the lower resolution levels are complete by then.
+			S32 discard_level = llmax(1, base.calcDiscardLevelBytes(base.getDataSize()));
+			LL_DEBUGS("Texture") << "Codestream truncated at " << base.getDataSize() << " bytes, decoding at discard level "
+								 << discard_level << LL_ENDL;
+			base.mRawDiscardLevel = discard_level;
+			base.setDiscardLevel(discard_level);
+			parameters.cp_reduce = discard_level;
 		}
 	}
 
@@ -213,6 +217,24 @@ BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decod
 			fclose(file);
 		}
 #endif
+		return NULL;
+	}
+
+	return image;
+}
+
+
+BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decode_time, S32 first_channel, S32 max_channel_count)
+{
+	//
+	// FIXME: Get the comment field out of the texture
+	//
+
+	LLTimer decode_timer;
+
+	opj_image_t *image = decodeCodestream(base);
+	if (!image)
+	{
 		base.decodeFailed();
 		return TRUE; // done
 	}
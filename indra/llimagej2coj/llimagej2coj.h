@@ -35,6 +35,8 @@
 
 #include "llimagej2c.h"
 
+struct opj_image;
+
 class LLImageJ2COJ : public LLImageJ2CImpl
 {	
 public:
@@ -52,6 +54,8 @@ protected:
 		return (a + (1 << b) - 1) >> b;
 	}
 
+private:
+	opj_image* decodeCodestream(LLImageJ2C &base);
 };
 
 #endif
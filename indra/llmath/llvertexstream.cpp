@@ -0,0 +1,420 @@
+/**
+ * @file llvertexstream.cpp
+ * @brief Loops that write volume face attributes into vertex buffer streams.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llvertexstream.h"
+
+#include "v2math.h"
+
+template<bool STREAM>
+static LL_FORCE_INLINE void store_quad(F32* dst, LLQuad val)
+{
+	if (STREAM)
+	{
+		_mm_stream_ps(dst, val);
+	}
+	else
+	{
+		_mm_store_ps(dst, val);
+	}
+}
+
+template<bool STREAM>
+static void transform_positions(const LLVector4a* src, U32 count, F32* dst, U32 pad_count, const LLMatrix4a& mat, F32 tex_index)
+{
+	LLVector4a texIdx;
+	texIdx.set(0, 0, 0, tex_index);
+
+	LLVector4Logical mask;
+	mask.clear();
+	mask.setElement<3>();
+
+	const LLVector4a* end = src + count;
+	F32* end_f32 = dst + pad_count * 4;
+	LLVector4a res;
+	LLVector4a tmp;
+	while (src < end)
+	{
+		mat.affineTransform(*src++, res);
+		tmp.setSelectWithMask(mask, texIdx, res);
+		store_quad<STREAM>(dst, tmp);
+		dst += 4;
+	}
+	while (dst < end_f32)
+	{
+		store_quad<STREAM>(dst, res);
+		dst += 4;
+	}
+}
+
+template<bool STREAM>
+static void rotate_normals(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat)
+{
+	const LLVector4a* end = src + count;
+	while (src < end)
+	{
+		LLVector4a normal;
+		mat.rotate(*src++, normal);
+		store_quad<STREAM>(dst, normal);
+		dst += 4;
+	}
+}
+
+template<bool STREAM>
+static void rotate_tangents(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat)
+{
+	const LLVector4a* end = src + count;
+	while (src < end)
+	{
+		LLVector4a tangent;
+		mat.rotate(*src, tangent);
+		tangent.normalize3fast();
+		tangent.copyComponent<3>(*src++);
+		store_quad<STREAM>(dst, tangent);
+		dst += 4;
+	}
+}
+
+template<bool STREAM>
+static void copy_quads(const F32* src, U32 num_quads, F32* dst)
+{
+	for (U32 i = 0; i < num_quads; ++i)
+	{
+		store_quad<STREAM>(dst, _mm_load_ps(src));
+		src += 4;
+		dst += 4;
+	}
+}
+
+template<bool STREAM>
+static void fill_quads(U32 value, U32 num_quads, F32* dst)
+{
+	const LLQuad val = _mm_castsi128_ps(_mm_set1_epi32(value));
+	for (U32 i = 0; i < num_quads; ++i)
+	{
+		store_quad<STREAM>(dst, val);
+		dst += 4;
+	}
+}
+
+// Two texture coordinates <s0, t0, s1, t1> per quad; the same operations as xform() in llface.cpp.
+template<bool STREAM>
+static void xform_tex_coords(const LLVector2* src, U32 count, F32* dst, const LLTexCoordXform& xf)
+{
+	LLVector4a trans;
+	trans.splat(-0.5f);
+	LLVector4a rot0;
+	rot0.set(xf.mCos, -xf.mSin, xf.mCos, -xf.mSin);
+	LLVector4a rot1;
+	rot1.set(xf.mSin, xf.mCos, xf.mSin, xf.mCos);
+	LLVector4a scale;
+	scale.set(xf.mScaleS, xf.mScaleT, xf.mScaleS, xf.mScaleT);
+	LLVector4a offset;
+	offset.set(xf.mOffsetS + 0.5f, xf.mOffsetT + 0.5f, xf.mOffsetS + 0.5f, xf.mOffsetT + 0.5f);
+
+	const F32* srcf = src->mV;
+	U32 num_quads = (count + 1) / 2;
+	for (U32 i = 0; i < num_quads; ++i)
+	{
+		LLVector4a st;
+		st.setAdd(LLVector4a(_mm_load_ps(srcf)), trans);
+		srcf += 4;
+
+		// <s0, s0, s1, s1> * <cos, -sin, cos, -sin> + <t0, t0, t1, t1> * <sin, cos, sin, cos>
+		LLVector4a ss = _mm_shuffle_ps(st, st, _MM_SHUFFLE(2, 2, 0, 0));
+		LLVector4a tt = _mm_shuffle_ps(st, st, _MM_SHUFFLE(3, 3, 1, 1));
+		LLVector4a a;
+		a.setMul(rot0, ss);
+		LLVector4a b;
+		b.setMul(rot1, tt);
+		st.setAdd(a, b);
+		st.mul(scale);
+		st.add(offset);
+		store_quad<STREAM>(dst, st);
+		dst += 4;
+	}
+}
+
+// The same operations as LLMatrix4a::affineTransform of <s, t, 0>, two texture coordinates at a time.
+template<bool STREAM>
+static void matrix_tex_coords(const LLVector2* src, U32 count, F32* dst, const LLMatrix4a& mat)
+{
+	const LLVector4a& row0 = mat.getRow<0>();
+	const LLVector4a& row1 = mat.getRow<1>();
+	LLVector4a row23;
+	row23.setMul(LLVector4a::getZero(), mat.getRow<2>());
+	row23.add(mat.getRow<3>());
+
+	const F32* srcf = src->mV;
+	U32 num_quads = (count + 1) / 2;
+	for (U32 i = 0; i < num_quads; ++i)
+	{
+		LLVector4a st(_mm_load_ps(srcf));
+		srcf += 4;
+
+		LLVector4a s0, t0, s1, t1;
+		s0.splat<0>(st);
+		t0.splat<1>(st);
+		s1.splat<2>(st);
+		t1.splat<3>(st);
+		s0.mul(row0);
+		t0.mul(row1);
+		s1.mul(row0);
+		t1.mul(row1);
+		s0.add(t0);
+		s1.add(t1);
+		s0.add(row23);
+		s1.add(row23);
+		store_quad<STREAM>(dst, _mm_shuffle_ps(s0, s1, _MM_SHUFFLE(1, 0, 1, 0)));
+		dst += 4;
+	}
+}
+
+// planarProjection() of llface.cpp for four vertices at a time, with the vertices in the
+// lanes: the binormal is picked with masks instead of branches.
+template<bool STREAM, bool MATRIX>
+static void planar_tex_coords(const LLVector4a* positions, const LLVector4a* normals, U32 count, const LLVector4a& scale,
+							  F32* dst, const LLMatrix4a* mat, const LLTexCoordXform& xf)
+{
+	const LLQuad zero = _mm_setzero_ps();
+	const LLQuad one = _mm_set1_ps(1.f);
+	const LLQuad minus_one = _mm_set1_ps(-1.f);
+	const LLQuad half = _mm_set1_ps(0.5f);
+	const LLQuad two = _mm_set1_ps(2.f);
+	const LLQuad sign_bit = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	const LLQuad scale_x = _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(0, 0, 0, 0));
+	const LLQuad scale_y = _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(1, 1, 1, 1));
+	const LLQuad scale_z = _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(2, 2, 2, 2));
+
+	// Texture matrix rows, one component per register.
+	LLQuad m0x = zero, m0y = zero, m1x = zero, m1y = zero, m23x = zero, m23y = zero;
+	if (MATRIX)
+	{
+		LLVector4a row23;
+		row23.setMul(LLVector4a::getZero(), mat->getRow<2>());
+		row23.add(mat->getRow<3>());
+		m0x = _mm_shuffle_ps(mat->getRow<0>(), mat->getRow<0>(), _MM_SHUFFLE(0, 0, 0, 0));
+		m0y = _mm_shuffle_ps(mat->getRow<0>(), mat->getRow<0>(), _MM_SHUFFLE(1, 1, 1, 1));
+		m1x = _mm_shuffle_ps(mat->getRow<1>(), mat->getRow<1>(), _MM_SHUFFLE(0, 0, 0, 0));
+		m1y = _mm_shuffle_ps(mat->getRow<1>(), mat->getRow<1>(), _MM_SHUFFLE(1, 1, 1, 1));
+		m23x = _mm_shuffle_ps(row23, row23, _MM_SHUFFLE(0, 0, 0, 0));
+		m23y = _mm_shuffle_ps(row23, row23, _MM_SHUFFLE(1, 1, 1, 1));
+	}
+	const LLQuad cos_ang = _mm_set1_ps(xf.mCos);
+	const LLQuad sin_ang = _mm_set1_ps(xf.mSin);
+	const LLQuad scale_s = _mm_set1_ps(xf.mScaleS);
+	const LLQuad scale_t = _mm_set1_ps(xf.mScaleT);
+	const LLQuad offset_s = _mm_set1_ps(xf.mOffsetS + 0.5f);
+	const LLQuad offset_t = _mm_set1_ps(xf.mOffsetT + 0.5f);
+
+	for (U32 i = 0; i < count; i += 4)
+	{
+		LLQuad p0, p1, p2, p3, n0, n1, n2, n3;
+		if (i + 4 <= count)
+		{
+			p0 = positions[i]; p1 = positions[i + 1]; p2 = positions[i + 2]; p3 = positions[i + 3];
+			n0 = normals[i]; n1 = normals[i + 1]; n2 = normals[i + 2]; n3 = normals[i + 3];
+		}
+		else
+		{	// The last few vertices; don't read past the end of the volume face.
+			U32 last = count - 1;
+			p0 = positions[i]; p1 = positions[llmin(i + 1, last)]; p2 = positions[llmin(i + 2, last)]; p3 = positions[last];
+			n0 = normals[i]; n1 = normals[llmin(i + 1, last)]; n2 = normals[llmin(i + 2, last)]; n3 = normals[last];
+		}
+		_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+		_MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+		const LLQuad px = _mm_mul_ps(p0, scale_x);
+		const LLQuad py = _mm_mul_ps(p1, scale_y);
+		const LLQuad pz = _mm_mul_ps(p2, scale_z);
+		const LLQuad& nx = n0;
+		const LLQuad& ny = n1;
+		const LLQuad& nz = n2;
+
+		// binormal = |nx| >= 0.5 ? <0, nx < 0 ? -1 : 1, 0> : <ny > 0 ? -1 : 1, 0, 0>
+		const LLQuad along_x = _mm_cmpge_ps(_mm_andnot_ps(sign_bit, nx), half);
+		const LLQuad bx = _mm_andnot_ps(along_x, _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(ny, zero), minus_one), _mm_andnot_ps(_mm_cmpgt_ps(ny, zero), one)));
+		const LLQuad by = _mm_and_ps(along_x, _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(nx, zero), minus_one), _mm_andnot_ps(_mm_cmplt_ps(nx, zero), one)));
+		const LLQuad bz = zero;
+
+		// tangent = binormal x normal, like LLVector4a::setCross3.
+		const LLQuad tx = _mm_sub_ps(_mm_mul_ps(by, nz), _mm_mul_ps(bz, ny));
+		const LLQuad ty = _mm_sub_ps(_mm_mul_ps(bz, nx), _mm_mul_ps(bx, nz));
+		const LLQuad tz = _mm_sub_ps(_mm_mul_ps(bx, ny), _mm_mul_ps(by, nx));
+
+		// The dot products, like LLVector4a::dot3.
+		const LLQuad tdot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz));
+		const LLQuad bdot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, px), _mm_mul_ps(by, py)), _mm_mul_ps(bz, pz));
+
+		LLQuad s = _mm_add_ps(one, _mm_sub_ps(_mm_mul_ps(bdot, two), half));
+		LLQuad t = _mm_xor_ps(sign_bit, _mm_sub_ps(_mm_mul_ps(tdot, two), half));
+
+		if (MATRIX)
+		{
+			LLQuad ms = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s, m0x), _mm_mul_ps(t, m1x)), m23x);
+			LLQuad mt = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s, m0y), _mm_mul_ps(t, m1y)), m23y);
+			s = ms;
+			t = mt;
+		}
+		else
+		{	// Like xform() in llface.cpp.
+			const LLQuad s0 = _mm_sub_ps(s, half);
+			const LLQuad t0 = _mm_sub_ps(t, half);
+			s = _mm_add_ps(_mm_mul_ps(s0, cos_ang), _mm_mul_ps(t0, sin_ang));
+			t = _mm_add_ps(_mm_mul_ps(_mm_xor_ps(sign_bit, s0), sin_ang), _mm_mul_ps(t0, cos_ang));
+			s = _mm_add_ps(_mm_mul_ps(s, scale_s), offset_s);
+			t = _mm_add_ps(_mm_mul_ps(t, scale_t), offset_t);
+		}
+
+		store_quad<STREAM>(dst, _mm_unpacklo_ps(s, t));
+		if (count - i > 2)
+		{	// Otherwise the stream ends with the first two; don't write past it.
+			store_quad<STREAM>(dst + 4, _mm_unpackhi_ps(s, t));
+		}
+		dst += 8;
+	}
+}
+
+//static
+void LLVertexStream::transformPositions(const LLVector4a* src, U32 count, F32* dst, U32 pad_count, const LLMatrix4a& mat, F32 tex_index, bool stream)
+{
+	if (stream)
+	{
+		transform_positions<true>(src, count, dst, pad_count, mat, tex_index);
+	}
+	else
+	{
+		transform_positions<false>(src, count, dst, pad_count, mat, tex_index);
+	}
+}
+
+//static
+void LLVertexStream::rotateNormals(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream)
+{
+	if (stream)
+	{
+		rotate_normals<true>(src, count, dst, mat);
+	}
+	else
+	{
+		rotate_normals<false>(src, count, dst, mat);
+	}
+}
+
+//static
+void LLVertexStream::rotateTangents(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream)
+{
+	if (stream)
+	{
+		rotate_tangents<true>(src, count, dst, mat);
+	}
+	else
+	{
+		rotate_tangents<false>(src, count, dst, mat);
+	}
+}
+
+//static
+void LLVertexStream::copy(const F32* src, U32 size, F32* dst, bool stream)
+{
+	U32 num_quads = (size + 0xF) >> 4;
+	if (stream)
+	{
+		copy_quads<true>(src, num_quads, dst);
+	}
+	else
+	{
+		copy_quads<false>(src, num_quads, dst);
+	}
+}
+
+//static
+void LLVertexStream::fill(U32 value, U32 count, F32* dst, bool stream)
+{
+	U32 num_quads = (count + 3) >> 2;
+	if (stream)
+	{
+		fill_quads<true>(value, num_quads, dst);
+	}
+	else
+	{
+		fill_quads<false>(value, num_quads, dst);
+	}
+}
+
+//static
+void LLVertexStream::xformTexCoords(const LLVector2* src, U32 count, F32* dst, const LLTexCoordXform& xf, bool stream)
+{
+	if (stream)
+	{
+		xform_tex_coords<true>(src, count, dst, xf);
+	}
+	else
+	{
+		xform_tex_coords<false>(src, count, dst, xf);
+	}
+}
+
+//static
+void LLVertexStream::matrixTexCoords(const LLVector2* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream)
+{
+	if (stream)
+	{
+		matrix_tex_coords<true>(src, count, dst, mat);
+	}
+	else
+	{
+		matrix_tex_coords<false>(src, count, dst, mat);
+	}
+}
+
+//static
+void LLVertexStream::planarTexCoords(const LLVector4a* positions, const LLVector4a* normals, U32 count, const LLVector4a& scale,
+									 F32* dst, const LLMatrix4a* mat, const LLTexCoordXform& xf, bool stream)
+{
+	if (mat)
+	{
+		if (stream)
+		{
+			planar_tex_coords<true, true>(positions, normals, count, scale, dst, mat, xf);
+		}
+		else
+		{
+			planar_tex_coords<false, true>(positions, normals, count, scale, dst, mat, xf);
+		}
+	}
+	else
+	{
+		if (stream)
+		{
+			planar_tex_coords<true, false>(positions, normals, count, scale, dst, mat, xf);
+		}
+		else
+		{
+			planar_tex_coords<false, false>(positions, normals, count, scale, dst, mat, xf);
+		}
+	}
+}
@@ -0,0 +1,85 @@
+/**
+ * @file llvertexstream.h
+ * @brief Loops that write volume face attributes into vertex buffer streams.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLVERTEXSTREAM_H
+#define LL_LLVERTEXSTREAM_H
+
+#include "llmath.h"
+#include "llvector4a.h"
+#include "llmatrix4a.h"
+
+class LLVector2;
+
+// The texture coordinate transform of a texture entry: rotation, then scale, then offset,
+// about the center of the face.
+struct LLTexCoordXform
+{
+	F32 mCos;
+	F32 mSin;
+	F32 mOffsetS;
+	F32 mOffsetT;
+	F32 mScaleS;
+	F32 mScaleT;
+};
+
+// Loops without per-vertex branches that write one attribute of an LLVolumeFace into a vertex
+// buffer stream, for LLFace::getGeometryVolume. Which loop to use is decided once per face.
+//
+// Destinations must be 16 byte aligned and have room for count vertices rounded up to a multiple
+// of 16 bytes, which is how LLVertexBuffer pads each stream; LLFace doesn't round the number of
+// vertices of rigged faces up to a multiple of four. If stream is set, the destination is written with
+// non-temporal stores: that is faster for memory that is write-combined (a mapped GL buffer) and
+// not read again, but fence() must be called by the same thread before the buffer is unmapped.
+// The results are bitwise identical to the per-vertex code that these loops replace.
+class LLVertexStream
+{
+public:
+	// Affine transform; the w component is replaced by tex_index (the bits of an integer).
+	// Destination vertices from count up to pad_count are set to the last position.
+	static void transformPositions(const LLVector4a* src, U32 count, F32* dst, U32 pad_count, const LLMatrix4a& mat, F32 tex_index, bool stream);
+	static void rotateNormals(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream);
+	// Rotation and normalization; the w component (the binormal sign) is kept.
+	static void rotateTangents(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream);
+
+	// Copies size bytes, rounded up to a multiple of 16. src must be 16 byte aligned too.
+	static void copy(const F32* src, U32 size, F32* dst, bool stream);
+	// Sets count four byte values (colors, glow) to value.
+	static void fill(U32 value, U32 count, F32* dst, bool stream);
+
+	// Texture coordinates. src is padded to a multiple of two texture coordinates, like those of LLVolumeFace.
+	static void xformTexCoords(const LLVector2* src, U32 count, F32* dst, const LLTexCoordXform& xf, bool stream);
+	// Texture animation: the texture matrix applied to <s, t, 0>.
+	static void matrixTexCoords(const LLVector2* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream);
+	// Planar texture generation from the scaled positions and the normals, followed by either
+	// the texture matrix (if mat is set) or xf.
+	static void planarTexCoords(const LLVector4a* positions, const LLVector4a* normals, U32 count, const LLVector4a& scale,
+								F32* dst, const LLMatrix4a* mat, const LLTexCoordXform& xf, bool stream);
+
+	// Orders the non-temporal stores of the calling thread before whatever it does next.
+	static void fence() { _mm_sfence(); }
+};
+
+#endif // LL_LLVERTEXSTREAM_H
@@ -2364,23 +2364,408 @@ bool LLVolumeFace::VertexData::compareNormal(const LLVolumeFace::VertexData& rhs
 	return retval;
 }
 
+// Raw pointers into an inflated mesh LOD block for one face.
+struct LLMeshFaceBlock
+{
+	LLMeshFaceBlock()
+	:	mNoGeometry(false),
+		mHasWeights(false),
+		mPosition(NULL), mPositionSize(0),
+		mNormal(NULL), mNormalSize(0),
+		mTexCoord(NULL), mTexCoordSize(0),
+		mIndices(NULL), mIndicesSize(0),
+		mWeights(NULL), mWeightsSize(0)
+	{
+	}
+
+	bool mNoGeometry;
+	bool mHasWeights;
+	const U8* mPosition;
+	U32 mPositionSize;
+	const U8* mNormal;
+	U32 mNormalSize;
+	const U8* mTexCoord;
+	U32 mTexCoordSize;
+	const U8* mIndices;
+	U32 mIndicesSize;
+	const U8* mWeights;
+	U32 mWeightsSize;
+	LLVector3 mPositionMin;
+	LLVector3 mPositionMax;
+	LLVector2 mTexCoordMin;
+	LLVector2 mTexCoordMax;
+};
+
+// Reads the faces of an inflated mesh LOD block (a binary LLSD array of maps) in place,
+// without building an LLSD tree or copying the vertex data blobs out of the block.
+class LLMeshBlockReader
+{
+public:
+	LLMeshBlockReader(const U8* data, U32 size)
+	:	mCur(data), mEnd(data + size)
+	{
+		static const char deprecated_header[] = "<? LLSD/Binary ?>";
+		const U32 header_size = sizeof(deprecated_header) - 1;
+		if (size > header_size && !memcmp(data, deprecated_header, header_size))
+		{
+			mCur += header_size + 1;
+		}
+	}
+
+	bool readFaces(std::vector<LLMeshFaceBlock>& faces)
+	{
+		U32 face_count;
+		if (!expect('[') || !readU32(face_count) || face_count > (U32)(mEnd - mCur))
+		{
+			return false;
+		}
+
+		faces.resize(face_count);
+		for (U32 i = 0; i < face_count; ++i)
+		{
+			if (!readFace(faces[i]))
+			{
+				return false;
+			}
+		}
+		return expect(']');
+	}
+
+private:
+	bool readFace(LLMeshFaceBlock& face)
+	{
+		U32 count;
+		if (!expect('{') || !readU32(count))
+		{
+			return false;
+		}
+
+		for (U32 i = 0; i < count; ++i)
+		{
+			const char* key;
+			U32 key_size;
+			if (!readKey(key, key_size))
+			{
+				return false;
+			}
+
+			bool ok;
+			if (isKey("Position", key, key_size))
+			{
+				ok = readBinary(face.mPosition, face.mPositionSize);
+			}
+			else if (isKey("Normal", key, key_size))
+			{
+				ok = readBinary(face.mNormal, face.mNormalSize);
+			}
+			else if (isKey("TexCoord0", key, key_size))
+			{
+				ok = readBinary(face.mTexCoord, face.mTexCoordSize);
+			}
+			else if (isKey("TriangleList", key, key_size))
+			{
+				ok = readBinary(face.mIndices, face.mIndicesSize);
+			}
+			else if (isKey("Weights", key, key_size))
+			{
+				face.mHasWeights = true;
+				ok = readBinary(face.mWeights, face.mWeightsSize);
+			}
+			else if (isKey("PositionDomain", key, key_size))
+			{
+				ok = readDomain(face.mPositionMin.mV, face.mPositionMax.mV, 3);
+			}
+			else if (isKey("TexCoord0Domain", key, key_size))
+			{
+				ok = readDomain(face.mTexCoordMin.mV, face.mTexCoordMax.mV, 2);
+			}
+			else
+			{
+				face.mNoGeometry |= isKey("NoGeometry", key, key_size);
+				ok = skipValue();
+			}
+
+			if (!ok)
+			{
+				return false;
+			}
+		}
+		return expect('}');
+	}
+
+	bool readDomain(F32* min, F32* max, U32 components)
+	{
+		U32 count;
+		if (!expect('{') || !readU32(count))
+		{
+			return false;
+		}
+
+		for (U32 i = 0; i < count; ++i)
+		{
+			const char* key;
+			U32 key_size;
+			if (!readKey(key, key_size))
+			{
+				return false;
+			}
+
+			bool ok;
+			if (isKey("Min", key, key_size))
+			{
+				ok = readVector(min, components);
+			}
+			else if (isKey("Max", key, key_size))
+			{
+				ok = readVector(max, components);
+			}
+			else
+			{
+				ok = skipValue();
+			}
+
+			if (!ok)
+			{
+				return false;
+			}
+		}
+		return expect('}');
+	}
+
+	// Array of reals, as LLVector3::getValue() writes them.
+	bool readVector(F32* v, U32 components)
+	{
+		U32 count;
+		if (!expect('[') || !readU32(count))
+		{
+			return false;
+		}
+
+		for (U32 i = 0; i < count; ++i)
+		{
+			F32 value;
+			if (!readReal(value))
+			{
+				return false;
+			}
+			if (i < components)
+			{
+				v[i] = value;
+			}
+		}
+		return expect(']');
+	}
+
+	bool readReal(F32& value)
+	{
+		if (mCur >= mEnd)
+		{
+			return false;
+		}
+
+		switch (*mCur++)
+		{
+			case 'r':
+			{
+				U32 hi, lo;
+				if (!readU32(hi) || !readU32(lo))
+				{
+					return false;
+				}
+				U64 bits = ((U64) hi << 32) | lo;
+				F64 real;
+				memcpy(&real, &bits, sizeof(real));
+				value = (F32) real;
+				return true;
+			}
+			case 'i':
+			{
+				U32 i;
+				if (!readU32(i))
+				{
+					return false;
+				}
+				value = (F32)(S32) i;
+				return true;
+			}
+			case '!':
+			case '0':
+				value = 0.f;
+				return true;
+			case '1':
+				value = 1.f;
+				return true;
+		}
+		return false;
+	}
+
+	// An undefined value reads as empty, like LLSD::asBinary().
+	bool readBinary(const U8*& data, U32& size)
+	{
+		if (mCur < mEnd && *mCur == '!')
+		{
+			++mCur;
+			data = NULL;
+			size = 0;
+			return true;
+		}
+
+		if (!expect('b') || !readU32(size) || size > (U32)(mEnd - mCur))
+		{
+			return false;
+		}
+		data = size ? mCur : NULL;
+		mCur += size;
+		return true;
+	}
+
+	bool readKey(const char*& key, U32& size)
+	{
+		if (!expect('k') || !readU32(size) || size > (U32)(mEnd - mCur))
+		{
+			return false;
+		}
+		key = (const char*) mCur;
+		mCur += size;
+		return true;
+	}
+
+	bool skipValue()
+	{
+		if (mCur >= mEnd)
+		{
+			return false;
+		}
+
+		U32 size;
+		switch (*mCur++)
+		{
+			case '!':
+			case '0':
+			case '1':
+				return true;
+			case 'i':
+				return skip(4);
+			case 'r':
+			case 'd':
+				return skip(8);
+			case 'u':
+				return skip(16);
+			case 's':
+			case 'l':
+			case 'b':
+				return readU32(size) && skip(size);
+			case '[':
+			{
+				if (!readU32(size))
+				{
+					return false;
+				}
+				for (U32 i = 0; i < size; ++i)
+				{
+					if (!skipValue())
+					{
+						return false;
+					}
+				}
+				return expect(']');
+			}
+			case '{':
+			{
+				if (!readU32(size))
+				{
+					return false;
+				}
+				for (U32 i = 0; i < size; ++i)
+				{
+					const char* key;
+					U32 key_size;
+					if (!readKey(key, key_size) || !skipValue())
+					{
+						return false;
+					}
+				}
+				return expect('}');
+			}
+		}
+		return false;
+	}
+
+	bool expect(U8 c)
+	{
+		if (mCur < mEnd && *mCur == c)
+		{
+			++mCur;
+			return true;
+		}
+		return false;
+	}
+
+	bool skip(U32 size)
+	{
+		if (size > (U32)(mEnd - mCur))
+		{
+			return false;
+		}
+		mCur += size;
+		return true;
+	}
+
+	// Sizes and counts are in network byte order.
+	bool readU32(U32& value)
+	{
+		if (mEnd - mCur < 4)
+		{
+			return false;
+		}
+		value = ((U32) mCur[0] << 24) | ((U32) mCur[1] << 16) | ((U32) mCur[2] << 8) | (U32) mCur[3];
+		mCur += 4;
+		return true;
+	}
+
+	static bool isKey(const char* name, const char* key, U32 key_size)
+	{
+		return strlen(name) == key_size && !memcmp(name, key, key_size);
+	}
+
+	const U8* mCur;
+	const U8* mEnd;
+};
+
+// The quantized vertex data in mesh assets is little endian and not necessarily aligned.
+inline U16 read_mesh_u16(const U8* p)
+{
+	return (U16)(p[0] | (p[1] << 8));
+}
+
 bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 {
 	//input stream is now pointing at a zlib compressed block of LLSD
 	//decompress block
-	LLSD mdl;
-	if (!unzip_llsd(mdl, is, size))
+	U32 block_size = 0;
+	U8* block = unzip_llsd_raw(block_size, is, size);
+	if (!block)
 	{
 		LL_DEBUGS("MeshStreaming") << "Failed to unzip LLSD blob for LoD, will probably fetch from sim again." << LL_ENDL;
 		return false;
 	}
+
+	//read the faces straight out of the inflated block into the face arrays
+	std::vector<LLMeshFaceBlock> blocks;
+	if (!LLMeshBlockReader(block, block_size).readFaces(blocks))
+	{
+		LL_DEBUGS("MeshStreaming") << "Failed to parse LLSD blob for LoD, will probably fetch from sim again." << LL_ENDL;
+		free(block);
+		return false;
+	}
 	
 	{
-		U32 face_count = mdl.size();
+		U32 face_count = blocks.size();
 
 		if (face_count == 0)
 		{ //no faces unpacked, treat as failed decode
 			llwarns << "found no faces!" << llendl;
+			free(block);
 			return false;
 		}
 
@@ -2389,8 +2774,9 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 		for (U32 i = 0; i < face_count; ++i)
 		{
 			LLVolumeFace& face = mVolumeFaces[i];
+			const LLMeshFaceBlock& src = blocks[i];
 
-			if (mdl[i].has("NoGeometry"))
+			if (src.mNoGeometry)
 			{ //face has no geometry, continue
 				face.resizeIndices(3);
 				face.resizeVertices(1);
@@ -2401,46 +2787,33 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 				continue;
 			}
 
-			LLSD::Binary pos = mdl[i]["Position"];
-			LLSD::Binary norm = mdl[i]["Normal"];
-			LLSD::Binary tc = mdl[i]["TexCoord0"];
-			LLSD::Binary idx = mdl[i]["TriangleList"];
-
-			
-
 			//copy out indices
-			face.resizeIndices(idx.size()/2);
+			face.resizeIndices(src.mIndicesSize/2);
 			
-			if (idx.empty() || face.mNumIndices < 3)
+			if (!src.mIndicesSize || face.mNumIndices < 3)
 			{ //why is there an empty index list?
 				llwarns <<"Empty face present!" << llendl;
 				continue;
 			}
 
-			U16* indices = (U16*) &(idx[0]);
-			U32 count = idx.size()/2;
-			for (U32 j = 0; j < count; ++j)
+			memcpy(face.mIndices, src.mIndices, face.mNumIndices*sizeof(U16));
+#ifdef LL_BIG_ENDIAN
+			for (S32 j = 0; j < face.mNumIndices; ++j)
 			{
-				face.mIndices[j] = indices[j];
+				face.mIndices[j] = read_mesh_u16((const U8*) (face.mIndices + j));
 			}
+#endif
 
 			//copy out vertices
-			U32 num_verts = pos.size()/(3*2);
+			U32 num_verts = src.mPositionSize/(3*2);
 			face.resizeVertices(num_verts);
 
-			LLVector3 minp;
-			LLVector3 maxp;
-			LLVector2 min_tc; 
-			LLVector2 max_tc; 
-		
-			minp.setValue(mdl[i]["PositionDomain"]["Min"]);
-			maxp.setValue(mdl[i]["PositionDomain"]["Max"]);
 			LLVector4a min_pos, max_pos;
-			min_pos.load3(minp.mV);
-			max_pos.load3(maxp.mV);
+			min_pos.load3(src.mPositionMin.mV);
+			max_pos.load3(src.mPositionMax.mV);
 
-			min_tc.setValue(mdl[i]["TexCoord0Domain"]["Min"]);
-			max_tc.setValue(mdl[i]["TexCoord0Domain"]["Max"]);
+			const LLVector2& min_tc = src.mTexCoordMin;
+			const LLVector2& max_tc = src.mTexCoordMax;
 
 			LLVector4a pos_range;
 			pos_range.setSub(max_pos, min_pos);
@@ -2454,31 +2827,31 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 			LLVector4a* tc_out = (LLVector4a*) face.mTexCoords;
 
 			{
-				U16* v = (U16*) &(pos[0]);
+				const U8* v = src.mPosition;
 				for (U32 j = 0; j < num_verts; ++j)
 				{
-					pos_out->set((F32) v[0], (F32) v[1], (F32) v[2]);
+					pos_out->set((F32) read_mesh_u16(v), (F32) read_mesh_u16(v+2), (F32) read_mesh_u16(v+4));
 					pos_out->div(65535.f);
 					pos_out->mul(pos_range);
 					pos_out->add(min_pos);
 					pos_out++;
-					v += 3;
+					v += 6;
 				}
 
 			}
 
 			{
-				if (!norm.empty())
+				if (src.mNormalSize >= num_verts*6)
 				{
-					U16* n = (U16*) &(norm[0]);
+					const U8* n = src.mNormal;
 					for (U32 j = 0; j < num_verts; ++j)
 					{
-						norm_out->set((F32) n[0], (F32) n[1], (F32) n[2]);
+						norm_out->set((F32) read_mesh_u16(n), (F32) read_mesh_u16(n+2), (F32) read_mesh_u16(n+4));
 						norm_out->div(65535.f);
 						norm_out->mul(2.f);
 						norm_out->sub(1.f);
 						norm_out++;
-						n += 3;
+						n += 6;
 					}
 				}
 				else
@@ -2488,21 +2861,21 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 			}
 
 			{
-				if (!tc.empty())
+				if (src.mTexCoordSize >= num_verts*4)
 				{
-					U16* t = (U16*) &(tc[0]);
+					const U8* t = src.mTexCoord;
 					for (U32 j = 0; j < num_verts; j+=2)
 					{
 						if (j < num_verts-1)
 						{
-							tc_out->set((F32) t[0], (F32) t[1], (F32) t[2], (F32) t[3]);
+							tc_out->set((F32) read_mesh_u16(t), (F32) read_mesh_u16(t+2), (F32) read_mesh_u16(t+4), (F32) read_mesh_u16(t+6));
 						}
 						else
 						{
-							tc_out->set((F32) t[0], (F32) t[1], 0.f, 0.f);
+							tc_out->set((F32) read_mesh_u16(t), (F32) read_mesh_u16(t+2), 0.f, 0.f);
 						}
 
-						t += 4;
+						t += 8;
 
 						tc_out->div(65535.f);
 						tc_out->mul(tc_range);
@@ -2517,16 +2890,17 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 				}
 			}
 
-			if (mdl[i].has("Weights"))
+			if (src.mHasWeights)
 			{
 				face.allocateWeights(num_verts);
 
-				LLSD::Binary weights = mdl[i]["Weights"];
+				const U8* weights = src.mWeights;
+				const U32 weights_size = src.mWeightsSize;
 
 				U32 idx = 0;
 
 				U32 cur_vertex = 0;
-				while (idx < weights.size() && cur_vertex < num_verts)
+				while (idx < weights_size && cur_vertex < num_verts)
 				{
 					const U8 END_INFLUENCES = 0xFF;
 					U8 joint = weights[idx++];
@@ -2534,15 +2908,15 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 					U32 cur_influence = 0;
 					LLVector4 wght(0,0,0,0);
 
-					while (joint != END_INFLUENCES && idx < weights.size())
+					while (joint != END_INFLUENCES && idx + 1 < weights_size)
 					{
-						U16 influence = weights[idx++];
-						influence |= ((U16) weights[idx++] << 8);
+						U16 influence = read_mesh_u16(weights + idx);
+						idx += 2;
 
 						F32 w = llclamp((F32) influence / 65535.f, 0.f, 0.99999f);
 						wght.mV[cur_influence++] = (F32) joint + w;
 
-						if (cur_influence >= 4)
+						if (cur_influence >= 4 || idx >= weights_size)
 						{
 							joint = END_INFLUENCES;
 						}
@@ -2557,7 +2931,7 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 					cur_vertex++;
 				}
 
-				if (cur_vertex != num_verts || idx != weights.size())
+				if (cur_vertex != num_verts || idx != weights_size)
 				{
 					llwarns << "Vertex weight count does not match vertex count!" << llendl;
 				}
@@ -2662,6 +3036,8 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 		}
 	}
 	
+	free(block);
+
 	mSculptLevel = 0;  // success!
 
 	cacheOptimize();
@@ -2670,6 +3046,157 @@ bool LLVolume::unpackVolumeFaces(std::istream& is, S32 size)
 }
 
 
+// Decoded face streams are a local cache in native byte order; bump the version whenever
+// LLVolumeFace's layout or the way unpackVolumeFaces() builds the faces changes.
+const U32 DECODED_FACES_MAGIC = 0x4d44544c;	// "LTDM"
+const U32 DECODED_FACES_VERSION = 1;
+
+struct LLDecodedFaceHeader
+{
+	S32 mNumVertices;
+	S32 mNumIndices;
+	U32 mHasWeights;
+	U32 mPad;
+	LLVector4a mExtents[2];
+	LLVector2 mTexCoordExtents[2];
+};
+
+// Both packDecodedFaces() and unpackDecodedFaces() only accept faces that pass this.
+// Only the counts are checked if indices is NULL.
+static bool is_valid_decoded_face(S32 num_vertices, S32 num_indices, const U16* indices)
+{
+	if (num_vertices < 0 || num_vertices > 65536 ||
+		num_indices < 0 || num_indices > 3*65536 || num_indices % 3 != 0)
+	{
+		return false;
+	}
+	if (!indices)
+	{
+		return true;
+	}
+
+	//a damaged file must not hand out of range indices to the renderer
+	for (S32 i = 0; i < num_indices; ++i)
+	{
+		if (indices[i] >= num_vertices)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool LLVolume::packDecodedFaces(std::ostream& os) const
+{
+	if (mVolumeFaces.empty() || mVolumeFaces.size() > (size_t) LL_SCULPT_MESH_MAX_FACES)
+	{
+		return false;
+	}
+	for (U32 i = 0; i < mVolumeFaces.size(); ++i)
+	{
+		const LLVolumeFace& face = mVolumeFaces[i];
+		if (!is_valid_decoded_face(face.mNumVertices, face.mNumIndices, face.mIndices))
+		{
+			return false;
+		}
+	}
+
+	U32 header[3] = { DECODED_FACES_MAGIC, DECODED_FACES_VERSION, (U32) mVolumeFaces.size() };
+	os.write((const char*) header, sizeof(header));
+
+	for (U32 i = 0; i < mVolumeFaces.size(); ++i)
+	{
+		const LLVolumeFace& face = mVolumeFaces[i];
+
+		LLDecodedFaceHeader face_header;
+		memset(&face_header, 0, sizeof(face_header));
+		face_header.mNumVertices = face.mNumVertices;
+		face_header.mNumIndices = face.mNumIndices;
+		face_header.mHasWeights = face.mWeights ? 1 : 0;
+		face_header.mExtents[0] = face.mExtents[0];
+		face_header.mExtents[1] = face.mExtents[1];
+		face_header.mTexCoordExtents[0] = face.mTexCoordExtents[0];
+		face_header.mTexCoordExtents[1] = face.mTexCoordExtents[1];
+		os.write((const char*) &face_header, sizeof(face_header));
+
+		if (face.mNumVertices)
+		{	//positions, normals and texture coordinates are one block
+			os.write((const char*) face.mPositions, (sizeof(LLVector4a)*2 + sizeof(LLVector2))*face.mNumVertices);
+			if (face.mWeights)
+			{
+				os.write((const char*) face.mWeights, sizeof(LLVector4a)*face.mNumVertices);
+			}
+		}
+		if (face.mNumIndices)
+		{
+			os.write((const char*) face.mIndices, sizeof(U16)*face.mNumIndices);
+		}
+	}
+
+	return os.good();
+}
+
+bool LLVolume::unpackDecodedFaces(std::istream& is)
+{
+	U32 header[3];
+	is.read((char*) header, sizeof(header));
+	if (!is.good() || header[0] != DECODED_FACES_MAGIC || header[1] != DECODED_FACES_VERSION ||
+		header[2] == 0 || header[2] > (U32) LL_SCULPT_MESH_MAX_FACES)
+	{
+		return false;
+	}
+
+	mVolumeFaces.resize(header[2]);
+
+	for (U32 i = 0; i < mVolumeFaces.size(); ++i)
+	{
+		LLVolumeFace& face = mVolumeFaces[i];
+
+		LLDecodedFaceHeader face_header;
+		is.read((char*) &face_header, sizeof(face_header));
+		if (!is.good() || !is_valid_decoded_face(face_header.mNumVertices, face_header.mNumIndices, NULL))
+		{
+			mVolumeFaces.clear();
+			return false;
+		}
+
+		face.mExtents[0] = face_header.mExtents[0];
+		face.mExtents[1] = face_header.mExtents[1];
+		face.mTexCoordExtents[0] = face_header.mTexCoordExtents[0];
+		face.mTexCoordExtents[1] = face_header.mTexCoordExtents[1];
+
+		//read straight into the face arrays
+		face.resizeVertices(face_header.mNumVertices);
+		if (face.mNumVertices)
+		{
+			is.read((char*) face.mPositions, (sizeof(LLVector4a)*2 + sizeof(LLVector2))*face.mNumVertices);
+			if (face_header.mHasWeights)
+			{
+				face.allocateWeights(face.mNumVertices);
+				is.read((char*) face.mWeights, sizeof(LLVector4a)*face.mNumVertices);
+			}
+		}
+
+		face.resizeIndices(face_header.mNumIndices);
+		if (face.mNumIndices)
+		{
+			is.read((char*) face.mIndices, sizeof(U16)*face.mNumIndices);
+		}
+
+		if (is.fail() || !is_valid_decoded_face(face.mNumVertices, face.mNumIndices, face.mIndices))
+		{
+			mVolumeFaces.clear();
+			return false;
+		}
+
+		face.mOptimized = TRUE;
+	}
+
+	mSculptLevel = 0;
+
+	return true;
+}
+
 BOOL LLVolume::isMeshAssetLoaded()
 {
 	return mIsMeshAssetLoaded;
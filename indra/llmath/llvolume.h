@@ -1065,6 +1065,12 @@ protected:
 public:
 	virtual bool unpackVolumeFaces(std::istream& is, S32 size);
 
+	// Write/read the faces exactly as they are in memory after unpackVolumeFaces(), so that
+	// a decoded mesh can be reloaded without inflating, parsing or cache optimizing it again.
+	// Both return false, without writing anything in the case of pack, for faces that unpack rejects.
+	bool packDecodedFaces(std::ostream& os) const;
+	bool unpackDecodedFaces(std::istream& is);
+
 	virtual void setMeshAssetLoaded(BOOL loaded);
 	virtual BOOL isMeshAssetLoaded();
 
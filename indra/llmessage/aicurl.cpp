@@ -1308,7 +1308,8 @@ bool BufferedCurlEasyRequest::sShuttingDown = false;
 AIAverage BufferedCurlEasyRequest::sHTTPBandwidth(25);
 
 BufferedCurlEasyRequest::BufferedCurlEasyRequest() :
-	mRequestTransferedBytes(0), mTotalRawBytes(0), mStatus(HTTP_INTERNAL_ERROR_OTHER), mBufferEventsTarget(NULL), mCapabilityType(number_of_capability_types)
+	mRequestTransferedBytes(0), mTotalRawBytes(0), mStatus(HTTP_INTERNAL_ERROR_OTHER), mBufferEventsTarget(NULL), mCapabilityType(number_of_capability_types),
+	mBodyBufferRequested(false), mBodyBuffer(NULL), mBodyBufferSize(0), mBodyBufferUsed(0)
 {
   AICurlInterface::Stats::BufferedCurlEasyRequest_count++;
 }
@@ -1397,6 +1398,10 @@ void BufferedCurlEasyRequest::resetState(void)
   mTotalRawBytes = 0;
   mBufferEventsTarget = NULL;
   mStatus = HTTP_INTERNAL_ERROR_OTHER;
+  mBodyBufferRequested = false;
+  mBodyBuffer = NULL;
+  mBodyBufferSize = 0;
+  mBodyBufferUsed = 0;
 }
 
 void BufferedCurlEasyRequest::print_diagnostics(CURLcode code)
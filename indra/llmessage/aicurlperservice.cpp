@@ -77,6 +77,9 @@ AIPerService::AIPerService(void) :
 		mTotalAdded(0),
 		mEventPolls(0),
 		mEstablishedConnections(0),
+		mReusedConnectionRequests(0),
+		mNewConnectionRequests(0),
+		mTimeToFirstByte(0.f),
 		mUsedCT(0),
 		mCTInUse(0)
 {
@@ -332,8 +335,43 @@ void AIPerService::redivide_connections(void)
 
 bool AIPerService::throttled(AICapabilityType capability_type) const
 {
-  return mTotalAdded >= mConcurrentConnections ||
-		 mCapabilityType[capability_type].mAdded >= mCapabilityType[capability_type].mConcurrentConnections;
+  CapabilityType const& ct(mCapabilityType[capability_type]);
+  if (ct.mAdded >= max_added(capability_type))
+  {
+	return true;
+  }
+  if (ct.mAdded >= ct.mConcurrentConnections)
+  {
+	// All connections of this capability type are busy, but the request can be pipelined
+	// behind one that is already running; that doesn't need another connection.
+	return false;
+  }
+  // Requests that are pipelined don't use a connection of their own.
+  int pipelined = 0;
+  for (int i = 0; i < number_of_capability_types; ++i)
+  {
+	if (pipelines((AICapabilityType)i))
+	{
+	  pipelined += llmax(0, mCapabilityType[i].mAdded - mCapabilityType[i].mConcurrentConnections);
+	}
+  }
+  return mTotalAdded - pipelined >= mConcurrentConnections;
+}
+
+void AIPerService::request_finished(bool reused_connection, F64 time_to_first_byte)
+{
+  if (reused_connection)
+  {
+	++mReusedConnectionRequests;
+  }
+  else
+  {
+	++mNewConnectionRequests;
+  }
+  F32 ttfb = (F32)(time_to_first_byte * 1000.0);
+  U32 const count = mReusedConnectionRequests + mNewConnectionRequests;
+  // Average over roughly the last 16 requests.
+  mTimeToFirstByte = (count == 1) ? ttfb : mTimeToFirstByte + (ttfb - mTimeToFirstByte) / 16.f;
 }
 
 void AIPerService::added_to_multi_handle(AICapabilityType capability_type, bool event_poll)
@@ -485,14 +523,11 @@ void AIPerService::add_queued_to(curlthread::MultiHandle* multi_handle, bool onl
 	  only_this_service = true;
 	  break;
 	}
-	if (mTotalAdded >= mConcurrentConnections)
-	{
-	  // We hit the maximum number of connections for this service. Abort any attempt to add anything to this service.
-	  break;
-	}
-	if (ct.mAdded >= ct.mConcurrentConnections)
+	if (throttled((AICapabilityType)i))
 	{
-	  // We hit the maximum number of connections for this capability type. Try the next one.
+	  // We hit the maximum number of connections (or pipelined requests) for this capability type,
+	  // or the maximum number of connections for this service. Try the next one; it might still be
+	  // possible to pipeline one of those.
 	  continue;
 	}
 	U32 mask = CT2mask((AICapabilityType)i);
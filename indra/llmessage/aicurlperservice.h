@@ -173,6 +173,12 @@ class AIPerService {
 	int mEventPolls;							// Number of active event poll handles with this service.
 	int mEstablishedConnections;				// Number of connected sockets to this service.
 
+	U32 mReusedConnectionRequests;				// Number of finished requests that were sent over an already established connection.
+	U32 mNewConnectionRequests;					// Number of finished requests that needed a new connection.
+	F32 mTimeToFirstByte;						// Running average of the time between sending a request and receiving the first byte of the reply, in ms.
+
+	static bool sPipelining;					// Set when HTTP pipelining is enabled (CurlPipelining).
+
 	U32 mUsedCT;								// Bit mask with one bit per capability type. A '1' means the capability was in use since the last resetUsedCT().
 	U32 mCTInUse;								// Bit mask with one bit per capability type. A '1' means the capability is in use right now.
 
@@ -209,6 +215,20 @@ class AIPerService {
 	int connection_established(void) { mEstablishedConnections++; return mEstablishedConnections; }
 	int connection_closed(void) { mEstablishedConnections--; return mEstablishedConnections; }
 
+	// The maximum number of requests that are pipelined over a single connection.
+	static int const pipeline_depth = 4;
+
+	// Called when a request for this service finished successfully.
+	void request_finished(bool reused_connection, F64 time_to_first_byte);
+	// Returns true if the service keeps connections alive (an HTTP/1.1 server that didn't close every connection so far).
+	bool keeps_alive(void) const { return mReusedConnectionRequests > 0; }
+	// Returns true if requests of this capability type are pipelined when all of its connections are busy.
+	// Only textures and meshes are; those are small (range) requests that don't block the ones behind it for long.
+	bool pipelines(AICapabilityType capability_type) const
+	  { return sPipelining && (capability_type == cap_texture || capability_type == cap_mesh) && keeps_alive(); }
+	static void setPipelining(bool pipelining) { sPipelining = pipelining; }
+	static bool pipelining(void) { return sPipelining; }
+
 	static bool is_approved(AICapabilityType capability_type) { return (((U32)1 << capability_type) & approved_mask); }
 	static U32 CT2mask(AICapabilityType capability_type) { return (U32)1 << capability_type; }
 	void resetUsedCt(void) { mUsedCT = mCTInUse; }
@@ -275,7 +295,13 @@ class AIPerService {
 								   bool downloaded_something, bool success);			// Called when an easy handle for this service is removed again from the multi handle.
 	void download_started(AICapabilityType capability_type) { ++mCapabilityType[capability_type].mDownloading; }
 	bool throttled(AICapabilityType capability_type) const;		// Returns true if the maximum number of allowed requests for this service/capability type have been added to the multi handle.
+	// The maximum number of requests of this capability type that may be added to the multi handle at the same time.
+	int max_added(AICapabilityType capability_type) const
+	  { int connections = mCapabilityType[capability_type].mConcurrentConnections; return pipelines(capability_type) ? connections * pipeline_depth : connections; }
 	bool nothing_added(AICapabilityType capability_type) const { return mCapabilityType[capability_type].mAdded == 0; }
+	// The number of requests of this capability type that approveHTTPRequestFor could still approve, ignoring bandwidth throttling.
+	S32 approvable_requests(AICapabilityType capability_type) const
+	  { CapabilityType const& ct(mCapabilityType[capability_type]); return llmax(0, (S32)ct.mMaxPipelinedRequests - ct.pipelined_requests()); }
 
 	bool queue(AICurlEasyRequest const& easy_request, AICapabilityType capability_type, bool force_queuing = true);	// Add easy_request to the queue if queue is empty or force_queuing.
 	bool cancel(AICurlEasyRequest const& easy_request, AICapabilityType capability_type);							// Remove easy_request from the queue (if it's there).
@@ -427,6 +427,10 @@ class BufferedCurlEasyRequest : public CurlEasyRequest {
 	U32 mRequestTransferedBytes;
 	size_t mTotalRawBytes;								// Raw body data (still, possibly, compressed) received from the server so far.
 	AIBufferedCurlEasyRequestEvents* mBufferEventsTarget;
+	bool mBodyBufferRequested;							// Set once the responder was asked for a body buffer.
+	U8* mBodyBuffer;									// Memory of the responder that the body is written to, or NULL when the body goes to mOutput.
+	U32 mBodyBufferSize;								// The size of mBodyBuffer.
+	U32 mBodyBufferUsed;								// The number of bytes written to mBodyBuffer so far.
 
   public:
 	static LLChannelDescriptors const sChannels;		// Channel object for mInput (channel out()) and mOutput (channel in()).
@@ -450,6 +454,9 @@ class BufferedCurlEasyRequest : public CurlEasyRequest {
 	// Called from curlHeaderCallback.
 	void setStatusAndReason(U32 status, std::string const& reason);
 
+	// Called from curlWriteCallback. Writes body data to mBodyBuffer if the responder supplied one and it fits, otherwise to mOutput.
+	void write_body(U8 const* data, U32 bytes);
+
 	// Called from processOutput by in case of an error.
 	void print_diagnostics(CURLcode code);
 
@@ -45,6 +45,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #endif
+#if LL_LINUX
+#include <sys/epoll.h>
+#endif
 #include <deque>
 #include <cctype>
 
@@ -202,6 +205,8 @@ int ioctlsocket(int fd, int, unsigned long* nonblocking_enable)
 #endif // DEBUG_WINDOWS_CODE_ON_LINUX
 
 #define WINDOWS_CODE (LL_WINDOWS || DEBUG_WINDOWS_CODE_ON_LINUX)
+// On linux epoll is used instead of select, unless CurlUseEpoll is false or epoll isn't available.
+#define USE_EPOLL (LL_LINUX && !DEBUG_WINDOWS_CODE_ON_LINUX)
 
 #undef AICurlPrivate
 
@@ -727,6 +732,119 @@ bool MergeIterator::next(curl_socket_t& fd_out, int& ev_bitmask_out)
   return true;
 }
 
+//-----------------------------------------------------------------------------
+// EPollSet
+//
+// The epoll alternative to a read and a write PollSet. The kernel keeps the
+// interest list, so nothing needs to be copied before waiting, there is no
+// FD_SETSIZE limit and only the filedescriptors that have events are returned.
+
+#if USE_EPOLL
+class EPollSet
+{
+  public:
+	EPollSet(void);
+	~EPollSet();
+
+	// Return false if epoll isn't available (the PollSet's must be used then).
+	bool is_valid(void) const { return mEPollFd != -1; }
+
+	// Change what to wait for on fd from old_action to action (CURL_POLL_* values).
+	void set_action(curl_socket_t fd, int old_action, int action);
+
+	// Wait at most timeout_ms for events. Returns the number of events, or -1 on error.
+	int wait(long timeout_ms);
+
+	// Run over the events returned by the last call to wait(), by calling next() until it returns false.
+	// Events of filedescriptors that were removed in the meantime are skipped.
+	bool next(curl_socket_t& fd_out, int& ev_bitmask_out);
+
+  private:
+	int mEPollFd;
+	std::vector<epoll_event> mEvents;
+	int mNrEvents;					// The number of events returned by the last call to wait().
+	int mIter;						// Index into mEvents of the next event to return by next().
+};
+
+// The maximum number of events returned by one call to wait(); any others are returned by the next call.
+static int const EPOLL_MAX_EVENTS = 256;
+
+EPollSet::EPollSet(void) : mEPollFd(epoll_create(EPOLL_MAX_EVENTS)), mEvents(EPOLL_MAX_EVENTS), mNrEvents(0), mIter(0)
+{
+  if (mEPollFd == -1)
+  {
+	llwarns << "epoll_create() failed: " << errno << ", " << strerror(errno) << llendl;
+	return;
+  }
+  fcntl(mEPollFd, F_SETFD, FD_CLOEXEC);
+}
+
+EPollSet::~EPollSet()
+{
+  if (mEPollFd != -1)
+	close(mEPollFd);
+}
+
+void EPollSet::set_action(curl_socket_t fd, int old_action, int action)
+{
+  epoll_event event;
+  event.events = 0;
+  event.data.u64 = 0;
+  event.data.fd = fd;
+  if (action == CURL_POLL_NONE)
+  {
+	if (old_action == CURL_POLL_NONE)
+	  return;
+	// This fails (with EBADF) if the filedescriptor was already closed behind our back,
+	// but then the kernel already removed it. Such a request is eventually ended by handle_stalls().
+	epoll_ctl(mEPollFd, EPOLL_CTL_DEL, fd, &event);
+	// Make sure we don't call curl_multi_socket_action for a socket that libcurl told us to remove;
+	// it might even be a new socket with the same filedescriptor by the time we get to it.
+	for (int i = mIter; i < mNrEvents; ++i)
+	  if (mEvents[i].data.fd == fd)
+		mEvents[i].data.fd = CURL_SOCKET_BAD;
+	return;
+  }
+  if ((action & CURL_POLL_IN))
+	event.events |= EPOLLIN;
+  if ((action & CURL_POLL_OUT))
+	event.events |= EPOLLOUT;
+  if (epoll_ctl(mEPollFd, (old_action == CURL_POLL_NONE) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event) == -1)
+  {
+	llwarns << "epoll_ctl(" << fd << ") failed: " << errno << ", " << strerror(errno) << llendl;
+  }
+}
+
+int EPollSet::wait(long timeout_ms)
+{
+  int ready = epoll_wait(mEPollFd, &mEvents[0], EPOLL_MAX_EVENTS, timeout_ms);
+  mNrEvents = llmax(ready, 0);
+  mIter = 0;
+  return ready;
+}
+
+bool EPollSet::next(curl_socket_t& fd_out, int& ev_bitmask_out)
+{
+  while (mIter < mNrEvents)
+  {
+	epoll_event const& event(mEvents[mIter++]);
+	if (event.data.fd == CURL_SOCKET_BAD)
+	  continue;
+	fd_out = event.data.fd;
+	ev_bitmask_out = 0;
+	// A hang up is reported as readable by select() too; libcurl will find the end-of-file when reading.
+	if ((event.events & (EPOLLIN | EPOLLHUP)))
+	  ev_bitmask_out |= CURL_CSELECT_IN;
+	if ((event.events & EPOLLOUT))
+	  ev_bitmask_out |= CURL_CSELECT_OUT;
+	if ((event.events & EPOLLERR))
+	  ev_bitmask_out |= CURL_CSELECT_ERR;
+	return true;
+  }
+  return false;
+}
+#endif // USE_EPOLL
+
 //-----------------------------------------------------------------------------
 // CurlSocketInfo
 
@@ -804,19 +922,34 @@ void CurlSocketInfo::set_action(int action)
 
   Dout(dc::curl, "CurlSocketInfo::set_action(" << action_str(mAction) << " --> " << action_str(action) << ") [" << (void*)mEasyRequest.get_ptr().get() << "]");
   int toggle_action = mAction ^ action; 
-  mAction = action;
-  if ((toggle_action & CURL_POLL_IN))
+#if USE_EPOLL
+  if (mMultiHandle.mEPollSet)
   {
-	if ((action & CURL_POLL_IN))
-	  mMultiHandle.mReadPollSet->add(this);
-	else
-	  mMultiHandle.mReadPollSet->remove(this);
+	mMultiHandle.mEPollSet->set_action(mSocketFd, mAction, action);
   }
+  else
+#endif
+  {
+	if ((toggle_action & CURL_POLL_IN))
+	{
+	  if ((action & CURL_POLL_IN))
+		mMultiHandle.mReadPollSet->add(this);
+	  else
+		mMultiHandle.mReadPollSet->remove(this);
+	}
+	if ((toggle_action & CURL_POLL_OUT))
+	{
+	  if ((action & CURL_POLL_OUT))
+		mMultiHandle.mWritePollSet->add(this);
+	  else
+		mMultiHandle.mWritePollSet->remove(this);
+	}
+  }
+  mAction = action;
   if ((toggle_action & CURL_POLL_OUT))
   {
 	if ((action & CURL_POLL_OUT))
 	{
-	  mMultiHandle.mWritePollSet->add(this);
 	  if (mTimeout)
 	  {
 		  // Note that this detection normally doesn't work because mTimeout will be zero.
@@ -826,8 +959,6 @@ void CurlSocketInfo::set_action(int action)
 	}
 	else
 	{
-	  mMultiHandle.mWritePollSet->remove(this);
-
 	  // The following is a bit of a hack, needed because of the lack of proper timeout callbacks in libcurl.
 	  // The removal of CURL_POLL_OUT could be part of the SSL handshake, therefore check if we're already connected:
 	  AICurlEasyRequest_wat curl_easy_request_w(*mEasyRequest);
@@ -869,6 +1000,15 @@ class AICurlThread : public LLThread
 	void wakeup(AICurlMultiHandle_wat const& multi_handle_w);
 	void process_commands(AICurlMultiHandle_wat const& multi_handle_w);
 
+	// Return the time in ms to wait for socket events; libcurl_timeout is set iff that is the timeout of libcurl.
+	long get_timeout(AICurlMultiHandle_wat const& multi_handle_w, bool& libcurl_timeout);
+	// Called after waiting timeout_ms without any socket event.
+	void handle_timeout(AICurlMultiHandle_wat const& multi_handle_w, bool libcurl_timeout, long timeout_ms);
+#if USE_EPOLL
+	// The epoll version of waiting for and handling socket events. Unlocks mWakeUpFlagMutex.
+	void wait_epoll(AICurlMultiHandle_wat const& multi_handle_w);
+#endif
+
   private:
 	// MAIN-THREAD
 	void create_wakeup_fds(void);
@@ -1381,6 +1521,111 @@ static bool is_bad(curl_socket_t fd, bool for_writing)
   return ret == -1;
 }
 
+// Update the clocks after waiting.
+static void update_clocks(void)
+{
+  AICurlTimer::sTime_1ms = get_clock_count() * AICurlTimer::sClockWidth_1ms;
+  Dout(dc::curl, "AICurlTimer::sTime_1ms = " << AICurlTimer::sTime_1ms);
+  HTTPTimeout::sTime_10ms = AICurlTimer::sTime_1ms / 10;
+}
+
+long AICurlThread::get_timeout(AICurlMultiHandle_wat const& multi_handle_w, bool& libcurl_timeout)
+{
+  // Update AICurlTimer::sTime_1ms.
+  AICurlTimer::sTime_1ms = get_clock_count() * AICurlTimer::sClockWidth_1ms;
+  Dout(dc::curl, "AICurlTimer::sTime_1ms = " << AICurlTimer::sTime_1ms);
+  // Get the time in ms that libcurl wants us to wait for socket actions - at most - before proceeding.
+  long timeout_ms = multi_handle_w->getTimeout();
+  // Set libcurl_timeout iff the shortest timeout is that of libcurl.
+  libcurl_timeout = timeout_ms == 0 || (timeout_ms > 0 && !AICurlTimer::expiresBefore(timeout_ms));
+  // If no curl timeout is set, sleep at most 4 seconds.
+  if (LL_UNLIKELY(timeout_ms < 0))
+	timeout_ms = 4000;
+  // Check if some AICurlTimer expires first.
+  if (AICurlTimer::expiresBefore(timeout_ms))
+  {
+	timeout_ms = AICurlTimer::nextExpiration();
+  }
+  // If we have to continue immediately, then just set a zero timeout, but only for 100 calls on a row;
+  // after that start sleeping 1ms and later even 10ms (this should never happen).
+  if (LL_UNLIKELY(timeout_ms <= 0))
+  {
+	if (mZeroTimeout >= 1000)
+	{
+	  if (mZeroTimeout % 10000 == 0)
+		llwarns << "Detected " << mZeroTimeout << " zero-timeout calls of select() by curl thread (more than 101 seconds)!" << llendl;
+	  timeout_ms = 10;
+	}
+	else if (mZeroTimeout >= 100)
+	  timeout_ms = 1;
+	else
+	  timeout_ms = 0;
+  }
+  else
+  {
+	if (LL_UNLIKELY(mZeroTimeout >= 10000))
+	  llinfos << "Timeout of select() call by curl thread reset (to " << timeout_ms << " ms)." << llendl;
+	mZeroTimeout = 0;
+  }
+  return timeout_ms;
+}
+
+void AICurlThread::handle_timeout(AICurlMultiHandle_wat const& multi_handle_w, bool libcurl_timeout, long timeout_ms)
+{
+  if (libcurl_timeout)
+  {
+	multi_handle_w->socket_action(CURL_SOCKET_TIMEOUT, 0);
+  }
+  else
+  {
+	// Update MultiHandle::mTimeout because next loop we need to sleep timeout_ms shorter.
+	multi_handle_w->update_timeout(timeout_ms);
+	Dout(dc::curl, "MultiHandle::mTimeout set to " << multi_handle_w->getTimeout() << " ms.");
+  }
+  // Handle timers.
+  if (AICurlTimer::expiresBefore(1))
+  {
+	AICurlTimer::handleExpiration();
+  }
+  // Handle stalling transactions.
+  multi_handle_w->handle_stalls();
+}
+
+#if USE_EPOLL
+void AICurlThread::wait_epoll(AICurlMultiHandle_wat const& multi_handle_w)
+{
+  bool libcurl_timeout;
+  long timeout_ms = get_timeout(multi_handle_w, libcurl_timeout);
+  int ready = multi_handle_w->mEPollSet->wait(timeout_ms);
+  mWakeUpFlagMutex.unlock();
+  if (ready == -1)
+  {
+	if (errno != EINTR)
+	  llwarns << "epoll_wait() failed: " << errno << ", " << strerror(errno) << llendl;
+	return;
+  }
+  update_clocks();
+  if (ready == 0)
+  {
+	handle_timeout(multi_handle_w, libcurl_timeout, timeout_ms);
+	return;
+  }
+  curl_socket_t fd;
+  int ev_bitmask;
+  while (multi_handle_w->mEPollSet->next(fd, ev_bitmask))
+  {
+	if (fd == mWakeUpFd)
+	{
+	  // Process commands from main-thread. This can add or remove filedescriptors from the epoll set.
+	  wakeup(multi_handle_w);
+	  continue;
+	}
+	// This can cause libcurl to do callbacks and remove filedescriptors, which drops any of their events that weren't handled yet.
+	multi_handle_w->socket_action(fd, ev_bitmask);
+  }
+}
+#endif
+
 // The main loop of the curl thread.
 void AICurlThread::run(void)
 {
@@ -1388,6 +1633,12 @@ void AICurlThread::run(void)
 
   {
 	AICurlMultiHandle_wat multi_handle_w(AICurlMultiHandle::getInstance());
+#if USE_EPOLL
+	if (multi_handle_w->mEPollSet)
+	{
+	  multi_handle_w->mEPollSet->set_action(mWakeUpFd, CURL_POLL_NONE, CURL_POLL_IN);
+	}
+#endif
 	while(mRunning)
 	{
 	  // If mRunning is true then we can only get here if mWakeUpFd != CURL_SOCKET_BAD.
@@ -1415,6 +1666,15 @@ void AICurlThread::run(void)
 	  // We're now entering select(), during which the main thread will write to the pipe/socket
 	  // to wake us up, because it can't get the lock.
 
+#if USE_EPOLL
+	  if (multi_handle_w->mEPollSet)
+	  {
+		wait_epoll(multi_handle_w);
+		multi_handle_w->check_msg_queue();
+		continue;
+	  }
+#endif
+
 	  // Copy the next batch of file descriptors from the PollSets mFileDescriptors into their mFdSet.
 	  multi_handle_w->mReadPollSet->refresh();
 	  refresh_t wres = multi_handle_w->mWritePollSet->refresh();
@@ -1437,42 +1697,8 @@ void AICurlThread::run(void)
 #endif
 	  int ready = 0;
 	  struct timeval timeout;
-	  // Update AICurlTimer::sTime_1ms.
-	  AICurlTimer::sTime_1ms = get_clock_count() * AICurlTimer::sClockWidth_1ms;
-	  Dout(dc::curl, "AICurlTimer::sTime_1ms = " << AICurlTimer::sTime_1ms);
-	  // Get the time in ms that libcurl wants us to wait for socket actions - at most - before proceeding.
-	  long timeout_ms = multi_handle_w->getTimeout();
-	  // Set libcurl_timeout iff the shortest timeout is that of libcurl.
-	  bool libcurl_timeout = timeout_ms == 0 || (timeout_ms > 0 && !AICurlTimer::expiresBefore(timeout_ms));
-	  // If no curl timeout is set, sleep at most 4 seconds.
-	  if (LL_UNLIKELY(timeout_ms < 0))
-		timeout_ms = 4000;
-	  // Check if some AICurlTimer expires first.
-	  if (AICurlTimer::expiresBefore(timeout_ms))
-	  {
-		timeout_ms = AICurlTimer::nextExpiration();
-	  }
-	  // If we have to continue immediately, then just set a zero timeout, but only for 100 calls on a row;
-	  // after that start sleeping 1ms and later even 10ms (this should never happen).
-	  if (LL_UNLIKELY(timeout_ms <= 0))
-	  {
-		if (mZeroTimeout >= 1000)
-		{
-		  if (mZeroTimeout % 10000 == 0)
-			llwarns << "Detected " << mZeroTimeout << " zero-timeout calls of select() by curl thread (more than 101 seconds)!" << llendl;
-		  timeout_ms = 10;
-		}
-		else if (mZeroTimeout >= 100)
-		  timeout_ms = 1;
-		else
-		  timeout_ms = 0;
-	  }
-	  else
-	  {
-		if (LL_UNLIKELY(mZeroTimeout >= 10000))
-		  llinfos << "Timeout of select() call by curl thread reset (to " << timeout_ms << " ms)." << llendl;
-		mZeroTimeout = 0;
-	  }
+	  bool libcurl_timeout;
+	  long timeout_ms = get_timeout(multi_handle_w, libcurl_timeout);
 	  timeout.tv_sec = timeout_ms / 1000;
 	  timeout.tv_usec = (timeout_ms % 1000) * 1000;
 #ifdef CWDEBUG
@@ -1572,29 +1798,10 @@ void AICurlThread::run(void)
 		}
 		continue;
 	  }
-	  // Update the clocks.
-	  AICurlTimer::sTime_1ms = get_clock_count() * AICurlTimer::sClockWidth_1ms;
-	  Dout(dc::curl, "AICurlTimer::sTime_1ms = " << AICurlTimer::sTime_1ms);
-	  HTTPTimeout::sTime_10ms = AICurlTimer::sTime_1ms / 10;
+	  update_clocks();
 	  if (ready == 0)
 	  {
-		if (libcurl_timeout)
-		{
-		  multi_handle_w->socket_action(CURL_SOCKET_TIMEOUT, 0);
-		}
-		else
-		{
-		  // Update MultiHandle::mTimeout because next loop we need to sleep timeout_ms shorter.
-		  multi_handle_w->update_timeout(timeout_ms);
-		  Dout(dc::curl, "MultiHandle::mTimeout set to " << multi_handle_w->getTimeout() << " ms.");
-		}
-		// Handle timers.
-		if (AICurlTimer::expiresBefore(1))
-		{
-		  AICurlTimer::handleExpiration();
-		}
-		// Handle stalling transactions.
-		multi_handle_w->handle_stalls();
+		handle_timeout(multi_handle_w, libcurl_timeout, timeout_ms);
 	  }
 	  else
 	  {
@@ -1632,14 +1839,33 @@ void AICurlThread::run(void)
 
 LLAtomicU32 MultiHandle::sTotalAdded;
 
-MultiHandle::MultiHandle(void) : mTimeout(-1), mReadPollSet(NULL), mWritePollSet(NULL)
+MultiHandle::MultiHandle(void) : mTimeout(-1), mReadPollSet(NULL), mWritePollSet(NULL), mEPollSet(NULL)
 {
   mReadPollSet = new PollSet;
   mWritePollSet = new PollSet;
+#if USE_EPOLL
+  if (curl_use_epoll)
+  {
+	mEPollSet = new EPollSet;
+	if (!mEPollSet->is_valid())
+	{
+	  llwarns << "Falling back to select() for the curl thread." << llendl;
+	  delete mEPollSet;
+	  mEPollSet = NULL;
+	}
+  }
+#endif
   check_multi_code(curl_multi_setopt(mMultiHandle, CURLMOPT_SOCKETFUNCTION, &MultiHandle::socket_callback));
   check_multi_code(curl_multi_setopt(mMultiHandle, CURLMOPT_SOCKETDATA, this));
   check_multi_code(curl_multi_setopt(mMultiHandle, CURLMOPT_TIMERFUNCTION, &MultiHandle::timer_callback));
   check_multi_code(curl_multi_setopt(mMultiHandle, CURLMOPT_TIMERDATA, this));
+  // Keep idle connections around between bursts of requests, so that the next burst can reuse them
+  // instead of paying for a new TCP (and TLS) handshake. The default is only a handful per multi handle.
+  setopt(CURLMOPT_MAXCONNECTS, (long)(2 * curl_max_total_concurrent_connections));
+  if (AIPerService::pipelining())
+  {
+	setopt(CURLMOPT_PIPELINING, 1L);
+  }
 }
 
 MultiHandle::~MultiHandle()
@@ -1653,6 +1879,9 @@ MultiHandle::~MultiHandle()
 	finish_easy_request(*iter, CURLE_GOT_NOTHING);	// Error code is not used anyway.
 	remove_easy_request(*iter);
   }
+#if USE_EPOLL
+  delete mEPollSet;
+#endif
   delete mWritePollSet;
   delete mReadPollSet;
 }
@@ -1745,6 +1974,7 @@ CURLMsg const* MultiHandle::info_read(int* msgs_in_queue) const
 }
 
 U32 curl_max_total_concurrent_connections = 32;						// Initialized on start up by startCurlThread().
+bool curl_use_epoll = true;												// Initialized on start up by startCurlThread().
 
 bool MultiHandle::add_easy_request(AICurlEasyRequest const& easy_request, bool from_queue)
 {
@@ -1920,6 +2150,18 @@ void MultiHandle::finish_easy_request(AICurlEasyRequest const& easy_request, CUR
   curl_easy_request_w->update_body_bandwidth();
   // Store the result in the easy handle.
   curl_easy_request_w->storeResult(result);
+  if (result == CURLE_OK)
+  {
+	// Keep track of connection reuse and the time to first byte of this service.
+	long num_connects;
+	double starttransfer_time;
+	curl_easy_request_w->getinfo(CURLINFO_NUM_CONNECTS, &num_connects);
+	curl_easy_request_w->getinfo(CURLINFO_STARTTRANSFER_TIME, &starttransfer_time);
+	if (starttransfer_time > 0)
+	{
+	  PerService_wat(*curl_easy_request_w->getPerServicePtr())->request_finished(num_connects == 0, starttransfer_time);
+	}
+  }
 #ifdef CWDEBUG
   char* eff_url;
   curl_easy_request_w->getinfo(CURLINFO_EFFECTIVE_URL, &eff_url);
@@ -2135,6 +2377,10 @@ void BufferedCurlEasyRequest::processOutput(void)
 	  // the body and provide completed/result/error calls.
 	  mBufferEventsTarget->completed_headers(responseCode, responseReason, (code == CURLE_FAILED_INIT) ? NULL : &info);
 	}
+	if (mBodyBuffer)
+	{
+	  mResponder->setBodyBufferSize(mBodyBufferUsed);
+	}
 	mResponder->finished(code, responseCode, responseReason, sChannels, mOutput);
   }
   sResponderCallbackMutex.unlock();
@@ -2182,7 +2428,7 @@ size_t BufferedCurlEasyRequest::curlWriteCallback(char* data, size_t size, size_
   S32 bytes = size * nmemb;		// The amount to write.
   // BufferedCurlEasyRequest::setBodyLimit is never called, so buffer_w->mBodyLimit is infinite.
   //S32 bytes = llmin(size * nmemb, buffer_w->mBodyLimit); buffer_w->mBodyLimit -= bytes;
-  self_w->getOutput()->append(sChannels.in(), (U8 const*)data, bytes);
+  self_w->write_body((U8 const*)data, bytes);
   // Update HTTP bandwith.
   self_w->update_body_bandwidth();
   // Update timeout administration.
@@ -2194,6 +2440,31 @@ size_t BufferedCurlEasyRequest::curlWriteCallback(char* data, size_t size, size_
   return bytes;
 }
 
+void BufferedCurlEasyRequest::write_body(U8 const* data, U32 bytes)
+{
+  if (!mBodyBufferRequested && mStatus >= 200 && mStatus < 300 && mResponder)
+  {
+	// The body of a successful reply starts to arrive; see if the responder wants it in its own memory.
+	mBodyBufferRequested = true;
+	mBodyBuffer = mResponder->getBodyBuffer(mBodyBufferSize);
+  }
+  if (mBodyBuffer)
+  {
+	if (mBodyBufferUsed + bytes <= mBodyBufferSize)
+	{
+	  memcpy(mBodyBuffer + mBodyBufferUsed, data, bytes);
+	  mBodyBufferUsed += bytes;
+	  return;
+	}
+	// The body doesn't fit. Move what we have so far to mOutput and continue there.
+	Dout(dc::curl, "Body of " << (void*)get_lockobj() << " doesn't fit in the body buffer of " << mBodyBufferSize << " bytes.");
+	mOutput->append(sChannels.in(), mBodyBuffer, mBodyBufferUsed);
+	mBodyBuffer = NULL;
+	mBodyBufferUsed = 0;
+  }
+  mOutput->append(sChannels.in(), data, bytes);
+}
+
 void BufferedCurlEasyRequest::update_body_bandwidth(void)
 {
   double size_download;	// Total amount of raw bytes received so far (ie. still compressed, 'bytes' is uncompressed).
@@ -2670,6 +2941,8 @@ void startCurlThread(LLControlGroup* control_group)
   // Cache Debug Settings.
   sConfigGroup = control_group;
   curl_max_total_concurrent_connections = sConfigGroup->getU32("CurlMaxTotalConcurrentConnections");
+  curl_use_epoll = sConfigGroup->getBOOL("CurlUseEpoll");
+  AIPerService::setPipelining(sConfigGroup->getBOOL("CurlPipelining"));
   CurlConcurrentConnectionsPerService = (U16)sConfigGroup->getU32("CurlConcurrentConnectionsPerService");
   gNoVerifySSLCert = sConfigGroup->getBOOL("NoVerifySSLCert");
   AIPerService::setMaxPipelinedRequests(curl_max_total_concurrent_connections);
@@ -2755,6 +3028,7 @@ AIThreadSafeSimpleDC<AIPerService::MaxPipelinedRequests> AIPerService::sMaxPipel
 AIThreadSafeSimpleDC<AIPerService::ThrottleFraction> AIPerService::sThrottleFraction;
 LLAtomicU32 AIPerService::sHTTPThrottleBandwidth125(250000);
 bool AIPerService::sNoHTTPBandwidthThrottling;
+bool AIPerService::sPipelining;
 
 // Return Approvement if we want at least one more HTTP request for this service.
 //
@@ -2878,7 +3152,8 @@ AIPerService::Approvement* AIPerService::approveHTTPRequestFor(AIPerServicePtr c
 	}
 	else if (increment_threshold && reject)
 	{
-	  if ((int)ct.mMaxPipelinedRequests < 2 * ct.mConcurrentConnections)
+	  // When requests of this type are pipelined, more of them can be in flight at once.
+	  if ((int)ct.mMaxPipelinedRequests < per_service_w->max_added(capability_type) + ct.mConcurrentConnections)
 	  {
 		ct.mMaxPipelinedRequests++;
 		// Immediately take the new threshold into account.
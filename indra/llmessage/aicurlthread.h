@@ -40,8 +40,10 @@ namespace AICurlPrivate {
 namespace curlthread {
 
 extern U32 curl_max_total_concurrent_connections;
+extern bool curl_use_epoll;
 
 class PollSet;
+class EPollSet;
 
 // For ordering a std::set with AICurlEasyRequest objects.
 struct AICurlEasyRequestCompare {
@@ -114,6 +116,7 @@ class MultiHandle : public CurlMultiHandle
 
 	PollSet* mReadPollSet;
 	PollSet* mWritePollSet;
+	EPollSet* mEPollSet;				// Used instead of the PollSet's when not NULL (linux only).
 };
 
 } // namespace curlthread
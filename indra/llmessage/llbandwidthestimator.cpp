@@ -0,0 +1,131 @@
+/**
+ * @file llbandwidthestimator.cpp
+ * @brief Delay and loss based estimate of the downstream capacity of a circuit.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+
+#include "linden_common.h"
+
+#include "llbandwidthestimator.h"
+#include "llmath.h"
+
+// Number of samples that the base round trip time is the minimum of.
+// A route change can raise the real minimum, so it has to be forgotten eventually.
+static const U32 RTT_HISTORY_SAMPLES = 24;
+static const F32 RTT_SMOOTHING = 0.5f;			// Weight of a new sample.
+
+// Queueing delay below which the estimate may grow and above which it is cut back, in milliseconds.
+// Both are raised to a fraction of the base round trip time, because long paths jitter more.
+static const F32 LOW_QUEUEING_DELAY = 20.f;
+static const F32 HIGH_QUEUEING_DELAY = 80.f;
+static const F32 LOW_QUEUEING_DELAY_FRACTION = 0.1f;
+static const F32 HIGH_QUEUEING_DELAY_FRACTION = 0.4f;
+
+// Packet loss percentages, as per the old throttle.
+static const F32 LOW_LOSS = 0.5f;
+static const F32 HIGH_LOSS = 3.0f;
+
+static const F32 INCREASE_FACTOR = 1.08f;
+static const F32 DECREASE_FACTOR = 0.85f;		// Of the throughput.
+static const F32 MAX_DECREASE_FACTOR = 0.5f;	// Of the estimate.
+static const F32 HOLD_HEADROOM = 1.05f;			// Of the throughput.
+// The estimate only grows when at least this fraction of it is in use.
+static const F32 MIN_USED_FRACTION = 0.5f;
+
+LLBandwidthEstimator::LLBandwidthEstimator(F32 min_kbps, F32 max_kbps) :
+	mMinEstimate(min_kbps),
+	mMaxEstimate(max_kbps),
+	mEstimate(max_kbps),
+	mBaseRTT(0.f),
+	mSmoothedRTT(0.f),
+	mState(STATE_HOLD)
+{
+}
+
+void LLBandwidthEstimator::reset(F32 initial_kbps)
+{
+	mEstimate = llclamp(initial_kbps, mMinEstimate, mMaxEstimate);
+	mRecentRTTs.clear();
+	mBaseRTT = 0.f;
+	mSmoothedRTT = 0.f;
+	mState = STATE_HOLD;
+}
+
+void LLBandwidthEstimator::setLimits(F32 min_kbps, F32 max_kbps)
+{
+	mMinEstimate = min_kbps;
+	mMaxEstimate = llmax(min_kbps, max_kbps);
+	mEstimate = llclamp(mEstimate, mMinEstimate, mMaxEstimate);
+}
+
+F32 LLBandwidthEstimator::update(F32 throughput_kbps, F32 rtt_msec, F32 loss_percent)
+{
+	if (mRecentRTTs.size() == RTT_HISTORY_SAMPLES)
+	{
+		mRecentRTTs.pop_front();
+	}
+	mRecentRTTs.push_back(rtt_msec);
+	mBaseRTT = rtt_msec;
+	for (std::deque<F32>::const_iterator iter = mRecentRTTs.begin(); iter != mRecentRTTs.end(); ++iter)
+	{
+		mBaseRTT = llmin(mBaseRTT, *iter);
+	}
+	if (mRecentRTTs.size() == 1)
+	{
+		mSmoothedRTT = rtt_msec;
+	}
+	else
+	{
+		mSmoothedRTT += RTT_SMOOTHING * (rtt_msec - mSmoothedRTT);
+	}
+
+	F32 queueing_delay = getQueueingDelay();
+	if (queueing_delay > llmax(HIGH_QUEUEING_DELAY, HIGH_QUEUEING_DELAY_FRACTION * mBaseRTT) || loss_percent > HIGH_LOSS)
+	{
+		// Back off to below what got through, so the queue drains.
+		mState = STATE_DECREASE;
+		mEstimate = llclamp(DECREASE_FACTOR * throughput_kbps, MAX_DECREASE_FACTOR * mEstimate, DECREASE_FACTOR * mEstimate);
+	}
+	else if (queueing_delay < llmax(LOW_QUEUEING_DELAY, LOW_QUEUEING_DELAY_FRACTION * mBaseRTT) && loss_percent <= LOW_LOSS)
+	{
+		mState = STATE_INCREASE;
+		if (throughput_kbps >= MIN_USED_FRACTION * mEstimate)
+		{
+			mEstimate *= INCREASE_FACTOR;
+		}
+	}
+	else
+	{
+		// Something is queueing up. Don't allow much more than what gets through,
+		// or the queue would stay put.
+		mState = STATE_HOLD;
+		if (throughput_kbps >= MIN_USED_FRACTION * mEstimate)
+		{
+			mEstimate = llmin(mEstimate, HOLD_HEADROOM * throughput_kbps);
+		}
+	}
+
+	mEstimate = llclamp(mEstimate, mMinEstimate, mMaxEstimate);
+	return mEstimate;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file llbandwidthestimator.h
+ * @brief Delay and loss based estimate of the downstream capacity of a circuit.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+
+#ifndef LL_LLBANDWIDTHESTIMATOR_H
+#define LL_LLBANDWIDTHESTIMATOR_H
+
+#include <deque>
+
+#include "stdtypes.h"
+
+// Estimates how much a circuit can carry from periodic samples of what it
+// carried, its round trip time and its packet loss.
+//
+// The round trip time is compared against the lowest one seen recently; what
+// is left over is the time that packets spend queued somewhere along the path.
+// While that is small and nothing gets lost the estimate grows, as soon as it
+// builds up (or packets start to get dropped) the estimate is cut back to
+// somewhat below what actually arrived, so that the queue drains again.
+// Increases are held back while the circuit doesn't use what it already has.
+class LLBandwidthEstimator
+{
+public:
+	enum EState
+	{
+		STATE_INCREASE,
+		STATE_HOLD,
+		STATE_DECREASE
+	};
+
+	LLBandwidthEstimator(F32 min_kbps, F32 max_kbps);
+
+	// Forgets everything but the limits and starts over at initial_kbps.
+	void reset(F32 initial_kbps);
+	void setLimits(F32 min_kbps, F32 max_kbps);
+
+	// Feeds one sample: the rate that data arrived at since the last sample,
+	// the current round trip time and the percentage of packets lost since
+	// the last sample. Returns the new estimate.
+	F32 update(F32 throughput_kbps, F32 rtt_msec, F32 loss_percent);
+
+	F32 getEstimate() const				{ return mEstimate; }
+	F32 getBaseRTT() const				{ return mBaseRTT; }
+	F32 getSmoothedRTT() const			{ return mSmoothedRTT; }
+	// Smoothed round trip time minus the base round trip time.
+	F32 getQueueingDelay() const		{ return mSmoothedRTT - mBaseRTT; }
+	EState getState() const				{ return mState; }
+
+private:
+	F32 mMinEstimate;
+	F32 mMaxEstimate;
+	F32 mEstimate;
+
+	// Round trip times in milliseconds; zero until the first sample.
+	std::deque<F32> mRecentRTTs;		// The last RTT_HISTORY_SAMPLES samples.
+	F32 mBaseRTT;						// Minimum of mRecentRTTs.
+	F32 mSmoothedRTT;
+
+	EState mState;
+};
+
+#endif // LL_LLBANDWIDTHESTIMATOR_H
@@ -62,8 +62,18 @@ const S32 PING_START_BLOCK = 3;		// How many pings behind we have to be to consi
 const S32 PING_RELEASE_BLOCK = 2;	// How many pings behind we have to be to consider ourself unblocked.
 
 const F32 TARGET_PERIOD_LENGTH = 5.f;	// seconds
-const F32 LL_DUPLICATE_SUPPRESSION_TIMEOUT = 60.f; //seconds - this can be long, as time-based cleanup is
-													// only done when wrapping packetids, now...
+
+// Received reliable packets are remembered until the other end tells us that it won't
+// resend them, but no further back than this many packet ids.
+const U32 DUPLICATE_WINDOW_INITIAL_SIZE = 1024;
+const U32 DUPLICATE_WINDOW_MAX_SIZE = 65536;
+const U32 LOST_WINDOW_INITIAL_SIZE = 256;
+const U32 LOST_WINDOW_MAX_SIZE = 65536;
+
+// Reliable packets are checked for resending with this granularity; a turn of the wheel
+// covers the usual resend timeouts.
+const F64 RESEND_WHEEL_TICK = 0.01;		// seconds
+const U32 RESEND_WHEEL_SLOTS = 512;
 
 LLCircuitData::LLCircuitData(const LLHost &host, TPACKETID in_id, 
 							 const F32 circuit_heartbeat_interval, const F32 circuit_timeout)
@@ -86,6 +96,9 @@ LLCircuitData::LLCircuitData(const LLHost &host, TPACKETID in_id,
 	mLastPingID(0),
 	mPingDelay(INITIAL_PING_VALUE_MSEC), 
 	mPingDelayAveraged((F32)INITIAL_PING_VALUE_MSEC), 
+	mPotentialLostPackets(LOST_WINDOW_INITIAL_SIZE, LOST_WINDOW_MAX_SIZE),
+	mRecentlyReceivedReliablePackets(DUPLICATE_WINDOW_INITIAL_SIZE, DUPLICATE_WINDOW_MAX_SIZE),
+	mResendWheel(RESEND_WHEEL_TICK, RESEND_WHEEL_SLOTS),
 	mUnackedPacketCount(0),
 	mUnackedPacketBytes(0),
 	mLastPacketInTime(0.0),
@@ -282,11 +295,35 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 	// I'm not going to worry about this for now - djs
 	//
 
+	// Only the packets that might have expired are looked at. Like when walking
+	// mUnackedPackets, resend the ones with the lowest packet id first.
+	mResendWheel.popDue(now, mDueResends);
+	std::sort(mDueResends.begin(), mDueResends.end());
+
 	reliable_iter iter;
 	BOOL have_resend_overflow = FALSE;
-	for (iter = mUnackedPackets.begin(); iter != mUnackedPackets.end();)
+	for (std::vector<TPACKETID>::iterator id_iter = mDueResends.begin(); id_iter != mDueResends.end(); ++id_iter)
 	{
+		TPACKETID packet_id = *id_iter;
+		iter = mUnackedPackets.find(packet_id);
+		if (iter == mUnackedPackets.end())
+		{
+			iter = mFinalRetryPackets.find(packet_id);
+			if (iter != mFinalRetryPackets.end())
+			{
+				expireFinalRetryPacket(iter, now);
+			}
+			// else it was acked.
+			continue;
+		}
+
 		packetp = iter->second;
+		if (now <= packetp->mExpirationTime)
+		{
+			// Popped a little early, or it was resent since it got scheduled.
+			mResendWheel.schedule(packet_id, packetp->mExpirationTime);
+			continue;
+		}
 
 		// Only check overflow if we haven't had one yet.
 		if (!have_resend_overflow)
@@ -302,18 +339,12 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 			// If we have too many unacked packets, we need to start dropping expired ones.
 			if (mUnackedPacketBytes > 512000)
 			{
-				if (now > packetp->mExpirationTime)
-				{
-					// This circuit has overflowed.  Do not retry.  Do not pass go.
-					packetp->mRetries = 0;
-					// Remove it from this list and add it to the final list.
-					mUnackedPackets.erase(iter++);
-					mFinalRetryPackets[packetp->mPacketID] = packetp;
-				}
-				else
-				{
-					++iter;
-				}
+				// This circuit has overflowed.  Do not retry.  Do not pass go.
+				packetp->mRetries = 0;
+				// Remove it from this list and add it to the final list.
+				mUnackedPackets.erase(iter);
+				mFinalRetryPackets[packet_id] = packetp;
+				expireFinalRetryPacket(mFinalRetryPackets.find(packet_id), now);
 				// Move on to the next unacked packet.
 				continue;
 			}
@@ -325,106 +356,106 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 						<< " bytes of reliable messages waiting" << llendl;
 			}
 			// Stop resending.  There are less than 512000 unacked packets.
+			// Try the rest again next time, but do fail the final retries.
+			for (; id_iter != mDueResends.end(); ++id_iter)
+			{
+				if (mUnackedPackets.find(*id_iter) != mUnackedPackets.end())
+				{
+					mResendWheel.schedule(*id_iter, now);
+				}
+				else if ((iter = mFinalRetryPackets.find(*id_iter)) != mFinalRetryPackets.end())
+				{
+					expireFinalRetryPacket(iter, now);
+				}
+			}
 			break;
 		}
 
-		if (now > packetp->mExpirationTime)
-		{
-			packetp->mRetries--;
-			
-			// retry		
-			mCurrentResendCount++;
+		packetp->mRetries--;
+		
+		// retry		
+		mCurrentResendCount++;
 
-			gMessageSystem->mResentPackets++;
+		gMessageSystem->mResentPackets++;
 
-			if(gMessageSystem->mVerboseLog)
-			{
-				std::ostringstream str;
-				str << "MSG: -> " << packetp->mHost
-					<< "\tRESENDING RELIABLE:\t" << packetp->mPacketID;
-				llinfos << str.str() << llendl;
-			}
-
-			packetp->mBuffer[0] |= LL_RESENT_FLAG;  // tag packet id as being a resend	
+		if(gMessageSystem->mVerboseLog)
+		{
+			std::ostringstream str;
+			str << "MSG: -> " << packetp->mHost
+				<< "\tRESENDING RELIABLE:\t" << packetp->mPacketID;
+			llinfos << str.str() << llendl;
+		}
 
-			gMessageSystem->mPacketRing->sendPacket(packetp->mSocket, 
-											   (char *)packetp->mBuffer, packetp->mBufferLength, 
-											   packetp->mHost);
+		packetp->mBuffer[0] |= LL_RESENT_FLAG;  // tag packet id as being a resend	
 
-			mThrottles.throttleOverflow(TC_RESEND, packetp->mBufferLength * 8.f);
+		gMessageSystem->mPacketRing->sendPacket(packetp->mSocket, 
+										   (char *)packetp->mBuffer, packetp->mBufferLength, 
+										   packetp->mHost);
 
-			// The new method, retry time based on ping
-			if (packetp->mPingBasedRetry)
-			{
-				packetp->mExpirationTime = now + llmax(LL_MINIMUM_RELIABLE_TIMEOUT_SECONDS, (LL_RELIABLE_TIMEOUT_FACTOR * getPingDelayAveraged()));
-			}
-			else
-			{
-				// custom, constant retry time
-				packetp->mExpirationTime = now + packetp->mTimeout;
-			}
+		mThrottles.throttleOverflow(TC_RESEND, packetp->mBufferLength * 8.f);
 
-			if (!packetp->mRetries)
-			{
-				// Last resend, remove it from this list and add it to the final list.
-				mUnackedPackets.erase(iter++);
-				mFinalRetryPackets[packetp->mPacketID] = packetp;
-			}
-			else
-			{
-				// Don't remove it yet, it still gets to try to resend at least once.
-				++iter;
-			}
-			resent_packets++;
+		// The new method, retry time based on ping
+		if (packetp->mPingBasedRetry)
+		{
+			packetp->mExpirationTime = now + llmax(LL_MINIMUM_RELIABLE_TIMEOUT_SECONDS, (LL_RELIABLE_TIMEOUT_FACTOR * getPingDelayAveraged()));
 		}
 		else
 		{
-			// Don't need to do anything with this packet, keep iterating.
-			++iter;
+			// custom, constant retry time
+			packetp->mExpirationTime = now + packetp->mTimeout;
 		}
+		mResendWheel.schedule(packet_id, packetp->mExpirationTime);
+
+		if (!packetp->mRetries)
+		{
+			// Last resend, remove it from this list and add it to the final list.
+			mUnackedPackets.erase(iter);
+			mFinalRetryPackets[packet_id] = packetp;
+		}
+		// else don't remove it yet, it still gets to try to resend at least once.
+		resent_packets++;
 	}
+	mDueResends.clear();
 
+	return mUnackedPacketCount;
+}
 
-	for (iter = mFinalRetryPackets.begin(); iter != mFinalRetryPackets.end();)
+void LLCircuitData::expireFinalRetryPacket(reliable_iter iter, const F64 now)
+{
+	LLReliablePacket* packetp = iter->second;
+	if (now <= packetp->mExpirationTime)
 	{
-		packetp = iter->second;
-		if (now > packetp->mExpirationTime)
-		{
-			// fail (too many retries)
-			//llinfos << "Packet " << packetp->mPacketID << " removed from the pending list: exceeded retry limit" << llendl;
-			//if (packetp->mMessageName)
-			//{
-			//	llinfos << "Packet name " << packetp->mMessageName << llendl;
-			//}
-			gMessageSystem->mFailedResendPackets++;
-
-			if(gMessageSystem->mVerboseLog)
-			{
-				std::ostringstream str;
-				str << "MSG: -> " << packetp->mHost << "\tABORTING RELIABLE:\t"
-					<< packetp->mPacketID;
-				llinfos << str.str() << llendl;
-			}
+		mResendWheel.schedule(packetp->mPacketID, packetp->mExpirationTime);
+		return;
+	}
 
-			if (packetp->mCallback)
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);
-			}
+	// fail (too many retries)
+	//llinfos << "Packet " << packetp->mPacketID << " removed from the pending list: exceeded retry limit" << llendl;
+	//if (packetp->mMessageName)
+	//{
+	//	llinfos << "Packet name " << packetp->mMessageName << llendl;
+	//}
+	gMessageSystem->mFailedResendPackets++;
 
-			// Update stats
-			mUnackedPacketCount--;
-			mUnackedPacketBytes -= packetp->mBufferLength;
+	if(gMessageSystem->mVerboseLog)
+	{
+		std::ostringstream str;
+		str << "MSG: -> " << packetp->mHost << "\tABORTING RELIABLE:\t"
+			<< packetp->mPacketID;
+		llinfos << str.str() << llendl;
+	}
 
-			mFinalRetryPackets.erase(iter++);
-			delete packetp;
-		}
-		else
-		{
-			++iter;
-		}
+	if (packetp->mCallback)
+	{
+		packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);
 	}
 
-	return mUnackedPacketCount;
+	// Update stats
+	mUnackedPacketCount--;
+	mUnackedPacketBytes -= packetp->mBufferLength;
+
+	mFinalRetryPackets.erase(iter);
+	delete packetp;
 }
 
 
@@ -580,6 +611,7 @@ void LLCircuitData::addReliablePacket(S32 mSocket, U8 *buf_ptr, S32 buf_len, LLR
 	{
 		mFinalRetryPackets[packet_info->mPacketID] = packet_info;
 	}
+	mResendWheel.schedule(packet_info->mPacketID, packet_info->mExpirationTime);
 }
 
 
@@ -602,7 +634,7 @@ void LLCircuit::resendUnackedPackets(S32& unacked_list_length, S32& unacked_list
 
 BOOL LLCircuitData::isDuplicateResend(TPACKETID packetnum)
 {
-	return (mRecentlyReceivedReliablePackets.find(packetnum) != mRecentlyReceivedReliablePackets.end());
+	return mRecentlyReceivedReliablePackets.contains(packetnum);
 }
 
 
@@ -714,7 +746,7 @@ void LLCircuitData::checkPacketInID(TPACKETID id, BOOL receive_resent)
 		const U8 width = 24;
 		gap = LLModularMath::subtract<width>(mPacketsInID, id);
 
-		if (mPotentialLostPackets.find(id) != mPotentialLostPackets.end())
+		if (mPotentialLostPackets.contains(id))
 		{
 			if(gMessageSystem->mVerboseLog)
 			{
@@ -743,7 +775,8 @@ void LLCircuitData::checkPacketInID(TPACKETID id, BOOL receive_resent)
 					}
 
 //						llinfos << "adding potential lost: " << index << llendl;
-					mPotentialLostPackets[index] = time;
+					mPotentialLostPackets.insert(index);
+					mPotentialLostQueue.push_back(std::make_pair(index, time));
 					index++;
 					index = index % LL_MAX_OUT_PACKET_ID;
 					gap_count++;
@@ -963,33 +996,42 @@ BOOL LLCircuitData::updateWatchDogTimers(LLMessageSystem *msgsys)
 	// Check to see if anything on our lost list is old enough to
 	// be considered lost
 
-	LLCircuitData::packet_time_map::iterator it;
 	U64 timeout = (U64)(1000000.0*llmin(LL_MAX_LOST_TIMEOUT, getPingDelayAveraged() * LL_LOST_TIMEOUT_FACTOR));
 
 	U64 mt_usec = LLMessageSystem::getMessageTimeUsecs();
-	for (it = mPotentialLostPackets.begin(); it != mPotentialLostPackets.end(); )
+	while (!mPotentialLostQueue.empty() && mt_usec - mPotentialLostQueue.front().second > timeout)
 	{
-		U64 delta_t_usec = mt_usec - (*it).second;
-		if (delta_t_usec > timeout)
+		TPACKETID id = mPotentialLostQueue.front().first;
+		mPotentialLostQueue.pop_front();
+		if (!mPotentialLostPackets.contains(id))
 		{
-			// let's call this one a loss!
-			mPacketsLost++;
-			gMessageSystem->mDroppedPackets++;
-			if(gMessageSystem->mVerboseLog)
-			{
-				std::ostringstream str;
-				str << "MSG: <- " << mHost << "\tLOST PACKET:\t"
-					<< (*it).first;
-				llinfos << str.str() << llendl;
-			}
-			mPotentialLostPackets.erase(it++);
+			// It turned up after all.
+			continue;
 		}
-		else
+		mPotentialLostPackets.erase(id);
+
+		// let's call this one a loss!
+		mPacketsLost++;
+		gMessageSystem->mDroppedPackets++;
+		if(gMessageSystem->mVerboseLog)
 		{
-			++it;
+			std::ostringstream str;
+			str << "MSG: <- " << mHost << "\tLOST PACKET:\t"
+				<< id;
+			llinfos << str.str() << llendl;
 		}
 	}
 
+	// Keep the window as small as the ids that are still pending.
+	if (mPotentialLostQueue.empty())
+	{
+		mPotentialLostPackets.clear();
+	}
+	else
+	{
+		mPotentialLostPackets.eraseBefore(mPotentialLostQueue.front().first);
+	}
+
 	return TRUE;
 }
 
@@ -1001,45 +1043,12 @@ void LLCircuitData::clearDuplicateList(TPACKETID oldest_id)
 	// we want to KEEP all x where oldest_id <= x <= last incoming packet, and delete everything else.
 
 	//llinfos << mHost << ": clearing before oldest " << oldest_id << llendl;
-	//llinfos << "Recent list before: " << mRecentlyReceivedReliablePackets.size() << llendl;
 	if (oldest_id < mHighestPacketID)
 	{
-		// Clean up everything with a packet ID less than oldest_id.
-		packet_time_map::iterator pit_start;
-		packet_time_map::iterator pit_end;
-		pit_start = mRecentlyReceivedReliablePackets.begin();
-		pit_end = mRecentlyReceivedReliablePackets.lower_bound(oldest_id);
-		mRecentlyReceivedReliablePackets.erase(pit_start, pit_end);
-	}
-
-	// Do timeout checks on everything with an ID > mHighestPacketID.
-	// This should be empty except for wrapping IDs.  Thus, this should be
-	// highly rare.
-	U64 mt_usec = LLMessageSystem::getMessageTimeUsecs();
-
-	packet_time_map::iterator pit;
-	for(pit = mRecentlyReceivedReliablePackets.upper_bound(mHighestPacketID);
-		pit != mRecentlyReceivedReliablePackets.end(); )
-	{
-		// Validate that the packet ID seems far enough away
-		if ((pit->first - mHighestPacketID) < 100)
-		{
-			llwarns << "Probably incorrectly timing out non-wrapped packets!" << llendl;
-		}
-		U64 delta_t_usec = mt_usec - (*pit).second;
-		F64 delta_t_sec = delta_t_usec * SEC_PER_USEC;
-		if (delta_t_sec > LL_DUPLICATE_SUPPRESSION_TIMEOUT)
-		{
-			// enough time has elapsed we're not likely to get a duplicate on this one
-			llinfos << "Clearing " << pit->first << " from recent list" << llendl;
-			mRecentlyReceivedReliablePackets.erase(pit++);
-		}
-		else
-		{
-			++pit;
-		}
+		// Forget everything with a packet ID less than oldest_id.
+		// The window takes care of wrapping packet IDs, so there is no time-based cleanup.
+		mRecentlyReceivedReliablePackets.eraseBefore(oldest_id);
 	}
-	//llinfos << "Recent list after: " << mRecentlyReceivedReliablePackets.size() << llendl;
 }
 
 BOOL LLCircuitData::checkCircuitTimeout()
@@ -28,6 +28,7 @@
 #ifndef LL_LLCIRCUIT_H
 #define LL_LLCIRCUIT_H
 
+#include <deque>
 #include <map>
 #include <vector>
 
@@ -38,6 +39,8 @@
 #include "net.h"
 #include "llhost.h"
 #include "llpacketack.h"
+#include "llpacketidwindow.h"
+#include "llpackettimerwheel.h"
 #include "lluuid.h"
 #include "llthrottle.h"
 
@@ -175,6 +178,8 @@ protected:
 
 	void			addReliablePacket(S32 mSocket, U8 *buf_ptr, S32 buf_len, LLReliablePacketParams *params);
 	BOOL			isDuplicateResend(TPACKETID packetnum);
+	// Fails the packet if it expired, and otherwise puts it back in mResendWheel.
+	void			expireFinalRetryPacket(std::map<TPACKETID, LLReliablePacket*>::iterator iter, const F64 now);
 	// Call this method when a reliable message comes in - this will
 	// correctly place the packet in the correct list to be acked
 	// later. RAack = requested ack
@@ -231,10 +236,13 @@ protected:
 	U32		mPingDelay;             // raw ping delay
 	F32		mPingDelayAveraged;     // averaged ping delay (fast attack/slow decay)
 
-	typedef std::map<TPACKETID, U64> packet_time_map;
+	// Ids that were skipped, and the time that they were, oldest first. The ids that
+	// didn't arrive since are in mPotentialLostPackets.
+	typedef std::deque<std::pair<TPACKETID, U64> > packet_time_queue;
 
-	packet_time_map							mPotentialLostPackets;
-	packet_time_map							mRecentlyReceivedReliablePackets;
+	LLPacketIDWindow						mPotentialLostPackets;
+	packet_time_queue						mPotentialLostQueue;
+	LLPacketIDWindow						mRecentlyReceivedReliablePackets;	// For duplicate suppression.
 	std::vector<TPACKETID> mAcks;
 
 	typedef std::map<TPACKETID, LLReliablePacket *> reliable_map;
@@ -242,6 +250,9 @@ protected:
 
 	reliable_map							mUnackedPackets;
 	reliable_map							mFinalRetryPackets;
+	// The ids of mUnackedPackets and mFinalRetryPackets, by expiration time.
+	LLPacketTimerWheel						mResendWheel;
+	std::vector<TPACKETID>					mDueResends;
 
 	S32										mUnackedPacketCount;
 	S32										mUnackedPacketBytes;
@@ -231,7 +231,7 @@ BOOL LLDataPackerBinaryBuffer::unpackBinaryData(U8 *value, S32 &size, const char
 	success &= verifyLength(4, name);
 	htonmemcpy(&size, mCurBufferp, MVT_S32, 4);
 	mCurBufferp += 4;
-	success &= verifyLength(size, name);
+	success &= size >= 0 && verifyLength(size, name);
 	if (success)
 	{
 		htonmemcpy(value, mCurBufferp, MVT_VARIABLE, size);
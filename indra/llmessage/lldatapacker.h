@@ -167,6 +167,7 @@ public:
 	/*virtual*/ BOOL		unpackUUID(LLUUID &value, const char *name);
 
 				S32			getCurrentSize() const	{ return (S32)(mCurBufferp - mBufferp); }
+				void		setCurrentSize(S32 size)	{ llassert(size >= 0 && size <= mBufferSize); mCurBufferp = mBufferp + size; }
 				S32			getBufferSize() const	{ return mBufferSize; }
 				const U8*   getBuffer() const   { return mBufferp; }    
 				void		reset()				{ mCurBufferp = mBufferp; mWriteEnabled = (mCurBufferp != NULL); }
@@ -209,7 +209,8 @@ void LLHTTPClient::request(
 	EAllowCompressedReply allow_compression,
 	AIStateMachine* parent,
 	AIStateMachine::state_type new_parent_state,
-	AIEngine* default_engine)
+	AIEngine* default_engine,
+	LLPointer<AIStateMachine>* request_out)
 {
 	llassert(responder);
 
@@ -234,6 +235,11 @@ void LLHTTPClient::request(
 		return ;
 	}
 
+	if (request_out)
+	{
+		*request_out = req;
+	}
+
 	req->run(parent, new_parent_state, parent != NULL, true, default_engine);
 }
 
@@ -287,7 +293,7 @@ void LLHTTPClient::get(std::string const& url, LLSD const& query, ResponderPtr r
 // class LLHTTPClient::ResponderBase
 //
 
-LLHTTPClient::ResponderBase::ResponderBase(void) : mReferenceCount(0), mCode(CURLE_FAILED_INIT), mFinished(false)
+LLHTTPClient::ResponderBase::ResponderBase(void) : mReferenceCount(0), mCode(CURLE_FAILED_INIT), mFinished(false), mBodyBufferSize(0)
 {
 	DoutEntering(dc::curl, "AICurlInterface::Responder() with this = " << (void*)this);
 	AICurlInterface::Stats::ResponderBase_count++;
@@ -39,6 +39,7 @@
 #include "llhttpstatuscodes.h"
 #include "aihttpheaders.h"
 #include "aicurlperservice.h"
+#include "llpointer.h"
 
 class LLUUID;
 class LLPumpIO;
@@ -184,6 +185,10 @@ public:
 		// Set when the transaction finished (with or without errors).
 		bool mFinished;
 
+		// The number of bytes of the body that were written to the buffer returned by getBodyBuffer,
+		// or zero when the body is in the buffer passed to finished().
+		U32 mBodyBufferSize;
+
 	public:
 		// Called to set the URL of the current request for this Responder,
 		// used only when printing debug output regarding activity of the Responder.
@@ -284,6 +289,16 @@ public:
 		// Overridden by LLEventPollResponder to return true.
 		virtual bool is_event_poll(void) const { return false; }
 
+		// Called by the curl thread when the body of a successful (2xx) reply starts to arrive.
+		// A derived class can return memory of size bytes here that the body is then written to
+		// directly, instead of to the buffer that is passed to finished(), which saves copying it
+		// into that buffer and out of it again. If the body turns out not to fit then it ends up
+		// in the buffer passed to finished() after all. The memory must stay valid until finished() is called.
+		virtual U8* getBodyBuffer(U32& size) { return NULL; }
+
+		// Called by the curl thread, right before finished(), when the body was written to the buffer returned by getBodyBuffer.
+		void setBodyBufferSize(U32 size) { mBodyBufferSize = size; }
+
 		// Returns the capability type used by this responder.
 		virtual AICapabilityType capability_type(void) const { return cap_other; }
 
@@ -467,7 +482,8 @@ public:
 		EAllowCompressedReply allow_compression = allow_compressed_reply,
 		AIStateMachine* parent = NULL,
 		/*AIStateMachine::state_type*/ U32 new_parent_state = 0,
-		AIEngine* default_engine = &gMainThreadEngine);
+		AIEngine* default_engine = &gMainThreadEngine,
+		LLPointer<AIStateMachine>* request_out = NULL);	// If non-NULL, set to the request; call abort() on it to cancel the transfer.
 
 	/** @name non-blocking API */
 	//@{
@@ -0,0 +1,148 @@
+/**
+ * @file llmessagereceivethread.cpp
+ * @brief Thread that reads UDP packets for LLMessageSystem.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llmessagereceivethread.h"
+
+#include "llpacketring.h"
+#include "lltemplatemessagereader.h"
+#include "lltimer.h"
+#include "message.h"
+
+// How long to wait for the socket to become readable before checking if we should quit.
+// This also bounds the delay of packets that the packet ring holds back when simulating a slow connection.
+static apr_interval_time_t const RECEIVE_POLL_TIMEOUT = 10000;	// microseconds
+
+LLMessageReceiveThread::LLMessageReceiveThread(LLPacketRing* packet_ring, S32 socket, apr_pollfd_t const& poll_fd, LLTemplateMessageReader const* reader) :
+	LLThread("Message receive"),
+	mPacketRing(packet_ring),
+	mSocket(socket),
+	mPollFD(poll_fd),
+	mTemplateReader(reader),
+	mRing(new LLReceivedPacket[sRingSize]),
+	mHead(0),
+	mTail(0)
+{
+}
+
+LLMessageReceiveThread::~LLMessageReceiveThread()
+{
+	delete [] mRing;
+}
+
+LLReceivedPacket const* LLMessageReceiveThread::front() const
+{
+	U32 head = mHead;
+	if (head == mTail)
+	{
+		return NULL;
+	}
+	return &mRing[head & (sRingSize - 1)];
+}
+
+void LLMessageReceiveThread::pop()
+{
+	llassert(mHead != mTail);
+	mHead++;		// Hands the slot back to the receive thread.
+}
+
+void LLMessageReceiveThread::run()
+{
+	while (!isQuitting())
+	{
+		U32 tail = mTail;
+		U32 space = sRingSize - (tail - mHead);
+		if (space == 0)
+		{
+			// The main thread is behind; leave the rest in the socket buffer for now.
+			ms_sleep(1);
+			continue;
+		}
+
+		apr_int32_t num_ready = 0;
+		apr_poll(&mPollFD, 1, &num_ready, RECEIVE_POLL_TIMEOUT);
+
+		// Read everything that is available (or fits), then publish the whole batch at once.
+		// Also try when the poll timed out, because the packet ring might have throttled packets to hand out.
+		U32 received = 0;
+		while (received < space)
+		{
+			LLReceivedPacket& packet(mRing[(tail + received) & (sRingSize - 1)]);
+			packet.mSize = mPacketRing->receivePacket(mSocket, (char*)packet.mData);
+			if (packet.mSize <= 0)
+			{
+				break;
+			}
+			packet.mSender = mPacketRing->getLastSender();
+			packet.mReceivingIF = mPacketRing->getLastReceivingInterface();
+			decode(packet);
+			++received;
+		}
+		if (received)
+		{
+			mTail += received;
+		}
+	}
+}
+
+// Does what LLMessageSystem::checkMessages does up till finding the circuit.
+void LLMessageReceiveThread::decode(LLReceivedPacket& packet)
+{
+	packet.mBodySize = -1;
+	packet.mZeroCoded = false;
+	packet.mExpandedSize = 0;
+	packet.mExpandOverflows = 0;
+	packet.mTemplate = NULL;
+
+	S32 size = packet.mSize;
+	if (size < (S32)LL_MINIMUM_VALID_PACKET_SIZE)
+	{
+		return;
+	}
+	U8* buffer = packet.mData;
+	if (buffer[0] & LL_ACK_FLAG)
+	{
+		S32 acks = buffer[--size];
+		if (size < (S32)(acks * sizeof(TPACKETID) + LL_MINIMUM_VALID_PACKET_SIZE))
+		{
+			return;
+		}
+		size -= acks * sizeof(TPACKETID);
+	}
+	packet.mBodySize = size;
+
+	if (buffer[0] & LL_ZERO_CODE_FLAG)
+	{
+		packet.mZeroCoded = true;
+		buffer[0] &= ~LL_ZERO_CODE_FLAG;
+		packet.mExpandOverflows = LLMessageSystem::zeroCodeExpandBuffer(buffer, size, packet.mExpanded, &packet.mExpandedSize);
+		buffer = packet.mExpanded;
+		size = packet.mExpandedSize;
+	}
+
+	packet.mTemplate = mTemplateReader->findTemplate(buffer, size);
+}
@@ -0,0 +1,91 @@
+/**
+ * @file llmessagereceivethread.h
+ * @brief Thread that reads UDP packets for LLMessageSystem.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLMESSAGERECEIVETHREAD_H
+#define LL_LLMESSAGERECEIVETHREAD_H
+
+#include "apr_poll.h"
+
+#include "llatomic.h"
+#include "llhost.h"
+#include "llthread.h"
+#include "net.h"
+
+class LLMessageTemplate;
+class LLPacketRing;
+class LLTemplateMessageReader;
+
+// A packet as read from the socket, together with the work that could be done on it
+// without knowing anything about circuits.
+struct LLReceivedPacket
+{
+	LLHost mSender;
+	LLHost mReceivingIF;
+	S32 mSize;						// Size of mData, including appended acks.
+	S32 mBodySize;					// Size of the message without appended acks, or -1 if the ack count is bogus.
+	bool mZeroCoded;				// Set if the message was zero-coded; mExpanded then holds the expanded message.
+	S32 mExpandedSize;
+	S32 mExpandOverflows;			// Number of times that zero-expansion ran out of buffer space.
+	LLMessageTemplate* mTemplate;	// The template of the message, or NULL if it couldn't be determined.
+	U8 mData[NET_BUFFER_SIZE];
+	U8 mExpanded[NET_BUFFER_SIZE];
+};
+
+// Drains the UDP socket of LLMessageSystem, strips, zero-expands and looks up the template of
+// every packet, and hands the result to the main thread in the order that they were received.
+// Circuit handling (acks, duplicate suppression, trust) is left to LLMessageSystem::checkMessages.
+class LLMessageReceiveThread : public LLThread
+{
+public:
+	LLMessageReceiveThread(LLPacketRing* packet_ring, S32 socket, apr_pollfd_t const& poll_fd, LLTemplateMessageReader const* reader);
+	~LLMessageReceiveThread();
+
+	// Main thread. Returns the oldest received packet, or NULL if there is none.
+	// The packet remains valid until pop() is called.
+	LLReceivedPacket const* front() const;
+	void pop();
+
+private:
+	/*virtual*/ void run(void);
+
+	// Receive thread.
+	void decode(LLReceivedPacket& packet);
+
+	// A power of two.
+	static U32 const sRingSize = 256;
+
+	LLPacketRing* mPacketRing;
+	S32 mSocket;
+	apr_pollfd_t mPollFD;
+	LLTemplateMessageReader const* mTemplateReader;
+
+	// Single producer, single consumer ring buffer.
+	LLReceivedPacket* mRing;
+	LLAtomicU32 mHead;				// Number of packets popped by the main thread.
+	LLAtomicU32 mTail;				// Number of packets pushed by the receive thread.
+};
+
+#endif // LL_LLMESSAGERECEIVETHREAD_H
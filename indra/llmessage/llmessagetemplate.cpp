@@ -190,3 +190,30 @@ void LLMessageTemplate::banUdp()
 	}
 }
 
+
+void LLMessageFieldRef::resolve(const LLMessageTemplate* message_template)
+{
+	mResolved = true;
+	mTemplate = NULL;
+	const LLMessageBlock* block = message_template ? message_template->getBlock(const_cast<char*>(mBlockName)) : NULL;
+	const LLMessageVariable* var = block ? block->getVariable(const_cast<char*>(mVarName)) : NULL;
+	if (!var || var->getOffset() < 0)
+	{
+		// Not there, or preceded by variable length data: use the named getters.
+		return;
+	}
+	mTemplate = message_template;
+	mBlockIndex = block->mIndex;
+	mOffset = var->getOffset();
+	mType = var->getType();
+	if (mType == MVT_VARIABLE)
+	{
+		mSize = 0;
+		mSizeFieldSize = var->getSize();
+	}
+	else
+	{
+		mSize = var->getSize();
+		mSizeFieldSize = 0;
+	}
+}
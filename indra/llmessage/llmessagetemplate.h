@@ -139,16 +139,16 @@ public:
 class LLMessageVariable
 {
 public:
-	LLMessageVariable() : mName(NULL), mType(MVT_NULL), mSize(-1)
+	LLMessageVariable() : mName(NULL), mType(MVT_NULL), mSize(-1), mOffset(-1)
 	{
 	}
 
-	LLMessageVariable(char *name) : mType(MVT_NULL), mSize(-1)
+	LLMessageVariable(char *name) : mType(MVT_NULL), mSize(-1), mOffset(-1)
 	{
 		mName = name;
 	}
 
-	LLMessageVariable(const char *name, const EMsgVariableType type, const S32 size) : mType(type), mSize(size) 
+	LLMessageVariable(const char *name, const EMsgVariableType type, const S32 size) : mType(type), mSize(size), mOffset(-1)
 	{
 		mName = LLMessageStringTable::getInstance()->getString(name); 
 	}
@@ -160,10 +160,15 @@ public:
 	EMsgVariableType getType() const				{ return mType; }
 	S32	getSize() const								{ return mSize; }
 	char *getName() const							{ return mName; }
+	// Offset of the variable (or of its size field, for MVT_VARIABLE) from the start of its block,
+	// or -1 if a variable length variable precedes it.
+	S32 getOffset() const							{ return mOffset; }
+	void setOffset(S32 offset)						{ mOffset = offset; }
 protected:
 	char				*mName;
 	EMsgVariableType	mType;
 	S32					mSize;
+	S32					mOffset;
 };
 
 
@@ -179,7 +184,7 @@ typedef enum e_message_block_type
 class LLMessageBlock
 {
 public:
-	LLMessageBlock(const char *name, EMsgBlockType type, S32 number = 1) : mType(type), mNumber(number), mTotalSize(0) 
+	LLMessageBlock(const char *name, EMsgBlockType type, S32 number = 1) : mType(type), mNumber(number), mTotalSize(0), mIndex(-1)
 	{ 
 		mName = LLMessageStringTable::getInstance()->getString(name);
 	}
@@ -197,6 +202,8 @@ public:
 			llerrs << name << " has already been used as a variable name!" << llendl;
 		}
 		*varp = new LLMessageVariable(name, type, size);
+		// As long as mTotalSize is known, it is where this variable starts.
+		(*varp)->setOffset(mTotalSize);
 		if (((*varp)->getType() != MVT_VARIABLE)
 			&&(mTotalSize != -1))
 		{
@@ -232,6 +239,7 @@ public:
 	EMsgBlockType							mType;
 	S32										mNumber;
 	S32										mTotalSize;
+	S32										mIndex;		// Position of the block in its template.
 };
 
 
@@ -305,6 +313,7 @@ public:
 				<< "has already been used as a block name!" << llendl;
 		}
 		*member_blockp = blockp;
+		blockp->mIndex = mMemberBlocks.size() - 1;
 		if (  (mTotalSize != -1)
 			&&(blockp->mTotalSize != -1)
 			&&(  (blockp->mType == MBT_SINGLE)
@@ -0,0 +1,176 @@
+/**
+ * @file llpacketidwindow.cpp
+ * @brief Set of recent packet ids, kept as a sliding bitset.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llpacketidwindow.h"
+
+#include <algorithm>
+
+LLPacketIDWindow::LLPacketIDWindow(U32 initial_size, U32 max_size) :
+	mBits(initial_size / 32),
+	mSize(initial_size),
+	mMaxSize(max_size),
+	mBase(0),
+	mEmpty(true)
+{
+	llassert(initial_size >= 32 && !(initial_size & (initial_size - 1)));
+	llassert(max_size >= initial_size && !(max_size & (max_size - 1)));
+}
+
+bool LLPacketIDWindow::insert(TPACKETID id)
+{
+	id &= ID_MASK;
+	if (mEmpty)
+	{
+		// Leave some room for ids that arrive out of order.
+		mBase = (id - mSize / 4) & ID_MASK;
+		mEmpty = false;
+	}
+
+	U32 offset = distance(mBase, id);
+	if (offset >= mSize)
+	{
+		if (offset >= HALF_ID_RANGE)
+		{
+			// Older than anything we still know about.
+			return true;
+		}
+		if (mSize < mMaxSize)
+		{
+			U32 size = mSize;
+			while (size <= offset && size < mMaxSize)
+			{
+				size *= 2;
+			}
+			resize(size);
+		}
+		if (offset >= mSize)
+		{
+			// Slide the window so that id is the newest id in it.
+			U32 advance = offset - mSize + 1;
+			clearRange(mBase, advance);
+			mBase = (mBase + advance) & ID_MASK;
+		}
+	}
+
+	U32 index = id & (mSize - 1);
+	U32 mask = 1U << (index & 31);
+	U32& word = mBits[index >> 5];
+	if (word & mask)
+	{
+		return false;
+	}
+	word |= mask;
+	return true;
+}
+
+bool LLPacketIDWindow::contains(TPACKETID id) const
+{
+	id &= ID_MASK;
+	if (mEmpty || distance(mBase, id) >= mSize)
+	{
+		return false;
+	}
+	U32 index = id & (mSize - 1);
+	return (mBits[index >> 5] & (1U << (index & 31))) != 0;
+}
+
+void LLPacketIDWindow::erase(TPACKETID id)
+{
+	id &= ID_MASK;
+	if (mEmpty || distance(mBase, id) >= mSize)
+	{
+		return;
+	}
+	U32 index = id & (mSize - 1);
+	mBits[index >> 5] &= ~(1U << (index & 31));
+}
+
+void LLPacketIDWindow::eraseBefore(TPACKETID oldest_id)
+{
+	oldest_id &= ID_MASK;
+	if (mEmpty)
+	{
+		return;
+	}
+	U32 offset = distance(mBase, oldest_id);
+	if (offset >= HALF_ID_RANGE)
+	{
+		// Already gone.
+		return;
+	}
+	clearRange(mBase, offset);
+	mBase = oldest_id;
+}
+
+void LLPacketIDWindow::clear()
+{
+	std::fill(mBits.begin(), mBits.end(), 0);
+	mEmpty = true;
+}
+
+void LLPacketIDWindow::clearRange(TPACKETID first, U32 count)
+{
+	if (count >= mSize)
+	{
+		std::fill(mBits.begin(), mBits.end(), 0);
+		return;
+	}
+	U32 index = first & (mSize - 1);
+	while (count)
+	{
+		if (!(index & 31) && count >= 32)
+		{
+			mBits[index >> 5] = 0;
+			index += 32;
+			count -= 32;
+		}
+		else
+		{
+			mBits[index >> 5] &= ~(1U << (index & 31));
+			++index;
+			--count;
+		}
+		index &= mSize - 1;
+	}
+}
+
+void LLPacketIDWindow::resize(U32 size)
+{
+	std::vector<U32> bits(size / 32);
+	for (U32 offset = 0; offset < mSize; ++offset)
+	{
+		U32 old_index = (mBase + offset) & (mSize - 1);
+		if (mBits[old_index >> 5] & (1U << (old_index & 31)))
+		{
+			U32 index = (mBase + offset) & (size - 1);
+			bits[index >> 5] |= 1U << (index & 31);
+		}
+	}
+	mBits.swap(bits);
+	mSize = size;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file llpacketidwindow.h
+ * @brief Set of recent packet ids, kept as a sliding bitset.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETIDWINDOW_H
+#define LL_LLPACKETIDWINDOW_H
+
+#include <vector>
+
+#include "stdtypes.h"
+
+// A set of packet ids that are close together, as one bit per id in a window that
+// slides along with the newest id. Packet ids are 24 bits and wrap around
+// (see LL_MAX_OUT_PACKET_ID); ids up to half that range behind the start of the
+// window count as older than it, the rest as newer.
+class LLPacketIDWindow
+{
+public:
+	// The window grows from initial_size up to max_size ids (both powers of two, at least 32).
+	// When an id doesn't fit, the oldest ids are forgotten to make room.
+	LLPacketIDWindow(U32 initial_size, U32 max_size);
+
+	// Returns true if id wasn't in the set yet.
+	// Ids older than the window aren't added, and are always reported as new.
+	bool insert(TPACKETID id);
+	bool contains(TPACKETID id) const;
+	void erase(TPACKETID id);
+
+	// Forgets every id before oldest_id, and moves the start of the window there.
+	void eraseBefore(TPACKETID oldest_id);
+	void clear();
+
+	U32 getWindowSize() const				{ return mSize; }
+
+private:
+	// How far to is ahead of from, with wrapping.
+	static U32 distance(TPACKETID from, TPACKETID to)	{ return (to - from) & ID_MASK; }
+
+	void clearRange(TPACKETID first, U32 count);
+	void resize(U32 size);
+
+	static const U32 ID_MASK = 0x00FFFFFF;
+	static const U32 HALF_ID_RANGE = 0x00800000;
+
+	std::vector<U32> mBits;			// The bit of an id is bit (id & (mSize - 1)).
+	U32 mSize;						// In ids.
+	U32 mMaxSize;
+	TPACKETID mBase;				// Oldest id that the window covers.
+	bool mEmpty;					// Set until the first insert(); mBase is meaningless then.
+};
+
+#endif // LL_LLPACKETIDWINDOW_H
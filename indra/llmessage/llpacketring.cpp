@@ -189,7 +189,7 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 					delete packetp;
 					packetp = NULL;
 					packet_size = 0;
-					mPacketsToDrop--;
+					--mPacketsToDrop;
 				}
 			}
 
@@ -267,7 +267,7 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 			if (mPacketsToDrop)
 			{
 				packet_size = 0;
-				mPacketsToDrop--;
+				--mPacketsToDrop;
 			}
 		}
 	}
@@ -30,12 +30,15 @@
 
 #include <queue>
 
+#include "llatomic.h"
 #include "llhost.h"
 #include "llpacketbuffer.h"
 //#include "llproxy.h"
 #include "llthrottle.h"
 #include "net.h"
 
+// When LLMessageSystem runs a LLMessageReceiveThread, that thread is the only one calling
+// receivePacket, receiveFromRing, getLastSender and getLastReceivingInterface.
 class LLPacketRing
 {
 public:
@@ -58,7 +61,7 @@ public:
 	inline LLHost getLastSender();
 	inline LLHost getLastReceivingInterface();
 
-	S32 getAndResetActualInBits()				{ S32 bits = mActualBitsIn; mActualBitsIn = 0; return bits;}
+	S32 getAndResetActualInBits()				{ S32 bits = mActualBitsIn; mActualBitsIn -= bits; return bits;}
 	S32 getAndResetActualOutBits()				{ S32 bits = mActualBitsOut; mActualBitsOut = 0; return bits;}
 protected:
 	BOOL mUseInThrottle;
@@ -68,14 +71,14 @@ protected:
 	LLThrottle mInThrottle;
 	LLThrottle mOutThrottle;
 
-	S32 mActualBitsIn;
+	LLAtomicS32 mActualBitsIn;		// Atomic because it might be incremented by the receive thread.
 	S32 mActualBitsOut;
 	S32 mMaxBufferLength;			// How much data can we queue up before dropping data.
 	S32 mInBufferLength;			// Current incoming buffer length
 	S32 mOutBufferLength;			// Current outgoing buffer length
 
 	F32 mDropPercentage;			// % of packets to drop
-	U32 mPacketsToDrop;				// drop next n packets
+	LLAtomicU32 mPacketsToDrop;		// drop next n packets
 
 	std::queue<LLPacketBuffer *> mReceiveQueue;
 	std::queue<LLPacketBuffer *> mSendQueue;
@@ -0,0 +1,99 @@
+/**
+ * @file llpackettimerwheel.cpp
+ * @brief Packet ids ordered by when they are due, in a timer wheel.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llpackettimerwheel.h"
+
+LLPacketTimerWheel::LLPacketTimerWheel(F64 tick_length, U32 num_slots) :
+	mSlots(num_slots),
+	mTickLength(tick_length),
+	mNextTick(0),
+	mStarted(false),
+	mSize(0)
+{
+	llassert(num_slots && !(num_slots & (num_slots - 1)));
+}
+
+void LLPacketTimerWheel::schedule(TPACKETID id, F64 due)
+{
+	Entry entry;
+	entry.mID = id;
+	entry.mTick = getTick(due);
+	if (!mStarted)
+	{
+		mNextTick = entry.mTick;
+		mStarted = true;
+	}
+	else if (entry.mTick < mNextTick)
+	{
+		entry.mTick = mNextTick;
+	}
+	mSlots[entry.mTick & (mSlots.size() - 1)].push_back(entry);
+	++mSize;
+}
+
+void LLPacketTimerWheel::popDue(F64 now, std::vector<TPACKETID>& due_ids)
+{
+	U64 now_tick = getTick(now);
+	if (!mStarted || now_tick < mNextTick)
+	{
+		return;
+	}
+
+	// When more than a turn passed, every slot is looked at once.
+	U64 num_ticks = llmin(now_tick - mNextTick + 1, (U64)mSlots.size());
+	for (U64 tick = mNextTick; tick < mNextTick + num_ticks && mSize; ++tick)
+	{
+		slot_t& slot = mSlots[tick & (mSlots.size() - 1)];
+		for (U32 i = 0; i < slot.size(); )
+		{
+			if (slot[i].mTick <= now_tick)
+			{
+				due_ids.push_back(slot[i].mID);
+				slot[i] = slot.back();
+				slot.pop_back();
+				--mSize;
+			}
+			else
+			{
+				// Due in a later turn.
+				++i;
+			}
+		}
+	}
+	mNextTick = now_tick + 1;
+}
+
+void LLPacketTimerWheel::clear()
+{
+	for (std::vector<slot_t>::iterator iter = mSlots.begin(); iter != mSlots.end(); ++iter)
+	{
+		iter->clear();
+	}
+	mStarted = false;
+	mSize = 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file llpackettimerwheel.h
+ * @brief Packet ids ordered by when they are due, in a timer wheel.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETTIMERWHEEL_H
+#define LL_LLPACKETTIMERWHEEL_H
+
+#include <vector>
+
+#include "stdtypes.h"
+
+// Packet ids keyed by the time that they are due. Times are rounded down to ticks and
+// the wheel has a slot for each tick of one turn; an id that is due more than a turn
+// ahead stays in its slot until the turn that it is due in.
+// Scheduling is constant time, and popDue() only looks at the slots that passed.
+class LLPacketTimerWheel
+{
+public:
+	LLPacketTimerWheel(F64 tick_length, U32 num_slots);	// num_slots must be a power of two.
+
+	void schedule(TPACKETID id, F64 due);
+
+	// Appends the ids that are due at now to due_ids and removes them from the wheel.
+	// Ids can come out up to a tick early, and times that are in the past when they
+	// are scheduled count as due in the next tick that hasn't been popped yet.
+	void popDue(F64 now, std::vector<TPACKETID>& due_ids);
+
+	void clear();
+	U32 size() const						{ return mSize; }
+
+private:
+	U64 getTick(F64 time) const				{ return (U64)(time / mTickLength); }
+
+	struct Entry
+	{
+		TPACKETID mID;
+		U64 mTick;
+	};
+	typedef std::vector<Entry> slot_t;
+
+	std::vector<slot_t> mSlots;
+	F64 mTickLength;				// Seconds.
+	U64 mNextTick;					// The first tick that wasn't popped yet.
+	bool mStarted;					// Set once mNextTick is.
+	U32 mSize;
+};
+
+#endif // LL_LLPACKETTIMERWHEEL_H
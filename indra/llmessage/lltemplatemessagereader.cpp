@@ -38,13 +38,40 @@
 #include "v3math.h"
 #include "v4math.h"
 
+// Low frequency message numbers at or above this are looked up in the map instead of the dense table (these are the Fixed messages).
+static U32 const LOW_FREQUENCY_TABLE_LIMIT = 0xFF00;
+
 LLTemplateMessageReader::LLTemplateMessageReader(message_template_number_map_t&
 												 number_template_map) :
 	mReceiveSize(0),
 	mCurrentRMessageTemplate(NULL),
 	mCurrentRMessageData(NULL),
-	mMessageNumbers(number_template_map)
+	mMessageNumbers(number_template_map),
+	mHighFrequencyTemplates(255, (LLMessageTemplate*)NULL),
+	mMediumFrequencyTemplates(255, (LLMessageTemplate*)NULL),
+	mCurrentRBuffer(NULL)
 {
+	for (message_template_number_map_t::const_iterator iter = mMessageNumbers.begin(); iter != mMessageNumbers.end(); ++iter)
+	{
+		U32 num = iter->first;
+		if (num < 255)
+		{
+			mHighFrequencyTemplates[num] = iter->second;
+		}
+		else if ((num >> 8) == 255 && (num & 255) != 255)
+		{
+			mMediumFrequencyTemplates[num & 255] = iter->second;
+		}
+		else if ((num >> 16) == 0xFFFF && (num & 0xFFFF) < LOW_FREQUENCY_TABLE_LIMIT)
+		{
+			U32 index = num & 0xFFFF;
+			if (index >= mLowFrequencyTemplates.size())
+			{
+				mLowFrequencyTemplates.resize(index + 1, NULL);
+			}
+			mLowFrequencyTemplates[index] = iter->second;
+		}
+	}
 }
 
 //virtual 
@@ -61,6 +88,53 @@ void LLTemplateMessageReader::clearMessage()
 	mCurrentRMessageTemplate = NULL;
 	delete mCurrentRMessageData;
 	mCurrentRMessageData = NULL;
+	mCurrentRBuffer = NULL;
+}
+
+const U8* LLTemplateMessageReader::getFieldData(const LLMessageFieldRef& field, S32 blocknum, S32& size) const
+{
+	if (!mCurrentRBuffer || field.mTemplate != mCurrentRMessageTemplate)
+	{
+		return NULL;
+	}
+	S32 first = mBlockFirstInstance[field.mBlockIndex];
+	if (blocknum < 0 || blocknum >= mBlockFirstInstance[field.mBlockIndex + 1] - first)
+	{
+		return NULL;
+	}
+	S32 pos = mBlockInstanceOffsets[first + blocknum] + field.mOffset;
+	size = field.mSize;
+	if (field.mSizeFieldSize)
+	{
+		if (pos + field.mSizeFieldSize > mReceiveSize)
+		{
+			return NULL;
+		}
+		U8 tsizeb;
+		U16 tsizeh;
+		U32 tsize = 0;
+		switch (field.mSizeFieldSize)
+		{
+		case 1:
+			tsizeb = mCurrentRBuffer[pos];
+			tsize = tsizeb;
+			break;
+		case 2:
+			htonmemcpy(&tsizeh, &mCurrentRBuffer[pos], MVT_U16, 2);
+			tsize = tsizeh;
+			break;
+		case 4:
+			htonmemcpy(&tsize, &mCurrentRBuffer[pos], MVT_U32, 4);
+			break;
+		}
+		pos += field.mSizeFieldSize;
+		size = (S32)tsize;
+	}
+	if (size < 0 || pos + size > mReceiveSize)
+	{
+		return NULL;
+	}
+	return mCurrentRBuffer + pos;
 }
 
 void LLTemplateMessageReader::getData(const char *blockname, const char *varname, void *datap, S32 size, S32 blocknum, S32 max_size)
@@ -442,21 +516,14 @@ S32 LLTemplateMessageReader::getMessageSize() const
 	return mReceiveSize;
 }
 
-// Returns template for the message contained in buffer
-BOOL LLTemplateMessageReader::decodeTemplate(  
-		const U8* buffer, S32 buffer_size,  // inputs
-		LLMessageTemplate** msg_template, bool custom ) // outputs
+// Extracts the message number from the header of the message contained in buffer.
+// Returns false if the buffer is too short to contain one.
+//static
+bool LLTemplateMessageReader::decodeMessageNumber(const U8* buffer, S32 buffer_size, U32& num)
 {
 	const U8* header = buffer + LL_PACKET_ID_SIZE;
 
-	// is there a message ready to go?
-	if (buffer_size <= 0)
-	{
-		llwarns << "No message waiting for decode!" << llendl;
-		return(FALSE);
-	}
-
-	U32 num = 0;
+	num = 0;
 
 	if (header[0] != 255)
 	{
@@ -486,6 +553,64 @@ BOOL LLTemplateMessageReader::decodeTemplate(
 		num = 0xFFFF0000 | message_id_U16;
 	}
 	else // bogus packet received (too short)
+	{
+		return false;
+	}
+	return true;
+}
+
+// Look up a template by message number in the dense tables.
+// Only the (few) Fixed messages, which are numbered at the very top of the low frequency range, go through the map.
+LLMessageTemplate* LLTemplateMessageReader::lookupTemplate(U32 num) const
+{
+	if (num < 255)
+	{
+		return mHighFrequencyTemplates[num];
+	}
+	if ((num >> 8) == 255)
+	{
+		return (num & 255) < 255 ? mMediumFrequencyTemplates[num & 255] : NULL;
+	}
+	if ((num >> 16) == 0xFFFF)
+	{
+		U32 index = num & 0xFFFF;
+		if (index < mLowFrequencyTemplates.size())
+		{
+			return mLowFrequencyTemplates[index];
+		}
+		if (index < LOW_FREQUENCY_TABLE_LIMIT)
+		{
+			return NULL;
+		}
+	}
+	return get_ptr_in_map(mMessageNumbers, num);
+}
+
+// Thread-safe version of decodeTemplate that doesn't log anything.
+LLMessageTemplate* LLTemplateMessageReader::findTemplate(const U8* buffer, S32 buffer_size) const
+{
+	U32 num;
+	if (buffer_size <= 0 || !decodeMessageNumber(buffer, buffer_size, num))
+	{
+		return NULL;
+	}
+	return lookupTemplate(num);
+}
+
+// Returns template for the message contained in buffer
+BOOL LLTemplateMessageReader::decodeTemplate(  
+		const U8* buffer, S32 buffer_size,  // inputs
+		LLMessageTemplate** msg_template, bool custom ) // outputs
+{
+	// is there a message ready to go?
+	if (buffer_size <= 0)
+	{
+		llwarns << "No message waiting for decode!" << llendl;
+		return(FALSE);
+	}
+
+	U32 num;
+	if (!decodeMessageNumber(buffer, buffer_size, num)) // bogus packet received (too short)
 	{
 		if(!custom)
 			llwarns << "Packet with unusable length received (too short): "
@@ -493,7 +618,7 @@ BOOL LLTemplateMessageReader::decodeTemplate(
 		return(FALSE);
 	}
 
-	LLMessageTemplate* temp = get_ptr_in_map(mMessageNumbers,num);
+	LLMessageTemplate* temp = lookupTemplate(num);
 	if (temp)
 	{
 		*msg_template = temp;
@@ -547,6 +672,10 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender,
 
 	// create base working data set
 	mCurrentRMessageData = new LLMsgData(mCurrentRMessageTemplate->mName);
+
+	mCurrentRBuffer = NULL;
+	mBlockFirstInstance.clear();
+	mBlockInstanceOffsets.clear();
 	
 	// loop through the template building the data structure as we go
 	LLMessageTemplate::message_block_map_t::const_iterator iter;
@@ -558,6 +687,8 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender,
 		U8	repeat_number;
 		S32	i;
 
+		mBlockFirstInstance.push_back(mBlockInstanceOffsets.size());
+
 		// how many of this block?
 
 		if (mbci->mType == MBT_SINGLE)
@@ -601,6 +732,7 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender,
 		// now loop through the block
 		for (i = 0; i < repeat_number; i++)
 		{
+			mBlockInstanceOffsets.push_back(decode_pos);
 			if (i)
 			{
 				// build new name to prevent collisions
@@ -697,6 +829,12 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender,
 		}
 	}
 
+	mBlockFirstInstance.push_back(mBlockInstanceOffsets.size());
+	if (!custom)
+	{
+		mCurrentRBuffer = buffer;
+	}
+
 	if (mCurrentRMessageData->mMemberBlocks.empty()
 		&& !mCurrentRMessageTemplate->mMemberBlocks.empty())
 	{
@@ -772,7 +910,27 @@ BOOL LLTemplateMessageReader::validateMessage(const U8* buffer,
 		//						 << " from " << sender << llendl;
 	}
 
-	if (valid && isBanned(trusted))
+	return valid && validateTemplate(sender, trusted);
+}
+
+// Like validateMessage, for a message of which findTemplate already returned the (non-NULL) template.
+BOOL LLTemplateMessageReader::validateDecodedMessage(LLMessageTemplate* msg_template,
+													 S32 buffer_size,
+													 const LLHost& sender,
+													 bool trusted)
+{
+	mReceiveSize = buffer_size;
+	mCurrentRMessageTemplate = msg_template;
+	mCurrentRMessageTemplate->mReceiveCount++;
+
+	return validateTemplate(sender, trusted);
+}
+
+BOOL LLTemplateMessageReader::validateTemplate(const LLHost& sender, bool trusted)
+{
+	BOOL valid = TRUE;
+
+	if (isBanned(trusted))
 	{
 		LL_WARNS("Messaging") << "LLMessageSystem::checkMessages "
 			<< "received banned message "
@@ -30,7 +30,9 @@
 #include "llmessagereader.h"
 
 #include <map>
+#include <vector>
 
+class LLMessageFieldRef;
 class LLMessageTemplate;
 class LLMsgData;
 
@@ -100,6 +102,15 @@ public:
 
 	BOOL validateMessage(const U8* buffer, S32 buffer_size, 
 						 const LLHost& sender, bool trusted = false, bool custom = false);
+	BOOL validateDecodedMessage(LLMessageTemplate* msg_template, S32 buffer_size,
+								const LLHost& sender, bool trusted);
+	// May be called from any thread, once all templates are loaded.
+	LLMessageTemplate* findTemplate(const U8* buffer, S32 buffer_size) const;
+
+	// Returns a pointer into the buffer passed to readMessage for the data of field in block blocknum,
+	// and its size; or NULL if field doesn't belong to the current message or the packet was truncated.
+	// The buffer must still be valid; for LLMessageSystem that is the case until the next packet is read.
+	const U8* getFieldData(const LLMessageFieldRef& field, S32 blocknum, S32& size) const;
 	BOOL readMessage(const U8* buffer, const LLHost& sender);
 
 	bool isTrusted() const;
@@ -114,6 +125,9 @@ private:
 	BOOL decodeTemplate(const U8* buffer, S32 buffer_size,  // inputs
 						LLMessageTemplate** msg_template,   // outputs
 						bool custom = false);
+	static bool decodeMessageNumber(const U8* buffer, S32 buffer_size, U32& num);
+	LLMessageTemplate* lookupTemplate(U32 num) const;
+	BOOL validateTemplate(const LLHost& sender, bool trusted);
 
 	void logRanOffEndOfPacket( const LLHost& host, const S32 where, const S32 wanted );
 
@@ -123,6 +137,16 @@ private:
 	LLMessageTemplate* mCurrentRMessageTemplate;
 	LLMsgData* mCurrentRMessageData;
 	message_template_number_map_t& mMessageNumbers;
+
+	// Dense copies of mMessageNumbers, made on construction, so that decoding needs no map lookup.
+	std::vector<LLMessageTemplate*> mHighFrequencyTemplates;	// Indexed by message number.
+	std::vector<LLMessageTemplate*> mMediumFrequencyTemplates;	// Indexed by the low byte of the message number.
+	std::vector<LLMessageTemplate*> mLowFrequencyTemplates;		// Indexed by the low 16 bits of the message number.
+
+	// Where decodeData found each block in the current message, for getFieldData.
+	const U8* mCurrentRBuffer;
+	std::vector<S32> mBlockFirstInstance;		// Per template block, index into mBlockInstanceOffsets; one extra at the end.
+	std::vector<S32> mBlockInstanceOffsets;		// Buffer offset of every block in the message.
 	friend class LLFloaterMessageLogItem;
 };
 
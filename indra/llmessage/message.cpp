@@ -80,6 +80,7 @@
 #include "v4math.h"
 #include "lltransfertargetvfile.h"
 #include "llpacketring.h"
+#include "llmessagereceivethread.h"
 
 class AIHTTPTimeoutPolicy;
 extern AIHTTPTimeoutPolicy fnPtrResponder_timeout;
@@ -238,6 +239,8 @@ void LLMessageSystem::init()
 
 	mMessageBuilder = NULL;
 	mMessageReader = NULL;
+
+	mReceiveThread = NULL;
 }
 
 // Read file and build message templates
@@ -362,6 +365,8 @@ void LLMessageSystem::loadTemplateFile(const std::string& filename, bool failure
 
 LLMessageSystem::~LLMessageSystem()
 {
+	stopReceiveThread();
+
 	mMessageTemplates.clear(); // don't delete templates.
 	for_each(mMessageNumbers.begin(), mMessageNumbers.end(), DeletePairedPointer());
 	mMessageNumbers.clear();
@@ -557,13 +562,48 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 
 		U8* buffer = mTrueReceiveBuffer;
 
-		mTrueReceiveSize = mPacketRing->receivePacket(mSocket, (char *)mTrueReceiveBuffer);
+		// Set when the receive thread already did the work that doesn't need circuits.
+		bool predecoded = false;
+		bool zero_coded = false;
+		S32 expanded_size = 0;
+		S32 expand_overflows = 0;
+		LLMessageTemplate* msg_template = NULL;
+
+		if (mReceiveThread)
+		{
+			LLReceivedPacket const* packet = mReceiveThread->front();
+			if (packet)
+			{
+				predecoded = packet->mBodySize >= 0;
+				zero_coded = packet->mZeroCoded;
+				expanded_size = packet->mExpandedSize;
+				expand_overflows = packet->mExpandOverflows;
+				msg_template = packet->mTemplate;
+				mTrueReceiveSize = packet->mSize;
+				memcpy(mTrueReceiveBuffer, packet->mData, packet->mSize);	/* Flawfinder: ignore */
+				if (zero_coded)
+				{
+					memcpy(mEncodedRecvBuffer, packet->mExpanded, expanded_size);	/* Flawfinder: ignore */
+				}
+				mLastSender = packet->mSender;
+				mLastReceivingIF = packet->mReceivingIF;
+				mReceiveThread->pop();
+			}
+			else
+			{
+				mTrueReceiveSize = 0;
+			}
+		}
+		else
+		{
+			mTrueReceiveSize = mPacketRing->receivePacket(mSocket, (char *)mTrueReceiveBuffer);
+			mLastSender = mPacketRing->getLastSender();
+			mLastReceivingIF = mPacketRing->getLastReceivingInterface();
+		}
 		// If you want to dump all received packets into SecondLife.log, uncomment this
 		//dumpPacketToLog();
 
 		receive_size = mTrueReceiveSize;
-		mLastSender = mPacketRing->getLastSender();
-		mLastReceivingIF = mPacketRing->getLastReceivingInterface();
 		
 		if (receive_size < (S32) LL_MINIMUM_VALID_PACKET_SIZE)
 		{
@@ -604,7 +644,14 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 			}
 
 			// process the message as normal
-			mIncomingCompressedSize = zeroCodeExpand(&buffer, &receive_size);
+			if (predecoded)
+			{
+				mIncomingCompressedSize = zeroCodeExpanded(&buffer, &receive_size, zero_coded, expanded_size, expand_overflows);
+			}
+			else
+			{
+				mIncomingCompressedSize = zeroCodeExpand(&buffer, &receive_size);
+			}
 			mCurrentRecvPacketID = ntohl(*((U32*)(&buffer[1])));
 			host = getSender();
 
@@ -688,11 +735,22 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 			// But we don't want to acknowledge UseCircuitCode until the circuit is
 			// available, which is why the acknowledgement test is done above.  JC
 			bool trusted = cdp && cdp->getTrusted();
-			valid_packet = mTemplateMessageReader->validateMessage(
-				buffer,
-				receive_size,
-				host,
-				trusted);
+			if (msg_template)
+			{
+				valid_packet = mTemplateMessageReader->validateDecodedMessage(
+					msg_template,
+					receive_size,
+					host,
+					trusted);
+			}
+			else
+			{
+				valid_packet = mTemplateMessageReader->validateMessage(
+					buffer,
+					receive_size,
+					host,
+					trusted);
+			}
 			if (!valid_packet)
 			{
 				clearReceiveState();
@@ -744,7 +802,7 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 				if (cdp && recv_reliable)
 				{
 					// Add to the recently received list for duplicate suppression
-					cdp->mRecentlyReceivedReliablePackets[mCurrentRecvPacketID] = getMessageTimeUsecs();
+					cdp->mRecentlyReceivedReliablePackets.insert(mCurrentRecvPacketID);
 
 					// Put it onto the list of packets to be acked
 					cdp->collectRAck(mCurrentRecvPacketID);
@@ -782,6 +840,35 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 	return valid_packet;
 }
 
+// Let a separate thread read, zero-expand and decode the template of incoming packets.
+// Call after the packet ring was configured.
+void LLMessageSystem::startReceiveThread()
+{
+	if (mReceiveThread || mbError)
+	{
+		return;
+	}
+	mReceiveThread = new LLMessageReceiveThread(mPacketRing, mSocket, mPollInfop->mPollFD, mTemplateMessageReader);
+	mReceiveThread->start();
+	LL_INFOS("Messaging") << "Started UDP receive thread." << llendl;
+}
+
+// Packets that the receive thread read but checkMessages didn't process yet are lost.
+void LLMessageSystem::stopReceiveThread()
+{
+	if (!mReceiveThread)
+	{
+		return;
+	}
+	mReceiveThread->setQuitting();
+	while (!mReceiveThread->isStopped())
+	{
+		ms_sleep(1);
+	}
+	delete mReceiveThread;
+	mReceiveThread = NULL;
+}
+
 S32	LLMessageSystem::getReceiveBytes() const
 {
 	if (getReceiveCompressedSize())
@@ -2899,10 +2986,63 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 	
 	*data[0] &= (~LL_ZERO_CODE_FLAG);
 
-	S32 count = (*data_size);  
+	S32 overflows = zeroCodeExpandBuffer(*data, in_size, mEncodedRecvBuffer, data_size);
+	for (S32 i = 0; i < overflows; ++i)
+	{
+		LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size" << llendl;
+		callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
+	}
+
+	*data = mEncodedRecvBuffer;
+	mUncompressedBytesIn += *data_size;
+
+	return(in_size);
+}
+
+// Does the accounting of zeroCodeExpand for a packet that LLMessageReceiveThread already expanded
+// into mEncodedRecvBuffer.
+S32 LLMessageSystem::zeroCodeExpanded(U8** data, S32* data_size, bool zero_coded, S32 expanded_size, S32 overflows)
+{
+	if ((*data_size ) < LL_MINIMUM_VALID_PACKET_SIZE)
+	{
+		LL_WARNS("Messaging") << "zeroCodeExpand() called with data_size of " << *data_size
+			<< llendl;
+	}
+
+	mTotalBytesIn += *data_size;
+
+	if (!zero_coded)
+	{
+		return 0;
+	}
+
+	S32 in_size = *data_size;
+	mCompressedPacketsIn++;
+	mCompressedBytesIn += *data_size;
+
+	for (S32 i = 0; i < overflows; ++i)
+	{
+		LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size" << llendl;
+		callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
+	}
+
+	*data = mEncodedRecvBuffer;
+	*data_size = expanded_size;
+	mUncompressedBytesIn += *data_size;
+
+	return(in_size);
+}
+
+// Expands the zero-coded message in into out, which must be MAX_BUFFER_SIZE bytes.
+// Returns the number of times that the expansion didn't fit. Thread-safe.
+//static
+S32 LLMessageSystem::zeroCodeExpandBuffer(U8 const* in, S32 in_size, U8* out, S32* out_size)
+{
+	S32 overflows = 0;
+	S32 count = in_size;
 	
-	U8 *inptr = (U8 *)*data;
-	U8 *outptr = (U8 *)mEncodedRecvBuffer;
+	U8 const* inptr = in;
+	U8* outptr = out;
 
 // skip the packet id field
 
@@ -2919,11 +3059,10 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 
 	while (count--)
 	{
-		if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-1]))
+		if (outptr > (&out[MAX_BUFFER_SIZE-1]))
 		{
-			LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 1" << llendl;
-			callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-			outptr = mEncodedRecvBuffer;					
+			++overflows;
+			outptr = out;
 			break;
 		}
 		if (!((*outptr++ = *inptr++)))
@@ -2931,11 +3070,10 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 			while (((count--)) && (!(*inptr)))
 			{
 				*outptr++ = *inptr++;
-  				if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-256]))
+  				if (outptr > (&out[MAX_BUFFER_SIZE-256]))
   				{
-  					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 2" << llendl;
-					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-					outptr = mEncodedRecvBuffer;
+					++overflows;
+					outptr = out;
 					count = -1;
 					break;
   				}
@@ -2950,11 +3088,10 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 
 			else
 			{
-  				if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-(*inptr)]))
+  				if (outptr > (&out[MAX_BUFFER_SIZE-(*inptr)]))
 				{
-  					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 3" << llendl;
-					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-					outptr = mEncodedRecvBuffer;					
+					++overflows;
+					outptr = out;
 				}
 				memset(outptr,0,(*inptr) - 1);
 				outptr += ((*inptr) - 1);
@@ -2963,11 +3100,9 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 		}		
 	}
 	
-	*data = mEncodedRecvBuffer;
-	*data_size = (S32)(outptr - mEncodedRecvBuffer);
-	mUncompressedBytesIn += *data_size;
+	*out_size = (S32)(outptr - out);
 
-	return(in_size);
+	return overflows;
 }
 
 
@@ -3815,6 +3950,77 @@ void LLMessageSystem::getBinaryData(const char *blockname,
 					  datap, size, blocknum, max_size);
 }
 
+const U8* LLMessageSystem::getFieldData(LLMessageFieldRef& field, S32 blocknum, S32& size)
+{
+	if (mMessageReader != mTemplateMessageReader)
+	{
+		return NULL;
+	}
+	if (!field.isResolved())
+	{
+		field.resolve(get_ptr_in_map(mMessageTemplates, field.getMessageName()));
+	}
+	return mTemplateMessageReader->getFieldData(field, blocknum, size);
+}
+
+void LLMessageSystem::getBinaryDataFast(LLMessageFieldRef& field, void *datap, S32 size, S32 blocknum, S32 max_size)
+{
+	S32 data_size;
+	const U8* data = getFieldData(field, blocknum, data_size);
+	if (data && (!size || size == data_size) && max_size >= data_size)
+	{
+		memcpy(datap, data, data_size);
+		return;
+	}
+	getBinaryDataFast(field.getBlockName(), field.getVarName(), datap, size, blocknum, max_size);
+}
+
+void LLMessageSystem::getU32Fast(LLMessageFieldRef& field, U32 &d, S32 blocknum)
+{
+	S32 data_size;
+	const U8* data = getFieldData(field, blocknum, data_size);
+	if (data && data_size == 4)
+	{
+		htonmemcpy(&d, data, MVT_U32, 4);
+		return;
+	}
+	getU32Fast(field.getBlockName(), field.getVarName(), d, blocknum);
+}
+
+void LLMessageSystem::getU64Fast(LLMessageFieldRef& field, U64 &d, S32 blocknum)
+{
+	S32 data_size;
+	const U8* data = getFieldData(field, blocknum, data_size);
+	if (data && data_size == 8)
+	{
+		htonmemcpy(&d, data, MVT_U64, 8);
+		return;
+	}
+	getU64Fast(field.getBlockName(), field.getVarName(), d, blocknum);
+}
+
+void LLMessageSystem::getUUIDFast(LLMessageFieldRef& field, LLUUID &u, S32 blocknum)
+{
+	S32 data_size;
+	const U8* data = getFieldData(field, blocknum, data_size);
+	if (data && data_size == UUID_BYTES)
+	{
+		memcpy(u.mData, data, UUID_BYTES);
+		return;
+	}
+	getUUIDFast(field.getBlockName(), field.getVarName(), u, blocknum);
+}
+
+S32 LLMessageSystem::getSizeFast(LLMessageFieldRef& field, S32 blocknum)
+{
+	S32 data_size;
+	if (getFieldData(field, blocknum, data_size))
+	{
+		return data_size;
+	}
+	return getSizeFast(field.getBlockName(), blocknum, field.getVarName());
+}
+
 void LLMessageSystem::getF32Fast(const char *block, const char *var, F32 &d, 
 								 S32 blocknum)
 {
@@ -62,6 +62,7 @@
 #include "llstoredmessage.h"
 
 class LLPacketRing;
+class LLMessageReceiveThread;
 namespace
 {
 	class LLFnPtrResponder;
@@ -200,6 +201,44 @@ class LLSDMessageReader;
 
 
 
+// A variable of a template message that is resolved once to its block and its offset within that block,
+// so that reading it doesn't need any name lookups. Use a static instance in hot message handlers:
+//
+//   static LLMessageFieldRef sIDField(_PREHASH_ObjectUpdate, _PREHASH_ObjectData, _PREHASH_ID);
+//   msg->getU32Fast(sIDField, local_id, i);
+//
+// The LLMessageSystem getters that take a LLMessageFieldRef fall back to the named getters when the
+// current message is a different message, or when the variable isn't at a fixed offset in its block.
+class LLMessageFieldRef
+{
+public:
+	LLMessageFieldRef(const char* message_name, const char* block_name, const char* var_name) :
+		mMessageName(message_name), mBlockName(block_name), mVarName(var_name), mResolved(false),
+		mTemplate(NULL), mBlockIndex(-1), mOffset(-1), mSize(0), mSizeFieldSize(0), mType(MVT_NULL) { }
+
+	// Look up block and variable in message_template. Called by LLMessageSystem on first use.
+	void resolve(const LLMessageTemplate* message_template);
+	bool isResolved() const { return mResolved; }
+
+	const char* getMessageName() const { return mMessageName; }
+	const char* getBlockName() const { return mBlockName; }
+	const char* getVarName() const { return mVarName; }
+
+private:
+	friend class LLTemplateMessageReader;
+
+	const char* mMessageName;
+	const char* mBlockName;
+	const char* mVarName;
+	bool mResolved;
+	const LLMessageTemplate* mTemplate;	// NULL if the variable can't be accessed by offset.
+	S32 mBlockIndex;
+	S32 mOffset;						// Offset of the variable within its block.
+	S32 mSize;							// Size of the variable, or 0 for MVT_VARIABLE.
+	S32 mSizeFieldSize;					// Size of the length field that precedes MVT_VARIABLE data.
+	EMsgVariableType mType;
+};
+
 class LLUseCircuitCodeResponder
 {
 	LOG_CLASS(LLMessageSystem);
@@ -466,6 +505,8 @@ public:
 
 	S32     zeroCode(U8 **data, S32 *data_size);
 	S32		zeroCodeExpand(U8 **data, S32 *data_size);
+	S32		zeroCodeExpanded(U8 **data, S32 *data_size, bool zero_coded, S32 expanded_size, S32 overflows);
+	static S32 zeroCodeExpandBuffer(U8 const* in, S32 in_size, U8* out, S32* out_size);
 	S32		zeroCodeAdjustCurrentSendTotal();
 
 	// Uses ping-based retry
@@ -568,6 +609,13 @@ public:
 	void getStringFast(	const char *block, const char *var, std::string& outstr, S32 blocknum = 0);
 	void	getString(	const char *block, const char *var, std::string& outstr, S32 blocknum = 0);
 
+	// Same as the above, but without name lookups when field is at a fixed offset in the current message.
+	void	getBinaryDataFast(LLMessageFieldRef& field, void *datap, S32 size, S32 blocknum = 0, S32 max_size = S32_MAX);
+	void	getU32Fast(LLMessageFieldRef& field, U32 &data, S32 blocknum = 0);
+	void	getU64Fast(LLMessageFieldRef& field, U64 &data, S32 blocknum = 0);
+	void	getUUIDFast(LLMessageFieldRef& field, LLUUID &uuid, S32 blocknum = 0);
+	S32		getSizeFast(LLMessageFieldRef& field, S32 blocknum);
+
 
 	// Utility functions to generate a replay-resistant digest check
 	// against the shared secret. The window specifies how much of a
@@ -745,6 +793,10 @@ public:
 	// Check UDP messages and pump http_pump to receive HTTP messages.
 	bool checkAllMessages(S64 frame_count, LLPumpIO* http_pump);
 
+	// Read UDP packets on a separate thread; checkMessages then picks them up from there.
+	void startReceiveThread();
+	void stopReceiveThread();
+
 	// Moved to allow access from LLTemplateMessageDispatcher
 	void clearReceiveState();
 
@@ -773,6 +825,9 @@ private:
 	void		logValidMsg(LLCircuitData *cdp, const LLHost& sender, BOOL recv_reliable, BOOL recv_resent, BOOL recv_acks );
 	void		logRanOffEndOfPacket( const LLHost& sender );
 
+	// Returns a pointer to the data of field in the current message, or NULL if the named getters must be used.
+	const U8*	getFieldData(LLMessageFieldRef& field, S32 blocknum, S32& size);
+
 	class LLMessageCountInfo
 	{
 	public:
@@ -782,6 +837,7 @@ private:
 	};
 
 	LLMessagePollInfo						*mPollInfop;
+	LLMessageReceiveThread*					mReceiveThread;
 
 	U8	mEncodedRecvBuffer[MAX_BUFFER_SIZE];
 	U8	mTrueReceiveBuffer[MAX_BUFFER_SIZE];
@@ -0,0 +1,126 @@
+/**
+ * @file llbandwidthestimator_test.cpp
+ * @brief LLBandwidthEstimator test cases.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "../llbandwidthestimator.h"
+
+#include "../test/lltut.h"
+
+namespace tut
+{
+	struct bandwidthestimator_data
+	{
+		bandwidthestimator_data() :
+			mEstimator(50.f, 2000.f)
+		{
+			mEstimator.reset(1000.f);
+		}
+
+		LLBandwidthEstimator mEstimator;
+	};
+	typedef test_group<bandwidthestimator_data> bandwidthestimator_test;
+	typedef bandwidthestimator_test::object bandwidthestimator_object;
+	tut::bandwidthestimator_test bandwidthestimator_testcase("LLBandwidthEstimator");
+
+	// Without queueing or loss, the estimate grows while it is used and stays put while it isn't.
+	template<> template<>
+	void bandwidthestimator_object::test<1>()
+	{
+		F32 estimate = mEstimator.update(1000.f, 50.f, 0.f);
+		ensure_equals("state", mEstimator.getState(), LLBandwidthEstimator::STATE_INCREASE);
+		ensure("grows", estimate > 1000.f);
+
+		F32 grown = estimate;
+		estimate = mEstimator.update(0.1f * grown, 50.f, 0.f);
+		ensure_equals("state when unused", mEstimator.getState(), LLBandwidthEstimator::STATE_INCREASE);
+		ensure_equals("doesn't grow when unused", estimate, grown);
+	}
+
+	// Packet loss cuts the estimate back to below what got through.
+	template<> template<>
+	void bandwidthestimator_object::test<2>()
+	{
+		mEstimator.update(1000.f, 50.f, 0.f);
+		F32 before = mEstimator.getEstimate();
+
+		F32 estimate = mEstimator.update(800.f, 50.f, 10.f);
+		ensure_equals("state", mEstimator.getState(), LLBandwidthEstimator::STATE_DECREASE);
+		ensure("below the throughput", estimate < 800.f);
+		ensure("at most halved", estimate >= 0.5f * before);
+
+		// A little loss doesn't count.
+		mEstimator.update(estimate, 50.f, 0.2f);
+		ensure_equals("state with little loss", mEstimator.getState(), LLBandwidthEstimator::STATE_INCREASE);
+	}
+
+	// A round trip time well above the base round trip time cuts the estimate back too.
+	template<> template<>
+	void bandwidthestimator_object::test<3>()
+	{
+		for (S32 i = 0; i < 5; ++i)
+		{
+			mEstimator.update(1000.f, 50.f, 0.f);
+		}
+		ensure_approximately_equals("base rtt", mEstimator.getBaseRTT(), 50.f, 8);
+		F32 before = mEstimator.getEstimate();
+
+		F32 estimate = mEstimator.update(1000.f, 400.f, 0.f);
+		ensure("queueing delay", mEstimator.getQueueingDelay() > 80.f);
+		ensure_equals("state", mEstimator.getState(), LLBandwidthEstimator::STATE_DECREASE);
+		ensure("cut back", estimate < before);
+		ensure_approximately_equals("base rtt unchanged", mEstimator.getBaseRTT(), 50.f, 8);
+
+		// Some queueing, but not enough to cut back: don't go much above what gets through.
+		mEstimator.reset(1000.f);
+		mEstimator.update(600.f, 100.f, 0.f);
+		estimate = mEstimator.update(600.f, 200.f, 0.f);
+		ensure_equals("state with some queueing", mEstimator.getState(), LLBandwidthEstimator::STATE_HOLD);
+		ensure("held near the throughput", estimate <= 1.05f * 600.f + 0.01f);
+	}
+
+	// The estimate never leaves the limits.
+	template<> template<>
+	void bandwidthestimator_object::test<4>()
+	{
+		for (S32 i = 0; i < 100; ++i)
+		{
+			mEstimator.update(mEstimator.getEstimate(), 50.f, 0.f);
+		}
+		ensure_equals("max", mEstimator.getEstimate(), 2000.f);
+
+		for (S32 i = 0; i < 100; ++i)
+		{
+			mEstimator.update(0.f, 50.f, 50.f);
+		}
+		ensure_equals("min", mEstimator.getEstimate(), 50.f);
+
+		mEstimator.setLimits(100.f, 500.f);
+		ensure_equals("raised min", mEstimator.getEstimate(), 100.f);
+		mEstimator.reset(1000.f);
+		ensure_equals("reset to above max", mEstimator.getEstimate(), 500.f);
+	}
+}
@@ -1049,6 +1049,7 @@ S32 LLPrimitive::packTEField(U8 *cur_ptr, U8 *data_ptr, U8 data_size, U8 last_fa
 	return (S32)(cur_ptr - start_loc);
 }
 
+//static
 S32 LLPrimitive::unpackTEField(U8 *cur_ptr, U8 *buffer_end, U8 *data_ptr, U8 data_size, U8 face_count, EMsgVariableType type)
 {
 	U8 *start_loc = cur_ptr;
@@ -1344,7 +1345,8 @@ S32 LLPrimitive::applyParsedTEMessage(LLTEContents& tec)
 
 	LLColor4 color;
 	LLColor4U coloru;
-	for (U32 i = 0; i < tec.face_count; i++)
+	U32 face_count = llmin(tec.face_count, (U32)getNumTEs());
+	for (U32 i = 0; i < face_count; i++)
 	{
 		LLUUID& req_id = ((LLUUID*)tec.image_data)[i];
 		retval |= setTETexture(i, req_id);
@@ -1385,109 +1387,78 @@ S32 LLPrimitive::unpackTEMessage(LLMessageSystem* mesgsys, char const* block_nam
 
 S32 LLPrimitive::unpackTEMessage(LLDataPacker &dp)
 {
-	// use a negative block_num to indicate a single-block read (a non-variable block)
-	S32 retval = 0;
-	const U32 MAX_TES = 32;
-
-	// Avoid construction of 32 UUIDs per call
-	static LLUUID image_ids[MAX_TES];
-	static LLMaterialID material_ids[MAX_TES];
-
-	U8     image_data[MAX_TES*16];
-	U8	   colors[MAX_TES*4];
-	F32    scale_s[MAX_TES];
-	F32    scale_t[MAX_TES];
-	S16    offset_s[MAX_TES];
-	S16    offset_t[MAX_TES];
-	S16    image_rot[MAX_TES];
-	U8	   bump[MAX_TES];
-	U8	   media_flags[MAX_TES];
-    U8     glow[MAX_TES];
-	U8     material_data[MAX_TES*16];
+	LLTEContents tec;
+	S32 retval = parseTEMessage(dp, tec);
+	if (retval != 1)
+	{
+		return retval;
+	}
+	return applyParsedTEMessage(tec);
+}
 
-	const U32 MAX_TE_BUFFER = 4096;
-	U8 packed_buffer[MAX_TE_BUFFER];
-	U8 *cur_ptr = packed_buffer;
+// Does not depend on the primitive, so that it can be done off the main thread:
+// parses all faces that are present; applyParsedTEMessage only applies those that the primitive has.
+// Returns TEM_INVALID if the texture entry block is bad, 0 if it is empty and 1 if tec was filled in.
+//static
+S32 LLPrimitive::parseTEMessage(LLDataPacker &dp, LLTEContents& tec)
+{
+	// temp buffer for material ID processing
+	// data will end up in tec.material_id[]
+	U8 material_data[LLTEContents::MAX_TES*16];
 
 	S32 size;
-	U32 face_count = 0;
-
-	if (!dp.unpackBinaryData(packed_buffer, size, "TextureEntry"))
+	if (!dp.unpackBinaryData(tec.packed_buffer, size, "TextureEntry"))
 	{
-		retval = TEM_INVALID;
 		llwarns << "Bad texture entry block!  Abort!" << llendl;
-		return retval;
+		return TEM_INVALID;
 	}
 
+	tec.size = size;
 	if (size == 0)
 	{
-		return retval;
+		tec.face_count = 0;
+		return 0;
 	}
 
-	face_count = llmin((U32) getNumTEs(), MAX_TES);
-	U32 i;
+	tec.face_count = LLTEContents::MAX_TES;
 
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)image_data, 16, face_count, MVT_LLUUID);
+	U8 *cur_ptr = tec.packed_buffer;
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.image_data, 16, tec.face_count, MVT_LLUUID);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)colors, 4, face_count, MVT_U8);
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.colors, 4, tec.face_count, MVT_U8);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)scale_s, 4, face_count, MVT_F32);
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.scale_s, 4, tec.face_count, MVT_F32);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)scale_t, 4, face_count, MVT_F32);
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.scale_t, 4, tec.face_count, MVT_F32);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)offset_s, 2, face_count, MVT_S16Array);
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.offset_s, 2, tec.face_count, MVT_S16Array);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)offset_t, 2, face_count, MVT_S16Array);
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.offset_t, 2, tec.face_count, MVT_S16Array);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)image_rot, 2, face_count, MVT_S16Array);
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.image_rot, 2, tec.face_count, MVT_S16Array);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)bump, 1, face_count, MVT_U8);
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.bump, 1, tec.face_count, MVT_U8);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)media_flags, 1, face_count, MVT_U8);
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.media_flags, 1, tec.face_count, MVT_U8);
 	cur_ptr++;
-	cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)glow, 1, face_count, MVT_U8);
-	if (cur_ptr < packed_buffer + size)
+	cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)tec.glow, 1, tec.face_count, MVT_U8);
+
+	if (cur_ptr < tec.packed_buffer + tec.size)
 	{
 		cur_ptr++;
-		cur_ptr += unpackTEField(cur_ptr, packed_buffer+size, (U8 *)material_data, 16, face_count, MVT_LLUUID);
+		cur_ptr += unpackTEField(cur_ptr, tec.packed_buffer+tec.size, (U8 *)material_data, 16, tec.face_count, MVT_LLUUID);
 	}
 	else
 	{
 		memset(material_data, 0, sizeof(material_data));
 	}
 
-	for (i = 0; i < face_count; i++)
+	for (U32 i = 0; i < tec.face_count; i++)
 	{
-		memcpy(image_ids[i].mData,&image_data[i*16],16);	/* Flawfinder: ignore */ 	
-		material_ids[i].set(&material_data[i * 16]);
-	}
-	
-	LLColor4 color;
-	LLColor4U coloru;
-	for (i = 0; i < face_count; i++)
-	{
-		retval |= setTETexture(i, image_ids[i]);
-		retval |= setTEScale(i, scale_s[i], scale_t[i]);
-		retval |= setTEOffset(i, (F32)offset_s[i] / (F32)0x7FFF, (F32) offset_t[i] / (F32) 0x7FFF);
-		retval |= setTERotation(i, ((F32)image_rot[i] / TEXTURE_ROTATION_PACK_FACTOR) * F_TWO_PI);
-		retval |= setTEBumpShinyFullbright(i, bump[i]);
-		retval |= setTEMediaTexGen(i, media_flags[i]);
-		retval |= setTEGlow(i, (F32)glow[i] / (F32)0xFF);
-		retval |= setTEMaterialID(i, material_ids[i]);
-		coloru = LLColor4U(colors + 4*i);
-
-		// Note:  This is an optimization to send common colors (1.f, 1.f, 1.f, 1.f)
-		// as all zeros.  However, the subtraction and addition must be done in unsigned
-		// byte space, not in float space, otherwise off-by-one errors occur. JC
-		color.mV[VRED]		= F32(255 - coloru.mV[VRED])   / 255.f;
-		color.mV[VGREEN]	= F32(255 - coloru.mV[VGREEN]) / 255.f;
-		color.mV[VBLUE]		= F32(255 - coloru.mV[VBLUE])  / 255.f;
-		color.mV[VALPHA]	= F32(255 - coloru.mV[VALPHA]) / 255.f;
-
-		retval |= setTEColor(i, color);
+		tec.material_ids[i].set(&material_data[i * 16]);
 	}
 
-	return retval;
+	return 1;
 }
 
 U8	LLPrimitive::getExpectedNumTEs() const
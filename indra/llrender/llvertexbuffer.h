@@ -277,6 +277,8 @@ public:
 	S32 getOffset(S32 type) const			{ return mOffsets[type]; }
 	S32 getUsage() const					{ return mUsage; }
 	bool isWriteable() const				{ return (mMappable || mUsage == GL_STREAM_DRAW_ARB) ? true : false; }
+	// True if the striders point into GL memory rather than into a copy that flush() uploads.
+	bool isMappedDirectly() const			{ return useVBOs() && mMappable; }
 
 	void draw(U32 mode, U32 count, U32 indices_offset) const;
 	void drawArrays(U32 mode, U32 offset, U32 count) const;
@@ -31,6 +31,8 @@
 #include <sys/stat.h>
 #include <set>
 #include <map>
+#include <vector>
+#include <algorithm>
 #if LL_WINDOWS
 #include <share.h>
 #elif LL_SOLARIS
@@ -40,6 +42,12 @@
 #else
 #include <sys/file.h>
 #endif
+#if LL_WINDOWS
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
     
 #include "llstl.h"
 #include "lltimer.h"
@@ -198,12 +206,12 @@ BOOL LLVFSFileBlock::insertLRU(LLVFSFileBlock* const& first,
 		: first->mAccessTime < second->mAccessTime;
 }
 
-// Helper structure for doing lru w/ stl... is there a simpler way?
-struct LLVFSFileBlock_less
+// Orders a snapshot of (access time, file block) pairs for LRU removal.
+struct lru_less
 {
-	bool operator()(LLVFSFileBlock* const& lhs, LLVFSFileBlock* const& rhs) const
+	bool operator()(const std::pair<U32, LLVFSFileBlock*>& lhs, const std::pair<U32, LLVFSFileBlock*>& rhs) const
 	{
-		return (LLVFSFileBlock::insertLRU(lhs, rhs)) ? true : false;
+		return (lhs.first == rhs.first) ? *lhs.second < *rhs.second : lhs.first < rhs.first;
 	}
 };
 
@@ -211,10 +219,16 @@ struct LLVFSFileBlock_less
 const S32 LLVFSFileBlock::SERIAL_SIZE = 34;
      
 
-LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash)
+LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash, const BOOL use_mapped_io)
 :	mRemoveAfterCrash(remove_after_crash),
 	mDataFP(NULL),
-	mIndexFP(NULL)
+	mIndexFP(NULL),
+	mMappedData(NULL),
+	mMappedSize(0),
+	mDataFileSize(0)
+#if LL_WINDOWS
+	, mMappingHandle(NULL)
+#endif
 {
 	mDataMutex = new LLMutex;
 
@@ -299,6 +313,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 	// determine the real file size
 	fseek(mDataFP, 0, SEEK_END);
 	U32 data_size = ftell(mDataFP);
+	mDataFileSize = data_size;
 
 	// read the index file
 	// make sure there's at least one file in it too
@@ -332,7 +347,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 				block->mFileType >= LLAssetType::AT_NONE &&
 				block->mFileType < LLAssetType::AT_COUNT)
 			{
-				mFileBlocks.insert(fileblock_map::value_type(*block, block));
+				insertFileBlock(block);
 				files_by_loc.push_back(block);
 			}
 			else
@@ -418,7 +433,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 						<< LL_ENDL;
 
 					// Duplicate entries.  Nuke them both for safety.
-					mFileBlocks.erase(*cur_file_block);	// remove ID/type entry
+					getShard(*cur_file_block).mFileBlocks.erase(*cur_file_block);	// remove ID/type entry
 					if (cur_file_block->mLength > 0)
 					{
 						// convert to hole
@@ -534,6 +549,19 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 		}
 	}
 
+	if (use_mapped_io)
+	{
+		// Map everything the free lists may hand out, so that the data file
+		// can grow into the mapping without remapping.
+		U32 extent = mDataFileSize;
+		if (!mFreeBlocksByLocation.empty())
+		{
+			LLVFSBlock* last_free = mFreeBlocksByLocation.rbegin()->second;
+			extent = llmax(extent, last_free->mLocation + (U32)last_free->mLength);
+		}
+		mapDataFile(extent);
+	}
+
 	LL_INFOS("VFS") << "Using VFS index file " << mIndexFilename << LL_ENDL;
 	LL_INFOS("VFS") << "Using VFS data file " << mDataFilename << LL_ENDL;
 
@@ -550,16 +578,21 @@ LLVFS::~LLVFS()
 	unlockAndClose(mIndexFP);
 	mIndexFP = NULL;
 
-	fileblock_map::const_iterator it;
-	for (it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	for (S32 i = 0; i < INDEX_SHARD_COUNT; i++)
 	{
-		delete (*it).second;
+		fileblock_map& file_blocks = mIndexShards[i].mFileBlocks;
+		for (fileblock_map::const_iterator it = file_blocks.begin(); it != file_blocks.end(); ++it)
+		{
+			delete (*it).second;
+		}
+		file_blocks.clear();
 	}
-	mFileBlocks.clear();
 	
 	mFreeBlocksByLength.clear();
 
 	for_each(mFreeBlocksByLocation.begin(), mFreeBlocksByLocation.end(), DeletePairedPointer());
+
+	unmapDataFile();
     
 	unlockAndClose(mDataFP);
 	mDataFP = NULL;
@@ -582,9 +615,10 @@ LLVFS * LLVFS::createLLVFS(const std::string& index_filename,
 		const std::string& data_filename, 
 		const BOOL read_only, 
 		const U32 presize, 
-		const BOOL remove_after_crash)
+		const BOOL remove_after_crash,
+		const BOOL use_mapped_io)
 {
-	LLVFS * new_vfs = new LLVFS(index_filename, data_filename, read_only, presize, remove_after_crash);
+	LLVFS * new_vfs = new LLVFS(index_filename, data_filename, read_only, presize, remove_after_crash, use_mapped_io);
 
 	if( !new_vfs->isValid() )
 	{	// First name failed, retry with new names
@@ -598,7 +632,7 @@ LLVFS * LLVFS::createLLVFS(const std::string& index_filename,
 			retry_vfs_data_name = data_filename + llformat(".%u", count);
 
 			delete new_vfs;	// Delete bad VFS and try again
-			new_vfs = new LLVFS(retry_vfs_index_name, retry_vfs_data_name, read_only, presize, remove_after_crash);
+			new_vfs = new LLVFS(retry_vfs_index_name, retry_vfs_data_name, read_only, presize, remove_after_crash, use_mapped_io);
 
 			count++;
 		}
@@ -644,28 +678,22 @@ void LLVFS::presizeDataFile(const U32 size)
 
 BOOL LLVFS::getExists(const LLUUID &file_id, const LLAssetType::EType file_type)
 {
-	LLVFSFileBlock *block = NULL;
-		
 	if (!isValid())
 	{
 		llerrs << "Attempting to use invalid VFS!" << llendl;
 	}
 
-	lockData();
-	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	LLVFSIndexShard& shard = getShard(spec);
+	LLMutexLock lock_shard(&shard.mMutex);
+
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	if (block)
 	{
-		block = (*it).second;
 		block->mAccessTime = (U32)time(NULL);
 	}
 
-	BOOL res = (block && block->mLength > 0) ? TRUE : FALSE;
-	
-	unlockData();
-	
-	return res;
+	return (block && block->mLength > 0) ? TRUE : FALSE;
 }
     
 S32	 LLVFS::getSize(const LLUUID &file_id, const LLAssetType::EType file_type)
@@ -678,20 +706,17 @@ S32	 LLVFS::getSize(const LLUUID &file_id, const LLAssetType::EType file_type)
 
 	}
 
-	lockData();
-	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		LLVFSFileBlock *block = (*it).second;
+	LLVFSIndexShard& shard = getShard(spec);
+	LLMutexLock lock_shard(&shard.mMutex);
 
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	if (block)
+	{
 		block->mAccessTime = (U32)time(NULL);
 		size = block->mSize;
 	}
 
-	unlockData();
-	
 	return size;
 }
     
@@ -704,20 +729,17 @@ S32  LLVFS::getMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 		llerrs << "Attempting to use invalid VFS!" << llendl;
 	}
 
-	lockData();
-	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		LLVFSFileBlock *block = (*it).second;
+	LLVFSIndexShard& shard = getShard(spec);
+	LLMutexLock lock_shard(&shard.mMutex);
 
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	if (block)
+	{
 		block->mAccessTime = (U32)time(NULL);
 		size = block->mLength;
 	}
 
-	unlockData();
-
 	return size;
 }
 
@@ -752,12 +774,10 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 	lockData();
 	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	LLVFSFileBlock *block = NULL;
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		block = (*it).second;
-	}
+	LLVFSIndexShard& shard = getShard(spec);
+	shard.mMutex.lock();
+
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
     
 	// round all sizes upward to KB increments
 	// SJB: Need to not round for the new texture-pipeline code so we know the correct
@@ -777,6 +797,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
     
 		if (max_size == block->mLength)
 		{
+			shard.mMutex.unlock();
 			unlockData();
 			return TRUE;
 		}
@@ -799,6 +820,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			sync(block);
 			//mergeFreeBlocks();
 
+			shard.mMutex.unlock();
 			unlockData();
 			return TRUE;
 		}
@@ -826,6 +848,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 					block->mLength += size_increase;
 					sync(block);
 
+					shard.mMutex.unlock();
 					unlockData();
 					return TRUE;
 				}
@@ -854,11 +877,9 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 					{
 						// move the file into the new block
 						std::vector<U8> buffer(block->mSize);
-						fseek(mDataFP, block->mLocation, SEEK_SET);
-						if (fread(&buffer[0], block->mSize, 1, mDataFP) == 1)
+						if (readDataFile(&buffer[0], block->mLocation, block->mSize) == block->mSize)
 						{
-							fseek(mDataFP, new_data_location, SEEK_SET);
-							if (fwrite(&buffer[0], block->mSize, 1, mDataFP) != 1)
+							if (writeDataFile(&buffer[0], new_data_location, block->mSize) != block->mSize)
 							{
 								llwarns << "Short write" << llendl;
 							}
@@ -875,6 +896,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 
 				sync(block);
 
+				shard.mMutex.unlock();
 				unlockData();
 				return TRUE;
 			}
@@ -882,6 +904,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			{
 				llwarns << "VFS: No space (" << max_size << ") to resize existing vfile " << file_id << llendl;
 				//dumpMap();
+				shard.mMutex.unlock();
 				unlockData();
 				dumpStatistics();
 				return FALSE;
@@ -904,7 +927,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			{
 				// this file doesn't exist, create it
 				block = new LLVFSFileBlock(file_id, file_type, free_block->mLocation, max_size);
-				mFileBlocks.insert(fileblock_map::value_type(spec, block));
+				shard.mFileBlocks.insert(fileblock_map::value_type(spec, block));
 			}
 
 			// Must call useFreeSpace before sync(), as sync()
@@ -918,11 +941,13 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 		{
 			llwarns << "VFS: No space (" << max_size << ") for new virtual file " << file_id << llendl;
 			//dumpMap();
+			shard.mMutex.unlock();
 			unlockData();
 			dumpStatistics();
 			return FALSE;
 		}
 	}
+	shard.mMutex.unlock();
 	unlockData();
 	return TRUE;
 }
@@ -946,26 +971,29 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 	
 	LLVFSFileSpecifier new_spec(new_id, new_type);
 	LLVFSFileSpecifier old_spec(file_id, file_type);
+
+	// Both shards are needed; lock them in address order so that two
+	// renames can never wait on each other.
+	LLVFSIndexShard* old_shard = &getShard(old_spec);
+	LLVFSIndexShard* new_shard = &getShard(new_spec);
+	LLVFSIndexShard* first_shard = llmin(old_shard, new_shard);
+	LLVFSIndexShard* second_shard = llmax(old_shard, new_shard);
+	first_shard->mMutex.lock();
+	if (second_shard != first_shard)
+	{
+		second_shard->mMutex.lock();
+	}
 	
-	fileblock_map::iterator it = mFileBlocks.find(old_spec);
-	if (it != mFileBlocks.end())
+	LLVFSFileBlock *src_block = findFileBlock(*old_shard, old_spec);
+	if (src_block)
 	{
-		LLVFSFileBlock *src_block = (*it).second;
-
 		// this will purge the data but leave the file block in place, w/ locks, if any
 		// WAS: removeFile(new_id, new_type); NOW uses removeFileBlock() to avoid mutex lock recursion
-		fileblock_map::iterator new_it = mFileBlocks.find(new_spec);
-		if (new_it != mFileBlocks.end())
-		{
-			LLVFSFileBlock *new_block = (*new_it).second;
-			removeFileBlock(new_block);
-		}
-		
 		// if there's something in the target location, remove it but inherit its locks
-		it = mFileBlocks.find(new_spec);
-		if (it != mFileBlocks.end())
+		LLVFSFileBlock *dest_block = findFileBlock(*new_shard, new_spec);
+		if (dest_block)
 		{
-			LLVFSFileBlock *dest_block = (*it).second;
+			removeFileBlock(dest_block);
 
 			for (S32 i = 0; i < (S32)VFSLOCK_COUNT; i++)
 			{
@@ -976,7 +1004,7 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 				dest_block->mLocks[i] = src_block->mLocks[i];
 			}
 			
-			mFileBlocks.erase(new_spec);
+			new_shard->mFileBlocks.erase(new_spec);
 			delete dest_block;
 		}
 
@@ -984,8 +1012,8 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 		src_block->mFileType = new_type;
 		src_block->mAccessTime = (U32)time(NULL);
    
-		mFileBlocks.erase(old_spec);
-		mFileBlocks.insert(fileblock_map::value_type(new_spec, src_block));
+		old_shard->mFileBlocks.erase(old_spec);
+		new_shard->mFileBlocks.insert(fileblock_map::value_type(new_spec, src_block));
 
 		sync(src_block);
 	}
@@ -993,10 +1021,16 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 	{
 		llwarns << "VFS: Attempt to rename nonexistent vfile " << file_id << ":" << file_type << llendl;
 	}
+
+	if (second_shard != first_shard)
+	{
+		second_shard->mMutex.unlock();
+	}
+	first_shard->mMutex.unlock();
 	unlockData();
 }
 
-// mDataMutex must be LOCKED before calling this
+// mDataMutex and the index shard mutex of fileblock must be LOCKED before calling this
 void LLVFS::removeFileBlock(LLVFSFileBlock *fileblock)
 {
 	// convert this into an unsaved, dummy fileblock to preserve locks
@@ -1033,10 +1067,12 @@ void LLVFS::removeFile(const LLUUID &file_id, const LLAssetType::EType file_type
     lockData();
 	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	LLVFSIndexShard& shard = getShard(spec);
+	shard.mMutex.lock();
+
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	if (block)
 	{
-		LLVFSFileBlock *block = (*it).second;
 		removeFileBlock(block);
 	}
 	else
@@ -1044,6 +1080,7 @@ void LLVFS::removeFile(const LLUUID &file_id, const LLAssetType::EType file_type
 		llwarns << "VFS: attempting to remove nonexistent file " << file_id << " type " << file_type << llendl;
 	}
 
+	shard.mMutex.unlock();
 	unlockData();
 }
     
@@ -1059,16 +1096,41 @@ S32 LLVFS::getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8
 	llassert(location >= 0);
 	llassert(length >= 0);
 
+	LLVFSFileSpecifier spec(file_id, file_type);
+	LLVFSIndexShard& shard = getShard(spec);
+
+	if (mMappedData)
+	{
+		// Fast path: copy straight out of the mapping, only holding the shard.
+		LLMutexLock lock_shard(&shard.mMutex);
+
+		LLVFSFileBlock *block = findFileBlock(shard, spec);
+		if (!block)
+		{
+			return 0;
+		}
+		if (location <= block->mSize)
+		{
+			S32 read_length = llmin(length, block->mSize - location);
+			U32 file_location = block->mLocation + location;
+			if (isMappedRange(file_location, read_length))
+			{
+				block->mAccessTime = (U32)time(NULL);
+				memcpy(buffer, mMappedData + file_location, read_length);	/* Flawfinder: ignore */
+				return read_length;
+			}
+		}
+		// Fall through to the stdio path, which also does the warning.
+	}
+
 	BOOL do_read = FALSE;
 	
     lockData();
+	shard.mMutex.lock();
 	
-	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	if (block)
 	{
-		LLVFSFileBlock *block = (*it).second;
-
 		block->mAccessTime = (U32)time(NULL);
     
 		if (location > block->mSize)
@@ -1088,10 +1150,10 @@ S32 LLVFS::getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8
 
 	if (do_read)
 	{
-		fseek(mDataFP, location, SEEK_SET);
-		bytesread = (S32)fread(buffer, 1, length, mDataFP);
+		bytesread = readDataFile(buffer, location, length);
 	}
 	
+	shard.mMutex.unlock();
 	unlockData();
 
 	return bytesread;
@@ -1113,11 +1175,12 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
     lockData();
     
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		LLVFSFileBlock *block = (*it).second;
+	LLVFSIndexShard& shard = getShard(spec);
+	LLMutexLock lock_shard(&shard.mMutex);
 
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	if (block)
+	{
 		S32 in_loc = location;
 		if (location == -1)
 		{
@@ -1158,8 +1221,7 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
 			}
 			U32 file_location = location + block->mLocation;
 			
-			fseek(mDataFP, file_location, SEEK_SET);
-			S32 write_len = (S32)fwrite(buffer, 1, length, mDataFP);
+			S32 write_len = writeDataFile(buffer, file_location, length);
 			if (write_len != length)
 			{
 				llwarns << llformat("VFS Write Error: %d != %d",write_len,length) << llendl;
@@ -1185,40 +1247,38 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
  
 void LLVFS::incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
 {
+	// May create a new index entry, so this needs mDataMutex too.
 	lockData();
 
 	LLVFSFileSpecifier spec(file_id, file_type);
-	LLVFSFileBlock *block;
-	
- 	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		block = (*it).second;
-	}
-	else
+	LLVFSIndexShard& shard = getShard(spec);
+	shard.mMutex.lock();
+
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	if (!block)
 	{
 		// Create a dummy block which isn't saved
 		block = new LLVFSFileBlock(file_id, file_type, 0, BLOCK_LENGTH_INVALID);
     	block->mAccessTime = (U32)time(NULL);
-		mFileBlocks.insert(fileblock_map::value_type(spec, block));
+		shard.mFileBlocks.insert(fileblock_map::value_type(spec, block));
 	}
 
 	block->mLocks[lock]++;
 	mLockCounts[lock]++;
 	
+	shard.mMutex.unlock();
 	unlockData();
 }
 
 void LLVFS::decLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
 {
-	lockData();
-
 	LLVFSFileSpecifier spec(file_id, file_type);
- 	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		LLVFSFileBlock *block = (*it).second;
+	LLVFSIndexShard& shard = getShard(spec);
+	LLMutexLock lock_shard(&shard.mMutex);
 
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	if (block)
+	{
 		if (block->mLocks[lock] > 0)
 		{
 			block->mLocks[lock]--;
@@ -1227,35 +1287,180 @@ void LLVFS::decLock(const LLUUID &file_id, const LLAssetType::EType file_type, E
 		{
 			llwarns << "VFS: Decrementing zero-value lock " << lock << llendl;
 		}
-		mLockCounts[lock]--;
+		--mLockCounts[lock];
 	}
-
-	unlockData();
 }
 
 BOOL LLVFS::isLocked(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
 {
-	lockData();
-	
-	BOOL res = FALSE;
-	
 	LLVFSFileSpecifier spec(file_id, file_type);
- 	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		LLVFSFileBlock *block = (*it).second;
-		res = (block->mLocks[lock] > 0);
-	}
+	LLVFSIndexShard& shard = getShard(spec);
+	LLMutexLock lock_shard(&shard.mMutex);
 
-	unlockData();
-
-	return res;
+	LLVFSFileBlock *block = findFileBlock(shard, spec);
+	return (block && block->mLocks[lock] > 0) ? TRUE : FALSE;
 }
 
 //============================================================================
 // protected
 //============================================================================
 
+LLVFS::LLVFSIndexShard& LLVFS::getShard(const LLVFSFileSpecifier& spec)
+{
+	// UUIDs are random enough that the first bytes make a fine hash.
+	U32 hash = spec.mFileID.mData[0] | (spec.mFileID.mData[1] << 8);
+	return mIndexShards[(hash ^ (U32)spec.mFileType) % INDEX_SHARD_COUNT];
+}
+
+// static
+LLVFSFileBlock* LLVFS::findFileBlock(LLVFSIndexShard& shard, const LLVFSFileSpecifier& spec)
+{
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	return (it != shard.mFileBlocks.end()) ? it->second : NULL;
+}
+
+void LLVFS::insertFileBlock(LLVFSFileBlock* block)
+{
+	LLVFSIndexShard& shard = getShard(*block);
+	LLMutexLock lock_shard(&shard.mMutex);
+	shard.mFileBlocks.insert(fileblock_map::value_type(*block, block));
+}
+
+LLVFS::fileblock_map LLVFS::collectFileBlocks() const
+{
+	fileblock_map file_blocks;
+	for (S32 i = 0; i < INDEX_SHARD_COUNT; i++)
+	{
+		file_blocks.insert(mIndexShards[i].mFileBlocks.begin(), mIndexShards[i].mFileBlocks.end());
+	}
+	return file_blocks;
+}
+
+BOOL LLVFS::isMappedRange(U32 location, S32 length) const
+{
+	U32 end = location + length;
+	return mMappedData && length >= 0 && end >= location && end <= mMappedSize && end <= (U32)mDataFileSize;
+}
+
+S32 LLVFS::readDataFile(U8* buffer, U32 location, S32 length)
+{
+	if (!mMappedData)
+	{
+		fseek(mDataFP, location, SEEK_SET);
+		return (S32)fread(buffer, 1, length, mDataFP);
+	}
+
+	// The stdio buffers aren't used while the file is mapped, see writeDataFile().
+#if LL_WINDOWS
+	int fd = _fileno(mDataFP);
+	if (_lseeki64(fd, location, SEEK_SET) < 0)
+	{
+		return 0;
+	}
+	int bytes = _read(fd, buffer, length);
+#else
+	ssize_t bytes = ::pread(fileno(mDataFP), buffer, length, location);
+#endif
+	return bytes > 0 ? (S32)bytes : 0;
+}
+
+S32 LLVFS::writeDataFile(const U8* buffer, U32 location, S32 length)
+{
+	if (!mMappedData)
+	{
+		fseek(mDataFP, location, SEEK_SET);
+		return (S32)fwrite(buffer, 1, length, mDataFP);
+	}
+
+	// Write straight to the descriptor, so that the data can be read through the
+	// mapping right away instead of after flushing stdio.
+#if LL_WINDOWS
+	int fd = _fileno(mDataFP);
+	if (_lseeki64(fd, location, SEEK_SET) < 0)
+	{
+		return 0;
+	}
+	int bytes = _write(fd, buffer, length);
+#else
+	ssize_t bytes = ::pwrite(fileno(mDataFP), buffer, length, location);
+#endif
+	if (bytes <= 0)
+	{
+		return 0;
+	}
+	if (location + (U32)bytes > mDataFileSize)
+	{
+		mDataFileSize = location + (U32)bytes;
+	}
+	return (S32)bytes;
+}
+
+void LLVFS::mapDataFile(U32 extent)
+{
+	// Once mapped, the data file is only accessed through its descriptor.
+	fflush(mDataFP);
+
+#if LL_WINDOWS
+	// A read-only view can't extend past the end of the file on Windows,
+	// so map what is there; anything beyond is read through stdio.
+	extent = mDataFileSize;
+	if (!extent)
+	{
+		return;
+	}
+	HANDLE file = (HANDLE)_get_osfhandle(_fileno(mDataFP));
+	mMappingHandle = CreateFileMapping(file, NULL, PAGE_READONLY, 0, extent, NULL);
+	if (mMappingHandle)
+	{
+		mMappedData = (U8*)MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, extent);
+		if (!mMappedData)
+		{
+			CloseHandle(mMappingHandle);
+			mMappingHandle = NULL;
+		}
+	}
+	if (!mMappedData)
+	{
+		LL_WARNS("VFS") << "Failed to map VFS data file " << mDataFilename << ": " << GetLastError() << LL_ENDL;
+		return;
+	}
+#else
+	if (!extent)
+	{
+		return;
+	}
+	// Reserve the whole extent up front so the mapping never has to move
+	// while readers hold pointers into it. Pages past the end of the file
+	// are never touched, see isMappedRange().
+	void* addr = ::mmap(NULL, extent, PROT_READ, MAP_SHARED, fileno(mDataFP), 0);
+	if (addr == MAP_FAILED)
+	{
+		LL_WARNS("VFS") << "Failed to map VFS data file " << mDataFilename << " (" << extent << " bytes)" << LL_ENDL;
+		return;
+	}
+	mMappedData = (U8*)addr;
+#endif
+	mMappedSize = extent;
+	LL_INFOS("VFS") << "Mapped " << extent << " bytes of VFS data file " << mDataFilename << LL_ENDL;
+}
+
+void LLVFS::unmapDataFile()
+{
+	if (!mMappedData)
+	{
+		return;
+	}
+#if LL_WINDOWS
+	UnmapViewOfFile(mMappedData);
+	CloseHandle(mMappingHandle);
+	mMappingHandle = NULL;
+#else
+	::munmap(mMappedData, mMappedSize);
+#endif
+	mMappedData = NULL;
+	mMappedSize = 0;
+}
+
 void LLVFS::eraseBlockLength(LLVFSBlock *block)
 {
 	// find the corresponding map entry in the length map and erase it
@@ -1494,7 +1699,18 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 	}
 	else
 	{
+		// mAccessTime is written by readers holding only the shard lock
+		LLMutex& shard_mutex = getShard(*block).mMutex;
+		bool need_lock = !shard_mutex.isSelfLocked();
+		if (need_lock)
+		{
+			shard_mutex.lock();
+		}
 		block->serialize(buffer);
+		if (need_lock)
+		{
+			shard_mutex.unlock();
+		}
 	}
 
 	// If set_index_to_end, file pointer is already at seek_pos
@@ -1515,6 +1731,33 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 	return;
 }
 
+// mDataMutex must be LOCKED before calling this
+// The caller may hold one index shard locked as well.
+// Returns FALSE if the file was locked since the LRU list was collected and was kept.
+BOOL LLVFS::removeLRUFileBlock(LLVFSFileBlock *fileblock)
+{
+	LLMutex& shard_mutex = getShard(*fileblock).mMutex;
+	bool need_lock = !shard_mutex.isSelfLocked();
+	if (need_lock)
+	{
+		shard_mutex.lock();
+	}
+	BOOL removed = FALSE;
+	if (fileblock->mLength > 0 &&
+		! fileblock->mLocks[VFSLOCK_READ] &&
+		! fileblock->mLocks[VFSLOCK_APPEND] &&
+		! fileblock->mLocks[VFSLOCK_OPEN])
+	{
+		removeFileBlock(fileblock);
+		removed = TRUE;
+	}
+	if (need_lock)
+	{
+		shard_mutex.unlock();
+	}
+	return removed;
+}
+
 // mDataMutex must be LOCKED before calling this
 // Can initiate LRU-based file removal to make space.
 // The immune file block will not be removed.
@@ -1528,8 +1771,12 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 	LLVFSBlock *block = NULL;
 	BOOL have_lru_list = FALSE;
 	
-	typedef std::set<LLVFSFileBlock*, LLVFSFileBlock_less> lru_set;
-	lru_set lru_list;
+	// Snapshot of (access time, file) pairs. Readers update mAccessTime under
+	// their shard lock only, so the blocks can't be kept ordered by it directly.
+	typedef std::pair<U32, LLVFSFileBlock*> lru_entry_t;
+	typedef std::vector<lru_entry_t> lru_list_t;
+	lru_list_t lru_list;
+	lru_list_t::iterator lru_iter;
     
 	LLTimer timer;
 
@@ -1544,27 +1791,48 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 		if (! block)
 		{
 			// create a list of files sorted by usage time
-			// this is far faster than sorting a linked list
 			if (! have_lru_list)
 			{
-				for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+				for (S32 i = 0; i < INDEX_SHARD_COUNT; i++)
 				{
-					LLVFSFileBlock *tmp = (*it).second;
+					// The caller may already hold the shard of the immune file.
+					// Only threads holding mDataMutex take more than one shard lock,
+					// so taking the others here can't deadlock.
+					LLMutex& shard_mutex = mIndexShards[i].mMutex;
+					bool need_lock = !shard_mutex.isSelfLocked();
+					if (need_lock)
+					{
+						shard_mutex.lock();
+					}
 
-					if (tmp != immune &&
-						tmp->mLength > 0 &&
-						! tmp->mLocks[VFSLOCK_READ] &&
-						! tmp->mLocks[VFSLOCK_APPEND] &&
-						! tmp->mLocks[VFSLOCK_OPEN])
+					fileblock_map& file_blocks = mIndexShards[i].mFileBlocks;
+					for (fileblock_map::iterator it = file_blocks.begin(); it != file_blocks.end(); ++it)
 					{
-						lru_list.insert(tmp);
+						LLVFSFileBlock *tmp = (*it).second;
+
+						if (tmp != immune &&
+							tmp->mLength > 0 &&
+							! tmp->mLocks[VFSLOCK_READ] &&
+							! tmp->mLocks[VFSLOCK_APPEND] &&
+							! tmp->mLocks[VFSLOCK_OPEN])
+						{
+							lru_list.push_back(lru_entry_t(tmp->mAccessTime, tmp));
+						}
+					}
+
+					if (need_lock)
+					{
+						shard_mutex.unlock();
 					}
 				}
-				
+
+				// ties are broken by file id and type, like LLVFSFileBlock::insertLRU
+				std::sort(lru_list.begin(), lru_list.end(), lru_less());
+				lru_iter = lru_list.begin();
 				have_lru_list = TRUE;
 			}
 
-			if (lru_list.size() == 0)
+			if (lru_iter == lru_list.end())
 			{
 				// No more files to delete, and still not enough room!
 				llwarns << "VFS: Can't make " << size << " bytes of free space in VFS, giving up" << llendl;
@@ -1572,21 +1840,19 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 			}
 
 			// is the oldest file big enough?  (Should be about half the time)
-			lru_set::iterator it = lru_list.begin();
-			LLVFSFileBlock *file_block = *it;
-			if (file_block->mLength >= size && file_block != immune)
+			LLVFSFileBlock *file_block = lru_iter->second;
+			if (file_block->mLength >= size)
 			{
 				// ditch this file and look again for a free block - should find it
 				// TODO: it'll be faster just to assign the free block and break
 				llinfos << "LRU: Removing " << file_block->mFileID << ":" << file_block->mFileType << llendl;
-				lru_list.erase(it);
-				removeFileBlock(file_block);
-				file_block = NULL;
+				++lru_iter;
+				removeLRUFileBlock(file_block);
 				continue;
 			}
 
 			
-			llinfos << "VFS: LRU: Aggressive: " << (S32)lru_list.size() << " files remain" << llendl;
+			llinfos << "VFS: LRU: Aggressive: " << (S32)(lru_list.end() - lru_iter) << " files remain" << llendl;
 			dumpLockCounts();
 			
 			// Now it's time to aggressively make more space
@@ -1594,19 +1860,17 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 			// This may yield too much free space, but we'll use it up soon enough
 			U32 cleanup_target = (size > VFS_CLEANUP_SIZE) ? size : VFS_CLEANUP_SIZE;
 			U32 cleaned_up = 0;
-		   	for (it = lru_list.begin();
-				 it != lru_list.end() && cleaned_up < cleanup_target;
-				 )
+			while (lru_iter != lru_list.end() && cleaned_up < cleanup_target)
 			{
-				file_block = *it;
+				file_block = lru_iter->second;
+				++lru_iter;
 				
 				// TODO: it would be great to be able to batch all these sync() calls
-				// llinfos << "LRU2: Removing " << file_block->mFileID << ":" << file_block->mFileType << " last accessed" << file_block->mAccessTime << llendl;
-
-				cleaned_up += file_block->mLength;
-				lru_list.erase(it++);
-				removeFileBlock(file_block);
-				file_block = NULL;
+				S32 length = file_block->mLength;
+				if (removeLRUFileBlock(file_block))
+				{
+					cleaned_up += length;
+				}
 			}
 			//mergeFreeBlocks();
 		}
@@ -1635,16 +1899,19 @@ void LLVFS::pokeFiles()
 	
 	// only write data if we actually read 4 bytes
 	// otherwise we're writing garbage and screwing up the file
-	fseek(mDataFP, 0, SEEK_SET);
-	if (fread(&word, sizeof(word), 1, mDataFP) == 1)
+	lockData();
+	if (readDataFile((U8*)&word, 0, sizeof(word)) == sizeof(word))
 	{
-		fseek(mDataFP, 0, SEEK_SET);
-		if (fwrite(&word, sizeof(word), 1, mDataFP) != 1)
+		if (writeDataFile((const U8*)&word, 0, sizeof(word)) != sizeof(word))
 		{
 			llwarns << "Could not write to data file" << llendl;
 		}
-		fflush(mDataFP);
+		if (!mMappedData)
+		{
+			fflush(mDataFP);
+		}
 	}
+	unlockData();
 
 	fseek(mIndexFP, 0, SEEK_SET);
 	if (fread(&word, sizeof(word), 1, mIndexFP) == 1)
@@ -1662,7 +1929,8 @@ void LLVFS::pokeFiles()
 void LLVFS::dumpMap()
 {
 	llinfos << "Files:" << llendl;
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	fileblock_map file_blocks = collectFileBlocks();
+	for (fileblock_map::iterator it = file_blocks.begin(); it != file_blocks.end(); ++it)
 	{
 		LLVFSFileBlock *file_block = (*it).second;
 		llinfos << "Location: " << file_block->mLocation << "\tLength: " << file_block->mLength << "\t" << file_block->mFileID << "\t" << file_block->mFileType << llendl;
@@ -1725,7 +1993,7 @@ void LLVFS::audit()
 			block->mAccessTime <= cur_time &&
 			block->mFileID != LLUUID::null)
 		{
-			if (mFileBlocks.find(*block) == mFileBlocks.end())
+			if (!findFileBlock(getShard(*block), *block))
 			{
 				llwarns << "VFile " << block->mFileID << ":" << block->mFileType << " on disk, not in memory, loc " << block->mIndexLocation << llendl;
 			}
@@ -1775,7 +2043,8 @@ void LLVFS::audit()
     
 	if (!vfs_corrupt)
 	{
-		for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+		fileblock_map file_blocks = collectFileBlocks();
+		for (fileblock_map::iterator it = file_blocks.begin(); it != file_blocks.end(); ++it)
 		{
 			LLVFSFileBlock* block = (*it).second;
 
@@ -1826,7 +2095,8 @@ void LLVFS::checkMem()
 {
 	lockData();
 	
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	fileblock_map file_blocks = collectFileBlocks();
+	for (fileblock_map::iterator it = file_blocks.begin(); it != file_blocks.end(); ++it)
 	{
 		LLVFSFileBlock *block = (*it).second;
 		llassert(block->mFileType >= LLAssetType::AT_NONE &&
@@ -1870,7 +2140,8 @@ void LLVFS::dumpStatistics()
 	S32 max_file_size = 0;
 	S32 total_file_size = 0;
 	S32 invalid_file_count = 0;
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	fileblock_map file_blocks = collectFileBlocks();
+	for (fileblock_map::iterator it = file_blocks.begin(); it != file_blocks.end(); ++it)
 	{
 		LLVFSFileBlock *file_block = (*it).second;
 		if (file_block->mLength == BLOCK_LENGTH_INVALID)
@@ -1947,7 +2218,7 @@ void LLVFS::dumpStatistics()
 	}
 
 	llinfos << "Invalid blocks: " << invalid_file_count << llendl;
-	llinfos << "File blocks:    " << mFileBlocks.size() << llendl;
+	llinfos << "File blocks:    " << file_blocks.size() << llendl;
 
 	S32 length_list_count = (S32)mFreeBlocksByLength.size();
 	S32 location_list_count = (S32)mFreeBlocksByLocation.size();
@@ -2036,7 +2307,8 @@ void LLVFS::listFiles()
 {
 	lockData();
 	
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	fileblock_map file_blocks = collectFileBlocks();
+	for (fileblock_map::iterator it = file_blocks.begin(); it != file_blocks.end(); ++it)
 	{
 		LLVFSFileSpecifier file_spec = it->first;
 		LLVFSFileBlock *file_block = it->second;
@@ -2060,7 +2332,7 @@ std::map<LLVFSFileSpecifier, LLVFSFileBlock*> LLVFS::getFileList()
 {
 	//have to do this so as not to mess with the gods of threading
 	lockData();
-	fileblock_map mFileList = mFileBlocks;
+	fileblock_map mFileList = collectFileBlocks();
 	unlockData();
 
 	return mFileList;
@@ -2072,7 +2344,8 @@ void LLVFS::dumpFiles()
 	lockData();
 	
 	S32 files_extracted = 0;
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	fileblock_map file_blocks = collectFileBlocks();
+	for (fileblock_map::iterator it = file_blocks.begin(); it != file_blocks.end(); ++it)
 	{
 		LLVFSFileSpecifier file_spec = it->first;
 		LLVFSFileBlock *file_block = it->second;
@@ -2102,7 +2375,7 @@ void LLVFS::dumpFiles()
 	
 	unlockData();
 
-	llinfos << "Extracted " << files_extracted << " files out of " << mFileBlocks.size() << llendl;
+	llinfos << "Extracted " << files_extracted << " files out of " << file_blocks.size() << llendl;
 }
 
 //============================================================================
@@ -32,6 +32,7 @@
 #include "linked_lists.h"
 #include "llassettype.h"
 #include "llthread.h"
+#include "llatomic.h"
 
 enum EVFSValid 
 {
@@ -119,22 +120,33 @@ private:
 			const std::string& data_filename, 
 			const BOOL read_only, 
 			const U32 presize, 
-			const BOOL remove_after_crash);
+			const BOOL remove_after_crash,
+			const BOOL use_mapped_io);
 public:
 	~LLVFS();
 
 	// Use this function normally to create LLVFS files
 	// Pass 0 to not presize
+	// With use_mapped_io the data file is memory mapped and reads are
+	// served from the mapping under a per-shard lock instead of mDataMutex.
 	static LLVFS * createLLVFS(const std::string& index_filename, 
 			const std::string& data_filename, 
 			const BOOL read_only, 
 			const U32 presize, 
-			const BOOL remove_after_crash);
+			const BOOL remove_after_crash,
+			const BOOL use_mapped_io = FALSE);
 
 	BOOL isValid() const			{ return (VFSVALID_OK == mValid); }
 	EVFSValid getValidState() const	{ return mValid; }
+	BOOL isMapped() const			{ return mMappedData != NULL; }
 
-	// ---------- The following fucntions lock/unlock mDataMutex ----------
+	// The file index is split into this many independently locked shards,
+	// selected by file id.
+	enum { INDEX_SHARD_COUNT = 16 };
+
+	// ---------- The following functions lock the index shard of the file ----------
+	// Lookups only take the shard lock. Anything that changes the layout of
+	// the data file also locks mDataMutex, always before any shard lock.
 	BOOL getExists(const LLUUID &file_id, const LLAssetType::EType file_type);
 	S32	 getSize(const LLUUID &file_id, const LLAssetType::EType file_type);
 
@@ -153,7 +165,7 @@ public:
 	void incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
 	void decLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
 	BOOL isLocked(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
-	// ----------------------------------------------------------------
+	// ------------------------------------------------------------------------------
 
 	// Used to trigger evil WinXP behavior of "preloading" entire file into memory.
 	void pokeFiles();
@@ -172,6 +184,7 @@ public:
 
 protected:
 	void removeFileBlock(LLVFSFileBlock *fileblock);
+	BOOL removeLRUFileBlock(LLVFSFileBlock *fileblock);
 	
 	void eraseBlockLength(LLVFSBlock *block);
 	void eraseBlock(LLVFSBlock *block);
@@ -191,6 +204,16 @@ protected:
 	// lock/unlock data mutex (mDataMutex)
 	void lockData() { mDataMutex->lock(); }
 	void unlockData() { mDataMutex->unlock(); }	
+
+	// Map the data file; extent is the largest offset the free lists can hand out.
+	void mapDataFile(U32 extent);
+	void unmapDataFile();
+	// Returns TRUE if [location, location + length) can be read from the mapping.
+	BOOL isMappedRange(U32 location, S32 length) const;
+	// Read and write the data file with mDataMutex held. While the file is mapped these
+	// bypass stdio, and writes extend mDataFileSize. Return the number of bytes transferred.
+	S32 readDataFile(U8* buffer, U32 location, S32 length);
+	S32 writeDataFile(const U8* buffer, U32 location, S32 length);
 	
 protected:
 	LLMutex* mDataMutex;
@@ -201,7 +224,21 @@ public:
 	std::map<LLVFSFileSpecifier, LLVFSFileBlock*> getFileList();
 //</edit>
 protected:
-	fileblock_map mFileBlocks;
+	struct LLVFSIndexShard
+	{
+		LLMutex mMutex;
+		fileblock_map mFileBlocks;
+	};
+
+	LLVFSIndexShard& getShard(const LLVFSFileSpecifier& spec);
+	// The shard's mutex must be LOCKED before calling this
+	static LLVFSFileBlock* findFileBlock(LLVFSIndexShard& shard, const LLVFSFileSpecifier& spec);
+	// mDataMutex must be LOCKED before calling this
+	void insertFileBlock(LLVFSFileBlock* block);
+	// Copy of the whole index; mDataMutex must be LOCKED to get a consistent view
+	fileblock_map collectFileBlocks() const;
+
+	LLVFSIndexShard mIndexShards[INDEX_SHARD_COUNT];
 
 	typedef std::multimap<S32, LLVFSBlock*>	blocks_length_map_t;
 	blocks_length_map_t 	mFreeBlocksByLength;
@@ -219,8 +256,15 @@ protected:
 
 	EVFSValid mValid;
 
-	S32 mLockCounts[VFSLOCK_COUNT];
+	LLAtomicS32 mLockCounts[VFSLOCK_COUNT];
 	BOOL mRemoveAfterCrash;
+
+	U8* mMappedData;
+	U32 mMappedSize;
+	LLAtomicU32 mDataFileSize;		// bytes known to be on disk; the mapping is only read below this
+#if LL_WINDOWS
+	void* mMappingHandle;
+#endif
 };
 
 extern LLVFS *gVFS;
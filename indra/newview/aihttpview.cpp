@@ -67,6 +67,7 @@ class AIServiceBar : public LLView
 
 int const mc_col = number_of_capability_types;				// Maximum connections column.
 int const bw_col = number_of_capability_types + 1;			// Bandwidth column.
+int const cr_col = number_of_capability_types + 2;			// Connection reuse column.
 
 void AIServiceBar::draw()
 {
@@ -84,6 +85,9 @@ void AIServiceBar::draw()
   int established_connections;
   int concurrent_connections;
   size_t bandwidth;
+  U32 reused_connection_requests;
+  U32 new_connection_requests;
+  F32 time_to_first_byte;
   {
 	PerService_rat per_service_r(*mPerService);
 	is_used = per_service_r->is_used();
@@ -93,6 +97,9 @@ void AIServiceBar::draw()
 	established_connections = per_service_r->mEstablishedConnections;
 	concurrent_connections = per_service_r->mConcurrentConnections;
 	bandwidth = per_service_r->bandwidth().truncateData(AIHTTPView::getTime_40ms());
+	reused_connection_requests = per_service_r->mReusedConnectionRequests;
+	new_connection_requests = per_service_r->mNewConnectionRequests;
+	time_to_first_byte = per_service_r->mTimeToFirstByte;
 	cts = per_service_r->mCapabilityType;	// Not thread-safe, but we're only reading from it and only using the results to show in a debug console.
   }
   for (int col = 0; col < number_of_capability_types; ++col)
@@ -171,6 +178,18 @@ void AIServiceBar::draw()
   start += LLFontGL::getFontMonospace()->getWidth(text);
   text = llformat("/%lu", max_bandwidth / 125);
   LLFontGL::getFontMonospace()->renderUTF8(text, 0, start, height, text_color, LLFontGL::LEFT, LLFontGL::TOP);
+  start += LLFontGL::getFontMonospace()->getWidth(text);
+  start = mHTTPView->updateColumn(cr_col, start);
+  U32 const finished_requests = reused_connection_requests + new_connection_requests;
+  if (finished_requests == 0)
+  {
+	text = " | --";
+  }
+  else
+  {
+	text = llformat(" | %u%% %dms", (100 * reused_connection_requests + finished_requests / 2) / finished_requests, llround(time_to_first_byte));
+  }
+  LLFontGL::getFontMonospace()->renderUTF8(text, 0, start, height, LLColor4::white, LLFontGL::LEFT, LLFontGL::TOP);
 }
 
 LLRect AIServiceBar::getRequiredRect(void)
@@ -223,6 +242,10 @@ void AIGLHTTPHeaderBar::draw(void)
   text = " | Tot/Max BW (kbit/s)";
   start = mHTTPView->updateColumn(bw_col, start);
   LLFontGL::getFontMonospace()->renderUTF8(text, 0, start, height, LLColor4::green, LLFontGL::LEFT, LLFontGL::TOP);
+  start += LLFontGL::getFontMonospace()->getWidth(text);
+  text = " | Reuse/TTFB";
+  start = mHTTPView->updateColumn(cr_col, start);
+  LLFontGL::getFontMonospace()->renderUTF8(text, 0, start, height, LLColor4::green, LLFontGL::LEFT, LLFontGL::TOP);
   mHTTPView->setWidth(start + LLFontGL::getFontMonospace()->getWidth(text) + h_offset);
 
   // Second header line.
@@ -81,6 +81,7 @@
 #include "llviewerstats.h"
 #include "llviewerwindow.h"
 #include "llvoavatarself.h"
+#include "llvocache.h"
 #include "llvoiceclient.h"
 #include "llworld.h"
 #include "llworldmap.h"
@@ -4082,6 +4083,10 @@ void LLAgent::handleTeleportFailed()
 	{
 		mTeleportRequest->setStatus(LLTeleportRequest::kFailed);
 	}
+	if (LLVOCache::hasInstance())
+	{
+		LLVOCache::getInstance()->cancelPrefetch();
+	}
 	if (mIsMaturityRatingChangingDuringTeleport)
 	{
 		// notify user that the maturity preference has been changed
@@ -4103,6 +4108,11 @@ void LLAgent::teleportRequest(
 	bool is_local = (region_handle == to_region_handle(getPositionGlobal()));
 	if(regionp && teleportCore(is_local))
 	{
+		if (!is_local && !LLWorld::getInstance()->getRegionFromHandle(region_handle) && LLVOCache::hasInstance())
+		{
+			// Read the object cache of the destination while the simulators hand us over.
+			LLVOCache::getInstance()->prefetch(region_handle);
+		}
 		LL_INFOS("") << "TeleportLocationRequest: '" << region_handle << "':"
 					 << pos_local << LL_ENDL;
 		LLMessageSystem* msg = gMessageSystem;
@@ -4214,6 +4224,10 @@ void LLAgent::teleportCancel()
 		}	
 	}
 	clearTeleportRequest();
+	if (LLVOCache::hasInstance())
+	{
+		LLVOCache::getInstance()->cancelPrefetch();
+	}
 	gAgent.setTeleportState( LLAgent::TELEPORT_NONE );
 }
 
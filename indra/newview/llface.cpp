@@ -40,10 +40,12 @@
 #include "llvolume.h"
 #include "m3math.h"
 #include "llmatrix4a.h"
+#include "llvertexstream.h"
 #include "v3color.h"
 
 #include "lldrawpoolavatar.h"
 #include "lldrawpoolbump.h"
+#include "llgeometryfillpool.h"
 #include "llgl.h"
 #include "llrender.h"
 #include "lllightconstants.h"
@@ -756,50 +758,6 @@ static void xform(LLVector2 &tex_coord, F32 cosAng, F32 sinAng, F32 offS, F32 of
 	tex_coord.mV[1] = t;
 }
 
-// Transform the texture coordinates for this face.
-static void xform4a(LLVector4a &tex_coord, const LLVector4a& trans, const LLVector4Logical& mask, const LLVector4a& rot0, const LLVector4a& rot1, const LLVector4a& offset, const LLVector4a& scale) 
-{
-	//tex coord is two coords, <s0, t0, s1, t1>
-	LLVector4a st;
-
-	// Texture transforms are done about the center of the face.
-	st.setAdd(tex_coord, trans);
-	
-	// Handle rotation
-	LLVector4a rot_st;
-		
-	// <s0 * cosAng, s0*-sinAng, s1*cosAng, s1*-sinAng>
-	LLVector4a s0;
-	s0.splat(st, 0);
-	LLVector4a s1;
-	s1.splat(st, 2);
-	LLVector4a ss;
-	ss.setSelectWithMask(mask, s1, s0);
-
-	LLVector4a a; 
-	a.setMul(rot0, ss);
-	
-	// <t0*sinAng, t0*cosAng, t1*sinAng, t1*cosAng>
-	LLVector4a t0;
-	t0.splat(st, 1);
-	LLVector4a t1;
-	t1.splat(st, 3);
-	LLVector4a tt;
-	tt.setSelectWithMask(mask, t1, t0);
-
-	LLVector4a b;
-	b.setMul(rot1, tt);
-		
-	st.setAdd(a,b);
-
-	// Then scale
-	st.mul(scale);
-
-	// Then offset
-	tex_coord.setAdd(st, offset);
-}
-
-
 bool less_than_max_mag(const LLVector4a& vec)
 {
 #if 1
@@ -1217,7 +1175,8 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 							   const S32 &f,
 								const LLMatrix4a& mat_vert_in, const LLMatrix4a& mat_norm_in,
 								const U16 &index_offset,
-								bool force_rebuild)
+								bool force_rebuild,
+								LLGeometryFillPool* fill_pool)
 {
 	LLFastTimer t(FTM_FACE_GET_GEOM);
 	llassert(verify());
@@ -1234,6 +1193,9 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 	//don't use map range (generates many redundant unmap calls)
 	bool map_range = false; //gGLManager.mHasMapBufferRange || gGLManager.mHasFlushBufferRange;
 
+	// Buffers that map GL memory directly are written with non-temporal stores (see LLVertexStream).
+	bool stream = mVertexBuffer.notNull() && mVertexBuffer->isMappedDirectly();
+
 	if (mVertexBuffer.notNull())
 	{
 		if (num_indices + (S32) mIndicesIndex > mVertexBuffer->getNumIndices())
@@ -1668,11 +1630,14 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 			}
 			
 			bool do_tex_mat = tex_mode && mTextureMatrix;
+			LLTexCoordXform tex_xform = { cos_ang, sin_ang, os, ot, ms, mt };
 
 			if (!do_bump)
 			{ //not in atlas or not bump mapped, might be able to do a cheap update
 				mVertexBuffer->getTexCoord0Strider(tex_coords0, mGeomIndex, mGeomCount);
 
+				F32* dst = (F32*) tex_coords0.get();
+
 				if (texgen != LLTextureEntry::TEX_GEN_PLANAR)
 				{
 					LLFastTimer t(FTM_FACE_TEX_QUICK);
@@ -1682,92 +1647,24 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 						{
 							LLFastTimer t(FTM_FACE_TEX_QUICK_NO_XFORM);
 							S32 tc_size = (num_vertices*2*sizeof(F32)+0xF) & ~0xF;
-							LLVector4a::memcpyNonAliased16((F32*) tex_coords0.get(), (F32*) vf.mTexCoords, tc_size);
+							LLVertexStream::copy((F32*) vf.mTexCoords, tc_size, dst, stream);
 						}
 						else
 						{
 							LLFastTimer t(FTM_FACE_TEX_QUICK_XFORM);
-							F32* dst = (F32*) tex_coords0.get();
-							LLVector4a* src = (LLVector4a*) vf.mTexCoords;
-
-							LLVector4a trans;
-							trans.splat(-0.5f);
-
-							LLVector4a rot0;
-							rot0.set(cos_ang, -sin_ang, cos_ang, -sin_ang);
-
-							LLVector4a rot1;
-							rot1.set(sin_ang, cos_ang, sin_ang, cos_ang);
-
-							LLVector4a scale;
-							scale.set(ms, mt, ms, mt);
-
-							LLVector4a offset;
-							offset.set(os+0.5f, ot+0.5f, os+0.5f, ot+0.5f);
-
-							LLVector4Logical mask;
-							mask.clear();
-							mask.setElement<2>();
-							mask.setElement<3>();
-
-							U32 count = num_vertices/2 + num_vertices%2;
-
-							for (U32 i = 0; i < count; i++)
-							{	
-								LLVector4a res = *src++;
-								xform4a(res, trans, mask, rot0, rot1, offset, scale);
-								res.store4a(dst);
-								dst += 4;
-							}
+							LLVertexStream::xformTexCoords(vf.mTexCoords, num_vertices, dst, tex_xform, stream);
 						}
 					}
 					else
 					{ //do tex mat, no texgen, no atlas, no bump
-						for (S32 i = 0; i < num_vertices; i++)
-						{
-							//LLVector4a& norm = vf.mNormals[i];
-							//LLVector4a& center = *(vf.mCenter);
-							LLVector4a tc(vf.mTexCoords[i].mV[VX],vf.mTexCoords[i].mV[VY],0.f);
-							mTextureMatrix->affineTransform(tc,tc);
-							(tex_coords0++)->set(tc.getF32ptr());
-						}
+						LLVertexStream::matrixTexCoords(vf.mTexCoords, num_vertices, dst, *mTextureMatrix, stream);
 					}
 				}
 				else
 				{ //no bump, no atlas, tex gen planar
 					LLFastTimer t(FTM_FACE_TEX_QUICK_PLANAR);
-					if (do_tex_mat)
-					{
-						for (S32 i = 0; i < num_vertices; i++)
-						{	
-							LLVector2 tc(vf.mTexCoords[i]);
-							LLVector4a& norm = vf.mNormals[i];
-							LLVector4a& center = *(vf.mCenter);
-							LLVector4a vec = vf.mPositions[i];	
-							vec.mul(scalea);
-							planarProjection(tc, norm, center, vec);
-						
-							LLVector4a tmp(tc.mV[VX],tc.mV[VY],0.f);
-							mTextureMatrix->affineTransform(tmp,tmp);
-							(tex_coords0++)->set(tmp.getF32ptr());
-						}
-					}
-					else
-					{
-						for (S32 i = 0; i < num_vertices; i++)
-						{	
-							LLVector2 tc(vf.mTexCoords[i]);
-							LLVector4a& norm = vf.mNormals[i];
-							LLVector4a& center = *(vf.mCenter);
-							LLVector4a vec = vf.mPositions[i];	
-							vec.mul(scalea);
-							planarProjection(tc, norm, center, vec);
-						
-							xform(tc, cos_ang, sin_ang, os, ot, ms, mt);
-
-							*tex_coords0++ = tc;	
-						}
-					}
+					LLVertexStream::planarTexCoords(vf.mPositions, vf.mNormals, num_vertices, scalea, dst,
+													do_tex_mat ? mTextureMatrix : NULL, tex_xform, stream);
 				}
 
 				if (map_range)
@@ -1928,11 +1825,6 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		if (rebuild_pos)
 		{
 			LLVector4a* src = vf.mPositions;
-			
-			//_mm_prefetch((char*)src, _MM_HINT_T0);
-
-			LLVector4a* end = src+num_vertices;
-			//LLVector4a* end_64 = end-4;
 
 			//LLFastTimer t(FTM_FACE_GEOM_POSITION);
 			llassert(num_vertices > 0);
@@ -1942,81 +1834,21 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 			const LLMatrix4a& mat_vert = mat_vert_in;
 
 			F32* dst = (F32*) vert.get();
-			F32* end_f32 = dst+mGeomCount*4;
-
-			//_mm_prefetch((char*)dst, _MM_HINT_NTA);
-			//_mm_prefetch((char*)src, _MM_HINT_NTA);
-				
-			//_mm_prefetch((char*)dst, _MM_HINT_NTA);
-
-
-			LLVector4a res0; //,res1,res2,res3;
-
-			LLVector4a texIdx;
 
 			S32 index = mTextureIndex < 255 ? mTextureIndex : 0;
+			llassert(index <= LLGLSLShader::sIndexedTextureChannels-1);
 
 			F32 val = 0.f;
 			S32* vp = (S32*) &val;
 			*vp = index;
-			
-			llassert(index <= LLGLSLShader::sIndexedTextureChannels-1);
-
-			LLVector4Logical mask;
-			mask.clear();
-			mask.setElement<3>();
-		
-			texIdx.set(0,0,0,val);
-
-			LLVector4a tmp;
 
+			if (fill_pool)
 			{
-				//LLFastTimer t2(FTM_FACE_POSITION_STORE);
-
-				/*if (num_vertices > 4)
-				{ //more than 64 bytes
-					while (src < end_64)
-					{	
-						_mm_prefetch((char*)src + 64, _MM_HINT_T0);
-						_mm_prefetch((char*)dst + 64, _MM_HINT_T0);
-
-						mat_vert.affineTransform(*src, res0);
-						tmp.setSelectWithMask(mask, texIdx, res0);
-						tmp.store4a((F32*) dst);
-
-						mat_vert.affineTransform(*(src+1), res1);
-						tmp.setSelectWithMask(mask, texIdx, res1);
-						tmp.store4a((F32*) dst+4);
-
-						mat_vert.affineTransform(*(src+2), res2);
-						tmp.setSelectWithMask(mask, texIdx, res2);
-						tmp.store4a((F32*) dst+8);
-
-						mat_vert.affineTransform(*(src+3), res3);
-						tmp.setSelectWithMask(mask, texIdx, res3);
-						tmp.store4a((F32*) dst+12);
-
-						dst += 16;
-						src += 4;
-					}
-				}*/
-
-				while (src < end)
-				{	
-					mat_vert.affineTransform(*src++, res0);
-					tmp.setSelectWithMask(mask, texIdx, res0);
-					tmp.store4a((F32*) dst);
-					dst += 4;
-				}
+				fill_pool->queuePositions(src, num_vertices, dst, mGeomCount, mat_vert, val, stream);
 			}
-
+			else
 			{
-				//LLFastTimer t(FTM_FACE_POSITION_PAD);
-				while (dst < end_f32)
-				{
-					res0.store4a((F32*) dst);
-					dst += 4;
-				}
+				LLVertexStream::transformPositions(src, num_vertices, dst, mGeomCount, mat_vert, val, stream);
 			}
 
 			if (map_range)
@@ -2032,14 +1864,14 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 			mVertexBuffer->getNormalStrider(norm, mGeomIndex, mGeomCount, map_range);
 			F32* normals = (F32*) norm.get();
 			LLVector4a* src = vf.mNormals;
-			LLVector4a* end = src+num_vertices;
 			
-			while (src < end)
-			{	
-				LLVector4a normal;
-				mat_normal.rotate(*src++, normal);
-				normal.store4a(normals);
-				normals += 4;
+			if (fill_pool)
+			{
+				fill_pool->queueNormals(src, num_vertices, normals, mat_normal, stream);
+			}
+			else
+			{
+				LLVertexStream::rotateNormals(src, num_vertices, normals, mat_normal, stream);
 			}
 
 			if (map_range)
@@ -2057,18 +1889,14 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 			mVObjp->getVolume()->genTangents(f);
 			
 			LLVector4a* src = vf.mTangents;
-			LLVector4a* end = vf.mTangents+num_vertices;
 
-			while (src < end)
+			if (fill_pool)
 			{
-				LLVector4a tangent_out;
-				mat_normal.rotate(*src, tangent_out);
-				tangent_out.normalize3fast();
-				tangent_out.copyComponent<3>(*src);
-				tangent_out.store4a(tangents);
-				
-				src++;
-				tangents += 4;
+				fill_pool->queueTangents(src, num_vertices, tangents, mat_normal, stream);
+			}
+			else
+			{
+				LLVertexStream::rotateTangents(src, num_vertices, tangents, mat_normal, stream);
 			}
 
 			if (map_range)
@@ -2081,10 +1909,7 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		{
 			LLFastTimer t(FTM_FACE_GEOM_WEIGHTS);
 			mVertexBuffer->getWeight4Strider(wght, mGeomIndex, mGeomCount, map_range);
-			for(S32 i=0;i<num_vertices;++i)
-			{
-				*(wght++) = vf.mWeights[i];
-			}
+			LLVertexStream::copy((F32*) vf.mWeights, num_vertices*sizeof(LLVector4a), (F32*) wght.get(), stream);
 			if (map_range)
 			{
 				mVertexBuffer->flush();
@@ -2095,26 +1920,7 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		{
 			LLFastTimer t(FTM_FACE_GEOM_COLOR);
 			mVertexBuffer->getColorStrider(colors, mGeomIndex, mGeomCount, map_range);
-
-			LLVector4a src;
-
-			U32 vec[4];
-			vec[0] = vec[1] = vec[2] = vec[3] = color.mAll;
-		
-			src.loadua((F32*) vec);
-
-			F32* dst = (F32*) colors.get();
-			S32 num_vecs = num_vertices/4;
-			if (num_vertices%4 > 0)
-			{
-				++num_vecs;
-			}
-
-			for (S32 i = 0; i < num_vecs; i++)
-			{	
-				src.store4a(dst);
-				dst += 4;
-			}
+			LLVertexStream::fill(color.mAll, num_vertices, (F32*) colors.get(), stream);
 
 			if (map_range)
 			{
@@ -2129,32 +1935,11 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 			mVertexBuffer->getEmissiveStrider(emissive, mGeomIndex, mGeomCount, map_range);
 
 			U8 glow = (U8) llclamp((S32) (getTextureEntry()->getGlow()*255), 0, 255);
-
-			LLVector4a src;
-
-		
 			U32 glow32 = glow |
 						 (glow << 8) |
 						 (glow << 16) |
 						 (glow << 24);
-
-			U32 vec[4];
-			std::fill_n(vec,4,glow32); // for clang
-		
-			src.loadua((F32*) vec);
-
-			F32* dst = (F32*) emissive.get();
-			S32 num_vecs = num_vertices/4;
-			if (num_vertices%4 > 0)
-			{
-				++num_vecs;
-			}
-
-			for (S32 i = 0; i < num_vecs; i++)
-			{	
-				src.store4a(dst);
-				dst += 4;
-			}
+			LLVertexStream::fill(glow32, num_vertices, (F32*) emissive.get(), stream);
 
 			if (map_range)
 			{
@@ -2178,6 +1963,10 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		mTexExtents[1][1] *= et ;
 	}
 
+	if (stream)
+	{
+		LLVertexStream::fence();
+	}
 
 	return TRUE;
 }
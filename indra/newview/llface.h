@@ -50,6 +50,7 @@ class LLTextureEntry;
 class LLVertexProgram;
 class LLViewerTexture;
 class LLGeometryManager;
+class LLGeometryFillPool;
 
 const F32 MIN_ALPHA_SIZE = 1024.f;
 const F32 MIN_TEX_ANIM_SIZE = 512.f;
@@ -171,11 +172,14 @@ public:
 	//for volumes
 	void updateRebuildFlags();
 	bool canRenderAsMask(); // logic helper
+	// If fill_pool is set, the position, normal and tangent transforms are queued on it
+	// and the vertex buffer must stay mapped until fill_pool->finish() is called.
 	BOOL getGeometryVolume(const LLVolume& volume,
 						const S32 &f,
 						const LLMatrix4a& mat_vert, const LLMatrix4a& mat_normal,
 						const U16 &index_offset,
-						bool force_rebuild = false);
+						bool force_rebuild = false,
+						LLGeometryFillPool* fill_pool = NULL);
 
 	// For avatar
 	U16			 getGeometryAvatar(
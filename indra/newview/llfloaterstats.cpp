@@ -322,6 +322,24 @@ void LLFloaterStats::buildStats()
 	stat_barp->mTickSpacing = 128.f;
 	stat_barp->mLabelSpacing = 256.f;
 
+	stat_barp = net_statviewp->addStat("Throttle", &(LLViewerStats::getInstance()->mThrottleKBitStat), "DebugStatModeThrottle");
+	stat_barp->setUnitLabel(" kbps");
+	stat_barp->mMinBar = 0.f;
+	stat_barp->mMaxBar = 2048.f;
+	stat_barp->mTickSpacing = 256.f;
+	stat_barp->mLabelSpacing = 512.f;
+	stat_barp->mPerSec = FALSE;
+	stat_barp->mDisplayMean = FALSE;
+
+	stat_barp = net_statviewp->addStat("Queueing Delay", &(LLViewerStats::getInstance()->mQueueingDelayStat), "DebugStatModeQueueingDelay");
+	stat_barp->setUnitLabel(" msec");
+	stat_barp->mMinBar = 0.f;
+	stat_barp->mMaxBar = 500.f;
+	stat_barp->mTickSpacing = 50.f;
+	stat_barp->mLabelSpacing = 100.f;
+	stat_barp->mPerSec = FALSE;
+	stat_barp->mDisplayMean = FALSE;
+
 	stat_barp = net_statviewp->addStat("VFS Pending Ops", &(LLViewerStats::getInstance()->mVFSPendingOperations),
 									   "DebugStatModeVFSPendingOps");
 	stat_barp->setUnitLabel(" ");
@@ -0,0 +1,152 @@
+/**
+ * @file llgeometryfillpool.cpp
+ * @brief Transforms volume face vertices into mapped vertex buffers on worker threads.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llgeometryfillpool.h"
+#include "llvertexstream.h"
+
+// Batches with fewer jobs than this are run on the calling thread only; waking the workers would cost more.
+static const U32 MIN_PARALLEL_BATCH = 8;
+
+LLGeometryFillPool::LLGeometryFillPool(U32 num_workers) :
+	mPool(LLBatchPool::getShared(num_workers)),
+	mNumWorkers(num_workers),
+	mJobs(NULL),
+	mJobCount(0),
+	mJobCapacity(0)
+{
+}
+
+LLGeometryFillPool::~LLGeometryFillPool()
+{
+	LLBatchPool::releaseShared();
+	ll_aligned_free_16(mJobs);
+}
+
+LLGeometryFillJob& LLGeometryFillPool::queue(U32 type, const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream)
+{
+	if (mJobCount == mJobCapacity)
+	{
+		mJobCapacity = llmax(mJobCapacity * 2, 256U);
+		LLGeometryFillJob* jobs = (LLGeometryFillJob*)ll_aligned_malloc_16(mJobCapacity * sizeof(LLGeometryFillJob));
+		if (mJobCount)
+		{
+			memcpy(jobs, mJobs, mJobCount * sizeof(LLGeometryFillJob));
+		}
+		ll_aligned_free_16(mJobs);
+		mJobs = jobs;
+	}
+
+	LLGeometryFillJob& job = mJobs[mJobCount++];
+	job.mType = type;
+	job.mSrc = src;
+	job.mDst = dst;
+	job.mCount = count;
+	job.mPadCount = count;
+	job.mTexIndex = 0.f;
+	job.mStream = stream;
+	job.mMatrix = mat;
+	return job;
+}
+
+void LLGeometryFillPool::queuePositions(const LLVector4a* src, U32 count, F32* dst, U32 pad_count, const LLMatrix4a& mat, F32 tex_index, bool stream)
+{
+	LLGeometryFillJob& job = queue(LLGeometryFillJob::POSITION, src, count, dst, mat, stream);
+	job.mPadCount = pad_count;
+	job.mTexIndex = tex_index;
+}
+
+void LLGeometryFillPool::queueNormals(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream)
+{
+	queue(LLGeometryFillJob::NORMAL, src, count, dst, mat, stream);
+}
+
+void LLGeometryFillPool::queueTangents(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream)
+{
+	queue(LLGeometryFillJob::TANGENT, src, count, dst, mat, stream);
+}
+
+void LLGeometryFillPool::deferFlush(LLVertexBuffer* buffer, U32 num_verts, U32 num_indices)
+{
+	DeferredFlush flush;
+	flush.mBuffer = buffer;
+	flush.mNumVerts = num_verts;
+	flush.mNumIndices = num_indices;
+	mDeferred.push_back(flush);
+}
+
+void LLGeometryFillPool::finish()
+{
+	mPool->run(*this, mJobCount, mNumWorkers, MIN_PARALLEL_BATCH);
+	mJobCount = 0;
+
+	// All vertices are written now; hand the buffers to GL.
+	for (std::vector<DeferredFlush>::iterator iter = mDeferred.begin(); iter != mDeferred.end(); ++iter)
+	{
+		if (iter->mNumVerts > 0)
+		{
+			iter->mBuffer->validateRange(0, iter->mNumVerts - 1, iter->mNumIndices, 0);
+		}
+		iter->mBuffer->flush();
+	}
+	mDeferred.clear();
+}
+
+void LLGeometryFillPool::runJob(U32 index)
+{
+	runJob(mJobs[index]);
+}
+
+//static
+void LLGeometryFillPool::runJob(const LLGeometryFillJob& job)
+{
+	switch (job.mType)
+	{
+	case LLGeometryFillJob::POSITION:
+		LLVertexStream::transformPositions(job.mSrc, job.mCount, job.mDst, job.mPadCount, job.mMatrix, job.mTexIndex, job.mStream);
+		break;
+	case LLGeometryFillJob::NORMAL:
+		LLVertexStream::rotateNormals(job.mSrc, job.mCount, job.mDst, job.mMatrix, job.mStream);
+		break;
+	case LLGeometryFillJob::TANGENT:
+		LLVertexStream::rotateTangents(job.mSrc, job.mCount, job.mDst, job.mMatrix, job.mStream);
+		break;
+	}
+
+	if (job.mStream)
+	{
+		// Before finish() flushes the buffer, possibly on another thread.
+		LLVertexStream::fence();
+	}
+}
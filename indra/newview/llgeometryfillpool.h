@@ -0,0 +1,113 @@
+/**
+ * @file llgeometryfillpool.h
+ * @brief Transforms volume face vertices into mapped vertex buffers on worker threads.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLGEOMETRYFILLPOOL_H
+#define LL_LLGEOMETRYFILLPOOL_H
+
+#include <vector>
+
+#include "llbatchpool.h"
+#include "llmatrix4a.h"
+#include "llpointer.h"
+#include "llvertexbuffer.h"
+
+// A vertex transform that LLFace::getGeometryVolume queued instead of doing it in place.
+// Both the source (volume face data) and the destination (mapped vertex buffer memory)
+// must stay valid until LLGeometryFillPool::finish() returns.
+LL_ALIGN_PREFIX(16)
+struct LLGeometryFillJob
+{
+	enum EType
+	{
+		POSITION,		// Affine transform; the w component is replaced by the texture index.
+		NORMAL,			// Rotation.
+		TANGENT			// Rotation and normalization; the w component (binormal sign) is kept.
+	};
+
+	LLMatrix4a mMatrix;
+	const LLVector4a* mSrc;
+	F32* mDst;
+	U32 mCount;			// Number of source vertices.
+	U32 mPadCount;		// POSITION only: number of destination vertices; the rest repeat the last position.
+	F32 mTexIndex;		// POSITION only: the texture index, as the bit pattern of a float.
+	U32 mType;
+	bool mStream;		// Write with non-temporal stores, see LLVertexStream.
+} LL_ALIGN_POSTFIX(16);
+
+// Runs the vertex transforms that LLVolumeGeometryManager queues while rebuilding a spatial group.
+// Everything that needs GL (allocating, mapping and flushing vertex buffers) stays on the main thread;
+// the queued transforms are split between the main thread and RenderGeometryFillThreads workers
+// of the shared LLBatchPool, and the vertex buffers that were filled are flushed once all of them are done.
+class LLGeometryFillPool : public LLBatchPool::Batch
+{
+public:
+	LLGeometryFillPool(U32 num_workers);
+	~LLGeometryFillPool();
+
+	// Main thread. Queue transforms into mapped vertex buffer memory.
+	// The arguments are those of the LLVertexStream function that runs the job.
+	void queuePositions(const LLVector4a* src, U32 count, F32* dst, U32 pad_count, const LLMatrix4a& mat, F32 tex_index, bool stream);
+	void queueNormals(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream);
+	void queueTangents(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream);
+
+	// Main thread. Has finish() validate and flush buffer instead of the caller.
+	void deferFlush(LLVertexBuffer* buffer, U32 num_verts, U32 num_indices);
+
+	// Main thread. Runs all queued transforms and returns when they are done, then flushes the deferred buffers.
+	void finish();
+
+	// Any thread.
+	static void runJob(const LLGeometryFillJob& job);
+
+private:
+	/*virtual*/ void runJob(U32 index);
+
+	struct DeferredFlush
+	{
+		LLPointer<LLVertexBuffer> mBuffer;
+		U32 mNumVerts;
+		U32 mNumIndices;
+	};
+
+	LLGeometryFillJob& queue(U32 type, const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat, bool stream);
+
+	LLBatchPool* mPool;
+	U32 mNumWorkers;
+	std::vector<DeferredFlush> mDeferred;
+
+	// 16 byte aligned.
+	LLGeometryFillJob* mJobs;
+	U32 mJobCount;
+	U32 mJobCapacity;
+};
+
+#endif // LL_LLGEOMETRYFILLPOOL_H
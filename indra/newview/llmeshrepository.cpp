@@ -45,6 +45,9 @@
 #include "llsd.h"
 #include "llsdutil_math.h"
 #include "llsdserialize.h"
+#include "llsys.h"
+#include "lldir.h"
+#include "lldiriterator.h"
 #include "llthread.h"
 #include "llvfile.h"
 #include "llviewercontrol.h"
@@ -86,6 +89,7 @@ extern AIHTTPTimeoutPolicy wholeModelUploadResponder_timeout;
 LLMeshRepository gMeshRepo;
 
 const U32 MAX_MESH_REQUESTS_PER_SECOND = 100;
+const U32 MAX_MESH_DECODE_THREADS = 8;
 
 // Maximum mesh version to support.  Three least significant digits are reserved for the minor version, 
 // with major version changes indicating a format change that is not backwards compatible and should not
@@ -248,17 +252,62 @@ public:
 	/*virtual*/ char const* getName(void) const { return "LLMeshHeaderResponder"; }
 };
 
-class LLMeshLODResponder : public LLHTTPClient::ResponderWithCompleted
+// Base class of the responders that fetch a range of a mesh asset. Lets curl write
+// the range directly into the memory that is handed to the decode worker.
+class LLMeshRangeResponder : public LLHTTPClient::ResponderWithCompleted
+{
+public:
+	U32 mRequestedBytes;
+
+	LLMeshRangeResponder(U32 requested_bytes) : mRequestedBytes(requested_bytes), mBodyBuffer(NULL) { }
+	~LLMeshRangeResponder() { delete [] mBodyBuffer; }
+
+	/*virtual*/ U8* getBodyBuffer(U32& size)
+	{
+		if (!mBodyBuffer)
+		{
+			mBodyBuffer = new U8[mRequestedBytes];
+		}
+		size = mRequestedBytes;
+		return mBodyBuffer;
+	}
+
+protected:
+	// The size of the received body.
+	S32 getBodySize(LLChannelDescriptors const& channels, LLIOPipe::buffer_ptr_t const& buffer) const
+	{
+		return mBodyBufferSize ? (S32)mBodyBufferSize : buffer->countAfter(channels.in(), NULL);
+	}
+
+	// Returns the received body in memory allocated with new [], which the caller takes over.
+	U8* takeBody(LLChannelDescriptors const& channels, LLIOPipe::buffer_ptr_t const& buffer, S32 data_size)
+	{
+		if (mBodyBufferSize)
+		{
+			U8* data = mBodyBuffer;
+			mBodyBuffer = NULL;
+			return data;
+		}
+		AIStateMachine::StateTimer timer("readAfter");
+		U8* data = new U8[data_size];
+		buffer->readAfter(channels.in(), NULL, data, data_size);
+		return data;
+	}
+
+private:
+	U8* mBodyBuffer;
+};
+
+class LLMeshLODResponder : public LLMeshRangeResponder
 {
 public:
 	LLVolumeParams mMeshParams;
 	S32 mLOD;
-	U32 mRequestedBytes;
 	U32 mOffset;
 	bool mProcessed;
 
 	LLMeshLODResponder(const LLVolumeParams& mesh_params, S32 lod, U32 offset, U32 requested_bytes)
-		: mMeshParams(mesh_params), mLOD(lod), mOffset(offset), mRequestedBytes(requested_bytes)
+		: LLMeshRangeResponder(requested_bytes), mMeshParams(mesh_params), mLOD(lod), mOffset(offset)
 	{
 		LLMeshRepoThread::incActiveLODRequests();
 		mProcessed = false;
@@ -286,16 +335,15 @@ public:
 	/*virtual*/ char const* getName(void) const { return "LLMeshLODResponder"; }
 };
 
-class LLMeshSkinInfoResponder : public LLHTTPClient::ResponderWithCompleted
+class LLMeshSkinInfoResponder : public LLMeshRangeResponder
 {
 public:
 	LLUUID mMeshID;
-	U32 mRequestedBytes;
 	U32 mOffset;
 	bool mProcessed;
 
 	LLMeshSkinInfoResponder(const LLUUID& id, U32 offset, U32 size)
-		: mMeshID(id), mRequestedBytes(size), mOffset(offset)
+		: LLMeshRangeResponder(size), mMeshID(id), mOffset(offset)
 	{
 		mProcessed = false;
 	}
@@ -320,16 +368,15 @@ public:
 	/*virtual*/ char const* getName(void) const { return "LLMeshSkinInfoResponder"; }
 };
 
-class LLMeshDecompositionResponder : public LLHTTPClient::ResponderWithCompleted
+class LLMeshDecompositionResponder : public LLMeshRangeResponder
 {
 public:
 	LLUUID mMeshID;
-	U32 mRequestedBytes;
 	U32 mOffset;
 	bool mProcessed;
 
 	LLMeshDecompositionResponder(const LLUUID& id, U32 offset, U32 size)
-		: mMeshID(id), mRequestedBytes(size), mOffset(offset)
+		: LLMeshRangeResponder(size), mMeshID(id), mOffset(offset)
 	{
 		mProcessed = false;
 	}
@@ -354,16 +401,15 @@ public:
 	/*virtual*/ char const* getName(void) const { return "LLMeshDecompositionResponder"; }
 };
 
-class LLMeshPhysicsShapeResponder : public LLHTTPClient::ResponderWithCompleted
+class LLMeshPhysicsShapeResponder : public LLMeshRangeResponder
 {
 public:
 	LLUUID mMeshID;
-	U32 mRequestedBytes;
 	U32 mOffset;
 	bool mProcessed;
 
 	LLMeshPhysicsShapeResponder(const LLUUID& id, U32 offset, U32 size)
-		: mMeshID(id), mRequestedBytes(size), mOffset(offset)
+		: LLMeshRangeResponder(size), mMeshID(id), mOffset(offset)
 	{
 		mProcessed = false;
 	}
@@ -552,16 +598,89 @@ public:
 	/*virtual*/ char const* getName(void) const { return "LLWholeModelUploadResponder"; }
 };
 
+LLMeshRepoThread::DecodeRequest::DecodeRequest(const LLVolumeParams& mesh_params, S32 lod, U8* data, S32 data_size, S32 cache_offset)
+: mType(LOD),
+  mMeshParams(mesh_params),
+  mMeshID(mesh_params.getSculptID()),
+  mLOD(lod),
+  mData(data),
+  mDataSize(data_size),
+  mCacheOffset(cache_offset)
+{
+}
+
+LLMeshRepoThread::DecodeRequest::DecodeRequest(EType type, const LLVolumeParams& mesh_params, S32 lod)
+: mType(type),
+  mMeshParams(mesh_params),
+  mMeshID(mesh_params.getSculptID()),
+  mLOD(lod),
+  mData(NULL),
+  mDataSize(0),
+  mCacheOffset(-1)
+{
+}
+
+LLMeshRepoThread::DecodeRequest::DecodeRequest(EType type, const LLUUID& mesh_id, U8* data, S32 data_size, S32 cache_offset)
+: mType(type),
+  mMeshID(mesh_id),
+  mLOD(0),
+  mData(data),
+  mDataSize(data_size),
+  mCacheOffset(cache_offset)
+{
+}
+
+LLMeshRepoThread::DecodeRequest::~DecodeRequest()
+{
+	delete [] mData;
+}
+
+LLMeshRepoThread::DecodeWorker::DecodeWorker(LLMeshRepoThread* repo, U32 index)
+: LLThread(llformat("mesh decode %d", index)),
+  mRepo(repo)
+{
+}
+
+void LLMeshRepoThread::DecodeWorker::run()
+{
+	LLCondition* signal = mRepo->mDecodeSignal;
+	signal->lock();
+	while (!isQuitting())
+	{
+		if (mRepo->mDecodeQ.empty())
+		{
+			signal->wait();
+			continue;
+		}
+
+		DecodeRequest* request = mRepo->mDecodeQ.front();
+		mRepo->mDecodeQ.pop();
+		signal->unlock();
+
+		mRepo->processDecodeRequest(request);
+		delete request;
+
+		signal->lock();
+	}
+	signal->unlock();
+}
+
 LLMeshRepoThread::LLMeshRepoThread()
-: LLThread("mesh repo") 
+: LLThread("mesh repo"),
+  mDecodedCacheBytes(0),
+  mDecodedCacheMaxBytes(0)
 { 
 	mMutex = new LLMutex();
 	mHeaderMutex = new LLMutex();
 	mSignal = new LLCondition();
+	mDecodeSignal = new LLCondition();
 }
 
 LLMeshRepoThread::~LLMeshRepoThread()
 {
+	stopDecodeWorkers();
+	delete mDecodeSignal;
+	mDecodeSignal = NULL;
 	delete mMutex;
 	mMutex = NULL;
 	delete mHeaderMutex;
@@ -687,6 +806,160 @@ void LLMeshRepoThread::run()
 
 }
 
+void LLMeshRepoThread::startDecodeWorkers(U32 num_workers)
+{
+	for (U32 i = 0; i < num_workers; ++i)
+	{
+		DecodeWorker* worker = new DecodeWorker(this, i);
+		mDecodeWorkers.push_back(worker);
+		worker->start();
+	}
+	llinfos << "Started " << num_workers << " mesh decode thread(s)." << llendl;
+}
+
+void LLMeshRepoThread::stopDecodeWorkers()
+{
+	if (mDecodeWorkers.empty())
+	{
+		return;
+	}
+
+	mDecodeSignal->lock();
+	for (std::vector<DecodeWorker*>::iterator iter = mDecodeWorkers.begin(); iter != mDecodeWorkers.end(); ++iter)
+	{
+		(*iter)->setQuitting();
+	}
+	mDecodeSignal->broadcast();
+	mDecodeSignal->unlock();
+
+	for (std::vector<DecodeWorker*>::iterator iter = mDecodeWorkers.begin(); iter != mDecodeWorkers.end(); ++iter)
+	{
+		while (!(*iter)->isStopped())
+		{
+			apr_sleep(10);
+		}
+		delete *iter;
+	}
+
+	//from here on queueDecode() decodes on the calling thread
+	mDecodeSignal->lock();
+	mDecodeWorkers.clear();
+	while (!mDecodeQ.empty())
+	{
+		delete mDecodeQ.front();
+		mDecodeQ.pop();
+	}
+	mDecodeSignal->unlock();
+}
+
+void LLMeshRepoThread::queueDecode(DecodeRequest* request)
+{ //could be called from any thread
+	mDecodeSignal->lock();
+	if (!mDecodeWorkers.empty())
+	{
+		mDecodeQ.push(request);
+		mDecodeSignal->signal();
+		mDecodeSignal->unlock();
+		return;
+	}
+	mDecodeSignal->unlock();
+
+	processDecodeRequest(request);
+	delete request;
+}
+
+void LLMeshRepoThread::processDecodeRequest(DecodeRequest* request)
+{ //called from a decode worker, or from the queueing thread when there are none
+	bool success = false;
+	switch (request->mType)
+	{
+		case DecodeRequest::LOD:
+			success = lodReceived(request->mMeshParams, request->mLOD, request->mData, request->mDataSize);
+			break;
+		case DecodeRequest::DECODED_LOD:
+			success = decodedLODReceived(request->mMeshParams, request->mLOD);
+			break;
+		case DecodeRequest::SKIN_INFO:
+			success = skinInfoReceived(request->mMeshID, request->mData, request->mDataSize);
+			break;
+		case DecodeRequest::DECOMPOSITION:
+			success = decompositionReceived(request->mMeshID, request->mData, request->mDataSize);
+			break;
+		case DecodeRequest::PHYSICS_SHAPE:
+			success = physicsShapeReceived(request->mMeshID, request->mData, request->mDataSize);
+			break;
+	}
+
+	if (request->mCacheOffset >= 0)
+	{
+		if (success)
+		{
+			//good fetch from sim, write to VFS for caching
+			LLVFile file(gVFS, request->mMeshID, LLAssetType::AT_MESH, LLVFile::WRITE);
+
+			S32 offset = request->mCacheOffset;
+			S32 size = request->mDataSize;
+
+			if (file.getSize() >= offset+size)
+			{
+				file.seek(offset);
+				file.write(request->mData, size);
+				LLMeshRepository::sCacheBytesWritten += size;
+
+				//the cache holds a good copy of the block again
+				LLMutexLock lock(mMutex);
+				mBadCacheMeshes.erase(request->mMeshID);
+			}
+		}
+		return;
+	}
+
+	if (success || LLApp::isQuitting())
+	{
+		return;
+	}
+
+	if (request->mType == DecodeRequest::DECODED_LOD)
+	{	//stale or damaged decoded LOD, drop it and load the asset instead
+		LLFile::remove(getDecodedLODFilename(request->mMeshParams, request->mLOD));
+		loadMeshLOD(request->mMeshParams, request->mLOD);
+		return;
+	}
+
+	//the cached block is corrupt; stop trusting the cache for this mesh and fetch it from the sim
+	{
+		LLMutexLock lock(mMutex);
+		mBadCacheMeshes.insert(request->mMeshID);
+	}
+
+	switch (request->mType)
+	{
+		case DecodeRequest::LOD:
+			loadMeshLOD(request->mMeshParams, request->mLOD);
+			break;
+		case DecodeRequest::SKIN_INFO:
+		{
+			LLMutexLock lock(gMeshRepo.mMeshMutex);
+			gMeshRepo.mPendingSkinRequests.push(request->mMeshID);
+			break;
+		}
+		case DecodeRequest::DECOMPOSITION:
+		{
+			LLMutexLock lock(gMeshRepo.mMeshMutex);
+			gMeshRepo.mPendingDecompositionRequests.push(request->mMeshID);
+			break;
+		}
+		case DecodeRequest::PHYSICS_SHAPE:
+		{
+			LLMutexLock lock(gMeshRepo.mMeshMutex);
+			gMeshRepo.mPendingPhysicsShapeRequests.push(request->mMeshID);
+			break;
+		}
+		default:	//DECODED_LOD was handled above
+			break;
+	}
+}
+
 void LLMeshRepoThread::loadMeshSkinInfo(const LLUUID& mesh_id)
 { //protected by mSignal, no locking needed here
 	mSkinRequests.insert(mesh_id);
@@ -790,8 +1063,16 @@ bool LLMeshRepoThread::getMeshHeaderInfo(const LLUUID& mesh_id, const char* bloc
 	return true;
 }
 
-bool LLMeshRepoThread::loadInfoFromVFS(const LLUUID& mesh_id, MeshHeaderInfo& info, boost::function<bool(const LLUUID&, U8*, S32)> fn)
+U8* LLMeshRepoThread::readInfoFromVFS(const LLUUID& mesh_id, const MeshHeaderInfo& info)
 {
+	{
+		LLMutexLock lock(mMutex);
+		if (mBadCacheMeshes.find(mesh_id) != mBadCacheMeshes.end())
+		{ //a block of this mesh failed to parse before, refetch it
+			return NULL;
+		}
+	}
+
 	//check VFS for mesh skin info
 	LLVFile file(gVFS, mesh_id, LLAssetType::AT_MESH);
 	if (file.getSize() >= info.mOffset + info.mSize)
@@ -810,17 +1091,13 @@ bool LLMeshRepoThread::loadInfoFromVFS(const LLUUID& mesh_id, MeshHeaderInfo& in
 		}
 
 		if (!zero)
-		{	//attempt to parse
-			if (fn(mesh_id, buffer, info.mSize))
-			{
-				delete[] buffer;
-				return true;
-			}
+		{	//parsed by a decode worker
+			return buffer;
 		}
 
 		delete[] buffer;
 	}
-	return false;
+	return NULL;
 }
 
 bool LLMeshRepoThread::fetchMeshSkinInfo(const LLUUID& mesh_id)
@@ -834,8 +1111,11 @@ bool LLMeshRepoThread::fetchMeshSkinInfo(const LLUUID& mesh_id)
 	if (info.mHeaderSize > 0 && info.mVersion <= MAX_MESH_VERSION && info.mOffset >= 0 && info.mSize > 0)
 	{
 		//check VFS for mesh skin info
-		if (loadInfoFromVFS(mesh_id, info, boost::bind(&LLMeshRepoThread::skinInfoReceived, this, _1, _2, _3 )))
+		if (U8* buffer = readInfoFromVFS(mesh_id, info))
+		{
+			queueDecode(new DecodeRequest(DecodeRequest::SKIN_INFO, mesh_id, buffer, info.mSize, -1));
 			return true;
+		}
 
 		//reading from VFS failed for whatever reason, fetch from sim
 		AIHTTPHeaders headers("Accept", "application/octet-stream");
@@ -864,8 +1144,11 @@ bool LLMeshRepoThread::fetchMeshDecomposition(const LLUUID& mesh_id)
 
 	if (info.mHeaderSize > 0 && info.mVersion <= MAX_MESH_VERSION && info.mOffset >= 0 && info.mSize > 0)
 	{
-		if (loadInfoFromVFS(mesh_id, info, boost::bind(&LLMeshRepoThread::decompositionReceived, this, _1, _2, _3 )))
+		if (U8* buffer = readInfoFromVFS(mesh_id, info))
+		{
+			queueDecode(new DecodeRequest(DecodeRequest::DECOMPOSITION, mesh_id, buffer, info.mSize, -1));
 			return true;
+		}
 
 		//reading from VFS failed for whatever reason, fetch from sim
 		AIHTTPHeaders headers("Accept", "application/octet-stream");
@@ -896,8 +1179,11 @@ bool LLMeshRepoThread::fetchMeshPhysicsShape(const LLUUID& mesh_id)
 	{
 		if (info.mVersion <= MAX_MESH_VERSION && info.mOffset >= 0 && info.mSize > 0)
 		{
-			if (loadInfoFromVFS(mesh_id, info, boost::bind(&LLMeshRepoThread::physicsShapeReceived, this, _1, _2, _3 )))
+			if (U8* buffer = readInfoFromVFS(mesh_id, info))
+			{
+				queueDecode(new DecodeRequest(DecodeRequest::PHYSICS_SHAPE, mesh_id, buffer, info.mSize, -1));
 				return true;
+			}
 
 			//reading from VFS failed for whatever reason, fetch from sim
 			AIHTTPHeaders headers("Accept", "application/octet-stream");
@@ -1007,8 +1293,17 @@ bool LLMeshRepoThread::fetchMeshLOD(const LLVolumeParams& mesh_params, S32 lod,
 	{
 		if(info.mVersion <= MAX_MESH_VERSION && info.mOffset >= 0 && info.mSize > 0)
 		{
-			if (loadInfoFromVFS(mesh_id, info, boost::bind(&LLMeshRepoThread::lodReceived, this, mesh_params, lod, _2, _3 )))
+			if (!mDecodedCacheDir.empty() && LLFile::isfile(getDecodedLODFilename(mesh_params, lod)))
+			{	//already decoded in an earlier session
+				queueDecode(new DecodeRequest(DecodeRequest::DECODED_LOD, mesh_params, lod));
+				return true;
+			}
+
+			if (U8* buffer = readInfoFromVFS(mesh_id, info))
+			{
+				queueDecode(new DecodeRequest(mesh_params, lod, buffer, info.mSize, -1));
 				return true;
+			}
 
 			//reading from VFS failed for whatever reason, fetch from sim
 			AIHTTPHeaders headers("Accept", "application/octet-stream");
@@ -1113,6 +1408,11 @@ bool LLMeshRepoThread::lodReceived(const LLVolumeParams& mesh_params, S32 lod, U
 		AIStateMachine::StateTimer timer("getNumFaces");
 		if (volume->getNumFaces() > 0)
 		{
+			if (!mDecodedCacheDir.empty())
+			{
+				saveDecodedLOD(mesh_params, lod, volume);
+			}
+
 			AIStateMachine::StateTimer timer("LoadedMesh");
 			LoadedMesh mesh(volume, mesh_params, lod);
 			{
@@ -1127,6 +1427,71 @@ bool LLMeshRepoThread::lodReceived(const LLVolumeParams& mesh_params, S32 lod, U
 	return false;
 }
 
+bool LLMeshRepoThread::decodedLODReceived(const LLVolumeParams& mesh_params, S32 lod)
+{
+	LLPointer<LLVolume> volume = new LLVolume(mesh_params, LLVolumeLODGroup::getVolumeScaleFromDetail(lod));
+
+	llifstream file(getDecodedLODFilename(mesh_params, lod), std::ios::in | std::ios::binary);
+	if (!file.is_open() || !volume->unpackDecodedFaces(file) || volume->getNumFaces() <= 0)
+	{
+		return false;
+	}
+
+	LoadedMesh mesh(volume, mesh_params, lod);
+	LLMutexLock lock(mMutex);
+	mLoadedQ.push(mesh);
+	return true;
+}
+
+std::string LLMeshRepoThread::getDecodedLODFilename(const LLVolumeParams& mesh_params, S32 lod) const
+{
+	//mirrored and inverted meshes are decoded differently
+	U8 flags = mesh_params.getSculptType() & (LL_SCULPT_FLAG_MIRROR | LL_SCULPT_FLAG_INVERT);
+	return mDecodedCacheDir + gDirUtilp->getDirDelimiter() +
+		llformat("%s_%d_%d.mesh", mesh_params.getSculptID().asString().c_str(), lod, flags);
+}
+
+void LLMeshRepoThread::saveDecodedLOD(const LLVolumeParams& mesh_params, S32 lod, const LLVolume* volume)
+{
+	static LLAtomicU32 sTempCount;
+
+	{
+		LLMutexLock lock(mMutex);
+		if (mDecodedCacheBytes >= mDecodedCacheMaxBytes)
+		{	//full until the next session clears it
+			return;
+		}
+	}
+
+	//write to a temporary file first, so other decode threads never see a partial file
+	std::string filename = getDecodedLODFilename(mesh_params, lod);
+	std::string temp_filename = filename + llformat(".%u", (U32)(sTempCount++));
+	U64 size = 0;
+	{
+		llofstream file(temp_filename, std::ios::out | std::ios::binary);
+		if (!file.is_open())
+		{
+			return;
+		}
+		if (!volume->packDecodedFaces(file) || file.fail())
+		{
+			file.close();
+			LLFile::remove(temp_filename);
+			return;
+		}
+		size = file.tellp();
+	}
+
+	if (LLFile::rename(temp_filename, filename) != 0)
+	{
+		LLFile::remove(temp_filename);
+		return;
+	}
+
+	LLMutexLock lock(mMutex);
+	mDecodedCacheBytes += size;
+}
+
 bool LLMeshRepoThread::skinInfoReceived(const LLUUID& mesh_id, U8* data, S32 data_size)
 {
 	LLSD skin;
@@ -1149,6 +1514,7 @@ bool LLMeshRepoThread::skinInfoReceived(const LLUUID& mesh_id, U8* data, S32 dat
 		info.mMeshID = mesh_id;
 
 		//llinfos<<"info pelvis offset"<<info.mPelvisOffset<<llendl;
+		LLMutexLock lock(mMutex);
 		mSkinInfoQ.push(info);
 	}
 
@@ -1175,6 +1541,7 @@ bool LLMeshRepoThread::decompositionReceived(const LLUUID& mesh_id, U8* data, S3
 	{
 		LLModel::Decomposition* d = new LLModel::Decomposition(decomp);
 		d->mMeshID = mesh_id;
+		LLMutexLock lock(mMutex);
 		mDecompositionQ.push(d);
 	}
 
@@ -1234,6 +1601,7 @@ bool LLMeshRepoThread::physicsShapeReceived(const LLUUID& mesh_id, U8* data, S32
 		}
 	}
 
+	LLMutexLock lock(mMutex);
 	mDecompositionQ.push(d);
 	return true;
 }
@@ -1660,6 +2028,7 @@ void LLMeshRepoThread::notifyLoadedMeshes()
 		gMeshRepo.notifyMeshUnavailable(req.mMeshParams, req.mLOD);
 	}
 
+	//the decode workers push to these under mMutex, which our caller holds
 	while (!mSkinInfoQ.empty())
 	{
 		gMeshRepo.notifySkinInfoReceived(mSkinInfoQ.front());
@@ -1760,7 +2129,7 @@ void LLMeshLODResponder::completedRaw(LLChannelDescriptors const& channels,
 		return;
 	}
 
-	S32 data_size = buffer->countAfter(channels.in(), NULL);
+	S32 data_size = getBodySize(channels, buffer);
 
 	if (mStatus < 200 || mStatus >= 400)
 	{
@@ -1790,30 +2159,11 @@ void LLMeshLODResponder::completedRaw(LLChannelDescriptors const& channels,
 
 	if (data_size > 0)
 	{
-		AIStateMachine::StateTimer timer("readAfter");
-		data = new U8[data_size];
-		buffer->readAfter(channels.in(), NULL, data, data_size);
-	}
-
-	if (gMeshRepo.mThread->lodReceived(mMeshParams, mLOD, data, data_size))
-	{
-		AIStateMachine::StateTimer timer("FileOpen");
-		//good fetch from sim, write to VFS for caching
-		LLVFile file(gVFS, mMeshParams.getSculptID(), LLAssetType::AT_MESH, LLVFile::WRITE);
-
-		S32 offset = mOffset;
-		S32 size = mRequestedBytes;
-
-		if (file.getSize() >= offset+size)
-		{
-			AIStateMachine::StateTimer timer("WriteData");
-			file.seek(offset);
-			file.write(data, size);
-			LLMeshRepository::sCacheBytesWritten += size;
-		}
+		data = takeBody(channels, buffer, data_size);
 	}
 
-	delete [] data;
+	//parsed, and written to the VFS for caching, by a decode worker
+	gMeshRepo.mThread->queueDecode(new LLMeshRepoThread::DecodeRequest(mMeshParams, mLOD, data, data_size, mOffset));
 }
 
 void LLMeshSkinInfoResponder::completedRaw(LLChannelDescriptors const& channels,
@@ -1827,7 +2177,7 @@ void LLMeshSkinInfoResponder::completedRaw(LLChannelDescriptors const& channels,
 		return;
 	}
 
-	S32 data_size = buffer->countAfter(channels.in(), NULL);
+	S32 data_size = getBodySize(channels, buffer);
 
 	if (mStatus < 200 || mStatus >= 400)
 	{
@@ -1856,27 +2206,11 @@ void LLMeshSkinInfoResponder::completedRaw(LLChannelDescriptors const& channels,
 
 	if (data_size > 0)
 	{
-		data = new U8[data_size];
-		buffer->readAfter(channels.in(), NULL, data, data_size);
-	}
-
-	if (gMeshRepo.mThread->skinInfoReceived(mMeshID, data, data_size))
-	{
-		//good fetch from sim, write to VFS for caching
-		LLVFile file(gVFS, mMeshID, LLAssetType::AT_MESH, LLVFile::WRITE);
-
-		S32 offset = mOffset;
-		S32 size = mRequestedBytes;
-
-		if (file.getSize() >= offset+size)
-		{
-			LLMeshRepository::sCacheBytesWritten += size;
-			file.seek(offset);
-			file.write(data, size);
-		}
+		data = takeBody(channels, buffer, data_size);
 	}
 
-	delete [] data;
+	//parsed, and written to the VFS for caching, by a decode worker
+	gMeshRepo.mThread->queueDecode(new LLMeshRepoThread::DecodeRequest(LLMeshRepoThread::DecodeRequest::SKIN_INFO, mMeshID, data, data_size, mOffset));
 }
 
 void LLMeshDecompositionResponder::completedRaw(LLChannelDescriptors const& channels,
@@ -1889,7 +2223,7 @@ void LLMeshDecompositionResponder::completedRaw(LLChannelDescriptors const& chan
 		return;
 	}
 
-	S32 data_size = buffer->countAfter(channels.in(), NULL);
+	S32 data_size = getBodySize(channels, buffer);
 
 	if (mStatus < 200 || mStatus >= 400)
 	{
@@ -1918,27 +2252,11 @@ void LLMeshDecompositionResponder::completedRaw(LLChannelDescriptors const& chan
 
 	if (data_size > 0)
 	{
-		data = new U8[data_size];
-		buffer->readAfter(channels.in(), NULL, data, data_size);
-	}
-
-	if (gMeshRepo.mThread->decompositionReceived(mMeshID, data, data_size))
-	{
-		//good fetch from sim, write to VFS for caching
-		LLVFile file(gVFS, mMeshID, LLAssetType::AT_MESH, LLVFile::WRITE);
-
-		S32 offset = mOffset;
-		S32 size = mRequestedBytes;
-
-		if (file.getSize() >= offset+size)
-		{
-			LLMeshRepository::sCacheBytesWritten += size;
-			file.seek(offset);
-			file.write(data, size);
-		}
+		data = takeBody(channels, buffer, data_size);
 	}
 
-	delete [] data;
+	//parsed, and written to the VFS for caching, by a decode worker
+	gMeshRepo.mThread->queueDecode(new LLMeshRepoThread::DecodeRequest(LLMeshRepoThread::DecodeRequest::DECOMPOSITION, mMeshID, data, data_size, mOffset));
 }
 
 void LLMeshPhysicsShapeResponder::completedRaw(LLChannelDescriptors const& channels,
@@ -1952,7 +2270,7 @@ void LLMeshPhysicsShapeResponder::completedRaw(LLChannelDescriptors const& chann
 		return;
 	}
 
-	S32 data_size = buffer->countAfter(channels.in(), NULL);
+	S32 data_size = getBodySize(channels, buffer);
 
 	if (mStatus < 200 || mStatus >= 400)
 	{
@@ -1981,27 +2299,11 @@ void LLMeshPhysicsShapeResponder::completedRaw(LLChannelDescriptors const& chann
 
 	if (data_size > 0)
 	{
-		data = new U8[data_size];
-		buffer->readAfter(channels.in(), NULL, data, data_size);
-	}
-
-	if (gMeshRepo.mThread->physicsShapeReceived(mMeshID, data, data_size))
-	{
-		//good fetch from sim, write to VFS for caching
-		LLVFile file(gVFS, mMeshID, LLAssetType::AT_MESH, LLVFile::WRITE);
-
-		S32 offset = mOffset;
-		S32 size = mRequestedBytes;
-
-		if (file.getSize() >= offset+size)
-		{
-			LLMeshRepository::sCacheBytesWritten += size;
-			file.seek(offset);
-			file.write(data, size);
-		}
+		data = takeBody(channels, buffer, data_size);
 	}
 
-	delete [] data;
+	//parsed, and written to the VFS for caching, by a decode worker
+	gMeshRepo.mThread->queueDecode(new LLMeshRepoThread::DecodeRequest(LLMeshRepoThread::DecodeRequest::PHYSICS_SHAPE, mMeshID, data, data_size, mOffset));
 }
 
 void LLMeshHeaderResponder::completedRaw(LLChannelDescriptors const& channels,
@@ -2125,6 +2427,10 @@ void LLMeshHeaderResponder::completedRaw(LLChannelDescriptors const& channels,
 					}
 					bytes_remaining -= llmin(bytes_remaining, bytes_to_write);
 				}
+
+				//the blocks are all zero now, which readInfoFromVFS doesn't trust either
+				LLMutexLock lock(gMeshRepo.mThread->mMutex);
+				gMeshRepo.mThread->mBadCacheMeshes.erase(mesh_id);
 			}
 		}
 	}
@@ -2159,7 +2465,58 @@ void LLMeshRepository::init()
 	
 	
 	mThread = new LLMeshRepoThread();
+	if (gSavedSettings.getBOOL("MeshDecodedCache"))
+	{
+		mThread->mDecodedCacheDir = initDecodedCache(mThread->mDecodedCacheBytes);
+		mThread->mDecodedCacheMaxBytes = (U64) gSavedSettings.getU32("MeshDecodedCacheSize") * 1024 * 1024;
+	}
 	mThread->start();
+
+	U32 decode_threads = gSavedSettings.getU32("MeshDecodeThreads");
+	if (!decode_threads)
+	{	//the shared LLBatchPool already has a worker for every core but the main thread's,
+		//so only take half as many again
+		decode_threads = llmax(LLCPUInfo::getDefaultWorkerCount() / 2, 1U);
+	}
+	mThread->startDecodeWorkers(llmin(decode_threads, MAX_MESH_DECODE_THREADS));
+}
+
+//static
+std::string LLMeshRepository::getDecodedCacheDir()
+{
+	return gDirUtilp->getExpandedFilename(LL_PATH_CACHE, "meshcache");
+}
+
+//static
+std::string LLMeshRepository::initDecodedCache(U64& total_size)
+{
+	std::string dir = getDecodedCacheDir();
+	LLFile::mkdir(dir);
+
+	//decoded LODs are a lot bigger than the assets; rather than keeping track of when
+	//each one was last used, start over when they outgrew their budget (saveDecodedLOD
+	//stops adding to the cache once it is full)
+	U64 max_size = (U64) gSavedSettings.getU32("MeshDecodedCacheSize") * 1024 * 1024;
+	total_size = 0;
+	std::string filename;
+	LLDirIterator iter(dir, "*.mesh");
+	while (iter.next(filename))
+	{
+		llstat stat_data;
+		if (!LLFile::stat(dir + gDirUtilp->getDirDelimiter() + filename, &stat_data))
+		{
+			total_size += stat_data.st_size;
+		}
+	}
+
+	if (total_size > max_size)
+	{
+		llinfos << "Decoded mesh cache is " << total_size / (1024 * 1024) << " MB, clearing it." << llendl;
+		gDirUtilp->deleteFilesInDir(dir, "*");
+		total_size = 0;
+	}
+
+	return dir;
 }
 
 void LLMeshRepository::shutdown()
@@ -2172,6 +2529,7 @@ void LLMeshRepository::shutdown()
 	{
 		apr_sleep(10);
 	}
+	mThread->stopDecodeWorkers();
 	delete mThread;
 	mThread = NULL;
 
@@ -326,6 +326,63 @@ public:
 	typedef std::map<LLVolumeParams, std::vector<S32> > pending_lod_map;
 	pending_lod_map mPendingLOD;
 
+	// A received mesh asset block, waiting to be parsed by one of the decode workers.
+	class DecodeRequest
+	{
+	public:
+		enum EType
+		{
+			LOD,
+			DECODED_LOD,
+			SKIN_INFO,
+			DECOMPOSITION,
+			PHYSICS_SHAPE
+		};
+
+		// Both take ownership of data. cache_offset is where the data goes in the VFS once
+		// it parsed successfully, or -1 if the data was read from the VFS.
+		DecodeRequest(const LLVolumeParams& mesh_params, S32 lod, U8* data, S32 data_size, S32 cache_offset);
+		DecodeRequest(EType type, const LLUUID& mesh_id, U8* data, S32 data_size, S32 cache_offset);
+		// A LOD that is read from mDecodedCacheDir.
+		DecodeRequest(EType type, const LLVolumeParams& mesh_params, S32 lod);
+		~DecodeRequest();
+
+		EType mType;
+		LLVolumeParams mMeshParams;
+		LLUUID mMeshID;
+		S32 mLOD;
+		U8* mData;
+		S32 mDataSize;
+		S32 mCacheOffset;
+	};
+
+	// Parses DecodeRequest's, so that neither the repo thread (which only schedules
+	// requests) nor the thread that receives the data spends its time unpacking meshes.
+	class DecodeWorker : public LLThread
+	{
+	public:
+		DecodeWorker(LLMeshRepoThread* repo, U32 index);
+
+	private:
+		/*virtual*/ void run(void);
+
+		LLMeshRepoThread* mRepo;
+	};
+
+	//queue of received blocks that still need to be parsed, protected by mDecodeSignal
+	std::queue<DecodeRequest*> mDecodeQ;
+	LLCondition* mDecodeSignal;
+	std::vector<DecodeWorker*> mDecodeWorkers;
+
+	//meshes whose cached blocks failed to parse and should be fetched from the sim, protected by mMutex
+	std::set<LLUUID> mBadCacheMeshes;
+
+	//directory of decoded LODs (see LLVolume::packDecodedFaces), empty if disabled; set before start()
+	std::string mDecodedCacheDir;
+	//bytes in mDecodedCacheDir and MeshDecodedCacheSize in bytes, protected by mMutex
+	U64 mDecodedCacheBytes;
+	U64 mDecodedCacheMaxBytes;
+
 	static std::string constructUrl(LLUUID mesh_id);
 
 	LLMeshRepoThread();
@@ -333,19 +390,29 @@ public:
 
 	virtual void run();
 
+	void startDecodeWorkers(U32 num_workers);
+	void stopDecodeWorkers();
+	// Takes ownership of request.
+	void queueDecode(DecodeRequest* request);
+	void processDecodeRequest(DecodeRequest* request);
+
 	void lockAndLoadMeshLOD(const LLVolumeParams& mesh_params, S32 lod);
 	void loadMeshLOD(const LLVolumeParams& mesh_params, S32 lod);
 	bool fetchMeshHeader(const LLVolumeParams& mesh_params, U32& count);
 	bool fetchMeshLOD(const LLVolumeParams& mesh_params, S32 lod, U32& count);
 	bool headerReceived(const LLVolumeParams& mesh_params, U8* data, S32 data_size);
 	bool lodReceived(const LLVolumeParams& mesh_params, S32 lod, U8* data, S32 data_size);
+	bool decodedLODReceived(const LLVolumeParams& mesh_params, S32 lod);
+	std::string getDecodedLODFilename(const LLVolumeParams& mesh_params, S32 lod) const;
+	void saveDecodedLOD(const LLVolumeParams& mesh_params, S32 lod, const LLVolume* volume);
 	bool skinInfoReceived(const LLUUID& mesh_id, U8* data, S32 data_size);
 	bool decompositionReceived(const LLUUID& mesh_id, U8* data, S32 data_size);
 	bool physicsShapeReceived(const LLUUID& mesh_id, U8* data, S32 data_size);
 	LLSD& getMeshHeader(const LLUUID& mesh_id);
 
 	bool getMeshHeaderInfo(const LLUUID& mesh_id, const char* block_name, MeshHeaderInfo& info);
-	bool loadInfoFromVFS(const LLUUID& mesh_id, MeshHeaderInfo& info, boost::function<bool(const LLUUID&, U8*, S32)> fn);
+	// Returns a new[]'d copy of the block described by info, or NULL if it isn't (validly) cached.
+	U8* readInfoFromVFS(const LLUUID& mesh_id, const MeshHeaderInfo& info);
 
 	void notifyLoadedMeshes();
 	S32 getActualMeshLOD(const LLVolumeParams& mesh_params, S32 lod);
@@ -495,6 +562,12 @@ public:
 	void init();
 	void shutdown();
 
+	// Directory of LODs saved by LLMeshRepoThread::saveDecodedLOD().
+	static std::string getDecodedCacheDir();
+	// Creates that directory, clearing it if it outgrew MeshDecodedCacheSize. total_size is
+	// set to the size of the files that are left in it.
+	static std::string initDecodedCache(U64& total_size);
+
 	//mesh management functions
 	S32 loadMesh(LLVOVolume* volume, const LLVolumeParams& mesh_params, S32 detail = 0, S32 last_lod = -1);
 	
@@ -0,0 +1,365 @@
+/**
+ * @file llobjectupdatedecoder.cpp
+ * @brief Decodes full object updates on worker threads.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llobjectupdatedecoder.h"
+
+#include "lldatapacker.h"
+#include "llpartdata.h"
+#include "llquantize.h"
+#include "llvolumemessage.h"
+#include "v4coloru.h"
+
+// Batches smaller than this are decoded on the calling thread only; waking the workers would cost more.
+static const U32 MIN_PARALLEL_BATCH = 4;
+
+// Zeros after the copy of an update that decodeUpdate() reads, enough for the largest read past its end:
+// the fixed size particle system block.
+static const S32 DECODE_PADDING = 128;
+
+LLObjectUpdateDecoder::LLObjectUpdateDecoder(U32 num_workers) :
+	mPool(LLBatchPool::getShared(num_workers)),
+	mNumWorkers(num_workers),
+	mQuantizedMotion(NULL),
+	mMotion(NULL),
+	mMotionCapacity(0)
+{
+}
+
+LLObjectUpdateDecoder::~LLObjectUpdateDecoder()
+{
+	LLBatchPool::releaseShared();
+
+	ll_aligned_free_16(mQuantizedMotion);
+	ll_aligned_free_16(mMotion);
+}
+
+LLStagedObjectUpdate* LLObjectUpdateDecoder::stage(U32 count)
+{
+	if (mUpdates.size() < count)
+	{
+		mUpdates.resize(count);
+	}
+	return mUpdates.empty() ? NULL : &mUpdates[0];
+}
+
+void LLObjectUpdateDecoder::decode(U32 count)
+{
+	llassert(count <= mUpdates.size());
+	mPool->run(*this, count, mNumWorkers, MIN_PARALLEL_BATCH);
+}
+
+void LLObjectUpdateDecoder::runJob(U32 index)
+{
+	decodeUpdate(mUpdates[index]);
+}
+
+//static
+void LLObjectUpdateDecoder::decodeUpdate(LLStagedObjectUpdate& update)
+{
+	update.mFieldsDecoded = false;
+	update.mVolumeDecoded = false;
+	update.mMotionDecoded = false;
+	if (!update.mBuffer || update.mSize <= 0 || update.mSize > MAX_OBJECT_UPDATE_SIZE)
+	{
+		return;
+	}
+
+	// Decode a zero padded copy: LLDataPackerBinaryBuffer reads a field before it notices that
+	// the buffer is too short, and unpackString() looks for the terminating zero. Decoding stops
+	// at the first field that doesn't fit, and the main thread handles the update as before.
+	// The offsets are the same as in the original buffer.
+	U8 data[MAX_OBJECT_UPDATE_SIZE + DECODE_PADDING];
+	memcpy(data, update.mBuffer, update.mSize);
+	memset(data + update.mSize, 0, DECODE_PADDING);
+	LLDataPackerBinaryBuffer dp(data, update.mSize);
+
+	// Skip what LLViewerObjectList::processObjectUpdate reads of a full update, and the State
+	// that LLViewerObject::processUpdateMessage reads before the rest.
+	LLUUID id;
+	U32 local_id;
+	LLPCode pcode;
+	U8 state;
+	if (!dp.unpackUUID(id, "ID") ||
+		!dp.unpackU32(local_id, "LocalID") ||
+		!dp.unpackU8(pcode, "PCode") ||
+		pcode != LL_PCODE_VOLUME ||
+		!dp.unpackU8(state, "State"))
+	{
+		return;
+	}
+
+	// What LLViewerObject::processUpdateMessage reads next.
+	update.mFieldsOffset = dp.getCurrentSize();
+	if (!unpackFullUpdate(dp, update.mFields) || dp.getCurrentSize() > update.mSize)
+	{
+		return;
+	}
+	update.mFieldsEnd = dp.getCurrentSize();
+	update.mFieldsDecoded = true;
+
+	// What LLVOVolume::processUpdateMessage reads next.
+	update.mVolumeOffset = dp.getCurrentSize();
+	update.mVolumeParams = LLVolumeParams();
+	update.mVolumeParamsValid = LLVolumeMessage::unpackVolumeParams(&update.mVolumeParams, dp);
+	if (dp.getCurrentSize() > update.mSize)
+	{
+		return;
+	}
+	update.mTEResult = LLPrimitive::parseTEMessage(dp, update.mTEContents);
+	update.mTEEnd = dp.getCurrentSize();
+	update.mVolumeDecoded = true;
+}
+
+LLFullObjectUpdate::LLFullObjectUpdate() :
+	mCRC(0),
+	mMaterial(0),
+	mClickAction(0),
+	mFlags(0),
+	mParentID(0),
+	mSoundGain(0.f),
+	mSoundFlags(0),
+	mSoundRadius(0.f)
+{
+}
+
+//static
+bool LLObjectUpdateDecoder::unpackFullUpdate(LLDataPackerBinaryBuffer& dp, LLFullObjectUpdate& fields)
+{
+	fields = LLFullObjectUpdate();
+
+	if (!dp.unpackU32(fields.mCRC, "CRC") ||
+		!dp.unpackU8(fields.mMaterial, "Material") ||
+		!dp.unpackU8(fields.mClickAction, "ClickAction") ||
+		!dp.unpackVector3(fields.mScale, "Scale") ||
+		!dp.unpackVector3(fields.mPos, "Pos") ||
+		!dp.unpackVector3(fields.mRot, "Rot") ||
+		!dp.unpackU32(fields.mFlags, "SpecialCode") ||
+		!dp.unpackUUID(fields.mOwnerID, "Owner"))
+	{
+		return false;
+	}
+	const U32 flags = fields.mFlags;
+
+	if ((flags & 0x80) && !dp.unpackVector3(fields.mAngularVelocity, "Omega"))
+	{
+		return false;
+	}
+	if ((flags & 0x20) && !dp.unpackU32(fields.mParentID, "ParentID"))
+	{
+		return false;
+	}
+
+	// No binary field is longer than what is left of the data.
+	const S32 remaining = llmax(dp.getBufferSize() - dp.getCurrentSize(), 1);
+	if (flags & 0x2)
+	{
+		fields.mScratchPad.resize(1);
+		if (!dp.unpackU8(fields.mScratchPad[0], "TreeData"))
+		{
+			return false;
+		}
+	}
+	else if (flags & 0x1)
+	{
+		U32 size;
+		S32 sp_size;
+		fields.mScratchPad.resize(remaining);
+		if (!dp.unpackU32(size, "ScratchPadSize") ||
+			!dp.unpackBinaryData(&fields.mScratchPad[0], sp_size, "PartData"))
+		{
+			return false;
+		}
+		fields.mScratchPad.resize(sp_size);
+	}
+
+	if (flags & 0x4)
+	{
+		if (!dp.unpackString(fields.mText, "Text") ||
+			!dp.unpackBinaryDataFixed(fields.mTextColor.mV, 4, "Color"))
+		{
+			return false;
+		}
+	}
+	if ((flags & 0x200) && !dp.unpackString(fields.mMediaURL, "MediaURL"))
+	{
+		return false;
+	}
+	if (flags & 0x8)
+	{
+		// Kept as it is, for LLViewerPartSourceScript::unpackPSS. This reads a fixed size block
+		// without checking that it fits.
+		const S32 start = dp.getCurrentSize();
+		LLPartSysData part_sys_data;
+		part_sys_data.unpackLegacy(dp);
+		if (dp.getCurrentSize() > dp.getBufferSize())
+		{
+			return false;
+		}
+		fields.mParticleSystem.assign(dp.getBuffer() + start, dp.getBuffer() + dp.getCurrentSize());
+	}
+
+	U8 num_parameters;
+	if (!dp.unpackU8(num_parameters, "num_params"))
+	{
+		return false;
+	}
+	fields.mExtraParameters.resize(num_parameters);
+	for (U8 param = 0; param < num_parameters; ++param)
+	{
+		std::pair<U16, std::vector<U8> >& parameter = fields.mExtraParameters[param];
+		S32 param_size;
+		parameter.second.resize(remaining);
+		if (!dp.unpackU16(parameter.first, "param_type") ||
+			!dp.unpackBinaryData(&parameter.second[0], param_size, "param_data"))
+		{
+			return false;
+		}
+		parameter.second.resize(param_size);
+	}
+
+	if (flags & 0x10)
+	{
+		if (!dp.unpackUUID(fields.mSoundID, "SoundUUID") ||
+			!dp.unpackF32(fields.mSoundGain, "SoundGain") ||
+			!dp.unpackU8(fields.mSoundFlags, "SoundFlags") ||
+			!dp.unpackF32(fields.mSoundRadius, "SoundRadius"))
+		{
+			return false;
+		}
+	}
+	if ((flags & 0x100) && !dp.unpackString(fields.mNameValues, "NV"))
+	{
+		return false;
+	}
+	return true;
+}
+
+// Does what U16_to_F32 does, for four values at a time. The ranges are those of
+// LLViewerObject::processUpdateMessage for terse updates: velocity, acceleration,
+// rotation and angular velocity. Both quantized and motion hold four vectors per update.
+static void dequantize_motion(const U16* quantized, LLVector4a* motion, U32 count)
+{
+	static const F32 ranges[4] = { 128.f, 64.f, 1.f, 64.f };
+
+	LLVector4a one_over_u16max;
+	one_over_u16max.splat(OOU16MAX);
+	LLVector4a lower[4], delta[4], max_error[4];
+	for (U32 j = 0; j < 4; ++j)
+	{
+		lower[j].splat(-ranges[j]);
+		delta[j].splat(2.f * ranges[j]);
+		max_error[j].setMul(delta[j], one_over_u16max);
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	for (U32 i = 0; i < count; ++i)
+	{
+		for (U32 j = 0; j < 4; ++j)
+		{
+			__m128i ival = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)quantized), zero);
+			LLVector4a val(_mm_cvtepi32_ps(ival));
+			// Same order of operations as U16_to_F32, so that the results are identical.
+			val.mul(one_over_u16max);
+			val.mul(delta[j]);
+			val.add(lower[j]);
+
+			// make sure that zero's come through as zero
+			LLVector4a abs_val;
+			abs_val.setAbs(val);
+			motion->setSelectWithMask(abs_val.lessThan(max_error[j]), LLVector4a::getZero(), val);
+
+			quantized += 4;
+			++motion;
+		}
+	}
+}
+
+void LLObjectUpdateDecoder::decodeTerse(U32 count)
+{
+	llassert(count <= mUpdates.size());
+	if (count > mMotionCapacity)
+	{
+		ll_aligned_free_16(mQuantizedMotion);
+		ll_aligned_free_16(mMotion);
+		mMotionCapacity = count;
+		mQuantizedMotion = (U16*)ll_aligned_malloc_16(mMotionCapacity * 16 * sizeof(U16));
+		mMotion = (LLVector4a*)ll_aligned_malloc_16(mMotionCapacity * 4 * sizeof(LLVector4a));
+	}
+
+	// Gather the quantized values of all updates, reading them like LLViewerObject::processUpdateMessage does.
+	for (U32 i = 0; i < count; ++i)
+	{
+		LLStagedObjectUpdate& update = mUpdates[i];
+		update.mFieldsDecoded = false;
+		update.mVolumeDecoded = false;
+		update.mMotionDecoded = false;
+		update.mMotion = mMotion + i * 4;
+
+		// Unused components are left at zero.
+		U16* quantized = mQuantizedMotion + i * 16;
+		memset(quantized, 0, 16 * sizeof(U16));
+
+		// LocalID, State and the agent flag, maybe the foot plane, and the position come first.
+		const S32 header_size = sizeof(U32) + 2 * sizeof(U8);
+		if (!update.mBuffer || update.mSize < header_size)
+		{
+			continue;
+		}
+		S32 motion_offset = header_size + (update.mBuffer[header_size - 1] ? 4 * sizeof(F32) : 0) + 3 * sizeof(F32);
+		if (motion_offset + TERSE_MOTION_SIZE > update.mSize)
+		{
+			continue;
+		}
+
+		LLDataPackerBinaryBuffer dp(const_cast<U8*>(update.mBuffer), update.mSize);
+		dp.setCurrentSize(motion_offset);
+		dp.unpackU16(quantized[VX], "VelX");
+		dp.unpackU16(quantized[VY], "VelY");
+		dp.unpackU16(quantized[VZ], "VelZ");
+		dp.unpackU16(quantized[4 + VX], "AccX");
+		dp.unpackU16(quantized[4 + VY], "AccY");
+		dp.unpackU16(quantized[4 + VZ], "AccZ");
+		dp.unpackU16(quantized[8 + VX], "ThetaX");
+		dp.unpackU16(quantized[8 + VY], "ThetaY");
+		dp.unpackU16(quantized[8 + VZ], "ThetaZ");
+		dp.unpackU16(quantized[8 + VS], "ThetaS");
+		dp.unpackU16(quantized[12 + VX], "AccX");
+		dp.unpackU16(quantized[12 + VY], "AccY");
+		dp.unpackU16(quantized[12 + VZ], "AccZ");
+		update.mMotionOffset = motion_offset;
+		update.mMotionDecoded = true;
+	}
+
+	dequantize_motion(mQuantizedMotion, mMotion, count);
+}
@@ -0,0 +1,158 @@
+/**
+ * @file llobjectupdatedecoder.h
+ * @brief Decodes full object updates on worker threads.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLOBJECTUPDATEDECODER_H
+#define LL_LLOBJECTUPDATEDECODER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llbatchpool.h"
+#include "llprimitive.h"
+#include "lluuid.h"
+#include "llvector4a.h"
+#include "llvolume.h"
+#include "v3math.h"
+#include "v4coloru.h"
+
+class LLDataPackerBinaryBuffer;
+
+// Largest ObjectUpdateCompressed data block.
+const S32 MAX_OBJECT_UPDATE_SIZE = 2048;
+
+// Size of the quantized velocity, acceleration, rotation and angular velocity of a terse update.
+const S32 TERSE_MOTION_SIZE = 13 * sizeof(U16);
+
+// The fields of a full update that LLViewerObject::processUpdateMessage applies, from the CRC up to
+// the name values; see LLObjectUpdateDecoder::unpackFullUpdate.
+struct LLFullObjectUpdate
+{
+	LLFullObjectUpdate();
+
+	U32 mCRC;
+	U8 mMaterial;
+	U8 mClickAction;
+	LLVector3 mScale;
+	LLVector3 mPos;
+	LLVector3 mRot;
+	U32 mFlags;						// SpecialCode; says which of the rest are present.
+	LLUUID mOwnerID;
+	LLVector3 mAngularVelocity;		// 0x80
+	U32 mParentID;					// 0x20, otherwise 0.
+	std::vector<U8> mScratchPad;	// Tree data (0x2) or scratch pad (0x1).
+	std::string mText;				// 0x4
+	LLColor4U mTextColor;
+	std::string mMediaURL;			// 0x200
+	std::vector<U8> mParticleSystem;	// Legacy particle system block (0x8).
+	std::vector<std::pair<U16, std::vector<U8> > > mExtraParameters;
+	LLUUID mSoundID;				// 0x10
+	F32 mSoundGain;
+	U8 mSoundFlags;
+	F32 mSoundRadius;
+	std::string mNameValues;		// 0x100
+};
+
+// A full object update (OUT_FULL_COMPRESSED, or a cache hit for OUT_FULL_CACHED) or a terse one
+// (OUT_TERSE_IMPROVED), and the parts of it that LLObjectUpdateDecoder decodes without touching
+// the object it is for. LLViewerObjectList fills in the input, LLViewerObject::processUpdateMessage
+// and LLVOVolume::processUpdateMessage apply the output.
+struct LLStagedObjectUpdate
+{
+	LLStagedObjectUpdate() : mBuffer(NULL), mSize(0), mCachedDP(NULL), mFieldsDecoded(false), mVolumeDecoded(false), mMotionDecoded(false), mMotion(NULL) { }
+
+	// Input.
+	const U8* mBuffer;				// The update data: mData, or the buffer of a cache entry.
+	S32 mSize;
+	U8 mData[MAX_OBJECT_UPDATE_SIZE];
+	LLDataPacker* mCachedDP;		// Cache hits only: the data packer of the cache entry.
+	U32 mCacheID;					// Cached updates only.
+	U32 mCRC;
+	U8 mCacheMissType;
+
+	// Output.
+	bool mFieldsDecoded;			// Set when mFields is valid; only for LL_PCODE_VOLUME.
+	S32 mFieldsOffset;				// Where mFields starts in the buffer (after the State).
+	S32 mFieldsEnd;
+	LLFullObjectUpdate mFields;
+	bool mVolumeDecoded;			// Set when the rest is valid.
+	S32 mVolumeOffset;				// Where the volume parameters start in the buffer.
+	S32 mTEEnd;						// Where the texture entries end in the buffer.
+	bool mVolumeParamsValid;
+	LLVolumeParams mVolumeParams;
+	S32 mTEResult;					// LLPrimitive::parseTEMessage result.
+	LLTEContents mTEContents;
+
+	// Output of terse updates.
+	bool mMotionDecoded;			// Set when the rest is valid.
+	S32 mMotionOffset;				// Where the quantized velocity starts in the buffer.
+	const LLVector4a* mMotion;		// Velocity, acceleration, rotation (x, y, z, s) and angular velocity.
+};
+
+// Decodes batches of staged object updates. The batch is split between the calling thread and
+// ObjectUpdateDecodeThreads workers of the shared LLBatchPool, and decode() returns when all of it is done.
+class LLObjectUpdateDecoder : public LLBatchPool::Batch
+{
+public:
+	LLObjectUpdateDecoder(U32 num_workers);
+	~LLObjectUpdateDecoder();
+
+	// Main thread. Returns room for count updates, to be filled in and then passed to decode().
+	// The updates stay valid until the next call.
+	LLStagedObjectUpdate* stage(U32 count);
+	void decode(U32 count);
+	// Main thread. Like decode(), for terse updates: dequantizes the motion of all of them at once.
+	void decodeTerse(U32 count);
+
+	// Any thread. Leaves mFieldsDecoded and mVolumeDecoded unset if the update is truncated or
+	// otherwise can't be decoded.
+	static void decodeUpdate(LLStagedObjectUpdate& update);
+
+	// Any thread. Reads the fields of a full update that follow the State, as both decodeUpdate() and
+	// LLViewerObject::processUpdateMessage do. Returns false at the first field that doesn't fit.
+	static bool unpackFullUpdate(LLDataPackerBinaryBuffer& dp, LLFullObjectUpdate& fields);
+
+private:
+	// Decodes one staged update.
+	/*virtual*/ void runJob(U32 index);
+
+	LLBatchPool* mPool;
+	U32 mNumWorkers;
+	std::vector<LLStagedObjectUpdate> mUpdates;
+
+	// Terse updates; four vectors of four values per update, 16 byte aligned.
+	U16* mQuantizedMotion;
+	LLVector4a* mMotion;
+	U32 mMotionCapacity;			// In updates.
+};
+
+#endif // LL_LLOBJECTUPDATEDECODER_H
@@ -0,0 +1,342 @@
+/**
+ * @file llocclusiondepthbuffer.cpp
+ * @brief Low resolution depth buffer of the terrain for occlusion culling on the CPU.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llocclusiondepthbuffer.h"
+
+#include "llappviewer.h"
+#include "llcamera.h"
+#include "llfasttimer.h"
+#include "llsurface.h"
+#include "llsurfacepatch.h"
+#include "llviewerregion.h"
+#include "llworld.h"
+
+static const S32 DEPTH_BUFFER_WIDTH = 256;
+static const S32 DEPTH_BUFFER_HEIGHT = 128;
+
+// The buffer covers a slightly wider field of view than the camera, so that boxes at the edge
+// of the screen can still be tested; boxes that reach outside of the buffer are never rejected.
+static const F32 DEPTH_BUFFER_GUARD_BAND = 1.1f;
+
+LLOcclusionDepthBuffer::LLOcclusionDepthBuffer()
+: mDepth(DEPTH_BUFFER_WIDTH * DEPTH_BUFFER_HEIGHT, 0.f),
+  mNear(1.f),
+  mFar(1.f),
+  mPixelScaleX(1.f),
+  mPixelScaleY(1.f),
+  mFrame(0),
+  mValid(false)
+{
+}
+
+bool LLOcclusionDepthBuffer::isCurrent(const LLCamera& camera) const
+{
+	return mValid && mFrame == gFrameCount &&
+		   camera.getOrigin() == mOrigin && camera.getAtAxis() == mAt;
+}
+
+static LLFastTimer::DeclareTimer FTM_OCCLUSION_DEPTH_BUFFER("Occlusion Depth Buffer");
+
+void LLOcclusionDepthBuffer::update(const LLCamera& camera)
+{
+	LLFastTimer t(FTM_OCCLUSION_DEPTH_BUFFER);
+
+	mFrame = gFrameCount;
+	mValid = false;
+	std::fill(mDepth.begin(), mDepth.end(), 0.f);
+
+	mOrigin = camera.getOrigin();
+	mAt = camera.getAtAxis();
+
+	//the lowered terrain only hides what the real terrain hides if the camera is above the real terrain
+	LLWorld* world = LLWorld::getInstance();
+	if (mOrigin.mV[VZ] <= world->resolveLandHeightAgent(mOrigin))
+	{
+		return;
+	}
+
+	mRight = -camera.getLeftAxis();
+	mUp = camera.getUpAxis();
+	mNear = camera.getNear();
+	mFar = camera.getFar();
+
+	F32 tan_half_view = tanf(camera.getView() * 0.5f) * DEPTH_BUFFER_GUARD_BAND;
+	mPixelScaleX = 0.5f * DEPTH_BUFFER_WIDTH / (tan_half_view * camera.getAspect());
+	mPixelScaleY = 0.5f * DEPTH_BUFFER_HEIGHT / tan_half_view;
+
+	for (LLWorld::region_list_t::const_iterator iter = world->getRegionList().begin();
+		 iter != world->getRegionList().end(); ++iter)
+	{
+		LLViewerRegion* region = *iter;
+		const LLSurface& land = region->getLand();
+		const S32 patches = land.getPatchesPerEdge();
+		const S32 corners = patches + 1;
+		const F32 patch_width = land.getGridsPerPatchEdge() * land.getMetersPerGrid();
+		const LLVector3 region_origin = region->getOriginAgent();
+
+		//each corner takes the lowest height of the patches around it, so the quad of a patch
+		//never rises above the lowest point of that patch
+		mCornerZ.assign(corners * corners, F32_MAX);
+		for (S32 j = 0; j < patches; j++)
+		{
+			for (S32 i = 0; i < patches; i++)
+			{
+				const LLSurfacePatch* patch = land.resolvePatchRegion((i + 0.5f) * patch_width, (j + 0.5f) * patch_width);
+				if (!patch || !patch->getHasReceivedData())
+				{
+					continue;
+				}
+
+				F32 z = patch->getMinZ();
+				F32* corner = &mCornerZ[i + j * corners];
+				corner[0] = llmin(corner[0], z);
+				corner[1] = llmin(corner[1], z);
+				corner[corners] = llmin(corner[corners], z);
+				corner[corners + 1] = llmin(corner[corners + 1], z);
+			}
+		}
+
+		for (S32 j = 0; j < patches; j++)
+		{
+			for (S32 i = 0; i < patches; i++)
+			{
+				const LLSurfacePatch* patch = land.resolvePatchRegion((i + 0.5f) * patch_width, (j + 0.5f) * patch_width);
+				if (!patch || !patch->getHasReceivedData())
+				{
+					continue;
+				}
+
+				const F32* corner = &mCornerZ[i + j * corners];
+				F32 x0 = region_origin.mV[VX] + i * patch_width;
+				F32 y0 = region_origin.mV[VY] + j * patch_width;
+				LLVector3 v00(x0, y0, region_origin.mV[VZ] + corner[0]);
+				LLVector3 v10(x0 + patch_width, y0, region_origin.mV[VZ] + corner[1]);
+				LLVector3 v01(x0, y0 + patch_width, region_origin.mV[VZ] + corner[corners]);
+				LLVector3 v11(x0 + patch_width, y0 + patch_width, region_origin.mV[VZ] + corner[corners + 1]);
+
+				addTriangle(v00, v10, v11);
+				addTriangle(v00, v11, v01);
+			}
+		}
+	}
+
+	mValid = true;
+}
+
+bool LLOcclusionDepthBuffer::isOccluded(const LLVector4a& center, const LLVector4a& size) const
+{
+	F32 min_x = F32_MAX;
+	F32 min_y = F32_MAX;
+	F32 max_x = -F32_MAX;
+	F32 max_y = -F32_MAX;
+	F32 max_z = 0.f;
+
+	for (U32 i = 0; i < 8; i++)
+	{
+		LLVector3 corner(center[0] + (i & 1 ? size[0] : -size[0]),
+						 center[1] + (i & 2 ? size[1] : -size[1]),
+						 center[2] + (i & 4 ? size[2] : -size[2]));
+		LLVector3 eye;
+		toEye(corner, eye);
+		if (eye.mV[VZ] < mNear)
+		{ //reaches behind the near plane
+			return false;
+		}
+
+		Vertex v;
+		toScreen(eye, v);
+		min_x = llmin(min_x, v.mX);
+		min_y = llmin(min_y, v.mY);
+		max_x = llmax(max_x, v.mX);
+		max_y = llmax(max_y, v.mY);
+		max_z = llmax(max_z, v.mZ);
+	}
+
+	if (min_x < 0.f || min_y < 0.f || max_x >= DEPTH_BUFFER_WIDTH || max_y >= DEPTH_BUFFER_HEIGHT)
+	{ //reaches outside of the buffer
+		return false;
+	}
+
+	S32 x0 = (S32) min_x;
+	S32 x1 = (S32) max_x;
+	S32 y1 = (S32) max_y;
+	for (S32 y = (S32) min_y; y <= y1; y++)
+	{
+		const F32* row = &mDepth[y * DEPTH_BUFFER_WIDTH];
+		for (S32 x = x0; x <= x1; x++)
+		{
+			if (row[x] <= max_z)
+			{ //no terrain in front of the nearest point of the box here
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void LLOcclusionDepthBuffer::toEye(const LLVector3& agent, LLVector3& eye) const
+{
+	LLVector3 offset = agent - mOrigin;
+	eye.set(offset * mRight, offset * mUp, offset * mAt);
+}
+
+void LLOcclusionDepthBuffer::toScreen(const LLVector3& eye, Vertex& screen) const
+{
+	screen.mZ = 1.f / eye.mV[VZ];
+	screen.mX = eye.mV[VX] * screen.mZ * mPixelScaleX + 0.5f * DEPTH_BUFFER_WIDTH;
+	screen.mY = eye.mV[VY] * screen.mZ * mPixelScaleY + 0.5f * DEPTH_BUFFER_HEIGHT;
+}
+
+void LLOcclusionDepthBuffer::addTriangle(const LLVector3& a, const LLVector3& b, const LLVector3& c)
+{
+	//terrain is seen from above, and the triangles that face away from the camera are behind others
+	LLVector3 normal = (b - a) % (c - a);
+	if (normal.mV[VZ] < 0.f)
+	{
+		normal = -normal;
+	}
+	if (normal * (mOrigin - a) <= 0.f)
+	{
+		return;
+	}
+
+	LLVector3 in[3];
+	toEye(a, in[0]);
+	toEye(b, in[1]);
+	toEye(c, in[2]);
+
+	if (in[0].mV[VZ] > mFar && in[1].mV[VZ] > mFar && in[2].mV[VZ] > mFar)
+	{ //nothing beyond the far clip plane is drawn
+		return;
+	}
+
+	//clip against the near plane, which leaves at most four vertices
+	LLVector3 out[4];
+	U32 count = 0;
+	for (U32 i = 0; i < 3; i++)
+	{
+		const LLVector3& cur = in[i];
+		const LLVector3& next = in[(i + 1) % 3];
+		bool cur_in = cur.mV[VZ] >= mNear;
+		bool next_in = next.mV[VZ] >= mNear;
+
+		if (cur_in)
+		{
+			out[count++] = cur;
+		}
+		if (cur_in != next_in)
+		{
+			F32 t = (mNear - cur.mV[VZ]) / (next.mV[VZ] - cur.mV[VZ]);
+			out[count++] = cur + (next - cur) * t;
+		}
+	}
+
+	if (count < 3)
+	{
+		return;
+	}
+
+	Vertex v[4];
+	for (U32 i = 0; i < count; i++)
+	{
+		toScreen(out[i], v[i]);
+	}
+
+	rasterize(v[0], v[1], v[2]);
+	if (count == 4)
+	{
+		rasterize(v[0], v[2], v[3]);
+	}
+}
+
+void LLOcclusionDepthBuffer::rasterize(const Vertex& v0, const Vertex& in1, const Vertex& in2)
+{
+	F32 area = (in1.mX - v0.mX) * (in2.mY - v0.mY) - (in2.mX - v0.mX) * (in1.mY - v0.mY);
+	if (fabsf(area) < 2.f)
+	{ //too small to cover a whole pixel
+		return;
+	}
+
+	const Vertex& v1 = area > 0.f ? in1 : in2;
+	const Vertex& v2 = area > 0.f ? in2 : in1;
+	area = fabsf(area);
+
+	F32 min_x = llclamp(llmin(v0.mX, llmin(v1.mX, v2.mX)), 0.f, (F32) DEPTH_BUFFER_WIDTH);
+	F32 max_x = llclamp(llmax(v0.mX, llmax(v1.mX, v2.mX)), 0.f, (F32) DEPTH_BUFFER_WIDTH);
+	F32 min_y = llclamp(llmin(v0.mY, llmin(v1.mY, v2.mY)), 0.f, (F32) DEPTH_BUFFER_HEIGHT);
+	F32 max_y = llclamp(llmax(v0.mY, llmax(v1.mY, v2.mY)), 0.f, (F32) DEPTH_BUFFER_HEIGHT);
+
+	S32 x0 = (S32) min_x;
+	S32 x1 = llmin((S32) max_x, DEPTH_BUFFER_WIDTH - 1);
+	S32 y0 = (S32) min_y;
+	S32 y1 = llmin((S32) max_y, DEPTH_BUFFER_HEIGHT - 1);
+
+	//inverse depth is linear in screen space; the farthest depth within a pixel is at one of its corners
+	F32 dzdx = ((v1.mZ - v0.mZ) * (v2.mY - v0.mY) - (v2.mZ - v0.mZ) * (v1.mY - v0.mY)) / area;
+	F32 dzdy = ((v2.mZ - v0.mZ) * (v1.mX - v0.mX) - (v1.mZ - v0.mZ) * (v2.mX - v0.mX)) / area;
+	F32 z_bias = 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+
+	//edge functions, positive inside; offset so that they are only positive at the center of a
+	//pixel that is entirely inside the edge
+	const Vertex* verts[3] = { &v0, &v1, &v2 };
+	F32 edge_a[3];
+	F32 edge_b[3];
+	F32 edge_c[3];
+	for (U32 i = 0; i < 3; i++)
+	{
+		const Vertex& a = *verts[i];
+		const Vertex& b = *verts[(i + 1) % 3];
+		edge_a[i] = a.mY - b.mY;
+		edge_b[i] = b.mX - a.mX;
+		edge_c[i] = -(edge_a[i] * a.mX + edge_b[i] * a.mY) - 0.5f * (fabsf(edge_a[i]) + fabsf(edge_b[i]));
+	}
+
+	for (S32 y = y0; y <= y1; y++)
+	{
+		F32 cy = y + 0.5f;
+		F32* row = &mDepth[y * DEPTH_BUFFER_WIDTH];
+		for (S32 x = x0; x <= x1; x++)
+		{
+			F32 cx = x + 0.5f;
+			if (edge_a[0] * cx + edge_b[0] * cy + edge_c[0] >= 0.f &&
+				edge_a[1] * cx + edge_b[1] * cy + edge_c[1] >= 0.f &&
+				edge_a[2] * cx + edge_b[2] * cy + edge_c[2] >= 0.f)
+			{
+				F32 z = v0.mZ + dzdx * (cx - v0.mX) + dzdy * (cy - v0.mY) - z_bias;
+				row[x] = llmax(row[x], z);
+			}
+		}
+	}
+}
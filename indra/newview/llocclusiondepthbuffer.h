@@ -0,0 +1,98 @@
+/**
+ * @file llocclusiondepthbuffer.h
+ * @brief Low resolution depth buffer of the terrain for occlusion culling on the CPU.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLOCCLUSIONDEPTHBUFFER_H
+#define LL_LLOCCLUSIONDEPTHBUFFER_H
+
+#include <vector>
+
+#include "llvector4a.h"
+#include "v3math.h"
+
+class LLCamera;
+
+// The terrain of the regions around the camera, rasterized on the CPU into a small depth buffer,
+// so that spatial groups hidden behind hills can be rejected before an occlusion query is issued
+// for them (see LLSpatialGroup::checkOcclusion and RenderOcclusionDepthBuffer).
+//
+// The test is conservative: the terrain is approximated by one quad per surface patch at the
+// lowest height of the patch, which never rises above the real terrain, only pixels that a
+// triangle covers completely are written, and each pixel keeps the farthest depth of the triangle
+// within it. A box is only reported hidden if every pixel that it touches is nearer than all of it.
+class LLOcclusionDepthBuffer
+{
+public:
+	LLOcclusionDepthBuffer();
+
+	// Main thread. Rasterizes the terrain as seen from camera. The buffer is only valid for the
+	// frame that it was last updated on, and only for a camera at the same place looking the same way.
+	void update(const LLCamera& camera);
+	bool isCurrent(const LLCamera& camera) const;
+
+	// True if the box (center and half size in agent space) is certainly hidden behind the terrain.
+	bool isOccluded(const LLVector4a& center, const LLVector4a& size) const;
+
+private:
+	// A vertex in pixel coordinates; mZ is the inverse of its eye space depth.
+	struct Vertex
+	{
+		F32 mX;
+		F32 mY;
+		F32 mZ;
+	};
+
+	void toEye(const LLVector3& agent, LLVector3& eye) const;
+	void toScreen(const LLVector3& eye, Vertex& screen) const;
+
+	// Clips the triangle (in agent space) against the near plane and rasterizes what is left.
+	void addTriangle(const LLVector3& a, const LLVector3& b, const LLVector3& c);
+	void rasterize(const Vertex& v0, const Vertex& v1, const Vertex& v2);
+
+	// Inverse depth of the nearest terrain that covers each pixel completely, 0 where there is none.
+	std::vector<F32> mDepth;
+	// Lowest height at the corners of the patches of one region.
+	std::vector<F32> mCornerZ;
+
+	LLVector3 mOrigin;
+	LLVector3 mRight;
+	LLVector3 mUp;
+	LLVector3 mAt;
+	F32 mNear;
+	F32 mFar;
+	F32 mPixelScaleX;
+	F32 mPixelScaleY;
+
+	U32 mFrame;
+	bool mValid;
+};
+
+#endif // LL_LLOCCLUSIONDEPTHBUFFER_H
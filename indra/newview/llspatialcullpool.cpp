@@ -0,0 +1,98 @@
+/**
+ * @file llspatialcullpool.cpp
+ * @brief Frustum culls spatial partitions on worker threads.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llspatialcullpool.h"
+
+// Batches with fewer tasks than this are recorded on the calling thread only; waking the workers would cost more.
+static const U32 MIN_PARALLEL_BATCH = 4;
+
+LLSpatialCullPool::LLSpatialCullPool(U32 num_workers) :
+	mPool(LLBatchPool::getShared(num_workers)),
+	mNumWorkers(num_workers),
+	mTaskCount(0)
+{
+}
+
+LLSpatialCullPool::~LLSpatialCullPool()
+{
+	LLBatchPool::releaseShared();
+
+	for (std::vector<LLSpatialCullTask*>::iterator iter = mTasks.begin(); iter != mTasks.end(); ++iter)
+	{
+		delete *iter;
+	}
+	mTasks.clear();
+}
+
+void LLSpatialCullPool::queue(LLSpatialPartition* part, const LLCamera& camera)
+{
+	// Bounds must be up to date before any thread walks the octree.
+	part->rebound();
+
+	if (mTaskCount == mTasks.size())
+	{
+		mTasks.push_back(new LLSpatialCullTask);
+	}
+
+	LLSpatialCullTask* task = mTasks[mTaskCount++];
+	task->mCamera = camera;
+	task->mPartition = part;
+}
+
+void LLSpatialCullPool::cull()
+{
+	U32 count = mTaskCount;
+	if (!count)
+	{
+		return;
+	}
+
+	mPool->run(*this, count, mNumWorkers, MIN_PARALLEL_BATCH);
+
+	// Merge in queue order, so the cull result doesn't depend on which thread recorded what.
+	LLSpatialCullTask* const* tasks = &mTasks[0];
+	for (U32 i = 0; i < count; ++i)
+	{
+		tasks[i]->mPartition->cullRecorded(tasks[i]->mCamera, tasks[i]->mRecords);
+		tasks[i]->mPartition = NULL;
+	}
+	mTaskCount = 0;
+}
+
+void LLSpatialCullPool::runJob(U32 index)
+{
+	LLSpatialCullTask* task = mTasks[index];
+	task->mPartition->recordCull(task->mCamera, task->mRecords);
+}
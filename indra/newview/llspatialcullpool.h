@@ -0,0 +1,93 @@
+/**
+ * @file llspatialcullpool.h
+ * @brief Frustum culls spatial partitions on worker threads.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLSPATIALCULLPOOL_H
+#define LL_LLSPATIALCULLPOOL_H
+
+#include <vector>
+
+#include "llbatchpool.h"
+#include "llcamera.h"
+#include "llspatialpartition.h"
+
+// The frustum culling of one spatial partition for one camera.
+LL_ALIGN_PREFIX(16)
+class LLSpatialCullTask
+{
+public:
+	void* operator new(size_t size)
+	{
+		return ll_aligned_malloc_16(size);
+	}
+
+	void operator delete(void* ptr)
+	{
+		ll_aligned_free_16(ptr);
+	}
+
+	LLSpatialCullTask() : mPartition(NULL) { }
+
+	LLCamera mCamera;		// A copy; LLPipeline::updateCull changes the user clip plane of its camera between regions.
+	LLSpatialPartition* mPartition;
+	std::vector<LLCullRecord> mRecords;
+} LL_ALIGN_POSTFIX(16);
+
+// Runs the frustum checks of LLPipeline::updateCull. The spatial partitions of all regions are queued,
+// their octrees are walked by the main thread and RenderCullThreads workers of the shared LLBatchPool
+// at once, each partition into its own records, and then the main thread finishes culling them (occlusion culling, which
+// needs GL, and adding the visible groups to the cull result) in the order they were queued.
+// That gives the same cull result as culling the partitions one after the other.
+class LLSpatialCullPool : public LLBatchPool::Batch
+{
+public:
+	LLSpatialCullPool(U32 num_workers);
+	~LLSpatialCullPool();
+
+	// Main thread. Rebounds part and queues it to be culled for camera as it is now.
+	void queue(LLSpatialPartition* part, const LLCamera& camera);
+
+	// Main thread. Culls all queued partitions and returns when done.
+	void cull();
+
+private:
+	// Records the frustum checks of one task.
+	/*virtual*/ void runJob(U32 index);
+
+	LLBatchPool* mPool;
+	U32 mNumWorkers;
+
+	// Kept between frames, along with their records.
+	std::vector<LLSpatialCullTask*> mTasks;
+	U32 mTaskCount;
+};
+
+#endif // LL_LLSPATIALCULLPOOL_H
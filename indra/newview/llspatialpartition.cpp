@@ -50,6 +50,7 @@
 #include "llviewercontrol.h"
 #include "llviewerregion.h"
 #include "llcamera.h"
+#include "llocclusiondepthbuffer.h"
 #include "pipeline.h"
 #include "llmeshrepository.h"
 #include "llrender.h"
@@ -78,6 +79,13 @@ extern bool gShiftFrame;
 
 static U32 sZombieGroups = 0;
 U32 LLSpatialGroup::sNodeCount = 0;
+U32 LLSpatialGroup::sQueriesIssued = 0;
+U32 LLSpatialGroup::sQueriesRead = 0;
+U32 LLSpatialGroup::sQueriesFenced = 0;
+U32 LLSpatialGroup::sQueriesLate = 0;
+U32 LLSpatialGroup::sQueriesStale = 0;
+U32 LLSpatialGroup::sDepthTests = 0;
+U32 LLSpatialGroup::sDepthRejects = 0;
 
 #define LL_TRACK_PENDING_OCCLUSION_QUERIES 0
 
@@ -788,6 +796,7 @@ void LLSpatialGroup::shift(const LLVector4a &offset)
 	mObjectBounds[0].add(offset);
 	mObjectExtents[0].add(offset);
 	mObjectExtents[1].add(offset);
+	mSpatialPartition->mSnapshot.update(this);
 
 	if (!mSpatialPartition->mRenderByGroup && 
 		mSpatialPartition->mPartitionType != LLViewerRegion::PARTITION_TREE &&
@@ -1052,7 +1061,8 @@ LLSpatialGroup::LLSpatialGroup(OctreeNode* node, LLSpatialPartition* part) :
 	mDistance(0.f),
 	mDepth(0.f),
 	mLastUpdateDistance(-1.f), 
-	mLastUpdateTime(gFrameTimeSeconds)
+	mLastUpdateTime(gFrameTimeSeconds),
+	mSnapshotIndex(U32_MAX)
 {
 	ll_assert_aligned(this,16);
 	
@@ -1082,6 +1092,7 @@ LLSpatialGroup::LLSpatialGroup(OctreeNode* node, LLSpatialPartition* part) :
 	{
 		mOcclusionQuery[i] = 0;
 		mOcclusionIssued[i] = 0;
+		mOcclusionChecked[i] = 0;
 		mOcclusionState[i] = parent ? SG_STATE_INHERIT_MASK & parent->mOcclusionState[i] : 0;
 		mVisible[i] = 0;
 	}
@@ -1257,6 +1268,7 @@ void LLSpatialGroup::handleRemoval(const TreeNode* node, LLDrawable* drawable)
 void LLSpatialGroup::handleDestruction(const TreeNode* node)
 {
 	setState(DEAD);
+	mSpatialPartition->mSnapshot.handleDestruction(this);
 	
 	{OctreeGuard guard(mOctreeNode);
 	for (element_iter i = getDataBegin(); i != getDataEnd(); ++i)
@@ -1295,6 +1307,7 @@ void LLSpatialGroup::handleStateChange(const TreeNode* node)
 		mOctreeNode = (OctreeNode*) node;
 	}
 	unbound();
+	mSpatialPartition->mSnapshot.setDirty();
 }
 
 void LLSpatialGroup::handleChildAddition(const OctreeNode* parent, OctreeNode* child) 
@@ -1309,6 +1322,7 @@ void LLSpatialGroup::handleChildAddition(const OctreeNode* parent, OctreeNode* c
 	}
 
 	unbound();
+	mSpatialPartition->mSnapshot.setDirty(this);
 
 	assert_states_valid(this);
 }
@@ -1316,6 +1330,7 @@ void LLSpatialGroup::handleChildAddition(const OctreeNode* parent, OctreeNode* c
 void LLSpatialGroup::handleChildRemoval(const OctreeNode* parent, const OctreeNode* child)
 {
 	unbound();
+	mSpatialPartition->mSnapshot.setDirty(this);
 }
 
 void LLSpatialGroup::destroyGL(bool keep_occlusion) 
@@ -1421,6 +1436,8 @@ BOOL LLSpatialGroup::rebound()
 	
 	clearState(DIRTY);
 
+	mSpatialPartition->mSnapshot.update(this);
+
 	return TRUE;
 }
 
@@ -1432,6 +1449,17 @@ void LLSpatialGroup::checkOcclusion()
 	if (LLPipeline::sUseOcclusion > 1)
 	{
 		LLFastTimer t(FTM_OCCLUSION_READBACK);
+		if (isOcclusionState(DEPTH_OCCLUDED))
+		{
+			if (mOcclusionChecked[LLViewerCamera::sCurCameraID] == gFrameCount)
+			{ //already rejected this frame
+				return;
+			}
+			//rejected on an earlier frame, test again
+			clearOcclusionState(DEPTH_OCCLUDED);
+			clearOcclusionState(LLSpatialGroup::OCCLUDED, LLSpatialGroup::STATE_MODE_DIFF);
+		}
+
 		LLSpatialGroup* parent = getParent();
 		if (parent && parent->isOcclusionState(LLSpatialGroup::OCCLUDED))
 		{	//if the parent has been marked as occluded, the child is implicitly occluded
@@ -1440,10 +1468,27 @@ void LLSpatialGroup::checkOcclusion()
 		else if (isOcclusionState(QUERY_PENDING))
 		{	//otherwise, if a query is pending, read it back
 
+			if (!isOcclusionState(DISCARD_QUERY) && mOcclusionChecked[LLViewerCamera::sCurCameraID] < gPipeline.getPreviousCullFrame())
+			{ //the group was out of view on the last cull, so the result of a query issued before that says
+				//nothing about the current view; treat the group as visible now rather than let it pop in a frame late
+				sQueriesStale++;
+				setOcclusionState(LLSpatialGroup::DISCARD_QUERY);
+				clearOcclusionState(LLSpatialGroup::OCCLUDED, LLSpatialGroup::STATE_MODE_DIFF);
+			}
+
 			GLuint available = 0;
 			if (mOcclusionQuery[LLViewerCamera::sCurCameraID])
 			{
-				glGetQueryObjectuivARB(mOcclusionQuery[LLViewerCamera::sCurCameraID], GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+				if (mOcclusionIssued[LLViewerCamera::sCurCameraID] < gFrameCount && 
+					gPipeline.isOcclusionFenceCompleted(mOcclusionIssued[LLViewerCamera::sCurCameraID]))
+				{ //every query issued before the fence has a result, no need to ask for this one
+					sQueriesFenced++;
+					available = 1;
+				}
+				else
+				{
+					glGetQueryObjectuivARB(mOcclusionQuery[LLViewerCamera::sCurCameraID], GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+				}
 
 				static LLCachedControl<bool> wait_for_query("RenderSynchronousOcclusion", true);
 
@@ -1473,6 +1518,7 @@ void LLSpatialGroup::checkOcclusion()
 				GLuint res = 1;
 				if (!isOcclusionState(DISCARD_QUERY) && mOcclusionQuery[LLViewerCamera::sCurCameraID])
 				{
+					sQueriesRead++;
 					glGetQueryObjectuivARB(mOcclusionQuery[LLViewerCamera::sCurCameraID], GL_QUERY_RESULT_ARB, &res);	
 #if LL_TRACK_PENDING_OCCLUSION_QUERIES
 					sPendingQueries.erase(mOcclusionQuery[LLViewerCamera::sCurCameraID]);
@@ -1504,6 +1550,10 @@ void LLSpatialGroup::checkOcclusion()
 
 				clearOcclusionState(QUERY_PENDING | DISCARD_QUERY);
 			}
+			else
+			{
+				sQueriesLate++;
+			}
 		}
 		else if (mSpatialPartition->isOcclusionEnabled() && isOcclusionState(LLSpatialGroup::OCCLUDED))
 		{	//check occlusion has been issued for occluded node that has not had a query issued
@@ -1511,6 +1561,29 @@ void LLSpatialGroup::checkOcclusion()
 			clearOcclusionState(LLSpatialGroup::OCCLUDED, LLSpatialGroup::STATE_MODE_DIFF);
 			assert_states_valid(this);
 		}
+
+		if (parent && !isOcclusionState(LLSpatialGroup::OCCLUDED) &&
+			mSpatialPartition->isOcclusionEnabled() && !mSpatialPartition->isBridge())
+		{ //reject groups that are hidden behind terrain before a query is issued for them
+			const LLOcclusionDepthBuffer* depth = gPipeline.getOcclusionDepthBuffer();
+			if (depth)
+			{
+				sDepthTests++;
+
+				LLVector4a size;
+				size.setAdd(LLVector4a(SG_OCCLUSION_FUDGE), mBounds[1]);
+				if (depth->isOccluded(mBounds[0], size))
+				{
+					sDepthRejects++;
+					assert_states_valid(this);
+					setOcclusionState(LLSpatialGroup::OCCLUDED, LLSpatialGroup::STATE_MODE_DIFF);
+					setOcclusionState(LLSpatialGroup::DEPTH_OCCLUDED);
+					assert_states_valid(this);
+				}
+			}
+		}
+
+		mOcclusionChecked[LLViewerCamera::sCurCameraID] = gFrameCount;
 	}
 }
 
@@ -1529,8 +1602,8 @@ static LLFastTimer::DeclareTimer FTM_OCCLUSION_DRAW("Draw");
 
 void LLSpatialGroup::doOcclusion(LLCamera* camera)
 {
-	LLGLDisable stencil(GL_STENCIL_TEST);
-	if (mSpatialPartition->isOcclusionEnabled() && LLPipeline::sUseOcclusion > 1)
+	if (mSpatialPartition->isOcclusionEnabled() && LLPipeline::sUseOcclusion > 1 &&
+		!isOcclusionState(LLSpatialGroup::DEPTH_OCCLUDED)) //found behind terrain by checkOcclusion(), no query needed
 	{
 		//static const LLCachedControl<BOOL> render_water_void_culling("RenderWaterVoidCulling", TRUE);
 		// Don't cull hole/edge water, unless RenderWaterVoidCulling is set and we have the GL_ARB_depth_clamp extension.
@@ -1557,15 +1630,6 @@ void LLSpatialGroup::doOcclusion(LLCamera* camera)
 						mOcclusionQuery[LLViewerCamera::sCurCameraID] = sQueryPool.allocate();
 					}
 
-					// Depth clamp all water to avoid it being culled as a result of being
-					// behind the far clip plane, and in the case of edge water to avoid
-					// it being culled while still visible.
-					bool const use_depth_clamp = gGLManager.mHasDepthClamp &&
-												(mSpatialPartition->mDrawableType == LLDrawPool::POOL_WATER ||
-												mSpatialPartition->mDrawableType == LLDrawPool::POOL_VOIDWATER);
-
-					LLGLEnable clamp(use_depth_clamp ? GL_DEPTH_CLAMP : 0);	
-
 #if !LL_DARWIN					
 					U32 mode = gGLManager.mHasOcclusionQuery2 ? GL_ANY_SAMPLES_PASSED : GL_SAMPLES_PASSED_ARB;
 #else
@@ -1581,6 +1645,7 @@ void LLSpatialGroup::doOcclusion(LLCamera* camera)
 						
 						//store which frame this query was issued on
 						mOcclusionIssued[LLViewerCamera::sCurCameraID] = gFrameCount;
+						sQueriesIssued++;
 
 						{
 							LLFastTimer t(FTM_OCCLUSION_BEGIN_QUERY);
@@ -1598,22 +1663,7 @@ void LLSpatialGroup::doOcclusion(LLCamera* camera)
 						bounds.setAdd(fudge,mBounds[1]);
 						shader->uniform3fv(LLShaderMgr::BOX_SIZE, 1, bounds.getF32ptr());
 
-						if (!use_depth_clamp && mSpatialPartition->mDrawableType == LLDrawPool::POOL_VOIDWATER)
-						{
-							LLFastTimer t(FTM_OCCLUSION_DRAW_WATER);
-
-							LLGLSquashToFarClip squash(glh_get_current_projection(), 1);
-							if (camera->getOrigin().isExactlyZero())
-							{ //origin is invalid, draw entire box
-								gPipeline.mCubeVB->drawRange(LLRender::TRIANGLE_FAN, 0, 7, 8, 0);
-								gPipeline.mCubeVB->drawRange(LLRender::TRIANGLE_FAN, 0, 7, 8, b111*8);				
-							}
-							else
-							{
-								gPipeline.mCubeVB->drawRange(LLRender::TRIANGLE_FAN, 0, 7, 8, get_box_fan_indices(camera, mBounds[0]));
-							}
-						}
-						else
+						//depth clamp and far clip squashing are set up by LLSpatialPartition::doOcclusion
 						{
 							LLFastTimer t(FTM_OCCLUSION_DRAW);
 							if (camera->getOrigin().isExactlyZero())
@@ -1647,6 +1697,229 @@ void LLSpatialGroup::doOcclusion(LLCamera* camera)
 
 //==============================================
 
+LLSpatialSnapshot::LLSpatialSnapshot()
+: mBounds(NULL),
+  mExtents(NULL),
+  mObjectBounds(NULL),
+  mObjectExtents(NULL),
+  mCapacity(0),
+  mDirty(true)
+{
+}
+
+LLSpatialSnapshot::~LLSpatialSnapshot()
+{
+	ll_aligned_free_16(mBounds);
+	ll_aligned_free_16(mExtents);
+	ll_aligned_free_16(mObjectBounds);
+	ll_aligned_free_16(mObjectExtents);
+}
+
+void LLSpatialSnapshot::rebuild(LLSpatialGroup::OctreeNode* root)
+{
+	if (mDirty)
+	{
+		mNodes.clear();
+		add(root);
+		mDirty = false;
+		mDirtySubtrees.clear();
+		return;
+	}
+
+	//a subtree that lies within another one is rebuilt along with it
+	std::sort(mDirtySubtrees.begin(), mDirtySubtrees.end());
+	std::vector<U32> subtrees;
+	U32 end = 0;
+	for (std::vector<U32>::iterator iter = mDirtySubtrees.begin(); iter != mDirtySubtrees.end(); ++iter)
+	{
+		if (*iter >= end)
+		{
+			subtrees.push_back(*iter);
+			end = mNodes[*iter].mEnd;
+		}
+	}
+	mDirtySubtrees.clear();
+
+	//back to front, so that the ranges that are left to do don't move
+	for (U32 i = subtrees.size(); i > 0; i--)
+	{
+		rebuildSubtree(subtrees[i-1]);
+	}
+}
+
+// Moves the pairs of vectors [tail, tail + count) to index, in place of the pairs [index, index + old_count).
+static void splice_bounds(LLVector4a* bounds, U32 index, U32 old_count, U32 tail, U32 count)
+{
+	std::rotate(bounds + index * 2, bounds + tail * 2, bounds + (tail + count) * 2);
+	memmove(bounds + (index + count) * 2, bounds + (index + count + old_count) * 2,
+			sizeof(LLVector4a) * 2 * (tail - index - old_count));
+}
+
+void LLSpatialSnapshot::rebuildSubtree(U32 index)
+{
+	LLSpatialGroup* group = mNodes[index].mGroup;
+	U32 old_count = mNodes[index].mEnd - index;
+
+	//append the subtree as it is now, then move it over the old one
+	U32 tail = mNodes.size();
+	add(group->mOctreeNode);
+	U32 count = mNodes.size() - tail;
+
+	std::rotate(mNodes.begin() + index, mNodes.begin() + tail, mNodes.end());
+	mNodes.erase(mNodes.begin() + index + count, mNodes.begin() + index + count + old_count);
+	splice_bounds(mBounds, index, old_count, tail, count);
+	splice_bounds(mExtents, index, old_count, tail, count);
+	splice_bounds(mObjectBounds, index, old_count, tail, count);
+	splice_bounds(mObjectExtents, index, old_count, tail, count);
+
+	//the ancestors of the subtree are the nodes before it that end after it starts
+	for (U32 i = 0; i < index; i++)
+	{
+		if (mNodes[i].mEnd > index)
+		{
+			mNodes[i].mEnd = mNodes[i].mEnd + count - old_count;
+		}
+	}
+	for (U32 i = index; i < index + count; i++)
+	{
+		mNodes[i].mEnd = mNodes[i].mEnd + index - tail;
+		mNodes[i].mGroup->mSnapshotIndex = i;
+	}
+	for (U32 i = index + count; i < mNodes.size(); i++)
+	{
+		mNodes[i].mEnd = mNodes[i].mEnd + count - old_count;
+		mNodes[i].mGroup->mSnapshotIndex = i;
+	}
+}
+
+bool LLSpatialSnapshot::contains(const LLSpatialGroup* group) const
+{
+	U32 index = group->mSnapshotIndex;
+	return index < mNodes.size() && mNodes[index].mGroup == group;
+}
+
+void LLSpatialSnapshot::setDirty(const LLSpatialGroup* group)
+{
+	if (mDirty)
+	{
+		return;
+	}
+
+	if (contains(group))
+	{
+		mDirtySubtrees.push_back(group->mSnapshotIndex);
+	}
+	else if (mDirtySubtrees.empty())
+	{
+		llassert(false);
+		mDirty = true;
+	}
+	//else the group was added since the snapshot was taken, under a subtree that is dirty already
+}
+
+void LLSpatialSnapshot::handleDestruction(const LLSpatialGroup* group)
+{
+	if (mDirty || !contains(group))
+	{ //nothing refers to it, or it was added under a subtree that is dirty already
+		return;
+	}
+
+	//a node that is removed from its parent lies in the subtree of that parent, which is dirty;
+	//its own subtree being dirty doesn't help, rebuild() would start from it
+	U32 index = group->mSnapshotIndex;
+	for (std::vector<U32>::iterator iter = mDirtySubtrees.begin(); iter != mDirtySubtrees.end(); ++iter)
+	{
+		if (*iter < index && index < mNodes[*iter].mEnd)
+		{
+			return;
+		}
+	}
+
+	//the octree dropped it without telling its parent
+	mDirty = true;
+}
+
+void LLSpatialSnapshot::update(const LLSpatialGroup* group)
+{
+	if (mDirty)
+	{ //rebuild() will pick up the new bounds
+		return;
+	}
+
+	U32 index = group->mSnapshotIndex;
+	if (!contains(group))
+	{ //added under a subtree that is dirty, rebuild() will pick up its bounds
+		llassert(!mDirtySubtrees.empty());
+		if (mDirtySubtrees.empty())
+		{
+			mDirty = true;
+		}
+		return;
+	}
+
+	copyBounds(index, group);
+
+	Node& node = mNodes[index];
+	node.mElementCount = group->getElementCount();
+
+	//the group that was rebound sets SKIP_FRUSTUM_CHECK on its children
+	U32 child = index + 1;
+	for (U32 i = 0; i < node.mChildCount; i++)
+	{
+		mNodes[child].mSkipFrustumCheck = mNodes[child].mGroup->isState(LLSpatialGroup::SKIP_FRUSTUM_CHECK);
+		child = mNodes[child].mEnd;
+	}
+}
+
+void LLSpatialSnapshot::add(LLSpatialGroup::OctreeNode* node)
+{
+	U32 index = mNodes.size();
+	if (index >= mCapacity)
+	{
+		U32 capacity = llmax(mCapacity * 2, (U32) 64);
+		size_t old_size = sizeof(LLVector4a) * 2 * mCapacity;
+		size_t new_size = sizeof(LLVector4a) * 2 * capacity;
+		mBounds = (LLVector4a*) ll_aligned_realloc_16(mBounds, new_size, old_size);
+		mExtents = (LLVector4a*) ll_aligned_realloc_16(mExtents, new_size, old_size);
+		mObjectBounds = (LLVector4a*) ll_aligned_realloc_16(mObjectBounds, new_size, old_size);
+		mObjectExtents = (LLVector4a*) ll_aligned_realloc_16(mObjectExtents, new_size, old_size);
+		mCapacity = capacity;
+	}
+
+	LLSpatialGroup* group = (LLSpatialGroup*) node->getListener(0);
+	group->mSnapshotIndex = index;
+	copyBounds(index, group);
+	mNodes.push_back(Node());
+
+	//children follow their parent, so a subtree is the range [index, mEnd)
+	for (U32 i = 0; i < node->getChildCount(); i++)
+	{
+		add(node->getChild(i));
+	}
+
+	Node& entry = mNodes[index];
+	entry.mGroup = group;
+	entry.mEnd = mNodes.size();
+	entry.mElementCount = node->getElementCount();
+	entry.mChildCount = node->getChildCount();
+	entry.mSkipFrustumCheck = group->isState(LLSpatialGroup::SKIP_FRUSTUM_CHECK);
+}
+
+void LLSpatialSnapshot::copyBounds(U32 index, const LLSpatialGroup* group)
+{
+	U32 i = index * 2;
+	mBounds[i] = group->mBounds[0];
+	mBounds[i+1] = group->mBounds[1];
+	mExtents[i] = group->mExtents[0];
+	mExtents[i+1] = group->mExtents[1];
+	mObjectBounds[i] = group->mObjectBounds[0];
+	mObjectBounds[i+1] = group->mObjectBounds[1];
+	mObjectExtents[i] = group->mObjectExtents[0];
+	mObjectExtents[i+1] = group->mObjectExtents[1];
+}
+
+//==============================================
+
 LLSpatialPartition::LLSpatialPartition(U32 data_mask, BOOL render_by_group, U32 buffer_usage)
 : mRenderByGroup(render_by_group), mBridge(NULL)
 {
@@ -1783,7 +2056,7 @@ class LLOctreeCull : public LLSpatialGroup::OctreeTraveler
 {
 public:
 	LLOctreeCull(LLCamera* camera)
-		: mCamera(camera), mRes(0) { }
+		: mCamera(camera), mRes(0), mRecord(NULL) { }
 
 	virtual bool earlyFail(LLSpatialGroup* group)
 	{
@@ -1827,22 +2100,23 @@ public:
 		}
 	}
 	
-	virtual S32 frustumCheck(const LLSpatialGroup* group)
+	S32 frustumCheck(const LLSpatialGroup* group)
 	{
-		S32 res = mCamera->AABBInFrustumNoFarClip(group->mBounds[0], group->mBounds[1]);
-		if (res != 0)
-		{
-			res = llmin(res, AABBSphereIntersect(group->mExtents[0], group->mExtents[1], mCamera->getOrigin(), mCamera->mFrustumCornerDist));
-		}
-		return res;
+		return checkBounds(group->mBounds, group->mExtents);
+	}
+
+	S32 frustumCheckObjects(const LLSpatialGroup* group)
+	{
+		return checkBounds(group->mObjectBounds, group->mObjectExtents);
 	}
 
-	virtual S32 frustumCheckObjects(const LLSpatialGroup* group)
+	// The bounds (center, size) and extents (min, max) of a group, or of the objects in it.
+	virtual S32 checkBounds(const LLVector4a* bounds, const LLVector4a* extents)
 	{
-		S32 res = mCamera->AABBInFrustumNoFarClip(group->mObjectBounds[0], group->mObjectBounds[1]);
+		S32 res = mCamera->AABBInFrustumNoFarClip(bounds[0], bounds[1]);
 		if (res != 0)
 		{
-			res = llmin(res, AABBSphereIntersect(group->mObjectExtents[0], group->mObjectExtents[1], mCamera->getOrigin(), mCamera->mFrustumCornerDist));
+			res = llmin(res, AABBSphereIntersect(extents[0], extents[1], mCamera->getOrigin(), mCamera->mFrustumCornerDist));
 		}
 		return res;
 	}
@@ -1857,7 +2131,7 @@ public:
 		{
 			return true;
 		}
-		else if (mRes == 1 && !frustumCheckObjects(group)) //no objects in frustum
+		else if (mRes == 1 && !(mRecord && mRecord->mObjects >= 0 ? mRecord->mObjects : frustumCheckObjects(group))) //no objects in frustum
 		{
 			return false;
 		}
@@ -1865,6 +2139,102 @@ public:
 		return true;
 	}
 
+	// The frustum checks that traverse() does, without earlyFail(), preprocess() and processGroup(),
+	// on the snapshot of the octree. Only reads the snapshot, so it can run on any thread.
+	void record(const LLSpatialSnapshot& snapshot, U32 node, std::vector<LLCullRecord>& records)
+	{
+		U32 index = records.size();
+		records.push_back(LLCullRecord());
+
+		S32 frustum = -1;
+		S32 objects = -1;
+		bool visited = true;
+		if (!(mRes == 2 ||
+			(mRes && snapshot.skipsFrustumCheck(node))))
+		{
+			frustum = mRes = checkBounds(snapshot.getBounds(node), snapshot.getExtents(node));
+			visited = mRes != 0;
+		}
+
+		if (visited)
+		{
+			U32 child_count = snapshot.getChildCount(node);
+			if (mRes == 1 && snapshot.getElementCount(node) && child_count)
+			{
+				objects = checkBounds(snapshot.getObjectBounds(node), snapshot.getObjectExtents(node));
+			}
+
+			U32 child = node + 1;
+			for (U32 i = 0; i < child_count; i++)
+			{
+				record(snapshot, child, records);
+				child = snapshot.getEnd(child);
+			}
+		}
+
+		if (frustum >= 0)
+		{
+			mRes = 0;
+		}
+
+		LLCullRecord& rec = records[index];
+		rec.mEnd = records.size();
+		rec.mFrustum = (S8) frustum;
+		rec.mObjects = (S8) objects;
+		rec.mVisited = visited;
+	}
+
+	// traverse(), with the frustum checks that record() did. Where the occlusion culling of this
+	// pass takes another path than record() did, the checks are done here instead.
+	void replay(const LLSpatialGroup::OctreeNode* n, const std::vector<LLCullRecord>& records, U32 index)
+	{
+		LLSpatialGroup* group = (LLSpatialGroup*) n->getListener(0);
+
+		if (earlyFail(group))
+		{
+			return;
+		}
+
+		const LLCullRecord& rec = records[index];
+		bool reset = false;
+		if (!(mRes == 2 ||
+			(mRes && group->isState(LLSpatialGroup::SKIP_FRUSTUM_CHECK))))
+		{
+			mRes = rec.mFrustum >= 0 ? rec.mFrustum : frustumCheck(group);
+			reset = true;
+		}
+
+		if (mRes)
+		{
+			mRecord = &rec;
+			n->accept(this);
+			mRecord = NULL;
+
+			if (rec.mVisited)
+			{
+				U32 child = index + 1;
+				for (U32 i = 0; i < n->getChildCount(); i++)
+				{
+					llassert(child < rec.mEnd);
+					replay(n->getChild(i), records, child);
+					child = records[child].mEnd;
+				}
+			}
+			else
+			{
+				for (U32 i = 0; i < n->getChildCount(); i++)
+				{
+					traverse(n->getChild(i));
+				}
+			}
+		}
+
+		if (reset)
+		{
+			mRes = 0;
+		}
+	}
+
 	virtual void preprocess(LLSpatialGroup* group)
 	{
 		
@@ -1875,7 +2245,8 @@ public:
 		if (group->needsUpdate() ||
 			group->mVisible[LLViewerCamera::sCurCameraID] < LLDrawable::getCurrentFrame() - 1)
 		{
-			group->doOcclusion(mCamera);
+			//go through the partition so the query gets its depth clamp and far clip squashing
+			group->mSpatialPartition->doOcclusion(mCamera, &group, 1);
 		}
 		gPipeline.markNotCulled(group, *mCamera);
 	}
@@ -1894,6 +2265,7 @@ public:
 
 	LLCamera *mCamera;
 	S32 mRes;
+	const LLCullRecord* mRecord;	// Of the group being visited, while replaying.
 };
 
 class LLOctreeCullNoFarClip : public LLOctreeCull
@@ -1902,15 +2274,9 @@ public:
 	LLOctreeCullNoFarClip(LLCamera* camera) 
 		: LLOctreeCull(camera) { }
 
-	virtual S32 frustumCheck(const LLSpatialGroup* group)
+	virtual S32 checkBounds(const LLVector4a* bounds, const LLVector4a* extents)
 	{
-		return mCamera->AABBInFrustumNoFarClip(group->mBounds[0], group->mBounds[1]);
-	}
-
-	virtual S32 frustumCheckObjects(const LLSpatialGroup* group)
-	{
-		S32 res = mCamera->AABBInFrustumNoFarClip(group->mObjectBounds[0], group->mObjectBounds[1]);
-		return res;
+		return mCamera->AABBInFrustumNoFarClip(bounds[0], bounds[1]);
 	}
 };
 
@@ -1920,14 +2286,9 @@ public:
 	LLOctreeCullShadow(LLCamera* camera)
 		: LLOctreeCull(camera) { }
 
-	virtual S32 frustumCheck(const LLSpatialGroup* group)
+	virtual S32 checkBounds(const LLVector4a* bounds, const LLVector4a* extents)
 	{
-		return mCamera->AABBInFrustum(group->mBounds[0], group->mBounds[1]);
-	}
-
-	virtual S32 frustumCheckObjects(const LLSpatialGroup* group)
-	{
-		return mCamera->AABBInFrustum(group->mObjectBounds[0], group->mObjectBounds[1]);
+		return mCamera->AABBInFrustum(bounds[0], bounds[1]);
 	}
 };
 
@@ -2204,6 +2565,43 @@ BOOL LLSpatialPartition::isOcclusionEnabled()
 	return mOcclusionEnabled || LLPipeline::sUseOcclusion > 2;
 }
 
+void LLSpatialPartition::doOcclusion(LLCamera* camera, LLSpatialGroup* const* groups, U32 count)
+{
+	if (!isOcclusionEnabled() || LLPipeline::sUseOcclusion <= 1)
+	{
+		return;
+	}
+
+	LLGLDisable stencil(GL_STENCIL_TEST);
+
+	// Depth clamp all water to avoid it being culled as a result of being
+	// behind the far clip plane, and in the case of edge water to avoid
+	// it being culled while still visible.
+	bool const use_depth_clamp = gGLManager.mHasDepthClamp &&
+								(mDrawableType == LLDrawPool::POOL_WATER ||
+								mDrawableType == LLDrawPool::POOL_VOIDWATER);
+
+	LLGLEnable clamp(use_depth_clamp ? GL_DEPTH_CLAMP : 0);	
+
+	if (!use_depth_clamp && mDrawableType == LLDrawPool::POOL_VOIDWATER)
+	{
+		LLFastTimer t(FTM_OCCLUSION_DRAW_WATER);
+
+		LLGLSquashToFarClip squash(glh_get_current_projection(), 1);
+		for (U32 i = 0; i < count; i++)
+		{
+			groups[i]->doOcclusion(camera);
+		}
+	}
+	else
+	{
+		for (U32 i = 0; i < count; i++)
+		{
+			groups[i]->doOcclusion(camera);
+		}
+	}
+}
+
 BOOL LLSpatialPartition::getVisibleExtents(LLCamera& camera, LLVector3& visMin, LLVector3& visMax)
 {
 	LLVector4a visMina, visMaxa;
@@ -2230,7 +2628,7 @@ BOOL LLSpatialPartition::visibleObjectsInFrustum(LLCamera& camera)
 	return vis.mResult;
 }
 
-S32 LLSpatialPartition::cull(LLCamera &camera, std::vector<LLDrawable *>* results, BOOL for_select)
+void LLSpatialPartition::rebound()
 {
 #if LL_OCTREE_PARANOIA_CHECK
 	((LLSpatialGroup*)mOctree->getListener(0))->checkStates();
@@ -2248,6 +2646,15 @@ S32 LLSpatialPartition::cull(LLCamera &camera, std::vector<LLDrawable *>* result
 	((LLSpatialGroup*)mOctree->getListener(0))->validate();
 #endif
 
+	if (mSnapshot.isDirty())
+	{
+		mSnapshot.rebuild(mOctree);
+	}
+}
+
+S32 LLSpatialPartition::cull(LLCamera &camera, std::vector<LLDrawable *>* results, BOOL for_select)
+{
+	rebound();
 	
 	if (for_select)
 	{
@@ -2276,6 +2683,51 @@ S32 LLSpatialPartition::cull(LLCamera &camera, std::vector<LLDrawable *>* result
 	return 0;
 }
 
+void LLSpatialPartition::recordCull(LLCamera& camera, std::vector<LLCullRecord>& records)
+{
+	records.clear();
+
+	// rebound() brought the snapshot up to date.
+	llassert(!mSnapshot.isDirty());
+
+	if (LLPipeline::sShadowRender)
+	{
+		LLOctreeCullShadow culler(&camera);
+		culler.record(mSnapshot, 0, records);
+	}
+	else if (mInfiniteFarClip || !LLPipeline::sUseFarClip)
+	{
+		LLOctreeCullNoFarClip culler(&camera);
+		culler.record(mSnapshot, 0, records);
+	}
+	else
+	{
+		LLOctreeCull culler(&camera);
+		culler.record(mSnapshot, 0, records);
+	}
+}
+
+void LLSpatialPartition::cullRecorded(LLCamera& camera, const std::vector<LLCullRecord>& records)
+{
+	LLFastTimer ftm(FTM_FRUSTUM_CULL);
+
+	if (LLPipeline::sShadowRender)
+	{
+		LLOctreeCullShadow culler(&camera);
+		culler.replay(mOctree, records, 0);
+	}
+	else if (mInfiniteFarClip || !LLPipeline::sUseFarClip)
+	{
+		LLOctreeCullNoFarClip culler(&camera);
+		culler.replay(mOctree, records, 0);
+	}
+	else
+	{
+		LLOctreeCull culler(&camera);
+		culler.replay(mOctree, records, 0);
+	}
+}
+
 BOOL earlyFail(LLCamera* camera, LLSpatialGroup* group)
 {
 	if (camera->getOrigin().isExactlyZero())
@@ -4350,6 +4802,54 @@ public:
 		return mHit;
 	}
 
+	// check(part->mOctree), walking the snapshot of part instead of the octree when it is up to date.
+	LLDrawable* checkPartition(LLSpatialPartition* part)
+	{
+		const LLSpatialSnapshot& snapshot = part->mSnapshot;
+		if (snapshot.isDirty() || !snapshot.getCount())
+		{
+			return check(part->mOctree);
+		}
+
+		if (part->isBridge())
+		{
+			LLMatrix4a local_matrix = part->asBridge()->mDrawable->getRenderMatrix();
+			local_matrix.invert();
+			checkSnapshot(snapshot, 0, &local_matrix);
+		}
+		else
+		{
+			checkSnapshot(snapshot, 0, NULL);
+		}
+
+		return mHit;
+	}
+
+	void checkSnapshot(const LLSpatialSnapshot& snapshot, U32 node, const LLMatrix4a* local_matrix)
+	{
+		snapshot.getGroup(node)->mOctreeNode->accept(this);
+
+		U32 child = node + 1;
+		for (U32 i = 0; i < snapshot.getChildCount(node); i++)
+		{
+			LLVector4a local_start = mStart;
+			LLVector4a local_end   = mEnd;
+
+			if (local_matrix)
+			{
+				local_matrix->affineTransform(mStart, local_start);
+				local_matrix->affineTransform(mEnd, local_end);
+			}
+
+			const LLVector4a* bounds = snapshot.getBounds(child);
+			if (LLLineSegmentBoxIntersect(local_start, local_end, bounds[0], bounds[1]))
+			{
+				checkSnapshot(snapshot, child, local_matrix);
+			}
+			child = snapshot.getEnd(child);
+		}
+	}
+
 	virtual bool check(LLDrawable* drawable)
 	{	
 		if (!drawable || !gPipeline.hasRenderType(drawable->getRenderType()) || !drawable->isVisible())
@@ -4363,7 +4863,7 @@ public:
 			LLSpatialBridge* bridge = part->asBridge();
 			if (bridge && gPipeline.hasRenderType(bridge->mDrawableType))
 			{
-				check(part->mOctree);
+				checkPartition(part);
 			}
 		}
 		else
@@ -4427,7 +4927,7 @@ LLDrawable* LLSpatialPartition::lineSegmentIntersect(const LLVector4a& start, co
 
 {
 	LLOctreeIntersect intersect(start, end, pick_transparent, face_hit, intersection, tex_coord, normal, tangent);
-	LLDrawable* drawable = intersect.check(mOctree);
+	LLDrawable* drawable = intersect.checkPartition(this);
 
 	return drawable;
 }
@@ -55,6 +55,7 @@
 class LLSpatialPartition;
 class LLSpatialBridge;
 class LLSpatialGroup;
+class LLGeometryFillPool;
 
 S32 AABBSphereIntersect(const LLVector4a& min, const LLVector4a& max, const LLVector3 &origin, const F32 &rad);
 S32 AABBSphereIntersectR2(const LLVector4a& min, const LLVector4a& max, const LLVector3 &origin, const F32 &radius_squared);
@@ -242,6 +243,15 @@ public:
 
 	static std::set<GLuint> sPendingQueries; //pending occlusion queries
 	static U32 sNodeCount;
+
+	//occlusion culling counts, reset when they are shown by DebugShowRenderInfo
+	static U32 sQueriesIssued;
+	static U32 sQueriesRead;
+	static U32 sQueriesFenced;		//results that were known to be available from the fence placed after them
+	static U32 sQueriesLate;		//results that were not available yet when checked
+	static U32 sQueriesStale;		//results discarded because the group was out of view after the query was issued
+	static U32 sDepthTests;			//tests against the CPU depth buffer
+	static U32 sDepthRejects;
 	static BOOL sNoDelete; //deletion of spatial groups and draw info not allowed if TRUE
 
 	typedef std::vector<LLPointer<LLSpatialGroup> > sg_vector_t;
@@ -292,6 +302,7 @@ public:
 		ACTIVE_OCCLUSION		= 0x00040000,
 		DISCARD_QUERY			= 0x00080000,
 		EARLY_FAIL				= 0x00100000,
+		DEPTH_OCCLUDED			= 0x00200000, //hidden behind terrain in the CPU depth buffer, no query is issued
 	} eOcclusionState;
 
 	typedef enum
@@ -354,7 +365,7 @@ public:
 	void unbound();
 	BOOL rebound();
 	void checkOcclusion(); //read back last occlusion query (if any)
-	void doOcclusion(LLCamera* camera); //issue occlusion query
+	void doOcclusion(LLCamera* camera); //issue occlusion query, only call through LLSpatialPartition::doOcclusion
 	void destroyGL(bool keep_occlusion = false);
 	
 	void updateDistance(LLCamera& camera);
@@ -411,6 +422,7 @@ protected:
 	U32 mState;
 	U32 mOcclusionState[LLViewerCamera::NUM_CAMERAS];
 	U32 mOcclusionIssued[LLViewerCamera::NUM_CAMERAS];
+	U32 mOcclusionChecked[LLViewerCamera::NUM_CAMERAS]; //frame of the last checkOcclusion()
 	S32 mLODHash;
 	static S32 sLODSeed;
 
@@ -439,6 +451,8 @@ public:
 	
 	F32 mPixelArea;
 	F32 mRadius;
+
+	U32 mSnapshotIndex; // index of this group in the snapshot of its partition, see LLSpatialSnapshot
 } LL_ALIGN_POSTFIX(64);
 
 inline LLSpatialGroup::eOcclusionState operator|(const LLSpatialGroup::eOcclusionState &a, const LLSpatialGroup::eOcclusionState &b) 
@@ -450,6 +464,84 @@ inline LLSpatialGroup::eSpatialState operator|(const LLSpatialGroup::eSpatialSta
   return LLSpatialGroup::eSpatialState(+a | +b);
 }
 
+// What LLSpatialPartition::recordCull found for one octree node, in traversal order: the frustum
+// checks of a cull without its occlusion culling, for LLSpatialPartition::cullRecorded to reuse.
+struct LLCullRecord
+{
+	U32 mEnd;			// Index of the first record after the subtree of the node.
+	S8 mFrustum;		// Frustum check of the node bounds (0 out, 1 partially in, 2 in), or -1 if not done.
+	S8 mObjects;		// Frustum check of the object bounds, or -1 if not done.
+	bool mVisited;		// The records of the children follow, if any.
+};
+
+// A flattened copy of the octree of a spatial partition for the bounding box tests of culling and
+// picking: the bounds of all groups in contiguous arrays, in traversal order, with the children of
+// a node linked by index instead of by pointer. The children of node i start at i + 1, and each
+// child is followed by the next one at getEnd(child).
+//
+// When children are added to or removed from a group, the subtree of that group is marked dirty,
+// and LLSpatialPartition::rebound() rebuilds just that range of the snapshot. Changes that the
+// octree doesn't report per node (the root collapsing into its only child) mark all of it dirty.
+// Until then, users walk the octree instead. Otherwise the bounds of a group are updated in place
+// whenever the group is rebounded or shifted.
+class LLSpatialSnapshot
+{
+public:
+	LLSpatialSnapshot();
+	~LLSpatialSnapshot();
+
+	// Main thread.
+	void rebuild(LLSpatialGroup::OctreeNode* root);
+	void update(const LLSpatialGroup* group);
+	void setDirty()													{ mDirty = true; }
+	void setDirty(const LLSpatialGroup* group);
+	void handleDestruction(const LLSpatialGroup* group);
+
+	bool isDirty() const											{ return mDirty || !mDirtySubtrees.empty(); }
+	U32 getCount() const											{ return mNodes.size(); }
+
+	// Two vectors per node, like the members of LLSpatialGroup that they are copies of.
+	const LLVector4a* getBounds(U32 node) const						{ return mBounds + node * 2; }
+	const LLVector4a* getExtents(U32 node) const					{ return mExtents + node * 2; }
+	const LLVector4a* getObjectBounds(U32 node) const				{ return mObjectBounds + node * 2; }
+	const LLVector4a* getObjectExtents(U32 node) const				{ return mObjectExtents + node * 2; }
+
+	U32 getEnd(U32 node) const										{ return mNodes[node].mEnd; }
+	U32 getChildCount(U32 node) const								{ return mNodes[node].mChildCount; }
+	U32 getElementCount(U32 node) const								{ return mNodes[node].mElementCount; }
+	bool skipsFrustumCheck(U32 node) const							{ return mNodes[node].mSkipFrustumCheck; }
+	LLSpatialGroup* getGroup(U32 node) const						{ return mNodes[node].mGroup; }
+
+private:
+	struct Node
+	{
+		LLSpatialGroup* mGroup;
+		U32 mEnd;					// Index of the first node after the subtree of this one.
+		U32 mElementCount;
+		U16 mChildCount;
+		bool mSkipFrustumCheck;		// LLSpatialGroup::SKIP_FRUSTUM_CHECK
+	};
+
+	void add(LLSpatialGroup::OctreeNode* node);
+	void copyBounds(U32 index, const LLSpatialGroup* group);
+	void rebuildSubtree(U32 index);
+	bool contains(const LLSpatialGroup* group) const;
+
+	std::vector<Node> mNodes;
+
+	// 16 byte aligned, two vectors per node.
+	LLVector4a* mBounds;
+	LLVector4a* mExtents;
+	LLVector4a* mObjectBounds;
+	LLVector4a* mObjectExtents;
+	U32 mCapacity;
+
+	bool mDirty;
+	// Indices of the groups whose subtrees changed. Their ranges may hold groups that were
+	// destroyed since, so only mEnd may be read there.
+	std::vector<U32> mDirtySubtrees;
+};
+
 class LLGeometryManager
 {
 public:
@@ -495,6 +587,13 @@ public:
 
 	BOOL visibleObjectsInFrustum(LLCamera& camera);
 	S32 cull(LLCamera &camera, std::vector<LLDrawable *>* results = NULL, BOOL for_select = FALSE); // Cull on arbitrary frustum
+
+	// cull() in steps, see LLSpatialCullPool: rebound() on the main thread, recordCull() on any thread,
+	// then cullRecorded() on the main thread with the same camera. The result is that of cull().
+	// rebound() also brings mSnapshot up to date.
+	void rebound();
+	void recordCull(LLCamera& camera, std::vector<LLCullRecord>& records);
+	void cullRecorded(LLCamera& camera, const std::vector<LLCullRecord>& records);
 	
 	BOOL isVisible(const LLVector3& v);
 	bool isHUDPartition() ;
@@ -508,6 +607,9 @@ public:
 	void restoreGL();
 	void resetVertexBuffers();
 	BOOL isOcclusionEnabled();
+	// Issues the occlusion queries of count groups of this partition, setting up the GL state
+	// that depends on the partition once for all of them.
+	void doOcclusion(LLCamera* camera, LLSpatialGroup* const* groups, U32 count);
 	BOOL getVisibleExtents(LLCamera& camera, LLVector3& visMin, LLVector3& visMax);
 
 public:
@@ -526,6 +628,7 @@ public:
 	BOOL mDepthMask; //if TRUE, objects in this partition will be written to depth during alpha rendering
 	U32 mDrawableType;
 	U32 mPartitionType;
+	LLSpatialSnapshot mSnapshot;
 };
 
 // class for creating bridges between spatial partitions
@@ -713,6 +816,9 @@ class LLVolumeGeometryManager: public LLGeometryManager
 	virtual void getGeometry(LLSpatialGroup* group);
 	void genDrawInfo(LLSpatialGroup* group, U32 mask, LLFace** faces, U32 face_count, BOOL distance_sort = FALSE, BOOL batch_textures = FALSE);
 	void registerFace(LLSpatialGroup* group, LLFace* facep, U32 type);
+
+	// Fills the vertex buffers of a group on worker threads; created by LLVOVolume::initClass.
+	static LLGeometryFillPool* sFillPool;
 };
 
 //spatial partition that uses volume geometry manager (implemented in LLVOVolume.cpp)
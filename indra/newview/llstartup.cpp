@@ -809,6 +809,11 @@ bool idle_startup()
 				msg->mPacketRing->setUseOutThrottle(TRUE);
 				msg->mPacketRing->setOutBandwidth(outBandwidth);
 			}
+
+			if (gSavedSettings.getBOOL("MessageReceiveThread"))
+			{
+				msg->startReceiveThread();
+			}
 		}
 
 		LL_INFOS("AppInit") << "Message System Initialized." << LL_ENDL;
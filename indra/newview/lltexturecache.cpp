@@ -38,6 +38,14 @@
 #include "llappviewer.h" 
 #include "llmemory.h"
 
+#if LL_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 // Cache organization:
 // cache/texture.entries
 //  Unordered array of Entry structs
@@ -50,6 +58,7 @@
 const S32 TEXTURE_CACHE_ENTRY_SIZE = FIRST_PACKET_SIZE;//1024;
 const F32 TEXTURE_CACHE_PURGE_AMOUNT = .20f; // % amount to reduce the cache by when it exceeds its limit
 const F32 TEXTURE_CACHE_LRU_SIZE = .10f; // % amount for LRU list (low overhead to regenerate)
+const U32 ENTRY_INDEX_TOMBSTONE = 0xffffffff;
 
 static std::queue<LLUUID> sgDelayedPurgeQueue;
 
@@ -742,14 +751,31 @@ LLTextureCache::LLTextureCache(bool threaded)
 	  mHeaderAPRFile(NULL),
 	  mReadOnly(TRUE), //do not allow to change the texture cache until setReadOnly() is called.
 	  mTexturesSizeTotal(0),
-	  mDoPurge(FALSE)
+	  mDoPurge(FALSE),
+	  mMappedHeaderFile(NULL),
+	  mMappedHeaderSize(0),
+#if LL_WINDOWS
+	  mMappedHeaderHandle(NULL),
+#endif
+	  mMappedEntriesInfo(NULL),
+	  mMappedEntries(NULL),
+	  mMappedEntriesCount(0),
+	  mEntryIndex(NULL),
+	  mEntryIndexMask(0),
+	  mEntryIndexUsed(0),
+	  mLRUTime(0)
 {
+	for (S32 i = 0; i < ENTRY_SEQ_STRIPES; ++i)
+	{
+		mEntrySeq[i] = 0;
+	}
 }
 
 LLTextureCache::~LLTextureCache()
 {
 	clearDeleteList();
 	writeUpdatedEntries();
+	unmapHeaderEntriesFile();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -826,6 +852,16 @@ std::string LLTextureCache::getTextureFileName(const LLUUID& id)
 //debug
 BOOL LLTextureCache::isInCache(const LLUUID& id) 
 {
+	if (isHeaderEntriesMapped())
+	{
+		Entry entry;
+		if (findMappedEntry(id, entry) >= 0)
+		{
+			return TRUE;
+		}
+		// A lock-free miss can be spurious (see findMappedEntry), ask the map.
+	}
+
 	LLMutexLock lock(&mHeaderMutex);
 	id_map_t::const_iterator iter = mHeaderIDMap.find(id);
 	
@@ -977,6 +1013,12 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL texture_cache
 	readHeaderCache();
 	purgeTextures(true); // calc mTexturesSize and make some room in the texture cache if we need it
 
+	if (gSavedSettings.getBOOL("TextureCacheMappedEntries"))
+	{
+		LLMutexLock lock(&mHeaderMutex);
+		mapHeaderEntriesFile();
+	}
+
 	llassert_always(getPending() == 0); //should not start accessing the texture cache before initialized.
 
 	return max_size; // unused cache space
@@ -1074,6 +1116,13 @@ S32 LLTextureCache::openAndReadEntry(const LLUUID& id, Entry& entry, bool create
 					id_map_t::iterator iter3 = mHeaderIDMap.find(oldid);
 					if (iter3 != mHeaderIDMap.end() && iter3->second >= 0)
 					{
+						Entry old_entry;
+						if (isHeaderEntriesMapped() && readMappedEntry(iter3->second, old_entry) &&
+							old_entry.mTime > mLRUTime)
+						{
+							// Touched by a lock-free read since the LRU was built.
+							continue;
+						}
 						idx = iter3->second;
 						removeCachedTexture(oldid);//remove the existing cached texture to release the entry index.
 						break;
@@ -1122,6 +1171,17 @@ S32 LLTextureCache::openAndReadEntry(const LLUUID& id, Entry& entry, bool create
 //mHeaderMutex is locked before calling this.
 void LLTextureCache::writeEntryToHeaderImmediately(S32& idx, Entry& entry, bool write_header)
 {	
+	if (isHeaderEntriesMapped())
+	{
+		if (write_header)
+		{
+			*mMappedEntriesInfo = mHeaderEntriesInfo;
+		}
+		writeMappedEntry(idx, entry);
+		mUpdatedEntryMap.erase(idx);
+		return;
+	}
+
 	LLAPRFile* aprfile;
 	S32 bytes_written;
 	S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
@@ -1158,6 +1218,16 @@ void LLTextureCache::writeEntryToHeaderImmediately(S32& idx, Entry& entry, bool
 //mHeaderMutex is locked before calling this.
 void LLTextureCache::readEntryFromHeaderImmediately(S32& idx, Entry& entry)
 {
+	if (isHeaderEntriesMapped())
+	{
+		if (!readMappedEntry(idx, entry))
+		{
+			clearCorruptedCache(); //clear the cache.
+			idx = -1;//mark the idx invalid.
+		}
+		return;
+	}
+
 		S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
 		LLAPRFile* aprfile = openHeaderEntriesFile(true, offset);
 		S32 bytes_read = aprfile->read((void*)&entry, (S32)sizeof(Entry));
@@ -1174,9 +1244,7 @@ void LLTextureCache::readEntryFromHeaderImmediately(S32& idx, Entry& entry)
 //update an existing entry time stamp, delay writing.
 void LLTextureCache::updateEntryTimeStamp(S32 idx, Entry& entry)
 {
-	static const U32 MAX_ENTRIES_WITHOUT_TIME_STAMP = (U32)(LLTextureCache::sCacheMaxEntries * 0.75f);
-
-	if(mHeaderEntriesInfo.mEntries < MAX_ENTRIES_WITHOUT_TIME_STAMP)
+	if(!needsTimeStamp())
 	{
 		return; //there are enough empty entry index space, no need to stamp time.
 	}
@@ -1185,12 +1253,26 @@ void LLTextureCache::updateEntryTimeStamp(S32 idx, Entry& entry)
 	{
 		if (!mReadOnly)
 		{
-			entry.mTime = time(NULL);
-			mUpdatedEntryMap[idx] = entry;
+			if (isHeaderEntriesMapped())
+			{
+				touchMappedEntry(idx, entry);
+			}
+			else
+			{
+				entry.mTime = time(NULL);
+				mUpdatedEntryMap[idx] = entry;
+			}
 		}
 	}
 }
 
+bool LLTextureCache::needsTimeStamp() const
+{
+	static const U32 MAX_ENTRIES_WITHOUT_TIME_STAMP = (U32)(LLTextureCache::sCacheMaxEntries * 0.75f);
+
+	return mHeaderEntriesInfo.mEntries >= MAX_ENTRIES_WITHOUT_TIME_STAMP;
+}
+
 //update an existing entry, write to header file immediately.
 bool LLTextureCache::updateEntry(S32& idx, Entry& entry, S32 new_image_size, S32 new_data_size)
 {
@@ -1228,6 +1310,11 @@ bool LLTextureCache::updateEntry(S32& idx, Entry& entry, S32 new_image_size, S32
 		entry.mBodySize = new_body_size;
 		
 		writeEntryToHeaderImmediately(idx, entry, update_header);
+		if (update_header && idx >= 0)
+		{
+			// Entry is on disk now, publish it to lock-free readers.
+			insertEntryIndex(entry.mID, idx);
+		}
 	
 		if (mTexturesSizeTotal > sCacheMaxTexturesSize)
 		{
@@ -1294,6 +1381,7 @@ U32 LLTextureCache::openAndReadEntries(std::vector<Entry>& entries)
 		}
 	}
 	closeHeaderEntriesFile();
+	rebuildEntryIndex();
 	return num_entries;
 }
 
@@ -1302,7 +1390,14 @@ void LLTextureCache::writeEntriesAndClose(const std::vector<Entry>& entries)
 	S32 num_entries = entries.size();
 	llassert_always(num_entries == mHeaderEntriesInfo.mEntries);
 	
-	if (!mReadOnly)
+	if (!mReadOnly && isHeaderEntriesMapped())
+	{
+		for (S32 idx=0; idx<num_entries; idx++)
+		{
+			writeMappedEntry(idx, entries[idx]);
+		}
+	}
+	else if (!mReadOnly)
 	{
 		LLAPRFile* aprfile = openHeaderEntriesFile(false, (S32)sizeof(EntriesInfo));
 		for (S32 idx=0; idx<num_entries; idx++)
@@ -1375,6 +1470,7 @@ void LLTextureCache::readHeaderCache()
 	mHeaderMutex.lock();
 
 	mLRU.clear(); // always clear the LRU
+	mLRUTime = time(NULL);
 
 	readEntriesHeader();
 	
@@ -1507,6 +1603,11 @@ void LLTextureCache::clearCorruptedCache()
 
 void LLTextureCache::purgeAllTextures(bool purge_directories)
 {
+	if (purge_directories)
+	{
+		// texture.entries is about to be deleted.
+		unmapHeaderEntriesFile();
+	}
 	if (!mReadOnly)
 	{
 		const char* subdirs = "0123456789abcdef";
@@ -1534,6 +1635,7 @@ void LLTextureCache::purgeAllTextures(bool purge_directories)
 	mFreeList.clear();
 	mTexturesSizeTotal = 0;
 	mUpdatedEntryMap.clear();
+	rebuildEntryIndex();
 
 	// Info with 0 entries
 	mHeaderEntriesInfo.mVersion = sHeaderCacheVersion;
@@ -1714,6 +1816,20 @@ LLTextureCacheWorker* LLTextureCache::getWriter(handle_t handle)
 // Reads imagesize from the header, updates timestamp
 S32 LLTextureCache::getHeaderCacheEntry(const LLUUID& id, Entry& entry)
 {
+	if (isHeaderEntriesMapped())
+	{
+		S32 idx = findMappedEntry(id, entry);
+		if (idx >= 0 && entry.mImageSize > entry.mBodySize)
+		{
+			if (!mReadOnly && needsTimeStamp())
+			{
+				touchMappedEntry(idx, entry);
+			}
+			return idx;
+		}
+		// A miss may be spurious (see findMappedEntry), and a corrupted entry is removed by the locked path.
+	}
+
 	LLMutexLock lock(&mHeaderMutex);
 	S32 idx = openAndReadEntry(id, entry, false);
 	if (idx >= 0)
@@ -1881,7 +1997,12 @@ void LLTextureCache::removeCachedTexture(const LLUUID& id)
 		mTexturesSizeTotal -= mTexturesSizeMap[id];
 		mTexturesSizeMap.erase(id);
 	}
-	mHeaderIDMap.erase(id);
+	id_map_t::iterator iter = mHeaderIDMap.find(id);
+	if (iter != mHeaderIDMap.end())
+	{
+		eraseEntryIndex(id, iter->second);
+		mHeaderIDMap.erase(iter);
+	}
 	LLAPRFile::remove(getTextureFileName(id));		
 }
 
@@ -1907,6 +2028,7 @@ void LLTextureCache::removeEntry(S32 idx, Entry& entry, std::string& filename)
 
 		entry.mImageSize = -1;
 		entry.mBodySize = 0;
+		eraseEntryIndex(entry.mID, idx);
 		mHeaderIDMap.erase(entry.mID);
 		mTexturesSizeMap.erase(entry.mID);		
 		mFreeList.insert(idx);	
@@ -1941,6 +2063,287 @@ bool LLTextureCache::removeFromCache(const LLUUID& id)
 	return ret;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Mapped texture.entries
+
+//mHeaderMutex is locked before calling this.
+bool LLTextureCache::mapHeaderEntriesFile()
+{
+	if (mReadOnly || isHeaderEntriesMapped())
+	{
+		return isHeaderEntriesMapped();
+	}
+
+	// Flush delayed time stamps, from now on they are written in place.
+	if (!mUpdatedEntryMap.empty())
+	{
+		openHeaderEntriesFile(false, 0);
+		updatedHeaderEntriesFile();
+		closeHeaderEntriesFile();
+	}
+
+	U32 size = sizeof(EntriesInfo) + sCacheMaxEntries * sizeof(Entry);
+	if (LLAPRFile::size(mHeaderEntriesFileName) < (S32)size)
+	{
+		// Back every entry slot with file space so the mapping can be touched anywhere.
+		U8 zero = 0;
+		if (LLAPRFile::writeEx(mHeaderEntriesFileName, &zero, size - 1, 1) != 1)
+		{
+			LL_WARNS("TextureCache") << "Could not grow " << mHeaderEntriesFileName << ", not mapping it." << LL_ENDL;
+			return false;
+		}
+	}
+
+#if LL_WINDOWS
+	HANDLE file = CreateFileW(utf8str_to_utf16str(mHeaderEntriesFileName).c_str(), GENERIC_READ | GENERIC_WRITE,
+							  FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		// The mapping keeps its own reference to the file.
+		mMappedHeaderHandle = CreateFileMapping(file, NULL, PAGE_READWRITE, 0, size, NULL);
+		CloseHandle(file);
+	}
+	if (mMappedHeaderHandle)
+	{
+		mMappedHeaderFile = (U8*)MapViewOfFile(mMappedHeaderHandle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		if (!mMappedHeaderFile)
+		{
+			CloseHandle(mMappedHeaderHandle);
+			mMappedHeaderHandle = NULL;
+		}
+	}
+#else
+	int fd = ::open(mHeaderEntriesFileName.c_str(), O_RDWR);
+	if (fd >= 0)
+	{
+		void* addr = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (addr != MAP_FAILED)
+		{
+			mMappedHeaderFile = (U8*)addr;
+		}
+	}
+#endif
+	if (!mMappedHeaderFile)
+	{
+		LL_WARNS("TextureCache") << "Failed to map " << mHeaderEntriesFileName << LL_ENDL;
+		return false;
+	}
+
+	mMappedHeaderSize = size;
+	mMappedEntriesCount = sCacheMaxEntries;
+
+	// At most half full, so probe sequences stay short.
+	U32 capacity = 16;
+	while (capacity < sCacheMaxEntries * 2)
+	{
+		capacity <<= 1;
+	}
+	mEntryIndex = new LLAtomicU32[capacity];
+	mEntryIndexMask = capacity - 1;
+
+	mMappedEntriesInfo = (EntriesInfo*)mMappedHeaderFile;
+	mMappedEntries = (Entry*)(mMappedHeaderFile + sizeof(EntriesInfo));
+	rebuildEntryIndex();
+
+	LL_INFOS("TextureCache") << "Mapped " << mHeaderEntriesFileName << ", " << sCacheMaxEntries << " entries" << LL_ENDL;
+	return true;
+}
+
+// Only called when no cache workers are running.
+void LLTextureCache::unmapHeaderEntriesFile()
+{
+	if (!isHeaderEntriesMapped())
+	{
+		return;
+	}
+	mMappedEntries = NULL;
+	mMappedEntriesInfo = NULL;
+	mMappedEntriesCount = 0;
+#if LL_WINDOWS
+	UnmapViewOfFile(mMappedHeaderFile);
+	CloseHandle(mMappedHeaderHandle);
+	mMappedHeaderHandle = NULL;
+#else
+	::munmap(mMappedHeaderFile, mMappedHeaderSize);
+#endif
+	mMappedHeaderFile = NULL;
+	mMappedHeaderSize = 0;
+
+	delete [] mEntryIndex;
+	mEntryIndex = NULL;
+	mEntryIndexMask = 0;
+	mEntryIndexUsed = 0;
+}
+
+// Full memory barrier. LLAtomicU32 loads and stores are plain volatile accesses, so the
+// sequence lock orders them against the entry copy explicitly.
+static inline void entry_seq_fence()
+{
+#if LL_WINDOWS
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+// Sequence lock read: retry while a writer is busy with this stripe.
+// Gives up (returns false) if writers keep it busy; callers then take mHeaderMutex.
+bool LLTextureCache::readMappedEntry(S32 idx, Entry& entry) const
+{
+	if (idx < 0 || (U32)idx >= mMappedEntriesCount)
+	{
+		return false;
+	}
+	const LLAtomicU32& seq = mEntrySeq[idx % ENTRY_SEQ_STRIPES];
+	for (S32 tries = 0; tries < 100; ++tries)
+	{
+		U32 before = seq;
+		if (before & 1)
+		{
+			continue;
+		}
+		entry_seq_fence();		// The copy is not read before the sequence number.
+		entry = mMappedEntries[idx];
+		entry_seq_fence();		// The copy is complete before the sequence number is checked again.
+		if (seq == before)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// A single aligned store; a concurrent full entry write may win, which is harmless.
+void LLTextureCache::touchMappedEntry(S32 idx, Entry& entry)
+{
+	entry.mTime = time(NULL);
+	*(volatile U32*)&mMappedEntries[idx].mTime = entry.mTime;
+}
+
+//mHeaderMutex is locked before calling this.
+void LLTextureCache::writeMappedEntry(S32 idx, const Entry& entry)
+{
+	llassert_always(idx >= 0 && (U32)idx < mMappedEntriesCount);
+	LLAtomicU32& seq = mEntrySeq[idx % ENTRY_SEQ_STRIPES];
+	seq++;
+	entry_seq_fence();
+	mMappedEntries[idx] = entry;
+	entry_seq_fence();
+	seq++;
+}
+
+static inline U32 entry_index_hash(const LLUUID& id)
+{
+	U32 hash;
+	memcpy(&hash, id.mData, sizeof(hash));
+	return hash * 2654435761U;
+}
+
+S32 LLTextureCache::findMappedEntry(const LLUUID& id, Entry& entry) const
+{
+	if (!mEntryIndex)
+	{
+		return -1;
+	}
+	// Misses are not authoritative: rebuildEntryIndex() empties the table while it refills it,
+	// and readMappedEntry() gives up on a busy entry. Callers fall back to mHeaderIDMap.
+	U32 slot = entry_index_hash(id) & mEntryIndexMask;
+	for (U32 probes = 0; probes <= mEntryIndexMask; ++probes, slot = (slot + 1) & mEntryIndexMask)
+	{
+		U32 value = mEntryIndex[slot];
+		if (!value)
+		{
+			break;
+		}
+		if (value != ENTRY_INDEX_TOMBSTONE)
+		{
+			S32 idx = (S32)value - 1;
+			// The entry itself is the key, so a slot that is being reused just misses.
+			if (readMappedEntry(idx, entry) && entry.mID == id)
+			{
+				return idx;
+			}
+		}
+	}
+	return -1;
+}
+
+//mHeaderMutex is locked before calling this.
+void LLTextureCache::insertEntryIndex(const LLUUID& id, S32 idx)
+{
+	if (!mEntryIndex)
+	{
+		return;
+	}
+	if ((mEntryIndexUsed + 1) * 4 > (mEntryIndexMask + 1) * 3)
+	{
+		// Too many tombstones.
+		rebuildEntryIndex();
+	}
+	U32 slot = entry_index_hash(id) & mEntryIndexMask;
+	while (true)
+	{
+		U32 value = mEntryIndex[slot];
+		if (!value || value == ENTRY_INDEX_TOMBSTONE)
+		{
+			if (!value)
+			{
+				++mEntryIndexUsed;
+			}
+			mEntryIndex[slot] = (U32)idx + 1;
+			return;
+		}
+		if (value == (U32)idx + 1)
+		{
+			return;
+		}
+		slot = (slot + 1) & mEntryIndexMask;
+	}
+}
+
+//mHeaderMutex is locked before calling this.
+void LLTextureCache::eraseEntryIndex(const LLUUID& id, S32 idx)
+{
+	if (!mEntryIndex || idx < 0)
+	{
+		return;
+	}
+	U32 slot = entry_index_hash(id) & mEntryIndexMask;
+	for (U32 probes = 0; probes <= mEntryIndexMask; ++probes, slot = (slot + 1) & mEntryIndexMask)
+	{
+		U32 value = mEntryIndex[slot];
+		if (!value)
+		{
+			return;
+		}
+		if (value == (U32)idx + 1)
+		{
+			mEntryIndex[slot] = ENTRY_INDEX_TOMBSTONE;
+			return;
+		}
+	}
+}
+
+//mHeaderMutex is locked before calling this.
+//Lock-free readers may miss entries while this runs; they retry under mHeaderMutex.
+void LLTextureCache::rebuildEntryIndex()
+{
+	if (!mEntryIndex)
+	{
+		return;
+	}
+	for (U32 slot = 0; slot <= mEntryIndexMask; ++slot)
+	{
+		mEntryIndex[slot] = 0;
+	}
+	mEntryIndexUsed = 0;
+	for (id_map_t::iterator iter = mHeaderIDMap.begin(); iter != mHeaderIDMap.end(); ++iter)
+	{
+		insertEntryIndex(iter->first, iter->second);
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 LLTextureCache::ReadResponder::ReadResponder()
@@ -33,6 +33,7 @@
 #include "lluuid.h"
 
 #include "llworkerthread.h"
+#include "llatomic.h"
 
 class LLImageFormatted;
 class LLTextureCacheWorker;
@@ -168,6 +169,23 @@ private:
 	void updatedHeaderEntriesFile() ;
 	void lockHeaders() { mHeaderMutex.lock(); }
 	void unlockHeaders() { mHeaderMutex.unlock(); }
+	bool needsTimeStamp() const;
+
+	// texture.entries mapped into memory. While mapped, entries are read and
+	// written in place and cache hits don't take mHeaderMutex; misses are
+	// checked again under it.
+	bool mapHeaderEntriesFile();
+	void unmapHeaderEntriesFile();
+	bool isHeaderEntriesMapped() const { return mMappedEntries != NULL; }
+	bool readMappedEntry(S32 idx, Entry& entry) const;		// lock-free
+	void touchMappedEntry(S32 idx, Entry& entry);			// lock-free
+	void writeMappedEntry(S32 idx, const Entry& entry);	// mHeaderMutex must be locked
+	// Open-addressed id -> index table for the mapped entries.
+	// Lookups are lock-free, changes need mHeaderMutex.
+	S32 findMappedEntry(const LLUUID& id, Entry& entry) const;
+	void insertEntryIndex(const LLUUID& id, S32 idx);
+	void eraseEntryIndex(const LLUUID& id, S32 idx);
+	void rebuildEntryIndex();
 	
 private:
 	// Internal
@@ -207,6 +225,25 @@ private:
 	typedef std::map<S32, Entry> idx_entry_map_t;
 	idx_entry_map_t mUpdatedEntryMap;
 
+	// MAPPED HEADERS
+	U8* mMappedHeaderFile;
+	U32 mMappedHeaderSize;
+#if LL_WINDOWS
+	void* mMappedHeaderHandle;
+#endif
+	EntriesInfo* mMappedEntriesInfo;
+	Entry* mMappedEntries;
+	U32 mMappedEntriesCount;
+	// Sequence locks over the mapped entries, odd while an entry is being written.
+	enum { ENTRY_SEQ_STRIPES = 256 };
+	LLAtomicU32 mEntrySeq[ENTRY_SEQ_STRIPES];
+	// Slots hold idx + 1, 0 when empty, ENTRY_INDEX_TOMBSTONE when erased.
+	LLAtomicU32* mEntryIndex;
+	U32 mEntryIndexMask;
+	U32 mEntryIndexUsed;
+	// Entries touched after the LRU was built are not evicted from it.
+	U32 mLRUTime;
+
 	// Statics
 	static F32 sHeaderCacheVersion;
 	static U32 sCacheMaxEntries;
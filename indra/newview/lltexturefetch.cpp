@@ -61,6 +61,7 @@
 #include "llsdserialize.h"
 #include "llbuffer.h"
 #include "hippogridmanager.h"
+#include "aistatemachine.h"
 
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
@@ -170,6 +171,7 @@ public:
 	S32 callbackHttpGet(U32 offset, U32 length,
 						 const LLChannelDescriptors& channels,
 						 const LLHTTPClient::ResponderBase::buffer_ptr_t& buffer,
+						 U8*& body, S32 body_size,
 						 bool partial, bool success);
 	void callbackCacheRead(bool success, LLImageFormatted* image,
 						   S32 imagesize, BOOL islocal);
@@ -198,6 +200,7 @@ private:
 	/*virtual*/ void endWork(S32 param, bool aborted); // called from doWork() (MAIN THREAD)
 
 	void resetFormattedData();
+	void releaseHttpBuffer();
 	
 	void setImagePriority(F32 priority);
 	void setDesiredDiscard(S32 discard, S32 size);
@@ -277,7 +280,8 @@ private:
 	F32				mCacheReadTime;
 	LLTextureCache::handle_t mCacheReadHandle;
 	LLTextureCache::handle_t mCacheWriteHandle;
-	std::vector<U8> mHttpBuffer;
+	U8* mHttpBuffer;					// Received HTTP body, allocated from the private pool of LLImageBase.
+	S32 mHttpBufferSize;
 	S32 mRequestedSize;
 	S32 mRequestedOffset;
 	S32 mDesiredSize;
@@ -298,6 +302,11 @@ private:
 	S32 mActiveCount;
 	U32 mGetStatus;
 	std::string mGetReason;
+	LLPointer<AIStateMachine> mHTTPRequest;	// The HTTP GET in flight, if any.
+	U32 mHTTPRequestSerial;					// Incremented when mHTTPRequest is cancelled, so that a late reply is ignored.
+	// Protected by LLTextureFetch::mNetworkQueueMutex.
+	void const* mHTTPWaitService;			// Non-NULL while this worker is in LLTextureFetch::mHTTPWaitQueue.
+	F32 mHTTPWaitPriority;					// The image priority that this worker was queued with.
 	
 	// Work Data
 	LLMutex mWorkMutex;
@@ -328,19 +337,40 @@ class HTTPGetResponder : public LLHTTPClient::ResponderWithCompleted
 {
 	LOG_CLASS(HTTPGetResponder);
 public:
-	HTTPGetResponder(LLTextureFetch* fetcher, const LLUUID& id, U64 startTime, S32 requestedSize, U32 offset)
+	HTTPGetResponder(LLTextureFetch* fetcher, const LLUUID& id, U32 serial, U64 startTime, S32 requestedSize, U32 offset)
 		: mFetcher(fetcher)
 		, mID(id)
+		, mRequestSerial(serial)
 		, mMetricsStartTime(startTime)
 		, mRequestedSize(requestedSize)
 		, mRequestedOffset(offset)
 		, mReplyOffset(0)
 		, mReplyLength(0)
 		, mReplyFullLength(0)
+		, mBodyBuffer(NULL)
 	{
 	}
 	~HTTPGetResponder()
 	{
+		if (mBodyBuffer)
+		{
+			FREE_MEM(LLImageBase::getPrivatePool(), mBodyBuffer);
+		}
+	}
+
+	// Let curl write the requested range straight into memory that the fetch worker can hand to LLImageFormatted.
+	/*virtual*/ U8* getBodyBuffer(U32& size)
+	{
+		if (mRequestedSize <= 0)
+		{
+			return NULL;
+		}
+		if (!mBodyBuffer)
+		{
+			mBodyBuffer = (U8*)ALLOCATE_MEM(LLImageBase::getPrivatePool(), mRequestedSize);
+		}
+		size = mRequestedSize;
+		return mBodyBuffer;
 	}
 
 	/*virtual*/ bool needsHeaders(void) const { return true; }
@@ -410,6 +440,15 @@ public:
 		if (worker)
 		{
 			worker->lockWorkMutex();
+			if (worker->mHTTPRequestSerial != mRequestSerial)
+			{
+				// This request was cancelled by LLTextureFetch::updateRequestPriority, which already
+				// removed it from the HTTP queue and put the worker back in SEND_HTTP_REQ.
+				LL_DEBUGS("Texture") << "Ignoring reply of cancelled request for " << mID << LL_ENDL;
+				worker->unlockWorkMutex();
+				return;
+			}
+			worker->mHTTPRequest = NULL;
 			bool success = false;
 			bool partial = false;
 			if (HTTP_OK <= mStatus &&  mStatus < HTTP_MULTIPLE_CHOICES)
@@ -425,7 +464,13 @@ public:
 				worker->setGetStatus(mStatus, mReason);
 				llwarns << "CURL GET FAILED, status:" << mStatus << " reason:" << mReason << llendl;
 			}
-			S32 data_size = worker->callbackHttpGet(mReplyOffset, mReplyLength, channels, buffer, partial, success);
+			// If the body was written to mBodyBuffer then the worker might take it over, in which case it resets body.
+			U8* body = mBodyBufferSize ? mBodyBuffer : NULL;
+			S32 data_size = worker->callbackHttpGet(mReplyOffset, mReplyLength, channels, buffer, body, mBodyBufferSize, partial, success);
+			if (mBodyBufferSize && !body)
+			{
+				mBodyBuffer = NULL;
+			}
 			
 			if(log_texture_traffic && data_size > 0)
 			{
@@ -455,12 +500,14 @@ private:
 
 	LLTextureFetch* mFetcher;
 	LLUUID mID;
+	U32 mRequestSerial;
 	U64 mMetricsStartTime;
 	S32 mRequestedSize;
 	U32 mRequestedOffset;
 	U32 mReplyOffset;
 	U32 mReplyLength;
 	U32 mReplyFullLength;
+	U8* mBodyBuffer;
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -804,6 +851,8 @@ LLTextureFetchWorker::LLTextureFetchWorker(LLTextureFetch* fetcher,
 	  mCacheReadTime(0.f),
 	  mCacheReadHandle(LLTextureCache::nullHandle()),
 	  mCacheWriteHandle(LLTextureCache::nullHandle()),
+	  mHttpBuffer(NULL),
+	  mHttpBufferSize(0),
 	  mRequestedSize(0),
 	  mRequestedOffset(0),
 	  mDesiredSize(TEXTURE_CACHE_ENTRY_SIZE),
@@ -822,6 +871,9 @@ LLTextureFetchWorker::LLTextureFetchWorker(LLTextureFetch* fetcher,
 	  mRetryAttempt(0),
 	  mActiveCount(0),
 	  mGetStatus(0),
+	  mHTTPRequestSerial(0),
+	  mHTTPWaitService(NULL),
+	  mHTTPWaitPriority(0.f),
 	  mFirstPacket(0),
 	  mLastPacket(-1),
 	  mTotalPackets(0),
@@ -873,7 +925,9 @@ LLTextureFetchWorker::~LLTextureFetchWorker()
 		mFetcher->mTextureCache->writeComplete(mCacheWriteHandle, true);
 	}
 	mFormattedImage = NULL;
+	releaseHttpBuffer();
 	clearPackets();
+	mFetcher->removeFromHTTPWaitQueue(this);
 	unlockWorkMutex();
 	mFetcher->removeFromHTTPQueue(mID);
 	mFetcher->updateStateStats(mCacheReadCount, mCacheWriteCount);
@@ -977,9 +1031,19 @@ void LLTextureFetchWorker::setImagePriority(F32 priority)
 	}
 }
 
+void LLTextureFetchWorker::releaseHttpBuffer()
+{
+	if (mHttpBuffer)
+	{
+		FREE_MEM(LLImageBase::getPrivatePool(), mHttpBuffer);
+		mHttpBuffer = NULL;
+	}
+	mHttpBufferSize = 0;
+}
+
 void LLTextureFetchWorker::resetFormattedData()
 {
-	std::vector<U8>().swap(mHttpBuffer);
+	releaseHttpBuffer();
 	if (mFormattedImage.notNull())
 	{
 		mFormattedImage->deleteData();
@@ -1060,7 +1124,7 @@ bool LLTextureFetchWorker::doWork(S32 param)
 		mSentRequest = UNSENT;
 		mDecoded  = FALSE;
 		mWritten  = FALSE;
-		std::vector<U8>().swap(mHttpBuffer);
+		releaseHttpBuffer();
 		mHttpReplySize = 0;
 		mHttpReplyOffset = 0;
 		mHaveAllData = FALSE;
@@ -1369,6 +1433,13 @@ bool LLTextureFetchWorker::doWork(S32 param)
 			}
 		}
 
+		// Requests to the same service are sent in order of descending image priority,
+		// so that textures that are in view do not wait behind ones that are not.
+		if (!mFetcher->mayRequestHTTP(this))
+		{
+			return false ; //wait.
+		}
+
 		// Let AICurl decide if we can process more HTTP requests at the moment or not.
 
 		// AIPerService::approveHTTPRequestFor returns approvement for ONE request.
@@ -1379,6 +1450,7 @@ bool LLTextureFetchWorker::doWork(S32 param)
 			return false ; //wait.
 		}
 
+		mFetcher->removeFromHTTPWaitQueue(this);
 		mFetcher->removeFromNetworkQueue(this, false);
 
 		mRequestedSize = mDesiredSize;
@@ -1420,8 +1492,8 @@ bool LLTextureFetchWorker::doWork(S32 param)
 				headers.addHeader("Range", llformat(range_format, mRequestedOffset, range_end));
 			}
 			LLHTTPClient::request(mUrl, LLHTTPClient::HTTP_GET, NULL,
-				new HTTPGetResponder(mFetcher, mID, LLTimer::getTotalTime(), mRequestedSize, mRequestedOffset),
-				headers, approved/*,*/ DEBUG_CURLIO_PARAM(debug_off), keep_alive, no_does_authentication, allow_compressed_reply, NULL, 0, NULL);
+				new HTTPGetResponder(mFetcher, mID, mHTTPRequestSerial, LLTimer::getTotalTime(), mRequestedSize, mRequestedOffset),
+				headers, approved/*,*/ DEBUG_CURLIO_PARAM(debug_off), keep_alive, no_does_authentication, allow_compressed_reply, NULL, 0, NULL, &mHTTPRequest);
 		}
 		else
 		{
@@ -1626,7 +1698,7 @@ bool LLTextureFetchWorker::doWork(S32 param)
 				mUrl.clear();
 			}
 			
-			if(mHttpBuffer.empty())//no data received.
+			if(!mHttpBuffer)//no data received.
 			{
 				//abort.
 				setState(DONE);
@@ -1634,7 +1706,7 @@ bool LLTextureFetchWorker::doWork(S32 param)
 				return true;
 			}
 
-			S32 append_size(mHttpBuffer.size());
+			S32 append_size(mHttpBufferSize);
 			S32 total_size(cur_size + append_size);
 			S32 src_offset(0);
 			llassert_always(append_size == mRequestedSize);
@@ -1678,19 +1750,30 @@ bool LLTextureFetchWorker::doWork(S32 param)
 				mFileSize = total_size + 1 ; //flag the file is not fully loaded.
 			}
 			
-			U8* buffer = (U8*)ALLOCATE_MEM(LLImageBase::getPrivatePool(), total_size);
-			if (cur_size > 0)
+			if (cur_size == 0 && src_offset == 0)
 			{
-				memcpy(buffer, mFormattedImage->getData(), cur_size);
+				// The received data is the whole image so far: hand it over without copying.
+				// NOTE: setData releases current data and owns new data (mHttpBuffer)
+				mFormattedImage->setData(mHttpBuffer, total_size);
+				mHttpBuffer = NULL;
+				mHttpBufferSize = 0;
 			}
-			if (append_size > 0)
+			else
 			{
-				memcpy(buffer + cur_size, &mHttpBuffer[src_offset], append_size);
+				U8* buffer = (U8*)ALLOCATE_MEM(LLImageBase::getPrivatePool(), total_size);
+				if (cur_size > 0)
+				{
+					memcpy(buffer, mFormattedImage->getData(), cur_size);
+				}
+				if (append_size > 0)
+				{
+					memcpy(buffer + cur_size, mHttpBuffer + src_offset, append_size);
+				}
+				// NOTE: setData releases current data and owns new data (buffer)
+				mFormattedImage->setData(buffer, total_size);
+				// delete temp data
+				releaseHttpBuffer();
 			}
-			// NOTE: setData releases current data and owns new data (buffer)
-			mFormattedImage->setData(buffer, total_size);
-			// delete temp data
-			std::vector<U8>().swap(mHttpBuffer);
 			mHttpReplySize = 0;
 			mHttpReplyOffset = 0;
 
@@ -1892,6 +1975,7 @@ void LLTextureFetchWorker::endWork(S32 param, bool aborted)
 		mFetcher->mImageDecodeThread->abortRequest(mDecodeHandle, false);
 		mDecodeHandle = 0;
 	}
+	mFetcher->removeFromHTTPWaitQueue(this);
 	mFormattedImage = NULL;
 }
 
@@ -2025,6 +2109,7 @@ bool LLTextureFetchWorker::processSimulatorPackets()
 S32 LLTextureFetchWorker::callbackHttpGet(U32 offset, U32 length,
 										   const LLChannelDescriptors& channels,
 										   const LLHTTPClient::ResponderBase::buffer_ptr_t& buffer,
+										   U8*& body, S32 body_size,
 										   bool partial, bool success)
 {
 	S32 data_size = 0 ;
@@ -2043,16 +2128,25 @@ S32 LLTextureFetchWorker::callbackHttpGet(U32 offset, U32 length,
 	if (success)
 	{
 		// get length of stream:
-		data_size = buffer->countAfter(channels.in(), NULL);
+		data_size = body ? body_size : buffer->countAfter(channels.in(), NULL);
 
 		LL_DEBUGS("Texture") << "HTTP RECEIVED: " << mID.asString() << " Bytes: " << data_size << LL_ENDL;
 		if (data_size > 0)
 		{
 			LLViewerStatsRecorder::instance().textureFetch(data_size);
-			// *TODO: set the formatted image data here directly to avoid the copy
-			llassert(mHttpBuffer.empty());
-			mHttpBuffer.resize(data_size);
-			buffer->readAfter(channels.in(), NULL, &mHttpBuffer[0], data_size);
+			llassert(!mHttpBuffer);
+			if (body)
+			{
+				// The body was written directly into memory of our own; take it over.
+				mHttpBuffer = body;
+				body = NULL;
+			}
+			else
+			{
+				mHttpBuffer = (U8*)ALLOCATE_MEM(LLImageBase::getPrivatePool(), data_size);
+				buffer->readAfter(channels.in(), NULL, mHttpBuffer, data_size);
+			}
+			mHttpBufferSize = data_size;
 
 			if (partial)
 			{
@@ -2179,6 +2273,13 @@ void LLTextureFetchWorker::callbackDecoded(bool success, LLImageRaw* raw, LLImag
 	llassert_always(mFormattedImage.notNull());
 	
 	mDecodeHandle = 0;
+	if (success && mHaveAllData && mFormattedImage->getDiscardLevel() > 0)
+	{
+		// We asked for the full resolution, but the decoder found the codestream truncated
+		// and decoded a lower one. Fetching again won't get more data, so treat it as a bad file.
+		LL_WARNS("Texture") << mID << ": codestream is truncated although all data was loaded" << LL_ENDL;
+		success = false;
+	}
 	if (success)
 	{
 		llassert_always(raw);
@@ -2432,6 +2533,61 @@ void LLTextureFetch::removeFromHTTPQueue(const LLUUID& id, S32 received_size)
 	mHTTPTextureQueue.erase(id);
 }
 
+// Called with the worker and mNetworkQueueMutex locked.
+void LLTextureFetch::insertInHTTPWaitQueue(LLTextureFetchWorker* worker)
+{
+	void const* service = worker->mPerServicePtr.get();
+	if (worker->mHTTPWaitService == service && worker->mHTTPWaitPriority == worker->mImagePriority)
+	{
+		return;
+	}
+	if (worker->mHTTPWaitService)
+	{
+		mHTTPWaitQueue[worker->mHTTPWaitService].erase(http_wait_key_t(-worker->mHTTPWaitPriority, worker->mID));
+	}
+	worker->mHTTPWaitService = service;
+	worker->mHTTPWaitPriority = worker->mImagePriority;
+	mHTTPWaitQueue[service].insert(http_wait_key_t(-worker->mHTTPWaitPriority, worker->mID));
+}
+
+// Called with the worker locked.
+bool LLTextureFetch::mayRequestHTTP(LLTextureFetchWorker* worker)
+{
+	// Only the highest priority waiting requests for a service get a shot at the requests that it can still approve.
+	S32 slots = llmax(1, PerService_rat(*worker->mPerServicePtr)->approvable_requests(cap_texture));
+	LLMutexLock lock(&mNetworkQueueMutex);
+	insertInHTTPWaitQueue(worker);
+	http_wait_set_t const& waiting(mHTTPWaitQueue[worker->mHTTPWaitService]);
+	for (http_wait_set_t::const_iterator iter = waiting.begin(); iter != waiting.end() && slots > 0; ++iter, --slots)
+	{
+		if (iter->second == worker->mID)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Called with the worker locked.
+void LLTextureFetch::removeFromHTTPWaitQueue(LLTextureFetchWorker* worker)
+{
+	LLMutexLock lock(&mNetworkQueueMutex);
+	if (!worker->mHTTPWaitService)
+	{
+		return;
+	}
+	http_wait_queue_t::iterator iter = mHTTPWaitQueue.find(worker->mHTTPWaitService);
+	if (iter != mHTTPWaitQueue.end())
+	{
+		iter->second.erase(http_wait_key_t(-worker->mHTTPWaitPriority, worker->mID));
+		if (iter->second.empty())
+		{
+			mHTTPWaitQueue.erase(iter);
+		}
+	}
+	worker->mHTTPWaitService = NULL;
+}
+
 void LLTextureFetch::deleteRequest(const LLUUID& id, bool cancel)
 {
 	lockQueue() ;
@@ -2590,9 +2746,41 @@ bool LLTextureFetch::updateRequestPriority(const LLUUID& id, F32 priority)
 	LLTextureFetchWorker* worker = getWorker(id);
 	if (worker)
 	{
+		LLPointer<AIStateMachine> cancelled_request;
 		worker->lockWorkMutex();
 		worker->setImagePriority(priority);
+		bool others_waiting = false;
+		{
+			LLMutexLock lock(&mNetworkQueueMutex);
+			if (worker->mHTTPWaitService)
+			{
+				// Keep the wait queue sorted on the new priority.
+				insertInHTTPWaitQueue(worker);
+			}
+			else if (worker->mPerServicePtr)
+			{
+				http_wait_queue_t::iterator iter = mHTTPWaitQueue.find(worker->mPerServicePtr.get());
+				others_waiting = iter != mHTTPWaitQueue.end() && !iter->second.empty();
+			}
+		}
+		// A texture that dropped out of view should not hold on to a connection that other textures are waiting for.
+		if (others_waiting && priority < F_ALMOST_ZERO && worker->mHTTPRequest &&
+			worker->mState == LLTextureFetchWorker::WAIT_HTTP_REQ && !worker->mLoaded)
+		{
+			LL_DEBUGS("Texture") << "Cancelling HTTP request for " << id << LL_ENDL;
+			cancelled_request = worker->mHTTPRequest;
+			worker->mHTTPRequest = NULL;
+			++worker->mHTTPRequestSerial;	// Make HTTPGetResponder ignore any reply that is already on its way.
+			removeFromHTTPQueue(id);
+			worker->setPriority(LLWorkerThread::PRIORITY_LOW | worker->mWorkPriority);
+			worker->setState(LLTextureFetchWorker::SEND_HTTP_REQ);
+		}
 		worker->unlockWorkMutex();
+		// Abort outside the worker lock, because abort() waits for a running reply callback, which locks the worker.
+		if (cancelled_request)
+		{
+			cancelled_request->abort();
+		}
 		res = true;
 	}
 	return res;
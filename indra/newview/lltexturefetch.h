@@ -122,12 +122,15 @@ protected:
 	void removeFromNetworkQueue(LLTextureFetchWorker* worker, bool cancel);
 	void addToHTTPQueue(const LLUUID& id);
 	void removeFromHTTPQueue(const LLUUID& id, S32 received_size = 0);
+	bool mayRequestHTTP(LLTextureFetchWorker* worker);
+	void removeFromHTTPWaitQueue(LLTextureFetchWorker* worker);
 	void removeRequest(LLTextureFetchWorker* worker, bool cancel, bool bNeedsLock = true);
 
 	// Overrides from the LLThread tree
 	bool runCondition();
 
 private:
+	void insertInHTTPWaitQueue(LLTextureFetchWorker* worker);
 	void sendRequestListToSimulators();
 	/*virtual*/ void startThread(void);
 	/*virtual*/ void endThread(void);
@@ -147,7 +150,7 @@ public:
 	
 private:
 	LLMutex mQueueMutex;        //to protect mRequestMap only
-	LLMutex mNetworkQueueMutex; //to protect mNetworkQueue, mHTTPTextureQueue and mCancelQueue.
+	LLMutex mNetworkQueueMutex; //to protect mNetworkQueue, mHTTPTextureQueue, mHTTPWaitQueue and mCancelQueue.
 
 public:
 	static LLStat sCacheHitRate;
@@ -167,6 +170,11 @@ private:
 	queue_t mHTTPTextureQueue;
 	typedef std::map<LLHost,std::set<LLUUID> > cancel_queue_t;
 	cancel_queue_t mCancelQueue;
+	// Workers waiting for approval of an HTTP request, per AIPerService, highest image priority first.
+	typedef std::pair<F32, LLUUID> http_wait_key_t;		// (-priority, id)
+	typedef std::set<http_wait_key_t> http_wait_set_t;
+	typedef std::map<void const*, http_wait_set_t> http_wait_queue_t;
+	http_wait_queue_t mHTTPWaitQueue;
 	LLTextureInfo mTextureInfo;
 
 	//debug use
@@ -670,7 +670,7 @@ void LLGLTexMemBar::draw()
 					LLAppViewer::getTextureCache()->getNumReads(), LLAppViewer::getTextureCache()->getNumWrites(),
 					LLLFSThread::sLocal->getPending(),
 					LLAppViewer::getImageDecodeThread()->getPending(),
-					LLImageRaw::sRawImageCount, LLImageRaw::sRawImageCachedCount,
+					(S32)LLImageRaw::sRawImageCount, LLImageRaw::sRawImageCachedCount,
 					AICurlInterface::getNumHTTPCommands(),
 					AICurlInterface::getNumHTTPQueued(),
 					AICurlInterface::getNumHTTPAdded(),
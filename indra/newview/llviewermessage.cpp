@@ -104,6 +104,7 @@
 #include "llviewerwindow.h"
 #include "llvlmanager.h"
 #include "llvoavatar.h"
+#include "llvocache.h"
 #include "llworld.h"
 #include "pipeline.h"
 #include "llfloaterworldmap.h"
@@ -4524,6 +4525,11 @@ void process_teleport_finish(LLMessageSystem* msg, void**)
 	msg->getU32Fast(_PREHASH_Info, _PREHASH_RegionSizeY, region_size_y);
 	LLWorld::getInstance()->setRegionSize(region_size_x, region_size_y);
 // </FS:CR> Aurora Sim
+	if (!LLWorld::getInstance()->getRegionFromHandle(region_handle) && LLVOCache::hasInstance())
+	{
+		// Read the object cache of the new region while we connect to it; the region handshake needs it.
+		LLVOCache::getInstance()->prefetch(region_handle);
+	}
 	LLViewerRegion* regionp =  LLWorld::getInstance()->addRegion(region_handle, sim_host);
 
 /*
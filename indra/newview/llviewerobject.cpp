@@ -65,6 +65,7 @@
 #include "llfloatertools.h"
 #include "llfollowcam.h"
 #include "llhudtext.h"
+#include "llobjectupdatedecoder.h"
 #include "llselectmgr.h"
 #include "llrendersphere.h"
 #include "lltooldraganddrop.h"
@@ -258,7 +259,8 @@ LLViewerObject::LLViewerObject(const LLUUID &id, const LLPCode pcode, LLViewerRe
 	mPhysicsShapeUnknown(true),
 	mAttachmentItemID(LLUUID::null),
 	mLastUpdateType(OUT_UNKNOWN),
-	mLastUpdateCached(FALSE)
+	mLastUpdateCached(FALSE),
+	mStagedUpdate(NULL)
 {
 	if(!is_global)
 	{
@@ -1558,6 +1560,26 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				}
 				test_pos_parent = getPosition();
 				dp->unpackVector3(new_pos_parent, "Pos");
+
+				LLStagedObjectUpdate* staged = getStagedUpdate();
+				LLDataPackerBinaryBuffer* staged_dp = static_cast<LLDataPackerBinaryBuffer*>(dp);
+				if (staged && staged->mMotionDecoded && staged_dp->getCurrentSize() == staged->mMotionOffset)
+				{
+					// LLObjectUpdateDecoder::decodeTerse dequantized this for the whole message.
+					const LLVector4a* motion = staged->mMotion;
+					staged_dp->setCurrentSize(staged->mMotionOffset + TERSE_MOTION_SIZE);
+					setVelocity(LLVector3(motion[0].getF32ptr()));
+					setAcceleration(LLVector3(motion[1].getF32ptr()));
+					const F32* rot = motion[2].getF32ptr();
+					new_rot.mQ[VX] = rot[VX];
+					new_rot.mQ[VY] = rot[VY];
+					new_rot.mQ[VZ] = rot[VZ];
+					new_rot.mQ[VS] = rot[VS];
+					new_angv.set(motion[3].getF32ptr());
+					setAngularVelocity(new_angv);
+					break;
+				}
+
 				dp->unpackU16(val[VX], "VelX");
 				dp->unpackU16(val[VY], "VelY");
 				dp->unpackU16(val[VZ], "VelZ");
@@ -1601,9 +1623,26 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 					gFloaterTools->dirty();
 				}
 	
-				dp->unpackU32(crc, "CRC");
+				// Use what LLObjectUpdateDecoder read on a decode thread if it got to the same place in
+				// the data, otherwise read it now. Staged and compressed updates always come with a
+				// LLDataPackerBinaryBuffer.
+				LLStagedObjectUpdate* staged = getStagedUpdate();
+				LLDataPackerBinaryBuffer* binary_dp = static_cast<LLDataPackerBinaryBuffer*>(dp);
+				LLFullObjectUpdate unpacked;
+				const LLFullObjectUpdate* fields = &unpacked;
+				if (staged && staged->mFieldsDecoded && binary_dp->getCurrentSize() == staged->mFieldsOffset)
+				{
+					fields = &staged->mFields;
+					binary_dp->setCurrentSize(staged->mFieldsEnd);
+				}
+				else
+				{
+					LLObjectUpdateDecoder::unpackFullUpdate(*binary_dp, unpacked);
+				}
+
+				crc = fields->mCRC;
 				mTotalCRC = crc;
-				dp->unpackU8(material, "Material");
+				material = fields->mMaterial;
 				U8 old_material = getMaterial();
 				if (old_material != material)
 				{
@@ -1613,56 +1652,37 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 						gPipeline.markMoved(mDrawable, FALSE); // undamped
 					}
 				}
-				dp->unpackU8(click_action, "ClickAction");
+				click_action = fields->mClickAction;
 				setClickAction(click_action);
-				dp->unpackVector3(new_scale, "Scale");
-				dp->unpackVector3(new_pos_parent, "Pos");
-				LLVector3 vec;
-				dp->unpackVector3(vec, "Rot");
-				new_rot.unpackFromVector3(vec);
+				new_scale = fields->mScale;
+				new_pos_parent = fields->mPos;
+				new_rot.unpackFromVector3(fields->mRot);
 				setAcceleration(LLVector3::zero);
 
-				U32 value;
-				dp->unpackU32(value, "SpecialCode");
+				U32 value = fields->mFlags;
 				dp->setPassFlags(value);
-				dp->unpackUUID(owner_id, "Owner");
+				owner_id = fields->mOwnerID;
 
 				mOwnerID = owner_id;
 
 				if (value & 0x80)
 				{
-					dp->unpackVector3(new_angv, "Omega");
+					new_angv = fields->mAngularVelocity;
 					setAngularVelocity(new_angv);
 				}
 
-				if (value & 0x20)
-				{
-					dp->unpackU32(parent_id, "ParentID");
-				}
-				else
-				{
-					parent_id = 0;
-				}
+				parent_id = fields->mParentID;
 
-				S32 sp_size;
-				U32 size;
-				if (value & 0x2)
+				delete [] mData;
+				mData = NULL;
+				if (value & 0x3)
 				{
-					sp_size = 1;
-					delete [] mData;
-					mData = new U8[1];
-					dp->unpackU8(((U8*)mData)[0], "TreeData");
-				}
-				else if (value & 0x1)
-				{
-					dp->unpackU32(size, "ScratchPadSize");
-					delete [] mData;
-					mData = new U8[size];
-					dp->unpackBinaryData((U8 *)mData, sp_size, "PartData");
-				}
-				else
-				{
-					mData = NULL;
+					// Tree data or scratch pad
+					mData = new U8[llmax((S32)fields->mScratchPad.size(), 1)];
+					if (!fields->mScratchPad.empty())
+					{
+						memcpy(mData, &fields->mScratchPad[0], fields->mScratchPad.size());
+					}
 				}
 
 				mHudTextString.clear();				//Cache for reset on debug infodisplay toggle.
@@ -1682,9 +1702,8 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				if (value & 0x4)
 				{
 					//Cache for reset on debug infodisplay toggle.
-					dp->unpackString(mHudTextString, "Text");
-					LLColor4U coloru;
-					dp->unpackBinaryDataFixed(coloru.mV, 4, "Color");
+					mHudTextString = fields->mText;
+					LLColor4U coloru = fields->mTextColor;
 					coloru.mV[3] = 255 - coloru.mV[3];
 					mHudTextColor = LLColor4(coloru);	//Cache for reset on debug infodisplay toggle.
 					if(mText->getDoFade())	//Fade is disabled when this is being overridden by debug text.
@@ -1705,19 +1724,15 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 					mText = NULL;
 				}
 
-                std::string media_url;
-				if (value & 0x200)
-				{
-					dp->unpackString(media_url, "MediaURL");
-				}
-                retval |= checkMediaURL(media_url);
+				retval |= checkMediaURL(fields->mMediaURL);
 
 				//
 				// Unpack particle system data
 				//
-				if (value & 0x8)
+				if ((value & 0x8) && !fields->mParticleSystem.empty())
 				{
-					unpackParticleSource(*dp, owner_id, true);
+					LLDataPackerBinaryBuffer part_dp(const_cast<U8*>(&fields->mParticleSystem[0]), fields->mParticleSystem.size());
+					unpackParticleSource(part_dp, owner_id, true);
 				}
 				else if (!(value & 0x400))
 				{
@@ -1732,18 +1747,14 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				}
 
 				// Unpack extra params
-				U8 num_parameters;
-				dp->unpackU8(num_parameters, "num_params");
-				U8 param_block[MAX_OBJECT_PARAMS_SIZE];
-				for (U8 param=0; param<num_parameters; ++param)
+				for (U32 param = 0; param < fields->mExtraParameters.size(); ++param)
 				{
-					U16 param_type;
-					S32 param_size;
-					dp->unpackU16(param_type, "param_type");
-					dp->unpackBinaryData(param_block, param_size, "param_data");
-					//llinfos << "Param type: " << param_type << ", Size: " << param_size << llendl;
-					LLDataPackerBinaryBuffer dp2(param_block, param_size);
-					unpackParameterEntry(param_type, &dp2);
+					const std::pair<U16, std::vector<U8> >& parameter = fields->mExtraParameters[param];
+					//llinfos << "Param type: " << parameter.first << ", Size: " << parameter.second.size() << llendl;
+					U8 empty = 0;
+					LLDataPackerBinaryBuffer dp2(parameter.second.empty() ? &empty : const_cast<U8*>(&parameter.second[0]),
+												 parameter.second.size());
+					unpackParameterEntry(parameter.first, &dp2);
 				}
 
 				for (iter = mExtraParameterList.begin(); iter != mExtraParameterList.end(); ++iter)
@@ -1757,18 +1768,15 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 
 				if (value & 0x10)
 				{
-					dp->unpackUUID(sound_uuid, "SoundUUID");
-					dp->unpackF32(gain, "SoundGain");
-					dp->unpackU8(sound_flags, "SoundFlags");
-					dp->unpackF32(cutoff, "SoundRadius");
+					sound_uuid = fields->mSoundID;
+					gain = fields->mSoundGain;
+					sound_flags = fields->mSoundFlags;
+					cutoff = fields->mSoundRadius;
 				}
 
 				if (value & 0x100)
 				{
-					std::string name_value_list;
-					dp->unpackString(name_value_list, "NV");
-
-					setNameValueList(name_value_list);
+					setNameValueList(fields->mNameValues);
 				}
 
 				mTotalCRC = crc;
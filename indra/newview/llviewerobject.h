@@ -73,6 +73,7 @@ class LLViewerObject;
 class LLViewerPartSourceScript;
 class LLViewerRegion;
 class LLViewerObjectMedia;
+struct LLStagedObjectUpdate;
 class LLVOInventoryListener;
 class LLVOAvatar;
 
@@ -820,10 +821,14 @@ public:
 	void setLastUpdateType(EObjectUpdateType last_update_type);
 	BOOL getLastUpdateCached() const;
 	void setLastUpdateCached(BOOL last_update_cached);
+	// What was decoded of the update that processUpdateMessage is processing, if anything.
+	LLStagedObjectUpdate* getStagedUpdate() const		{ return mStagedUpdate; }
+	void setStagedUpdate(LLStagedObjectUpdate* update)	{ mStagedUpdate = update; }
 private:
 	LLUUID mAttachmentItemID; // ItemID when item is in user inventory.
 	EObjectUpdateType	mLastUpdateType;
 	BOOL	mLastUpdateCached;
+	LLStagedObjectUpdate* mStagedUpdate;
 };
 
 ///////////////////
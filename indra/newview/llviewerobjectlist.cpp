@@ -75,6 +75,8 @@
 #include "u64.h"
 #include "llviewertexturelist.h"
 #include "lldatapacker.h"
+#include "llobjectupdatedecoder.h"
+#include "llsys.h"
 #ifdef LL_STANDALONE
 #include <zlib.h>
 #else
@@ -130,6 +132,7 @@ LLViewerObjectList::LLViewerObjectList()
 	mNumDeadObjectUpdates = 0;
 	mNumUnknownKills = 0;
 	mNumUnknownUpdates = 0;
+	mUpdateDecoder = NULL;
 }
 
 LLViewerObjectList::~LLViewerObjectList()
@@ -147,6 +150,9 @@ void LLViewerObjectList::destroy()
 	mMapObjects.clear();
 	mUUIDObjectMap.clear();
 	mUUIDAvatarMap.clear();
+
+	delete mUpdateDecoder;
+	mUpdateDecoder = NULL;
 }
 
 
@@ -251,12 +257,15 @@ void LLViewerObjectList::processUpdateCore(LLViewerObject* objectp,
 										   U32 i, 
 										   const EObjectUpdateType update_type, 
 										   LLDataPacker* dpp, 
-										   BOOL just_created)
+										   BOOL just_created,
+										   LLStagedObjectUpdate* staged)
 {
 	LLMessageSystem* msg = gMessageSystem;
 
 	// ignore returned flags
+	objectp->setStagedUpdate(staged);
 	objectp->processUpdateMessage(msg, user_data, i, update_type, dpp);
+	objectp->setStagedUpdate(NULL);
 		
 	if (objectp->isDead())
 	{
@@ -316,6 +325,79 @@ void LLViewerObjectList::processUpdateCore(LLViewerObject* objectp,
 
 static LLFastTimer::DeclareTimer FTM_PROCESS_OBJECTS("Process Objects");
 
+// Fields read for every object in an update, resolved once to their offsets in the packet.
+static LLMessageFieldRef sFullRegionHandle(_PREHASH_ObjectUpdate, _PREHASH_RegionData, _PREHASH_RegionHandle);
+static LLMessageFieldRef sFullID(_PREHASH_ObjectUpdate, _PREHASH_ObjectData, _PREHASH_ID);
+static LLMessageFieldRef sFullFullID(_PREHASH_ObjectUpdate, _PREHASH_ObjectData, _PREHASH_FullID);
+static LLMessageFieldRef sCachedRegionHandle(_PREHASH_ObjectUpdateCached, _PREHASH_RegionData, _PREHASH_RegionHandle);
+static LLMessageFieldRef sCachedID(_PREHASH_ObjectUpdateCached, _PREHASH_ObjectData, _PREHASH_ID);
+static LLMessageFieldRef sCachedCRC(_PREHASH_ObjectUpdateCached, _PREHASH_ObjectData, _PREHASH_CRC);
+static LLMessageFieldRef sCompressedRegionHandle(_PREHASH_ObjectUpdateCompressed, _PREHASH_RegionData, _PREHASH_RegionHandle);
+static LLMessageFieldRef sCompressedData(_PREHASH_ObjectUpdateCompressed, _PREHASH_ObjectData, _PREHASH_Data);
+static LLMessageFieldRef sTerseRegionHandle(_PREHASH_ImprovedTerseObjectUpdate, _PREHASH_RegionData, _PREHASH_RegionHandle);
+static LLMessageFieldRef sTerseData(_PREHASH_ImprovedTerseObjectUpdate, _PREHASH_ObjectData, _PREHASH_Data);
+
+const U32 MAX_OBJECT_UPDATE_DECODE_THREADS = 8;
+
+// Copies the data of the updates in the current message (or finds it in the object cache),
+// and has mUpdateDecoder decode it.
+LLStagedObjectUpdate* LLViewerObjectList::stageObjectUpdates(LLMessageSystem* mesgsys, LLViewerRegion* regionp, S32 num_objects, bool cached, bool terse)
+{
+	if (!mUpdateDecoder)
+	{
+		U32 decode_threads = gSavedSettings.getU32("ObjectUpdateDecodeThreads");
+		if (!decode_threads)
+		{
+			decode_threads = LLCPUInfo::getDefaultWorkerCount();
+		}
+		mUpdateDecoder = new LLObjectUpdateDecoder(llmin(decode_threads, MAX_OBJECT_UPDATE_DECODE_THREADS));
+	}
+
+	LLStagedObjectUpdate* staged = mUpdateDecoder->stage(num_objects);
+	for (S32 i = 0; i < num_objects; i++)
+	{
+		LLStagedObjectUpdate& update = staged[i];
+		if (cached)
+		{
+			mesgsys->getU32Fast(sCachedID, update.mCacheID, i);
+			mesgsys->getU32Fast(sCachedCRC, update.mCRC, i);
+
+			// Lookup data packer and add this id to cache miss lists if necessary.
+			update.mCacheMissType = LLViewerRegion::CACHE_MISS_TYPE_NONE;
+			update.mCachedDP = regionp->getDP(update.mCacheID, update.mCRC, update.mCacheMissType);
+			// Cache entries hold their data in a LLDataPackerBinaryBuffer.
+			LLDataPackerBinaryBuffer* dp = static_cast<LLDataPackerBinaryBuffer*>(update.mCachedDP);
+			update.mBuffer = dp ? dp->getBuffer() : NULL;
+			update.mSize = dp ? dp->getBufferSize() : 0;
+		}
+		else
+		{
+			LLMessageFieldRef& data = terse ? sTerseData : sCompressedData;
+			update.mSize = mesgsys->getSizeFast(data, i);
+			if (update.mSize > MAX_OBJECT_UPDATE_SIZE)
+			{
+				llwarns << "Oversized object update of " << update.mSize << " bytes" << llendl;
+				update.mSize = 0;
+			}
+			else
+			{
+				mesgsys->getBinaryDataFast(data, update.mData, 0, i);
+			}
+			update.mBuffer = update.mData;
+		}
+	}
+	if (terse)
+	{
+		mUpdateDecoder->decodeTerse(num_objects);
+	}
+	else
+	{
+		mUpdateDecoder->decode(num_objects);
+	}
+
+	return staged;
+}
+
 void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 											 void **user_data,
 											 const EObjectUpdateType update_type,
@@ -373,7 +455,9 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 	}
 
 	U64 region_handle;
-	mesgsys->getU64Fast(_PREHASH_RegionData, _PREHASH_RegionHandle, region_handle);
+	mesgsys->getU64Fast(cached ? sCachedRegionHandle :
+						compressed ? (update_type == OUT_TERSE_IMPROVED ? sTerseRegionHandle : sCompressedRegionHandle) :
+						sFullRegionHandle, region_handle);
 	LLViewerRegion *regionp = LLWorld::getInstance()->getRegionFromHandle(region_handle);
 
 	if (!regionp)
@@ -382,10 +466,27 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 		return;
 	}
 
-	U8 compressed_dpbuffer[2048];
-	LLDataPackerBinaryBuffer compressed_dp(compressed_dpbuffer, 2048);
+	LLDataPackerBinaryBuffer compressed_dp; // reads the staged copy of each compressed update
 	LLDataPacker *cached_dpp = NULL;
 	LLViewerStatsRecorder& recorder = LLViewerStatsRecorder::instance();
+
+	// Full updates are decoded on worker threads as far as possible, and the motion of terse
+	// updates is dequantized for all of them at once, before they are applied below.
+	// Uncompressed full updates (OUT_FULL) are not staged: LLViewerObject::processUpdateMessage
+	// reads them field by field from the message blocks, which only the main thread may touch,
+	// while the decoder works on the single data block of a compressed or cached update.
+	LLStagedObjectUpdate* staged = NULL;
+	bool terse = compressed && update_type == OUT_TERSE_IMPROVED;
+	if (cached || compressed)
+	{
+		staged = stageObjectUpdates(mesgsys, regionp, num_objects, cached, terse);
+	}
+	if (terse)
+	{
+		// Lots of terse updates are for avatars and vehicles that move together;
+		// have the pipeline mark them moved in one go.
+		gPipeline.beginMoveBatch();
+	}
 	
 	for (i = 0; i < num_objects; i++)
 	{
@@ -396,15 +497,12 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 
 		if (cached)
 		{
-			U32 id;
-			U32 crc;
-			mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_ID, id, i);
-			mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_CRC, crc, i);
+			// The cache was looked up by stageObjectUpdates.
+			U32 id = staged[i].mCacheID;
+			U8 cache_miss_type = staged[i].mCacheMissType;
+			cached_dpp = staged[i].mCachedDP;
 			msg_size += sizeof(U32) * 2;
 		
-			// Lookup data packer and add this id to cache miss lists if necessary.
-			U8 cache_miss_type = LLViewerRegion::CACHE_MISS_TYPE_NONE;
-			cached_dpp = regionp->getDP(id, crc, cache_miss_type);
 			if (cached_dpp)
 			{
 				// Cache Hit.
@@ -423,18 +521,7 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 		}
 		else if (compressed)
 		{
-			S32							uncompressed_length = 2048;
-			compressed_dp.reset();
-
-			U32 flags = 0;
-			if (update_type != OUT_TERSE_IMPROVED)
-			{
-				mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_UpdateFlags, flags, i);
-			}
-			
-			uncompressed_length = mesgsys->getSizeFast(_PREHASH_ObjectData, i, _PREHASH_Data);
-			mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_Data, compressed_dpbuffer, 0, i);
-			compressed_dp.assignBuffer(compressed_dpbuffer, uncompressed_length);
+			compressed_dp.assignBuffer(staged[i].mData, staged[i].mSize);
 
 			if (update_type != OUT_TERSE_IMPROVED) // OUT_FULL_COMPRESSED only?
 			{
@@ -473,8 +560,8 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 		}
 		else // OUT_FULL only?
 		{
-			mesgsys->getUUIDFast(_PREHASH_ObjectData, _PREHASH_FullID, fullid, i);
-			mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_ID, local_id, i);
+			mesgsys->getUUIDFast(sFullFullID, fullid, i);
+			mesgsys->getU32Fast(sFullID, local_id, i);
 			msg_size += sizeof(LLUUID);
 			msg_size += sizeof(U32);
 			// llinfos << "Full Update, obj " << local_id << ", global ID" << fullid << "from " << mesgsys->getSender() << llendl;
@@ -587,7 +674,7 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 			{
 				objectp->mLocalID = local_id;
 			}
-			processUpdateCore(objectp, user_data, i, update_type, &compressed_dp, justCreated);
+			processUpdateCore(objectp, user_data, i, update_type, &compressed_dp, justCreated, &staged[i]);
 			if (update_type != OUT_TERSE_IMPROVED) // OUT_FULL_COMPRESSED only?
 			{
 				bCached = true;
@@ -598,7 +685,7 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 		else if (cached)
 		{
 			objectp->mLocalID = local_id;
-			processUpdateCore(objectp, user_data, i, update_type, cached_dpp, justCreated);
+			processUpdateCore(objectp, user_data, i, update_type, cached_dpp, justCreated, &staged[i]);
 		}
 		else
 		{
@@ -613,6 +700,11 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 		objectp->setLastUpdateCached(bCached);
 	}
 
+	if (terse)
+	{
+		gPipeline.endMoveBatch();
+	}
+
 	recorder.log(0.2f);
 
 	LLVOAvatar::cullAvatarsByPixelArea();
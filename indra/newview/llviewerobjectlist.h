@@ -48,6 +48,8 @@
 class LLCamera;
 class LLNetMap;
 class LLDebugBeacon;
+class LLObjectUpdateDecoder;
+struct LLStagedObjectUpdate;
 
 const U32 CLOSE_BIN_SIZE = 10;
 const U32 NUM_BINS = 128;
@@ -89,7 +91,7 @@ public:
 	void cleanDeadObjects(const BOOL use_timer = TRUE);	// Clean up the dead object list.
 
 	// Simulator and viewer side object updates...
-	void processUpdateCore(LLViewerObject* objectp, void** data, U32 block, const EObjectUpdateType update_type, LLDataPacker* dpp, BOOL justCreated);
+	void processUpdateCore(LLViewerObject* objectp, void** data, U32 block, const EObjectUpdateType update_type, LLDataPacker* dpp, BOOL justCreated, LLStagedObjectUpdate* staged = NULL);
 	void processObjectUpdate(LLMessageSystem *mesgsys, void **user_data, EObjectUpdateType update_type, bool cached=false, bool compressed=false);
 	void processCompressedObjectUpdate(LLMessageSystem *mesgsys, void **user_data, EObjectUpdateType update_type);
 	void processCachedObjectUpdate(LLMessageSystem *mesgsys, void **user_data, EObjectUpdateType update_type);
@@ -241,6 +243,10 @@ public:
 
 	std::set<LLViewerObject *> mSelectPickList;
 
+	// Decodes updates before processObjectUpdate applies them. Created on first use.
+	LLObjectUpdateDecoder* mUpdateDecoder;
+	LLStagedObjectUpdate* stageObjectUpdates(LLMessageSystem* mesgsys, LLViewerRegion* regionp, S32 num_objects, bool cached, bool terse);
+
 	friend class LLViewerObject;
 };
 
@@ -231,6 +231,8 @@ LLViewerStats::LLViewerStats() :
 	mTexturePacketsStat("texturepacketsstat"),
 	mActualInKBitStat("actualinkbitstat"),
 	mActualOutKBitStat("actualoutkbitstat"),
+	mThrottleKBitStat("throttlekbitstat"),
+	mQueueingDelayStat("queueingdelaystat"),
 	mTrianglesDrawnStat("trianglesdrawnstat"),
 	mSimTimeDilation("simtimedilation"),
 	mSimFPS("simfps"),
@@ -640,6 +642,8 @@ void update_statistics()
 	{
 		stats.mSimPingStat.addValue(10000);
 	}
+	stats.mThrottleKBitStat.addValue(gViewerThrottle.getCurrentBandwidth() / 1024.f);
+	stats.mQueueingDelayStat.addValue(gViewerThrottle.getEstimator().getQueueingDelay());
 
 	stats.mFPSStat.addValue(1);
 	F32 layer_bits = (F32)(gVLManager.getLandBits() + gVLManager.getWindBits() + gVLManager.getCloudBits());
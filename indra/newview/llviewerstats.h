@@ -59,6 +59,8 @@ public:
 			mTexturePacketsStat,
 			mActualInKBitStat,	// From the packet ring (when faking a bad connection)
 			mActualOutKBitStat,	// From the packet ring (when faking a bad connection)
+			mThrottleKBitStat,	// Total of the throttles last sent to the agent region
+			mQueueingDelayStat,	// Round trip time to the agent region above the lowest recent one
 			mTrianglesDrawnStat,
 			mMallocStat;
 
@@ -36,9 +36,12 @@
 #include "llviewercontrol.h"
 #include "message.h"
 #include "llagent.h"
+#include "llcircuit.h"
+#include "llviewerregion.h"
 #include "llframetimer.h"
 #include "llviewerstats.h"
 #include "lldatapacker.h"
+#include "llappviewer.h"
 
 using namespace LLOldEvents;
 
@@ -57,6 +60,11 @@ const F32 STEP_FRACTIONAL = 0.1f;
 const F32 TIGHTEN_THROTTLE_THRESHOLD = 3.0f; // packet loss % per s
 const F32 EASE_THROTTLE_THRESHOLD = 0.5f; // packet loss % per s
 const F32 DYNAMIC_UPDATE_DURATION = 5.0f; // seconds
+// Don't bother the sim with adaptive throttle changes smaller than this fraction.
+const F32 ADAPTIVE_RESEND_THRESHOLD = 0.05f;
+// Ping replies wait for the next frame to be processed, so a long frame shows up as
+// round trip time. Adaptive throttle samples of intervals with longer frames are dropped.
+const F32 ADAPTIVE_MAX_FRAME_INTERVAL = 0.1f; // seconds
 
 LLViewerThrottle gViewerThrottle;
 
@@ -203,7 +211,12 @@ public:
 LLViewerThrottle::LLViewerThrottle() :
 	mMaxBandwidth(0.f),
 	mCurrentBandwidth(0.f),
-	mThrottleFrac(1.f)
+	mThrottleFrac(1.f),
+	mEstimator(MIN_BANDWIDTH, MAX_BANDWIDTH),
+	mLastBytesIn(0),
+	mLastPacketsIn(0),
+	mLastPacketsLost(0),
+	mMaxFrameInterval(0.f)
 {
 	// Need to be pushed on in bandwidth order
 	mPresets.push_back(LLViewerThrottleGroup(BW_PRESET_50));
@@ -300,15 +313,32 @@ void LLViewerThrottle::resetDynamicThrottle()
 
 	mCurrentBandwidth = mMaxBandwidth*MAX_FRACTIONAL;
 	mCurrent = getThrottleGroup(mCurrentBandwidth / 1024.0f);
+
+	// The adaptive throttle starts out at the maximum too, and never goes beyond it.
+	F32 max_kbps = llclamp(mCurrentBandwidth / 1024.0f, MIN_BANDWIDTH, MAX_BANDWIDTH);
+	mEstimator.setLimits(MIN_BANDWIDTH, max_kbps);
+	mEstimator.reset(max_kbps);
+	mSampleHost.invalidate();
 }
 
 void LLViewerThrottle::updateDynamicThrottle()
 {
-	if (mUpdateTimer.getElapsedTimeF32() < DYNAMIC_UPDATE_DURATION)
+	mMaxFrameInterval = llmax(mMaxFrameInterval, gFrameIntervalSeconds);
+	F32 elapsed = mUpdateTimer.getElapsedTimeF32();
+	if (elapsed < DYNAMIC_UPDATE_DURATION)
 	{
 		return;
 	}
 	mUpdateTimer.reset();
+	F32 max_frame_interval = mMaxFrameInterval;
+	mMaxFrameInterval = 0.f;
+
+	static LLCachedControl<bool> adaptive(gSavedSettings, "ThrottleBandwidthAdaptive", true);
+	if (adaptive)
+	{
+		updateAdaptiveThrottle(elapsed, max_frame_interval);
+		return;
+	}
 
 	if (LLViewerStats::getInstance()->mPacketsLostPercentStat.getMean() > TIGHTEN_THROTTLE_THRESHOLD)
 	{
@@ -337,3 +367,68 @@ void LLViewerThrottle::updateDynamicThrottle()
 		llinfos << "Easing network throttle to " << mCurrentBandwidth << llendl;
 	}
 }
+
+void LLViewerThrottle::updateAdaptiveThrottle(F32 elapsed, F32 max_frame_interval)
+{
+	LLViewerRegion* regionp = gAgent.getRegion();
+	LLCircuitData* cdp = regionp ? gMessageSystem->mCircuitInfo.findCircuit(regionp->getHost()) : NULL;
+	if (!cdp)
+	{
+		return;
+	}
+
+	S32 bytes_in = cdp->getBytesIn() - mLastBytesIn;
+	S32 packets_in = (S32)(cdp->getPacketsIn() - mLastPacketsIn);
+	S32 packets_lost = (S32)(cdp->getPacketsLost() - mLastPacketsLost);
+	mLastBytesIn = cdp->getBytesIn();
+	mLastPacketsIn = cdp->getPacketsIn();
+	mLastPacketsLost = cdp->getPacketsLost();
+	if (regionp->getHost() != mSampleHost)
+	{
+		// The agent changed regions; the counters are of another circuit.
+		mSampleHost = regionp->getHost();
+		return;
+	}
+	if (max_frame_interval > ADAPTIVE_MAX_FRAME_INTERVAL)
+	{
+		// The viewer hitched; the round trip time includes the hitch, not just the network.
+		LL_DEBUGS("Throttle") << "Dropping sample, frame time up to " << max_frame_interval << " s" << LL_ENDL;
+		return;
+	}
+
+	F32 throughput_kbps = (F32)bytes_in * 8.f / 1024.f / elapsed;
+	F32 loss_percent = packets_in > 0 ? 100.f * (F32)packets_lost / (F32)packets_in : 0.f;
+	F32 estimate_kbps = mEstimator.update(throughput_kbps, (F32)cdp->getPingDelay(), loss_percent);
+
+	LL_DEBUGS("Throttle") << "In: " << throughput_kbps << " kbps, loss: " << loss_percent
+		<< "%, RTT: " << mEstimator.getSmoothedRTT() << " (base " << mEstimator.getBaseRTT()
+		<< ") ms, estimate: " << estimate_kbps << " kbps" << LL_ENDL;
+
+	F32 estimate = estimate_kbps * 1024.f;
+	if (fabsf(estimate - mCurrentBandwidth) <= ADAPTIVE_RESEND_THRESHOLD * mCurrentBandwidth)
+	{
+		return;
+	}
+	mCurrentBandwidth = estimate;
+	if (mMaxBandwidth > 0.f)
+	{
+		mThrottleFrac = mCurrentBandwidth / mMaxBandwidth;
+	}
+	mCurrent = getThrottleGroup(mCurrentBandwidth / 1024.0f);
+	mCurrent.sendToSim();
+
+	const char* action = "Easing";
+	switch (mEstimator.getState())
+	{
+		case LLBandwidthEstimator::STATE_DECREASE:
+			action = "Tightening";
+			break;
+		case LLBandwidthEstimator::STATE_HOLD:
+			// Something is queueing up; the throttle is pulled towards what gets through.
+			action = "Holding";
+			break;
+		default:
+			break;
+	}
+	llinfos << action << " network throttle to " << mCurrentBandwidth << llendl;
+}
@@ -36,7 +36,9 @@
 #include <vector>
 
 #include "llstring.h"
+#include "llbandwidthestimator.h"
 #include "llframetimer.h"
+#include "llhost.h"
 #include "llthrottle.h"
 
 class LLViewerThrottleGroup
@@ -76,6 +78,8 @@ public:
 	void updateDynamicThrottle();
 	void resetDynamicThrottle();
 
+	const LLBandwidthEstimator& getEstimator() const	{ return mEstimator; }
+
 	LLViewerThrottleGroup getThrottleGroup(const F32 bandwidth_kbps);
 
 	static const std::string sNames[TC_EOF];
@@ -89,6 +93,18 @@ protected:
 	
 	LLFrameTimer mUpdateTimer;
 	F32 mThrottleFrac;
+
+	// ThrottleBandwidthAdaptive.
+	void updateAdaptiveThrottle(F32 elapsed, F32 max_frame_interval);
+
+	LLBandwidthEstimator mEstimator;
+	// Counters of the circuit to the agent region at the last update.
+	LLHost mSampleHost;
+	S32 mLastBytesIn;
+	U32 mLastPacketsIn;
+	U32 mLastPacketsLost;
+	// Longest frame since the last update, in seconds.
+	F32 mMaxFrameInterval;
 };
 
 extern LLViewerThrottle gViewerThrottle;
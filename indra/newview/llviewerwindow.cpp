@@ -612,6 +612,29 @@ public:
 				ypos += y_inc;
 			}
 
+			if (LLSpatialGroup::sQueriesIssued || LLSpatialGroup::sQueriesRead || LLSpatialGroup::sDepthTests)
+			{
+				addText(xpos, ypos, llformat("%d Queries issued, %d read (%d fenced), %d late, %d stale",
+					LLSpatialGroup::sQueriesIssued, LLSpatialGroup::sQueriesRead, LLSpatialGroup::sQueriesFenced,
+					LLSpatialGroup::sQueriesLate, LLSpatialGroup::sQueriesStale));
+				ypos += y_inc;
+
+				if (LLSpatialGroup::sDepthTests)
+				{
+					addText(xpos, ypos, llformat("%d/%d Depth buffer rejects (%.1f%%)", LLSpatialGroup::sDepthRejects, LLSpatialGroup::sDepthTests,
+						100.f * LLSpatialGroup::sDepthRejects / LLSpatialGroup::sDepthTests));
+					ypos += y_inc;
+				}
+
+				LLSpatialGroup::sQueriesIssued = 0;
+				LLSpatialGroup::sQueriesRead = 0;
+				LLSpatialGroup::sQueriesFenced = 0;
+				LLSpatialGroup::sQueriesLate = 0;
+				LLSpatialGroup::sQueriesStale = 0;
+				LLSpatialGroup::sDepthTests = 0;
+				LLSpatialGroup::sDepthRejects = 0;
+			}
+
 
 			addText(xpos,ypos, llformat("%d Avatars visible", LLVOAvatar::sNumVisibleAvatars));
 			
@@ -35,8 +35,13 @@
 #include "llvocache.h"
 
 #include "llerror.h"
+#include "llobjectupdatedecoder.h"
 #include "llregionhandle.h"
 #include "llviewercontrol.h"
+#include "llviewertexturelist.h"
+#include "lltimer.h"	// ms_sleep()
+
+#include <deque>
 
 BOOL check_read(LLAPRFile* apr_file, void* src, S32 n_bytes) 
 {
@@ -57,13 +62,31 @@ LLVOCacheEntry::LLVOCacheEntry(U32 local_id, U32 crc, LLDataPackerBinaryBuffer &
 	mCRC(crc),
 	mHitCount(0),
 	mDupeCount(0),
-	mCRCChangeCount(0)
+	mCRCChangeCount(0),
+	mFileOffset(0),
+	mFileSize(0)
 {
 	mBuffer = new U8[dp.getBufferSize()];
 	mDP.assignBuffer(mBuffer, dp.getBufferSize());
 	mDP = dp; //memcpy
 }
 
+LLVOCacheEntry::LLVOCacheEntry(U32 local_id, U32 crc, S32 hit_count, S32 dupe_count, S32 crc_change_count,
+							   LLVOCacheFileBuffer* file_buffer, S32 offset, S32 size)
+	:
+	mLocalID(local_id),
+	mCRC(crc),
+	mHitCount(hit_count),
+	mDupeCount(dupe_count),
+	mCRCChangeCount(crc_change_count),
+	mBuffer(NULL),
+	mFileBuffer(file_buffer),
+	mFileOffset(offset),
+	mFileSize(size)
+{
+	mDP.assignBuffer(mBuffer, 0);
+}
+
 LLVOCacheEntry::LLVOCacheEntry()
 	:
 	mLocalID(0),
@@ -71,92 +94,52 @@ LLVOCacheEntry::LLVOCacheEntry()
 	mHitCount(0),
 	mDupeCount(0),
 	mCRCChangeCount(0),
-	mBuffer(NULL)
+	mBuffer(NULL),
+	mFileOffset(0),
+	mFileSize(0)
 {
 	mDP.assignBuffer(mBuffer, 0);
 }
 
-LLVOCacheEntry::LLVOCacheEntry(LLAPRFile* apr_file)
-	: mBuffer(NULL)
+LLVOCacheEntry::~LLVOCacheEntry()
 {
-	S32 size = -1;
-	BOOL success;
-
-	mDP.assignBuffer(mBuffer, 0);
-	success = check_read(apr_file, &mLocalID, sizeof(U32));
-	if(success)
-	{
-		success = check_read(apr_file, &mCRC, sizeof(U32));
-	}
-	if(success)
-	{
-		success = check_read(apr_file, &mHitCount, sizeof(S32));
-	}
-	if(success)
-	{
-		success = check_read(apr_file, &mDupeCount, sizeof(S32));
-	}
-	if(success)
-	{
-		success = check_read(apr_file, &mCRCChangeCount, sizeof(S32));
-	}
-	if(success)
-	{
-		success = check_read(apr_file, &size, sizeof(S32));
-
-	// Corruption in the cache entries
-	if ((size > 10000) || (size < 1))
-	{
-		// We've got a bogus size, skip reading it.
-		// We won't bother seeking, because the rest of this file
-		// is likely bogus, and will be tossed anyway.
-			llwarns << "Bogus cache entry, size " << size << ", aborting!" << llendl;
-			success = FALSE;
-		}
-	}
-	if(success && size > 0)
-	{
-		mBuffer = new U8[size];
-		success = check_read(apr_file, mBuffer, size);
+	mDP.freeBuffer();
+}
 
-		if(success)
-		{
-			mDP.assignBuffer(mBuffer, size);
-		}
-		else
-		{
-			delete[] mBuffer ;
-			mBuffer = NULL ;
-		}
-	}
 
-	if(!success)
+void LLVOCacheEntry::materialize()
+{
+	if (mFileBuffer.notNull())
 	{
-		mLocalID = 0;
-		mCRC = 0;
-		mHitCount = 0;
-		mDupeCount = 0;
-		mCRCChangeCount = 0;
-		mBuffer = NULL;
+		mDP.freeBuffer();
+		mBuffer = new U8[mFileSize];
+		memcpy(mBuffer, mFileBuffer->getData() + mFileOffset, mFileSize);
+		mDP.assignBuffer(mBuffer, mFileSize);
+		mFileBuffer = NULL;
 	}
 }
 
-LLVOCacheEntry::~LLVOCacheEntry()
+const U8* LLVOCacheEntry::getData() const
 {
-	mDP.freeBuffer();
+	return mFileBuffer.notNull() ? mFileBuffer->getData() + mFileOffset : mDP.getBuffer();
 }
 
+S32 LLVOCacheEntry::getDataSize() const
+{
+	return mFileBuffer.notNull() ? mFileSize : mDP.getBufferSize();
+}
 
 // New CRC means the object has changed.
 void LLVOCacheEntry::assignCRC(U32 crc, LLDataPackerBinaryBuffer &dp)
 {
 	if (  (mCRC != crc)
-		||(mDP.getBufferSize() == 0))
+		||(getDataSize() == 0))
 	{
 		mCRC = crc;
 		mHitCount = 0;
 		mCRCChangeCount++;
 
+		mFileBuffer = NULL;
 		mDP.freeBuffer();
 		mBuffer = new U8[dp.getBufferSize()];
 		mDP.assignBuffer(mBuffer, dp.getBufferSize());
@@ -167,11 +150,12 @@ void LLVOCacheEntry::assignCRC(U32 crc, LLDataPackerBinaryBuffer &dp)
 LLDataPackerBinaryBuffer *LLVOCacheEntry::getDP(U32 crc)
 {
 	if (  (mCRC != crc)
-		||(mDP.getBufferSize() == 0))
+		||(getDataSize() == 0))
 	{
 		//llinfos << "Not getting cache entry, invalid!" << llendl;
 		return NULL;
 	}
+	materialize();
 	mHitCount++;
 	return &mDP;
 }
@@ -193,52 +177,528 @@ void LLVOCacheEntry::dump() const
 		<< llendl;
 }
 
-BOOL LLVOCacheEntry::writeToFile(LLAPRFile* apr_file) const
+//-------------------------------------------------------------------
+//LLVOCache
+//-------------------------------------------------------------------
+// Format string used to construct filename for the object cache
+static const char OBJECT_CACHE_FILENAME[] = "objects_%d_%d.slc";
+
+const U32 MAX_NUM_OBJECT_ENTRIES = 128 ;
+const U32 MIN_ENTRIES_TO_PURGE = 16 ;
+const U32 INVALID_TIME = 0 ;
+const char* object_cache_dirname = "objectcache";
+const char* header_filename = "object.cache";
+
+// Layout of a region cache file:
+//   ObjectCacheFileHeader
+//   ObjectCacheTOCEntry[mNumEntries], sorted by local ID
+//   the object update data of each entry, at the offset given in its TOC entry
+// The file is read into memory with a single read and can equally well be mapped;
+// the TOC holds everything needed to check an entry against the CRC of an object
+// update, the data itself is only touched when the entry is used.
+const U32 OBJECT_CACHE_FILE_MAGIC = 0x434f4c4c;	// "LLOC"
+const U32 OBJECT_CACHE_FILE_VERSION = 1;
+const S32 MAX_OBJECT_CACHE_ENTRY_SIZE = 10000;
+
+struct ObjectCacheFileHeader
+{
+	U32 mMagic;
+	U32 mVersion;
+	U8  mRegionID[UUID_BYTES];
+	U32 mNumEntries;
+	U32 mFileSize;
+};
+
+struct ObjectCacheTOCEntry
 {
-	BOOL success;
-	success = check_write(apr_file, (void*)&mLocalID, sizeof(U32));
-	if(success)
+	U32 mLocalID;
+	U32 mCRC;
+	S32 mHitCount;
+	S32 mDupeCount;
+	S32 mCRCChangeCount;
+	U32 mOffset;
+	U32 mSize;
+};
+
+// Serialize cache_entry_map into the contents of a region cache file.
+static LLVOCacheFileBuffer* serialize_cache_entries(const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map)
+{
+	U32 num_entries = 0;
+	U32 file_size = sizeof(ObjectCacheFileHeader);
+	for (LLVOCacheEntry::vocache_entry_map_t::const_iterator iter = cache_entry_map.begin(); iter != cache_entry_map.end(); ++iter)
+	{
+		S32 size = iter->second->getDataSize();
+		if (size > 0)
+		{
+			++num_entries;
+			file_size += sizeof(ObjectCacheTOCEntry) + size;
+		}
+	}
+
+	LLVOCacheFileBuffer* file_buffer = new LLVOCacheFileBuffer(file_size);
+	U8* data = file_buffer->getData();
+
+	ObjectCacheFileHeader* header = (ObjectCacheFileHeader*)data;
+	header->mMagic = OBJECT_CACHE_FILE_MAGIC;
+	header->mVersion = OBJECT_CACHE_FILE_VERSION;
+	memcpy(header->mRegionID, id.mData, UUID_BYTES);
+	header->mNumEntries = num_entries;
+	header->mFileSize = file_size;
+
+	ObjectCacheTOCEntry* toc_entry = (ObjectCacheTOCEntry*)(header + 1);
+	U32 offset = sizeof(ObjectCacheFileHeader) + num_entries * sizeof(ObjectCacheTOCEntry);
+	for (LLVOCacheEntry::vocache_entry_map_t::const_iterator iter = cache_entry_map.begin(); iter != cache_entry_map.end(); ++iter)
 	{
-		success = check_write(apr_file, (void*)&mCRC, sizeof(U32));
+		LLVOCacheEntry const* entry = iter->second;
+		S32 size = entry->getDataSize();
+		if (size <= 0)
+		{
+			continue;
+		}
+		toc_entry->mLocalID = entry->getLocalID();
+		toc_entry->mCRC = entry->getCRC();
+		toc_entry->mHitCount = entry->getHitCount();
+		toc_entry->mDupeCount = entry->getDupeCount();
+		toc_entry->mCRCChangeCount = entry->getCRCChangeCount();
+		toc_entry->mOffset = offset;
+		toc_entry->mSize = size;
+		memcpy(data + offset, entry->getData(), size);
+		offset += size;
+		++toc_entry;
 	}
-	if(success)
+	llassert(offset == file_size);
+
+	return file_buffer;
+}
+
+// Read a region cache file into file_buffer. Returns false if it couldn't be read or isn't a region cache file.
+static bool read_cache_file(const std::string& filename, LLPointer<LLVOCacheFileBuffer>& file_buffer)
+{
+	file_buffer = NULL;
+	S32 file_size = 0;
+	LLAPRFile apr_file(filename, APR_READ|APR_BINARY, &file_size);
+	if (file_size < (S32)sizeof(ObjectCacheFileHeader))
 	{
-		success = check_write(apr_file, (void*)&mHitCount, sizeof(S32));
+		return false;
 	}
-	if(success)
+
+	file_buffer = new LLVOCacheFileBuffer(file_size);
+	if (!check_read(&apr_file, file_buffer->getData(), file_size))
 	{
-		success = check_write(apr_file, (void*)&mDupeCount, sizeof(S32));
+		file_buffer = NULL;
+		return false;
 	}
-	if(success)
+
+	ObjectCacheFileHeader const* header = (ObjectCacheFileHeader const*)file_buffer->getData();
+	if (header->mMagic != OBJECT_CACHE_FILE_MAGIC ||
+		header->mVersion != OBJECT_CACHE_FILE_VERSION ||
+		header->mFileSize != (U32)file_size ||
+		header->mNumEntries > (file_size - sizeof(ObjectCacheFileHeader)) / sizeof(ObjectCacheTOCEntry))
 	{
-		success = check_write(apr_file, (void*)&mCRCChangeCount, sizeof(S32));
+		llwarns << "Unrecognized object cache file " << filename << ", discarding" << llendl;
+		file_buffer = NULL;
+		return false;
 	}
-	if(success)
+	return true;
+}
+
+// Maximum number of textures that prefetching a region warms up, and the pixel area they are fetched for.
+const U32 MAX_PREFETCHED_TEXTURES = 256;
+const F32 PREFETCHED_TEXTURE_PIXEL_AREA = 128.f * 128.f;
+
+// Decode the objects in a region cache file and collect the textures they use, most used first.
+static void collect_cache_file_textures(const LLVOCacheFileBuffer* file_buffer, std::vector<LLUUID>& textures)
+{
+	ObjectCacheFileHeader const* header = (ObjectCacheFileHeader const*)file_buffer->getData();
+	ObjectCacheTOCEntry const* toc = (ObjectCacheTOCEntry const*)(header + 1);
+	U32 const file_size = file_buffer->getSize();
+	U32 const data_start = sizeof(ObjectCacheFileHeader) + header->mNumEntries * sizeof(ObjectCacheTOCEntry);
+
+	std::map<LLUUID, S32> uses;
+	LLStagedObjectUpdate* update = new LLStagedObjectUpdate;
+	for (U32 i = 0; i < header->mNumEntries; i++)
 	{
-		S32 size = mDP.getBufferSize();
-		success = check_write(apr_file, (void*)&size, sizeof(S32));
-	
-		if(success)
+		ObjectCacheTOCEntry const& toc_entry = toc[i];
+		if (toc_entry.mSize < 1 || toc_entry.mSize > (U32)MAX_OBJECT_CACHE_ENTRY_SIZE ||
+			toc_entry.mOffset < data_start || toc_entry.mOffset > file_size || toc_entry.mSize > file_size - toc_entry.mOffset)
 		{
-			success = check_write(apr_file, (void*)mBuffer, size);
+			// Corrupt; readFromCache will discard the file.
+			break;
+		}
+		update->mBuffer = file_buffer->getData() + toc_entry.mOffset;
+		update->mSize = toc_entry.mSize;
+		LLObjectUpdateDecoder::decodeUpdate(*update);
+		if (!update->mVolumeDecoded || update->mTEResult <= 0)
+		{
+			continue;
+		}
+		// Faces past the last one repeat its texture; count every texture once per object.
+		std::set<LLUUID> object_textures;
+		for (U32 face = 0; face < update->mTEContents.face_count; ++face)
+		{
+			LLUUID id;
+			memcpy(id.mData, &update->mTEContents.image_data[face * UUID_BYTES], UUID_BYTES);
+			if (id.notNull() && object_textures.insert(id).second)
+			{
+				++uses[id];
+			}
 		}
 	}
+	delete update;
 
-	return success ;
+	std::vector<std::pair<S32, LLUUID> > sorted;
+	sorted.reserve(uses.size());
+	for (std::map<LLUUID, S32>::iterator iter = uses.begin(); iter != uses.end(); ++iter)
+	{
+		sorted.push_back(std::make_pair(-iter->second, iter->first));
+	}
+	U32 count = llmin((U32)sorted.size(), MAX_PREFETCHED_TEXTURES);
+	std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end());
+	textures.clear();
+	for (U32 i = 0; i < count; ++i)
+	{
+		textures.push_back(sorted[i].second);
+	}
 }
 
 //-------------------------------------------------------------------
-//LLVOCache
+//LLVOCacheWriter
 //-------------------------------------------------------------------
-// Format string used to construct filename for the object cache
-static const char OBJECT_CACHE_FILENAME[] = "objects_%d_%d.slc";
+// Write-behind thread for the object cache: serializes and writes region cache files,
+// removes them, and writes the cache header, so that leaving a region never waits for
+// the disk. Operations are carried out in the order in which they were queued; header
+// writes are coalesced, only the most recent header snapshot is written.
+// It also reads the cache file of a teleport destination ahead of time (prefetchRegion),
+// so that the region handshake doesn't wait for the disk either.
+class LLVOCacheWriter : public LLThread
+{
+public:
+	LLVOCacheWriter();
+	~LLVOCacheWriter();
+
+	// Takes ownership of the entries, cache_entry_map is empty upon return.
+	void writeRegion(U64 handle, const std::string& filename, const LLUUID& id, LLVOCacheEntry::vocache_entry_map_t& cache_entry_map);
+	void removeRegion(U64 handle, const std::string& filename);
+	void writeHeader(const std::string& filename, LLVOCacheFileBuffer* header);
+	// Read the region cache file of handle, and collect the textures its objects use.
+	void prefetchRegion(U64 handle, const std::string& filename);
+	// Drop the result of the last prefetchRegion, or the prefetch itself when it didn't run yet.
+	void cancelPrefetch();
+
+	// Moves the prefetched cache file of handle to file_buffer. Returns false if it wasn't prefetched.
+	// A failed prefetch (no or a bad file) counts as prefetched, with file_buffer set to NULL.
+	bool takePrefetched(U64 handle, LLPointer<LLVOCacheFileBuffer>& file_buffer);
+	// Moves the textures that were found by the last prefetch to textures. Returns false if there are none.
+	bool takePrefetchedTextures(std::vector<LLUUID>& textures);
+
+	// Returns true if a write or remove of the region cache file of handle is still queued.
+	bool isPending(U64 handle);
+	// Block until everything that was queued so far has been written.
+	void flush();
+
+private:
+	struct Operation
+	{
+		U64 mHandle;
+		std::string mFilename;
+		LLUUID mRegionID;
+		LLVOCacheEntry::vocache_entry_map_t* mEntries;	// NULL for a remove or a prefetch.
+		bool mPrefetch;
+	};
+
+	/*virtual*/ bool runCondition(void);
+	/*virtual*/ void run(void);
+	void process(Operation const& op);
+	void prefetch(Operation const& op);
+
+	// All protected by mRunCondition.
+	std::deque<Operation*> mQueue;		// The front operation is removed only after it was carried out.
+	LLPointer<LLVOCacheFileBuffer> mHeader;
+	std::string mHeaderFileName;
+	bool mWritingHeader;
+	U64 mPrefetchedHandle;
+	U64 mWantedPrefetchHandle;		// The region of the last prefetchRegion that wasn't cancelled, or 0.
+	LLPointer<LLVOCacheFileBuffer> mPrefetched;
+	std::vector<LLUUID> mPrefetchedTextures;
+};
+
+LLVOCacheWriter::LLVOCacheWriter()
+	: LLThread("object cache writer"),
+	  mWritingHeader(false),
+	  mPrefetchedHandle(0),
+	  mWantedPrefetchHandle(0)
+{
+	start();
+}
 
-const U32 MAX_NUM_OBJECT_ENTRIES = 128 ;
-const U32 MIN_ENTRIES_TO_PURGE = 16 ;
-const U32 INVALID_TIME = 0 ;
-const char* object_cache_dirname = "objectcache";
-const char* header_filename = "object.cache";
+LLVOCacheWriter::~LLVOCacheWriter()
+{
+	flush();
+
+	// Stop the thread before our members are destroyed; ~LLThread() cleans up the rest.
+	setQuitting();
+	for (S32 timeout = 100; timeout > 0 && !isStopped(); --timeout)
+	{
+		ms_sleep(100);
+	}
+	if (!isStopped())
+	{
+		llwarns << "LLVOCacheWriter timed out!" << llendl;
+	}
+}
+
+void LLVOCacheWriter::writeRegion(U64 handle, const std::string& filename, const LLUUID& id, LLVOCacheEntry::vocache_entry_map_t& cache_entry_map)
+{
+	Operation* op = new Operation;
+	op->mHandle = handle;
+	op->mFilename = filename;
+	op->mRegionID = id;
+	op->mEntries = new LLVOCacheEntry::vocache_entry_map_t;
+	op->mEntries->swap(cache_entry_map);
+	op->mPrefetch = false;
+	lockData();
+	mQueue.push_back(op);
+	unlockData();
+	wake();
+}
+
+void LLVOCacheWriter::removeRegion(U64 handle, const std::string& filename)
+{
+	Operation* op = new Operation;
+	op->mHandle = handle;
+	op->mFilename = filename;
+	op->mEntries = NULL;
+	op->mPrefetch = false;
+	lockData();
+	mQueue.push_back(op);
+	unlockData();
+	wake();
+}
+
+void LLVOCacheWriter::prefetchRegion(U64 handle, const std::string& filename)
+{
+	Operation* op = new Operation;
+	op->mHandle = handle;
+	op->mFilename = filename;
+	op->mEntries = NULL;
+	op->mPrefetch = true;
+	lockData();
+	mWantedPrefetchHandle = handle;
+	mQueue.push_back(op);
+	unlockData();
+	wake();
+}
+
+void LLVOCacheWriter::cancelPrefetch()
+{
+	lockData();
+	mWantedPrefetchHandle = 0;
+	mPrefetched = NULL;
+	mPrefetchedHandle = 0;
+	mPrefetchedTextures.clear();
+	unlockData();
+}
+
+bool LLVOCacheWriter::takePrefetched(U64 handle, LLPointer<LLVOCacheFileBuffer>& file_buffer)
+{
+	bool prefetched = false;
+	lockData();
+	if (mPrefetchedHandle == handle)
+	{
+		prefetched = true;
+		file_buffer = mPrefetched;
+		mPrefetched = NULL;
+		mPrefetchedHandle = 0;
+	}
+	unlockData();
+	return prefetched;
+}
+
+bool LLVOCacheWriter::takePrefetchedTextures(std::vector<LLUUID>& textures)
+{
+	lockData();
+	textures.swap(mPrefetchedTextures);
+	mPrefetchedTextures.clear();
+	unlockData();
+	return !textures.empty();
+}
+
+void LLVOCacheWriter::writeHeader(const std::string& filename, LLVOCacheFileBuffer* header)
+{
+	lockData();
+	// Replaces any snapshot that wasn't written yet.
+	mHeader = header;
+	mHeaderFileName = filename;
+	unlockData();
+	wake();
+}
+
+bool LLVOCacheWriter::isPending(U64 handle)
+{
+	bool pending = false;
+	lockData();
+	for (std::deque<Operation*>::iterator iter = mQueue.begin(); iter != mQueue.end(); ++iter)
+	{
+		if ((*iter)->mHandle == handle)
+		{
+			pending = true;
+			break;
+		}
+	}
+	unlockData();
+	return pending;
+}
+
+void LLVOCacheWriter::flush()
+{
+	while (1)
+	{
+		lockData();
+		bool idle = mQueue.empty() && mHeader.isNull() && !mWritingHeader;
+		unlockData();
+		if (idle || isStopped())
+		{
+			break;
+		}
+		ms_sleep(1);
+	}
+}
+
+// virtual
+bool LLVOCacheWriter::runCondition()
+{
+	// mRunCondition must be locked here
+	return !mQueue.empty() || mHeader.notNull();
+}
+
+// virtual
+void LLVOCacheWriter::run()
+{
+	while (1)
+	{
+		// Blocks until there is something to write, or until we're asked to quit.
+		checkPause();
+
+		lockData();
+		Operation* op = NULL;
+		LLPointer<LLVOCacheFileBuffer> header;
+		std::string header_filename;
+		if (!mQueue.empty())
+		{
+			op = mQueue.front();
+		}
+		else if (mHeader.notNull())
+		{
+			header = mHeader;
+			header_filename = mHeaderFileName;
+			mHeader = NULL;
+			mWritingHeader = true;
+		}
+		unlockData();
+
+		if (op)
+		{
+			process(*op);
+			lockData();
+			mQueue.pop_front();
+			unlockData();
+			delete op;
+		}
+		else if (header.notNull())
+		{
+			LLAPRFile apr_file(header_filename, APR_CREATE|APR_WRITE|APR_TRUNCATE|APR_BINARY);
+			if (!check_write(&apr_file, header->getData(), header->getSize()))
+			{
+				llwarns << "Failed to write object cache header " << header_filename << llendl;
+			}
+			lockData();
+			mWritingHeader = false;
+			unlockData();
+		}
+		else if (isQuitting())
+		{
+			break;
+		}
+	}
+}
+
+void LLVOCacheWriter::process(Operation const& op)
+{
+	if (op.mPrefetch)
+	{
+		prefetch(op);
+		return;
+	}
+
+	// A prefetched copy of this file is out of date now.
+	lockData();
+	if (mPrefetchedHandle == op.mHandle)
+	{
+		mPrefetched = NULL;
+		mPrefetchedHandle = 0;
+	}
+	unlockData();
+
+	if (!op.mEntries)
+	{
+		LLAPRFile::remove(op.mFilename);
+		return;
+	}
+
+	bool success;
+	{
+		LLPointer<LLVOCacheFileBuffer> file_buffer = serialize_cache_entries(op.mRegionID, *op.mEntries);
+		LLAPRFile apr_file(op.mFilename, APR_CREATE|APR_WRITE|APR_TRUNCATE|APR_BINARY);
+		success = check_write(&apr_file, file_buffer->getData(), file_buffer->getSize());
+	}
+	if (!success)
+	{
+		// Don't leave a truncated file behind; the header entry pointing to it
+		// is removed when the file fails to load.
+		llwarns << "Failed to write object cache file " << op.mFilename << llendl;
+		LLAPRFile::remove(op.mFilename);
+	}
 
+	for (LLVOCacheEntry::vocache_entry_map_t::iterator iter = op.mEntries->begin(); iter != op.mEntries->end(); ++iter)
+	{
+		delete iter->second;
+	}
+	delete op.mEntries;
+}
+
+void LLVOCacheWriter::prefetch(Operation const& op)
+{
+	lockData();
+	bool wanted = mWantedPrefetchHandle == op.mHandle;
+	unlockData();
+	if (!wanted)
+	{
+		// Cancelled, or replaced by a later prefetch.
+		return;
+	}
+
+	LLPointer<LLVOCacheFileBuffer> file_buffer;
+	std::vector<LLUUID> textures;
+	if (read_cache_file(op.mFilename, file_buffer))
+	{
+		collect_cache_file_textures(file_buffer, textures);
+	}
+	lockData();
+	if (mWantedPrefetchHandle != op.mHandle)
+	{
+		unlockData();
+		return;
+	}
+	// Only one teleport destination at a time; this replaces any previous prefetch.
+	mPrefetchedHandle = op.mHandle;
+	mPrefetched = file_buffer;
+	mPrefetchedTextures.swap(textures);
+	unlockData();
+}
+
+//-------------------------------------------------------------------
+//LLVOCache
+//-------------------------------------------------------------------
 LLVOCache* LLVOCache::sInstance = NULL;
 
 //static 
@@ -271,13 +731,19 @@ LLVOCache::LLVOCache():
 	mInitialized(FALSE),
 	mReadOnly(TRUE),
 	mNumEntries(0),
-	mCacheSize(1)
+	mCacheSize(1),
+	mWriter(NULL),
+	mPrefetchHandle(0)
 {
 	mEnabled = gSavedSettings.getBOOL("ObjectCacheEnabled");
 }
 
 LLVOCache::~LLVOCache()
 {
+	// Write out everything that is still queued before the final header.
+	delete mWriter;
+	mWriter = NULL;
+
 	if(mEnabled)
 	{
 		writeCacheHeader();
@@ -310,6 +776,10 @@ void LLVOCache::initCache(ELLPath location, U32 size, U32 cache_version)
 	if (!mReadOnly)
 	{
 		LLFile::mkdir(mObjectCacheDirName);
+		if (!mWriter)
+		{
+			mWriter = new LLVOCacheWriter;
+		}
 	}
 	mCacheSize = llclamp(size, MIN_ENTRIES_TO_PURGE, MAX_NUM_OBJECT_ENTRIES);
 	mMetaInfo.mVersion = cache_version;
@@ -342,6 +812,7 @@ void LLVOCache::removeCache(ELLPath location)
 	std::string mask = "*";
 	std::string cache_dir = gDirUtilp->getExpandedFilename(location, object_cache_dirname);
 	llinfos << "Removing cache at " << cache_dir << llendl;
+	flushWrites();
 	gDirUtilp->deleteFilesInDir(cache_dir, mask); //delete all files
 	LLFile::rmdir(cache_dir);
 
@@ -362,6 +833,7 @@ void LLVOCache::removeCache()
 
 	std::string mask = "*";
 	llinfos << "Removing cache at " << mObjectCacheDirName << llendl;
+	flushWrites();
 	gDirUtilp->deleteFilesInDir(mObjectCacheDirName, mask); 
 
 	clearCacheInMemory() ;
@@ -389,6 +861,7 @@ void LLVOCache::removeEntry(HeaderEntryInfo* entry)
 		delete entry ;
 
 		mNumEntries = mHandleEntryMap.size() ;
+		scheduleHeaderWrite() ;
 	}
 }
 
@@ -439,9 +912,17 @@ void LLVOCache::removeFromCache(HeaderEntryInfo* entry)
 
 	std::string filename;
 	getObjectCacheFilename(entry->mHandle, filename);
-	LLAPRFile::remove(filename);
+	if(mWriter)
+	{
+		// Keep the order with respect to queued writes of the same file.
+		mWriter->removeRegion(entry->mHandle, filename);
+	}
+	else
+	{
+		LLAPRFile::remove(filename);
+	}
 	entry->mTime = INVALID_TIME ;
-	updateEntry(entry) ; //update the head file.
+	// The caller updates the header file.
 }
 
 void LLVOCache::readCacheHeader()
@@ -541,34 +1022,14 @@ void LLVOCache::writeCacheHeader()
 		return;
 	}
 
+	// Don't let a queued header snapshot overwrite this one.
+	flushWrites();
+
 	bool success = true ;
 	{
+		LLPointer<LLVOCacheFileBuffer> header = buildCacheHeader();
 		LLAPRFile apr_file(mHeaderFileName, APR_CREATE|APR_WRITE|APR_BINARY);
-
-		//write the meta element
-		success = check_write(&apr_file, &mMetaInfo, sizeof(HeaderMetaInfo)) ;
-
-
-		mNumEntries = 0 ;	
-		for(header_entry_queue_t::iterator iter = mHeaderEntryQueue.begin() ; success && iter != mHeaderEntryQueue.end(); ++iter)
-		{
-			(*iter)->mIndex = mNumEntries++ ;
-			success = check_write(&apr_file, (void*)*iter, sizeof(HeaderEntryInfo));
-		}
-	
-		mNumEntries = mHeaderEntryQueue.size() ;
-		if(success && mNumEntries < MAX_NUM_OBJECT_ENTRIES)
-		{
-			HeaderEntryInfo* entry = new HeaderEntryInfo() ;
-			entry->mTime = INVALID_TIME ;
-			for(S32 i = mNumEntries ; success && i < MAX_NUM_OBJECT_ENTRIES ; i++)
-			{
-				//fill the cache with the default entry.
-				success = check_write(&apr_file, entry, sizeof(HeaderEntryInfo)) ;			
-
-			}
-			delete entry ;
-		}
+		success = check_write(&apr_file, header->getData(), header->getSize());
 	}
 
 	if(!success)
@@ -579,12 +1040,57 @@ void LLVOCache::writeCacheHeader()
 	return ;
 }
 
-BOOL LLVOCache::updateEntry(const HeaderEntryInfo* entry)
+// Returns the contents of the header file: the meta element, followed by one entry
+// for each cached region, oldest first, padded with empty entries.
+LLVOCacheFileBuffer* LLVOCache::buildCacheHeader()
+{
+	const S32 size = sizeof(HeaderMetaInfo) + MAX_NUM_OBJECT_ENTRIES * sizeof(HeaderEntryInfo);
+	LLVOCacheFileBuffer* header = new LLVOCacheFileBuffer(size);
+	memset(header->getData(), 0, size);
+	memcpy(header->getData(), &mMetaInfo, sizeof(HeaderMetaInfo));
+
+	HeaderEntryInfo* entries = (HeaderEntryInfo*)(header->getData() + sizeof(HeaderMetaInfo));
+	mNumEntries = 0 ;
+	for(header_entry_queue_t::iterator iter = mHeaderEntryQueue.begin() ; iter != mHeaderEntryQueue.end() && mNumEntries < MAX_NUM_OBJECT_ENTRIES; ++iter)
+	{
+		(*iter)->mIndex = mNumEntries ;
+		entries[mNumEntries++] = **iter ;
+	}
+	mNumEntries = mHeaderEntryQueue.size() ;
+
+	//fill the cache with the default entry.
+	HeaderEntryInfo empty_entry;
+	empty_entry.mTime = INVALID_TIME ;
+	for(U32 i = mNumEntries ; i < MAX_NUM_OBJECT_ENTRIES ; i++)
+	{
+		entries[i] = empty_entry ;
+	}
+
+	return header;
+}
+
+// Hand a snapshot of the header to the writer thread. Snapshots that weren't
+// written yet are replaced, so any number of updates costs at most one write.
+void LLVOCache::scheduleHeaderWrite()
 {
-	LLAPRFile apr_file(mHeaderFileName, APR_WRITE|APR_BINARY);
-	apr_file.seek(APR_SET, entry->mIndex * sizeof(HeaderEntryInfo) + sizeof(HeaderMetaInfo)) ;
+	if(mReadOnly)
+	{
+		return ;
+	}
+	if(!mWriter)
+	{
+		writeCacheHeader() ;
+		return ;
+	}
+	mWriter->writeHeader(mHeaderFileName, buildCacheHeader()) ;
+}
 
-	return check_write(&apr_file, (void*)entry, sizeof(HeaderEntryInfo)) ;
+void LLVOCache::flushWrites()
+{
+	if(mWriter)
+	{
+		mWriter->flush() ;
+	}
 }
 
 void LLVOCache::readFromCache(U64 handle, const LLUUID& id, LLVOCacheEntry::vocache_entry_map_t& cache_entry_map) 
@@ -603,45 +1109,73 @@ void LLVOCache::readFromCache(U64 handle, const LLUUID& id, LLVOCacheEntry::voca
 		return ;
 	}
 
+	if(mWriter && mWriter->isPending(handle))
+	{
+		// We're back in a region that we only just left, or its cache file is still
+		// being prefetched; wait for that to finish.
+		flushWrites();
+	}
+
 	bool success = true ;
 	{
 		std::string filename;
 		getObjectCacheFilename(handle, filename);
-		LLAPRFile apr_file(filename, APR_READ|APR_BINARY);
-	
-		LLUUID cache_id ;
-		success = check_read(&apr_file, cache_id.mData, UUID_BYTES) ;
-	
+
+		// Read the whole file at once, unless that was already done by prefetch(). The entries
+		// point into this buffer and only copy their data out of it when an object update
+		// actually asks for them.
+		LLPointer<LLVOCacheFileBuffer> file_buffer;
+		if(handle == mPrefetchHandle)
+		{
+			mPrefetchHandle = 0;
+		}
+		if(mWriter && mWriter->takePrefetched(handle, file_buffer))
+		{
+			success = file_buffer.notNull();
+		}
+		else
+		{
+			success = read_cache_file(filename, file_buffer);
+		}
+
+		ObjectCacheFileHeader const* header = NULL;
 		if(success)
-		{		
-			if(cache_id != id)
+		{
+			header = (ObjectCacheFileHeader const*)file_buffer->getData();
+			if(memcmp(header->mRegionID, id.mData, UUID_BYTES))
 			{
 				llinfos << "Cache ID doesn't match for this region, discarding"<< llendl;
 				success = false ;
 			}
+		}
 
-			if(success)
+		if(success)
+		{
+			U32 const file_size = file_buffer->getSize();
+			ObjectCacheTOCEntry const* toc = (ObjectCacheTOCEntry const*)(header + 1);
+			U32 data_start = sizeof(ObjectCacheFileHeader) + header->mNumEntries * sizeof(ObjectCacheTOCEntry);
+			U32 last_local_id = 0;
+			for (U32 i = 0; i < header->mNumEntries; i++)
 			{
-				S32 num_entries;
-				success = check_read(&apr_file, &num_entries, sizeof(S32)) ;
-	
-				if(success)
+				ObjectCacheTOCEntry const& toc_entry = toc[i];
+				// Corruption in the cache entries
+				if (toc_entry.mLocalID <= last_local_id ||
+					toc_entry.mSize < 1 || toc_entry.mSize > (U32)MAX_OBJECT_CACHE_ENTRY_SIZE ||
+					toc_entry.mOffset < data_start || toc_entry.mOffset > file_size || toc_entry.mSize > file_size - toc_entry.mOffset)
 				{
-					for (S32 i = 0; i < num_entries; i++)
-					{
-						LLVOCacheEntry* entry = new LLVOCacheEntry(&apr_file);
-						if (!entry->getLocalID())
-						{
-							llwarns << "Aborting cache file load for " << filename << ", cache file corruption!" << llendl;
-							delete entry ;
-							success = false ;
-							break ;
-						}
-						cache_entry_map[entry->getLocalID()] = entry;
-					}
+					llwarns << "Aborting cache file load for " << filename << ", cache file corruption!" << llendl;
+					success = false ;
+					break ;
 				}
+				last_local_id = toc_entry.mLocalID;
+
+				LLVOCacheEntry* entry = new LLVOCacheEntry(toc_entry.mLocalID, toc_entry.mCRC,
+					toc_entry.mHitCount, toc_entry.mDupeCount, toc_entry.mCRCChangeCount,
+					file_buffer, toc_entry.mOffset, toc_entry.mSize);
+				// The TOC is sorted, so every entry goes at the end of the map.
+				cache_entry_map.insert(cache_entry_map.end(), std::make_pair(toc_entry.mLocalID, entry));
 			}
-		}		
+		}
 	}
 	
 	if(!success)
@@ -655,8 +1189,66 @@ void LLVOCache::readFromCache(U64 handle, const LLUUID& id, LLVOCacheEntry::voca
 	return ;
 }
 	
+void LLVOCache::prefetch(U64 handle)
+{
+	if(!mEnabled || !mInitialized || !mWriter)
+	{
+		return ;
+	}
+	if(handle == mPrefetchHandle || mHandleEntryMap.find(handle) == mHandleEntryMap.end()) //already prefetching, or no cache
+	{
+		return ;
+	}
+	static const LLCachedControl<bool> object_cache_prefetch("ObjectCachePrefetch", true);
+	if(!object_cache_prefetch)
+	{
+		return ;
+	}
+
+	mPrefetchHandle = handle;
+	std::string filename;
+	getObjectCacheFilename(handle, filename);
+	mWriter->prefetchRegion(handle, filename);
+}
+
+void LLVOCache::cancelPrefetch()
+{
+	if(!mPrefetchHandle)
+	{
+		return ;
+	}
+	mPrefetchHandle = 0;
+	if(mWriter)
+	{
+		mWriter->cancelPrefetch();
+	}
+}
+
+void LLVOCache::updatePrefetch()
+{
+	std::vector<LLUUID> textures;
+	if(!mWriter || !mWriter->takePrefetchedTextures(textures))
+	{
+		return ;
+	}
+	// Get the textures that the destination region uses going, like LLViewerTextureList::doPrefetchImages
+	// does for the textures of the last session; by the time the objects arrive, their textures are on their way.
+	for(std::vector<LLUUID>::iterator iter = textures.begin(); iter != textures.end(); ++iter)
+	{
+		LLViewerFetchedTexture* image = LLViewerTextureManager::getFetchedTexture(*iter, MIPMAP_TRUE, LLGLTexture::BOOST_NONE, LLViewerTexture::LOD_TEXTURE);
+		if(image)
+		{
+			image->addTextureStats(PREFETCHED_TEXTURE_PIXEL_AREA);
+		}
+	}
+}
+
 void LLVOCache::purgeEntries(U32 size)
 {
+	if(mHeaderEntryQueue.size() <= size)
+	{
+		return ;
+	}
 	while(mHeaderEntryQueue.size() > size)
 	{
 		header_entry_queue_t::iterator iter = mHeaderEntryQueue.begin() ;
@@ -667,9 +1259,10 @@ void LLVOCache::purgeEntries(U32 size)
 		delete entry;
 	}
 	mNumEntries = mHandleEntryMap.size() ;
+	scheduleHeaderWrite() ;
 }
 
-void LLVOCache::writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map, BOOL dirty_cache) 
+void LLVOCache::writeToCache(U64 handle, const LLUUID& id, LLVOCacheEntry::vocache_entry_map_t& cache_entry_map, BOOL dirty_cache) 
 {
 	if(!mEnabled)
 	{
@@ -713,11 +1306,7 @@ void LLVOCache::writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry:
 	}
 
 	//update cache header
-	if(!updateEntry(entry))
-	{
-		llwarns << "Failed to update cache header index " << entry->mIndex << ". handle = " << handle << llendl;
-		return ; //update failed.
-	}
+	scheduleHeaderWrite() ;
 
 	if(!dirty_cache)
 	{
@@ -726,31 +1315,24 @@ void LLVOCache::writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry:
 	}
 
 	//write to cache file
-	bool success = true ;
+	std::string filename;
+	getObjectCacheFilename(handle, filename);
+	if(mWriter)
 	{
-		std::string filename;
-		getObjectCacheFilename(handle, filename);
-		LLAPRFile apr_file(filename, APR_CREATE|APR_WRITE|APR_BINARY);
-	
-		success = check_write(&apr_file, (void*)id.mData, UUID_BYTES) ;
-
-	
-		if(success)
-		{
-			S32 num_entries = cache_entry_map.size() ;
-			success = check_write(&apr_file, &num_entries, sizeof(S32));
-	
-			for (LLVOCacheEntry::vocache_entry_map_t::const_iterator iter = cache_entry_map.begin(); success && iter != cache_entry_map.end(); ++iter)
-			{
-				success = iter->second->writeToFile(&apr_file) ;
-			}
-		}
+		mWriter->writeRegion(handle, filename, id, cache_entry_map) ;
 	}
-
-	if(!success)
+	else
 	{
-		removeEntry(entry) ;
-
+		bool success;
+		{
+			LLPointer<LLVOCacheFileBuffer> file_buffer = serialize_cache_entries(id, cache_entry_map);
+			LLAPRFile apr_file(filename, APR_CREATE|APR_WRITE|APR_TRUNCATE|APR_BINARY);
+			success = check_write(&apr_file, file_buffer->getData(), file_buffer->getSize());
+		}
+		if(!success)
+		{
+			removeEntry(entry) ;
+		}
 	}
 
 	return ;
@@ -37,8 +37,29 @@
 #include "lldatapacker.h"
 #include "lldlinked.h"
 #include "lldir.h"
+#include "llpointer.h"
+#include "llthread.h"
 
 
+//---------------------------------------------------------------------------
+// A region cache file, read into memory in one go.
+// Cache entries read from the file point into it until their data is first used.
+class LLVOCacheFileBuffer : public LLThreadSafeRefCount
+{
+public:
+	LLVOCacheFileBuffer(S32 size) : mData(new U8[size]), mSize(size) { }
+
+	U8* getData() const				{ return mData; }
+	S32 getSize() const				{ return mSize; }
+
+protected:
+	~LLVOCacheFileBuffer()			{ delete [] mData; }
+
+private:
+	U8* mData;
+	S32 mSize;
+};
+
 //---------------------------------------------------------------------------
 // Cache entries
 class LLVOCacheEntry;
@@ -47,17 +68,22 @@ class LLVOCacheEntry
 {
 public:
 	LLVOCacheEntry(U32 local_id, U32 crc, LLDataPackerBinaryBuffer &dp);
-	LLVOCacheEntry(LLAPRFile* apr_file);
+	LLVOCacheEntry(U32 local_id, U32 crc, S32 hit_count, S32 dupe_count, S32 crc_change_count,
+				   LLVOCacheFileBuffer* file_buffer, S32 offset, S32 size);
 	LLVOCacheEntry();
 	~LLVOCacheEntry();
 
 	U32 getLocalID() const			{ return mLocalID; }
 	U32 getCRC() const				{ return mCRC; }
 	S32 getHitCount() const			{ return mHitCount; }
+	S32 getDupeCount() const		{ return mDupeCount; }
 	S32 getCRCChangeCount() const	{ return mCRCChangeCount; }
 
+	// The object update data, whether or not it was materialized yet.
+	const U8* getData() const;
+	S32 getDataSize() const;
+
 	void dump() const;
-	BOOL writeToFile(LLAPRFile* apr_file) const;
 	void assignCRC(U32 crc, LLDataPackerBinaryBuffer &dp);
 	LLDataPackerBinaryBuffer *getDP(U32 crc);
 	void recordHit();
@@ -67,6 +93,9 @@ public:
 	typedef std::map<U32, LLVOCacheEntry*>	vocache_entry_map_t;
 
 protected:
+	// Copy the data out of the cache file buffer, so that mDP can be used.
+	void materialize();
+
 	U32							mLocalID;
 	U32							mCRC;
 	S32							mHitCount;
@@ -74,8 +103,15 @@ protected:
 	S32							mCRCChangeCount;
 	LLDataPackerBinaryBuffer	mDP;
 	U8							*mBuffer;
+
+	// Not yet materialized data, at mFileOffset in mFileBuffer.
+	LLPointer<LLVOCacheFileBuffer> mFileBuffer;
+	S32							mFileOffset;
+	S32							mFileSize;
 };
 
+class LLVOCacheWriter;
+
 //
 //Note: LLVOCache is not thread-safe
 //
@@ -121,9 +157,19 @@ public:
 	void removeCache(ELLPath location) ;
 
 	void readFromCache(U64 handle, const LLUUID& id, LLVOCacheEntry::vocache_entry_map_t& cache_entry_map) ;
-	void writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map, BOOL dirty_cache) ;
+	// The entries of cache_entry_map are handed over to the background writer when the
+	// cache file needs to be written, in which case cache_entry_map is empty upon return.
+	void writeToCache(U64 handle, const LLUUID& id, LLVOCacheEntry::vocache_entry_map_t& cache_entry_map, BOOL dirty_cache) ;
 	void removeEntry(U64 handle) ;
 
+	// Start reading the cache file of the region with this handle in the background, before the region
+	// is created (for example when the destination of a teleport is known); readFromCache then uses it.
+	void prefetch(U64 handle) ;
+	// Drop the prefetched cache file and textures, when the teleport failed or was cancelled.
+	void cancelPrefetch() ;
+	// Called once per frame. Starts fetching the textures used by a prefetched region.
+	void updatePrefetch() ;
+
 	void setReadOnly(BOOL read_only) {mReadOnly = read_only;} 
 
 private:
@@ -137,7 +183,9 @@ private:
 	void removeCache() ;
 	void removeEntry(HeaderEntryInfo* entry) ;
 	void purgeEntries(U32 size);
-	BOOL updateEntry(const HeaderEntryInfo* entry);
+	LLVOCacheFileBuffer* buildCacheHeader();
+	void scheduleHeaderWrite();
+	void flushWrites();
 	
 private:
 	BOOL                 mEnabled;
@@ -150,6 +198,8 @@ private:
 	std::string          mObjectCacheDirName;
 	header_entry_queue_t mHeaderEntryQueue;
 	handle_entry_map_t   mHandleEntryMap;	
+	LLVOCacheWriter*     mWriter;
+	U64                  mPrefetchHandle;	// The region that was last prefetched and not read yet, or 0.
 
 	static LLVOCache* sInstance ;
 public:
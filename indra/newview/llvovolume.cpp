@@ -42,8 +42,10 @@
 #include "llflexibleobject.h"
 #include "llfloaterinspect.h"
 #include "llfloatertools.h"
+#include "llgeometryfillpool.h"
 #include "llmaterialid.h"
 #include "llmaterialtable.h"
+#include "llobjectupdatedecoder.h"
 #include "llprimitive.h"
 #include "llvolume.h"
 #include "llvolumeoctree.h"
@@ -73,6 +75,7 @@
 #include "llselectmgr.h"
 #include "pipeline.h"
 #include "llsdutil.h"
+#include "llsys.h"
 #include "llmatrix4a.h"
 #include "llmediaentry.h"
 #include "llmediadataclient.h"
@@ -105,6 +108,9 @@ S32 LLVOVolume::mRenderComplexity_last = 0;
 S32 LLVOVolume::mRenderComplexity_current = 0;
 LLPointer<LLObjectMediaDataClient> LLVOVolume::sObjectMediaClient = NULL;
 LLPointer<LLObjectMediaNavigateClient> LLVOVolume::sObjectMediaNavigateClient = NULL;
+LLGeometryFillPool* LLVolumeGeometryManager::sFillPool = NULL;
+
+const U32 MAX_GEOMETRY_FILL_THREADS = 8;
 
 static LLFastTimer::DeclareTimer FTM_GEN_TRIANGLES("Generate Triangles");
 static LLFastTimer::DeclareTimer FTM_GEN_VOLUME("Generate Volumes");
@@ -297,6 +303,13 @@ void LLVOVolume::initClass()
 		sObjectMediaNavigateClient = new LLObjectMediaNavigateClient(queue_timer_delay, retry_timer_delay, 
 																	 max_retries, max_sorted_queue_size, max_round_robin_queue_size);
 	}
+
+	U32 fill_threads = gSavedSettings.getU32("RenderGeometryFillThreads");
+	if (!fill_threads)
+	{
+		fill_threads = LLCPUInfo::getDefaultWorkerCount();
+	}
+	LLVolumeGeometryManager::sFillPool = new LLGeometryFillPool(llmin(fill_threads, MAX_GEOMETRY_FILL_THREADS));
 }
 
 // static
@@ -304,6 +317,9 @@ void LLVOVolume::cleanupClass()
 {
     sObjectMediaClient = NULL;
     sObjectMediaNavigateClient = NULL;
+
+	delete LLVolumeGeometryManager::sFillPool;
+	LLVolumeGeometryManager::sFillPool = NULL;
 }
 
 U32 LLVOVolume::processUpdateMessage(LLMessageSystem *mesgsys,
@@ -397,8 +413,26 @@ U32 LLVOVolume::processUpdateMessage(LLMessageSystem *mesgsys,
 		// CORY TO DO: Figure out how to get the value here
 		if (update_type != OUT_TERSE_IMPROVED)
 		{
+			// Use what LLObjectUpdateDecoder decoded, if it got to the same place in the data.
+			// Staged updates always come with a LLDataPackerBinaryBuffer.
+			LLStagedObjectUpdate* staged = getStagedUpdate();
+			LLDataPackerBinaryBuffer* staged_dp = static_cast<LLDataPackerBinaryBuffer*>(dp);
+			if (staged && (!staged->mVolumeDecoded || staged_dp->getCurrentSize() != staged->mVolumeOffset))
+			{
+				staged = NULL;
+			}
+
 			LLVolumeParams volume_params;
-			BOOL res = LLVolumeMessage::unpackVolumeParams(&volume_params, *dp);
+			BOOL res;
+			if (staged)
+			{
+				volume_params = staged->mVolumeParams;
+				res = staged->mVolumeParamsValid;
+			}
+			else
+			{
+				res = LLVolumeMessage::unpackVolumeParams(&volume_params, *dp);
+			}
 			if (!res)
 			{
 				llwarns << "Bogus volume parameters in object " << getID() << llendl;
@@ -411,7 +445,16 @@ U32 LLVOVolume::processUpdateMessage(LLMessageSystem *mesgsys,
 			{
 				markForUpdate(TRUE);
 			}
-			S32 res2 = unpackTEMessage(*dp);
+			S32 res2;
+			if (staged)
+			{
+				res2 = staged->mTEResult == 1 ? applyParsedTEMessage(staged->mTEContents) : staged->mTEResult;
+				staged_dp->setCurrentSize(staged->mTEEnd);
+			}
+			else
+			{
+				res2 = unpackTEMessage(*dp);
+			}
 			if (TEM_INVALID == res2)
 			{
 				// There's something bogus in the data that we're unpacking.
@@ -5243,6 +5286,11 @@ void LLVolumeGeometryManager::rebuildGeom(LLSpatialGroup* group)
 	genDrawInfo(group, spec_mask | additional_flags, spec_faces, spec_count, FALSE);
 	genDrawInfo(group, normspec_mask | additional_flags, normspec_faces, normspec_count, FALSE);
 
+	if (sFillPool)
+	{ //transform the vertices of all faces of the group at once, then flush their buffers
+		sFillPool->finish();
+	}
+
 	if (!LLPipeline::sDelayVBUpdate)
 	{
 		//drawables have been rebuilt, clear rebuild status
@@ -5318,7 +5366,7 @@ void LLVolumeGeometryManager::rebuildMesh(LLSpatialGroup* group)
 							llassert(!face->isState(LLFace::RIGGED));
 
 							if (!face->getGeometryVolume(*volume, face->getTEOffset(), 
-								vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), face->getGeomIndex()))
+								vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), face->getGeomIndex(), false, sFillPool))
 							{ //something's gone wrong with the vertex buffer accounting, rebuild this group 
 								group->dirtyGeom();
 								gPipeline.markRebuild(group, TRUE);
@@ -5342,6 +5390,11 @@ void LLVolumeGeometryManager::rebuildMesh(LLSpatialGroup* group)
 				drawablep->clearState(LLDrawable::REBUILD_ALL);
 			}
 		}
+
+		if (sFillPool)
+		{ //the vertex transforms were queued; they must be done before anything is unmapped
+			sFillPool->finish();
+		}
 		
 		for (LLVertexBuffer** iter = locked_buffer, ** end_iter = locked_buffer+buffer_count; iter != end_iter; ++iter)
 		{
@@ -6297,7 +6350,7 @@ void LLVolumeGeometryManager::genDrawInfo(LLSpatialGroup* group, U32 mask, LLFac
 				llassert(!facep->isState(LLFace::RIGGED));
 
 				if (!facep->getGeometryVolume(*volume, te_idx, 
-					vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), index_offset,true))
+					vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), index_offset, true, sFillPool))
 				{
 					llwarns << "Failed to get geometry for face!" << llendl;
 				}
@@ -6314,12 +6367,19 @@ void LLVolumeGeometryManager::genDrawInfo(LLSpatialGroup* group, U32 mask, LLFac
 			++face_iter;
 		}
 
-		if(index_offset > 0)
-		{
-			buffer->validateRange(0,  index_offset - 1, indices_index, 0);
+		if (sFillPool)
+		{ //rebuildGeom flushes the buffer once the queued vertex transforms of the whole group are done
+			sFillPool->deferFlush(buffer, index_offset, indices_index);
 		}
+		else
+		{
+			if(index_offset > 0)
+			{
+				buffer->validateRange(0,  index_offset - 1, indices_index, 0);
+			}
 
-		buffer->flush();
+			buffer->flush();
+		}
 	}
 
 	group->mBufferMap[mask].clear();
@@ -45,6 +45,7 @@
 #include "llnamevalue.h"
 #include "llpointer.h"
 #include "llprimitive.h"
+#include "llsys.h"
 #include "llvolume.h"
 #include "material_codes.h"
 #include "timing.h"
@@ -108,6 +109,8 @@
 #include "llwlparammanager.h"
 #include "llwaterparammanager.h"
 #include "llspatialpartition.h"
+#include "llspatialcullpool.h"
+#include "llocclusiondepthbuffer.h"
 #include "llmutelist.h"
 #include "llfloatertools.h"
 #include "llpanelface.h"
@@ -156,6 +159,7 @@ const U32 REFLECTION_MAP_RES = 128;
 const U32 AUX_VB_MASK = LLVertexBuffer::MAP_VERTEX | LLVertexBuffer::MAP_TEXCOORD0 | LLVertexBuffer::MAP_TEXCOORD1;
 // Max number of occluders to search for. JC
 const S32 MAX_OCCLUDER_COUNT = 2;
+const U32 MAX_CULL_THREADS = 8;
 
 extern S32 gBoxFrame;
 //extern BOOL gHideSelectedObjects;
@@ -376,6 +380,7 @@ LLPipeline::LLPipeline() :
 	mGroupQ1Locked(false),
 	mGroupQ2Locked(false),
 	mResetVertexBuffers(false),
+	mBatchingMoves(false),
 	mLastRebuildPool(NULL),
 	mAlphaPool(NULL),
 	mSkyPool(NULL),
@@ -399,6 +404,16 @@ LLPipeline::LLPipeline() :
 	mNoiseMap = 0;
 	mTrueNoiseMap = 0;
 	mLightFunc = 0;
+	mCullPool = NULL;
+	mOcclusionDepthBuffer = NULL;
+	for (U32 i = 0; i < LLViewerCamera::NUM_CAMERAS; i++)
+	{
+		mOcclusionFence[i] = NULL;
+		mOcclusionFenceFrame[i] = 0;
+		mOcclusionFenceCompleted[i] = false;
+		mCullFrame[i] = 0;
+		mPreviousCullFrame[i] = 0;
+	}
 }
 
 void LLPipeline::init()
@@ -418,6 +433,14 @@ void LLPipeline::init()
 	sRenderAttachedLights = gSavedSettings.getBOOL("RenderAttachedLights");
 	sRenderAttachedParticles = gSavedSettings.getBOOL("RenderAttachedParticles");
 
+	U32 cull_threads = gSavedSettings.getU32("RenderCullThreads");
+	if (!cull_threads)
+	{
+		cull_threads = LLCPUInfo::getDefaultWorkerCount();
+	}
+	mCullPool = new LLSpatialCullPool(llmin(cull_threads, MAX_CULL_THREADS));
+	mOcclusionDepthBuffer = new LLOcclusionDepthBuffer();
+
 	mInitialized = TRUE;
 	
 	stop_glerror();
@@ -579,6 +602,12 @@ void LLPipeline::cleanup()
 
 	mAuxScreenRectVB = NULL;
 	mCubeVB = NULL;
+
+	delete mCullPool;
+	mCullPool = NULL;
+
+	delete mOcclusionDepthBuffer;
+	mOcclusionDepthBuffer = NULL;
 }
 
 //============================================================================
@@ -610,6 +639,12 @@ void LLPipeline::destroyGL()
 		glDeleteQueriesARB(1, &mMeshDirtyQueryObject);
 		mMeshDirtyQueryObject = 0;
 	}
+
+	for (U32 i = 0; i < LLViewerCamera::NUM_CAMERAS; i++)
+	{
+		delete mOcclusionFence[i];
+		mOcclusionFence[i] = NULL;
+	}
 }
 
 static LLFastTimer::DeclareTimer FTM_RESIZE_SCREEN_TEXTURE("Resize Screen Texture");
@@ -2288,6 +2323,21 @@ void LLPipeline::updateCull(LLCamera& camera, LLCullResult& result, S32 water_cl
 
 	sCull->clear();
 
+	U32 camera_id = LLViewerCamera::sCurCameraID;
+	if (mCullFrame[camera_id] != gFrameCount)
+	{
+		mPreviousCullFrame[camera_id] = mCullFrame[camera_id];
+		mCullFrame[camera_id] = gFrameCount;
+	}
+
+	static const LLCachedControl<bool> use_depth_buffer("RenderOcclusionDepthBuffer", false);
+	if (use_depth_buffer && mOcclusionDepthBuffer && sUseOcclusion > 1 &&
+		LLViewerCamera::sCurCameraID == LLViewerCamera::CAMERA_WORLD && !hasRenderType(LLPipeline::RENDER_TYPE_HUD) &&
+		hasRenderType(LLPipeline::RENDER_TYPE_TERRAIN))
+	{
+		mOcclusionDepthBuffer->update(camera);
+	}
+
 	BOOL to_texture =	LLPipeline::sUseOcclusion > 1 &&
 						!hasRenderType(LLPipeline::RENDER_TYPE_HUD) && 
 						LLViewerCamera::sCurCameraID == LLViewerCamera::CAMERA_WORLD &&
@@ -2396,12 +2446,24 @@ void LLPipeline::updateCull(LLCamera& camera, LLCullResult& result, S32 water_cl
 			{
 				if (hasRenderType(part->mDrawableType))
 				{
-					part->cull(camera);
+					if (mCullPool)
+					{
+						mCullPool->queue(part, camera);
+					}
+					else
+					{
+						part->cull(camera);
+					}
 				}
 			}
 		}
 	}
 
+	if (mCullPool)
+	{
+		mCullPool->cull();
+	}
+
 	if (bound_shader)
 	{
 		gOcclusionCubeProgram.unbind();
@@ -2616,11 +2678,36 @@ void LLPipeline::doOcclusion(LLCamera& camera)
 		}
 		mCubeVB->setBuffer(LLVertexBuffer::MAP_VERTEX);
 
-		for (LLCullResult::sg_iterator iter = sCull->beginOcclusionGroups(); iter != sCull->endOcclusionGroups(); ++iter)
+		//issue the queries in runs of groups of the same partition, which is mostly the order they were culled in
+		LLCullResult::sg_iterator begin = sCull->beginOcclusionGroups();
+		LLCullResult::sg_iterator end = sCull->endOcclusionGroups();
+		while (begin != end)
 		{
-			LLSpatialGroup* group = *iter;
-			group->doOcclusion(&camera);
-			group->clearOcclusionState(LLSpatialGroup::ACTIVE_OCCLUSION);
+			LLSpatialPartition* part = (*begin)->mSpatialPartition;
+			LLCullResult::sg_iterator batch_end = begin + 1;
+			while (batch_end != end && (*batch_end)->mSpatialPartition == part)
+			{
+				++batch_end;
+			}
+
+			part->doOcclusion(&camera, &*begin, batch_end - begin);
+
+			for (; begin != batch_end; ++begin)
+			{
+				(*begin)->clearOcclusionState(LLSpatialGroup::ACTIVE_OCCLUSION);
+			}
+		}
+
+		if (gGLManager.mHasSync)
+		{ //lets checkOcclusion() find out whether all of these results are in at once
+			U32 camera_id = LLViewerCamera::sCurCameraID;
+			if (!mOcclusionFence[camera_id])
+			{
+				mOcclusionFence[camera_id] = new LLGLSyncFence();
+			}
+			mOcclusionFence[camera_id]->placeFence();
+			mOcclusionFenceFrame[camera_id] = gFrameCount;
+			mOcclusionFenceCompleted[camera_id] = false;
 		}
 	
 		if (bind_shader)
@@ -2639,6 +2726,34 @@ void LLPipeline::doOcclusion(LLCamera& camera)
 	}
 }
 	
+bool LLPipeline::isOcclusionFenceCompleted(U32 frame)
+{
+	U32 camera_id = LLViewerCamera::sCurCameraID;
+	if (!mOcclusionFence[camera_id] || mOcclusionFenceFrame[camera_id] < frame)
+	{
+		return false;
+	}
+
+	if (!mOcclusionFenceCompleted[camera_id])
+	{
+		mOcclusionFenceCompleted[camera_id] = mOcclusionFence[camera_id]->isCompleted();
+	}
+
+	return mOcclusionFenceCompleted[camera_id];
+}
+
+const LLOcclusionDepthBuffer* LLPipeline::getOcclusionDepthBuffer() const
+{
+	//only terrain that is drawn for the camera that is being culled may hide anything
+	if (mOcclusionDepthBuffer && LLViewerCamera::sCurCameraID == LLViewerCamera::CAMERA_WORLD &&
+		hasRenderType(LLPipeline::RENDER_TYPE_TERRAIN) &&
+		mOcclusionDepthBuffer->isCurrent(*LLViewerCamera::getInstance()))
+	{
+		return mOcclusionDepthBuffer;
+	}
+	return NULL;
+}
+
 BOOL LLPipeline::updateDrawableGeom(LLDrawable* drawablep, BOOL priority)
 {
 	BOOL update_complete = drawablep->updateGeometry(priority);
@@ -2965,6 +3080,12 @@ void LLPipeline::markMoved(LLDrawable *drawablep, BOOL damped_motion)
 		llwarns << "Marking NULL or dead drawable moved!" << llendl;
 		return;
 	}
+
+	if (mBatchingMoves)
+	{
+		mPendingMoves.push_back(std::make_pair(LLPointer<LLDrawable>(drawablep), damped_motion));
+		return;
+	}
 	
 	if (drawablep->getParent()) 
 	{
@@ -2996,6 +3117,42 @@ void LLPipeline::markMoved(LLDrawable *drawablep, BOOL damped_motion)
 	}
 }
 
+void LLPipeline::beginMoveBatch()
+{
+	llassert(!mBatchingMoves);
+	mBatchingMoves = true;
+}
+
+static bool pending_move_less(const std::pair<LLPointer<LLDrawable>, BOOL>& lhs, const std::pair<LLPointer<LLDrawable>, BOOL>& rhs)
+{
+	return lhs.first.get() < rhs.first.get();
+}
+
+void LLPipeline::endMoveBatch()
+{
+	llassert(mBatchingMoves);
+	mBatchingMoves = false;
+
+	std::sort(mPendingMoves.begin(), mPendingMoves.end(), pending_move_less);
+
+	pending_move_list_t::iterator iter = mPendingMoves.begin();
+	while (iter != mPendingMoves.end())
+	{
+		LLDrawable* drawablep = iter->first;
+		BOOL damped_motion = iter->second;
+		while (++iter != mPendingMoves.end() && iter->first.get() == drawablep)
+		{
+			damped_motion = damped_motion && iter->second;
+		}
+		//it might have been killed after it was recorded
+		if (!drawablep->isDead())
+		{
+			markMoved(drawablep, damped_motion);
+		}
+	}
+	mPendingMoves.clear();
+}
+
 void LLPipeline::markShift(LLDrawable *drawablep)
 {
 	if (!drawablep || drawablep->isDead())
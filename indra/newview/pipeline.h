@@ -68,6 +68,8 @@ class LLVOAvatar;
 class LLVOPartGroup;
 class LLGLSLShader;
 class LLDrawPoolAlpha;
+class LLSpatialCullPool;
+class LLOcclusionDepthBuffer;
 
 class LLMeshResponder;
 
@@ -187,9 +189,19 @@ public:
 
 	void		doOcclusion(LLCamera& camera, LLRenderTarget& source, LLRenderTarget& dest, LLRenderTarget* scratch_space = NULL);
 	void		doOcclusion(LLCamera& camera);
+	// True if every occlusion query issued for the current camera on or before frame has a result.
+	bool		isOcclusionFenceCompleted(U32 frame);
+	// The terrain depth of the current frame, or NULL if there is none for the current camera.
+	const LLOcclusionDepthBuffer* getOcclusionDepthBuffer() const;
+	// The frame that the current camera was culled on before the current one.
+	U32			getPreviousCullFrame() const { return mPreviousCullFrame[LLViewerCamera::sCurCameraID]; }
 	void		markNotCulled(LLSpatialGroup* group, LLCamera &camera);
 	void        markMoved(LLDrawable *drawablep, BOOL damped_motion = FALSE);
 	void        markShift(LLDrawable *drawablep);
+	// Until endMoveBatch(), markMoved() only records the drawable. endMoveBatch() then marks all
+	// of them in address order, once per drawable (undamped if any of the calls was).
+	void		beginMoveBatch();
+	void		endMoveBatch();
 	void        markTextured(LLDrawable *drawablep);
 	void		markGLRebuild(LLGLUpdate* glu);
 	void		markRebuild(LLSpatialGroup* group, BOOL priority = FALSE);
@@ -617,6 +629,20 @@ public:
 	LLPointer<LLVertexBuffer> mCubeVB;
 
 private:
+	// Frustum culls the spatial partitions of updateCull on RenderCullThreads workers.
+	LLSpatialCullPool*		mCullPool;
+
+	// Terrain depth for rejecting groups before their occlusion queries, see RenderOcclusionDepthBuffer.
+	LLOcclusionDepthBuffer*	mOcclusionDepthBuffer;
+
+	// Placed after the occlusion queries that doOcclusion issued for each camera, on frame mOcclusionFenceFrame.
+	LLGLSyncFence*			mOcclusionFence[LLViewerCamera::NUM_CAMERAS];
+	U32						mOcclusionFenceFrame[LLViewerCamera::NUM_CAMERAS];
+	bool					mOcclusionFenceCompleted[LLViewerCamera::NUM_CAMERAS];
+
+	U32						mCullFrame[LLViewerCamera::NUM_CAMERAS];
+	U32						mPreviousCullFrame[LLViewerCamera::NUM_CAMERAS];
+
 	//sun shadow map
 	LLRenderTarget			mShadow[6];
 	LLRenderTarget			mShadowOcclusion[6];
@@ -730,6 +756,10 @@ private:
 
 	bool mResetVertexBuffers; //if true, clear vertex buffers on next update
 
+	bool mBatchingMoves; //if true, markMoved adds to mPendingMoves
+	typedef std::vector<std::pair<LLPointer<LLDrawable>, BOOL> > pending_move_list_t;
+	pending_move_list_t				mPendingMoves; //drawables and damped_motion passed to markMoved since beginMoveBatch
+
 	LLViewerObject::vobj_list_t		mCreateQ;
 		
 	LLDrawable::drawable_set_t		mRetexturedList;
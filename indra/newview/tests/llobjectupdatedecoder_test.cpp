@@ -0,0 +1,304 @@
+/**
+ * @file llobjectupdatedecoder_test.cpp
+ * @brief LLObjectUpdateDecoder tests, and tests of the texture entry parsing it uses
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+// Precompiled header: almost always required for newview cpp files
+#include "../llviewerprecompiledheaders.h"
+// Class to test
+#include "../llobjectupdatedecoder.h"
+// Dependencies
+#include "lldatapacker.h"
+#include "llprimitive.h"
+#include "lltextureentry.h"
+#include "llvolumemessage.h"
+
+// Tut header
+#include "../test/lltut.h"
+
+// -------------------------------------------------------------------------------------------
+// TUT
+// -------------------------------------------------------------------------------------------
+
+namespace tut
+{
+	// Test wrapper declarations
+	struct objectupdatedecoder_test
+	{
+		objectupdatedecoder_test()
+		{
+			mTextures[0].set("3a0efa3b-84dc-4e17-9b8c-79ea028850c1");
+			mTextures[1].set("8dcd4a48-2d37-4909-9f78-f7a9eb4ef903");
+			mTextures[2].set("f54a0c32-3cd1-d49a-5b4f-7b792bebc204");
+			mVolumeParams.setType(LL_PCODE_PROFILE_CIRCLE, LL_PCODE_PATH_CIRCLE);
+		}
+
+		// Packs a texture entry block of three faces.
+		void packTextureEntry(LLDataPacker& dp)
+		{
+			LLPrimitive prim;
+			prim.setNumTEs(3);
+			for (U8 face = 0; face < 3; ++face)
+			{
+				prim.setTETexture(face, mTextures[face]);
+				prim.setTEScale(face, 1.f + face, 2.f);
+			}
+			prim.packTEMessage(dp);
+		}
+
+		// Packs the data block of an ObjectUpdateCompressed message like the simulator does,
+		// with the optional fields that flags asks for. Returns its size.
+		S32 packUpdate(U8* buffer, S32 size, LLPCode pcode, U32 flags)
+		{
+			LLDataPackerBinaryBuffer dp(buffer, size);
+			LLUUID id("6c2ba3a4-0d62-4d53-a3e4-7c1b1e2c5e5b");
+			dp.packUUID(id, "ID");
+			dp.packU32(1234, "LocalID");
+			dp.packU8(pcode, "PCode");
+			dp.packU8(0, "State");
+			dp.packU32(0x55aa55aa, "CRC");
+			dp.packU8(LL_MCODE_WOOD, "Material");
+			dp.packU8(0, "ClickAction");
+			dp.packVector3(LLVector3(1.f, 2.f, 3.f), "Scale");
+			dp.packVector3(LLVector3(128.f, 128.f, 25.f), "Pos");
+			dp.packVector3(LLVector3(0.f, 0.f, 0.f), "Rot");
+			dp.packU32(flags, "SpecialCode");
+			dp.packUUID(id, "Owner");
+			if (flags & 0x4)
+			{
+				dp.packString(std::string("hover text"), "Text");
+				U8 color[4] = { 255, 0, 0, 255 };
+				dp.packBinaryDataFixed(color, 4, "Color");
+			}
+			dp.packU8(0, "num_params");
+			if (flags & 0x100)
+			{
+				dp.packString(std::string("AttachItemID STRING RW SV 00000000-0000-0000-0000-000000000000"), "NV");
+			}
+			mVolumeOffset = dp.getCurrentSize();
+			LLVolumeMessage::packVolumeParams(&mVolumeParams, dp);
+			packTextureEntry(dp);
+			return dp.getCurrentSize();
+		}
+
+		LLUUID mTextures[3];
+		LLVolumeParams mVolumeParams;
+		S32 mVolumeOffset;
+	};
+
+	// Tut templating thingamagic: test group, object and test instance
+	typedef test_group<objectupdatedecoder_test> objectupdatedecoder_t;
+	typedef objectupdatedecoder_t::object objectupdatedecoder_object_t;
+	tut::objectupdatedecoder_t tut_objectupdatedecoder("objectupdatedecoder");
+
+	// ---------------------------------------------------------------------------------------
+	// Test functions
+	// ---------------------------------------------------------------------------------------
+
+	// LLPrimitive::parseTEMessage reads back what packTEMessage wrote, without a primitive.
+	template<> template<>
+	void objectupdatedecoder_object_t::test<1>()
+	{
+		U8 buffer[MAX_OBJECT_UPDATE_SIZE];
+		LLDataPackerBinaryBuffer dp(buffer, sizeof(buffer));
+		packTextureEntry(dp);
+		S32 size = dp.getCurrentSize();
+
+		LLDataPackerBinaryBuffer dp1(buffer, size);
+		LLTEContents tec;
+		ensure_equals("parseTEMessage result", LLPrimitive::parseTEMessage(dp1, tec), 1);
+		ensure_equals("parseTEMessage read the whole block", dp1.getCurrentSize(), size);
+		ensure_equals("parseTEMessage face count", tec.face_count, (U32)LLTEContents::MAX_TES);
+		for (U32 face = 0; face < 3; ++face)
+		{
+			ensure("parseTEMessage texture", ((LLUUID*)tec.image_data)[face] == mTextures[face]);
+			ensure_equals("parseTEMessage scale s", tec.scale_s[face], 1.f + face);
+			ensure_equals("parseTEMessage scale t", tec.scale_t[face], 2.f);
+		}
+		// Faces past the last one repeat its values.
+		ensure("parseTEMessage repeats the last face", ((LLUUID*)tec.image_data)[LLTEContents::MAX_TES - 1] == mTextures[2]);
+	}
+
+	// LLPrimitive::parseTEMessage rejects a block that is cut short, and accepts an empty one.
+	template<> template<>
+	void objectupdatedecoder_object_t::test<2>()
+	{
+		U8 buffer[MAX_OBJECT_UPDATE_SIZE];
+		LLDataPackerBinaryBuffer dp(buffer, sizeof(buffer));
+		packTextureEntry(dp);
+		S32 size = dp.getCurrentSize();
+
+		for (S32 truncated = 0; truncated < size; ++truncated)
+		{
+			LLDataPackerBinaryBuffer dp1(buffer, truncated);
+			LLTEContents tec;
+			ensure_equals("parseTEMessage of a truncated block", LLPrimitive::parseTEMessage(dp1, tec), TEM_INVALID);
+		}
+
+		LLDataPackerBinaryBuffer dp2(buffer, sizeof(buffer));
+		dp2.packBinaryData(buffer, 0, "TextureEntry");
+		LLDataPackerBinaryBuffer dp3(buffer, dp2.getCurrentSize());
+		LLTEContents tec;
+		ensure_equals("parseTEMessage of an empty block", LLPrimitive::parseTEMessage(dp3, tec), 0);
+		ensure_equals("parseTEMessage face count of an empty block", tec.face_count, 0U);
+	}
+
+	// decodeUpdate finds the volume parameters and texture entries of a full update.
+	template<> template<>
+	void objectupdatedecoder_object_t::test<3>()
+	{
+		LLStagedObjectUpdate update;
+		update.mSize = packUpdate(update.mData, MAX_OBJECT_UPDATE_SIZE, LL_PCODE_VOLUME, 0);
+		update.mBuffer = update.mData;
+		LLObjectUpdateDecoder::decodeUpdate(update);
+
+		ensure("decodeUpdate decoded the volume", update.mVolumeDecoded);
+		ensure_equals("decodeUpdate volume offset", update.mVolumeOffset, mVolumeOffset);
+		ensure("decodeUpdate volume parameters are valid", update.mVolumeParamsValid);
+		ensure("decodeUpdate volume parameters", update.mVolumeParams == mVolumeParams);
+		ensure_equals("decodeUpdate texture entry result", update.mTEResult, 1);
+		ensure_equals("decodeUpdate texture entry end", update.mTEEnd, update.mSize);
+		ensure("decodeUpdate texture", ((LLUUID*)update.mTEContents.image_data)[1] == mTextures[1]);
+		ensure("decodeUpdate decoded motion", !update.mMotionDecoded);
+	}
+
+	// decodeUpdate skips the optional fields it doesn't need, and leaves anything but volumes alone.
+	template<> template<>
+	void objectupdatedecoder_object_t::test<4>()
+	{
+		LLStagedObjectUpdate update;
+		update.mSize = packUpdate(update.mData, MAX_OBJECT_UPDATE_SIZE, LL_PCODE_VOLUME, 0x4 | 0x100);
+		update.mBuffer = update.mData;
+		LLObjectUpdateDecoder::decodeUpdate(update);
+		ensure("decodeUpdate with text and name values", update.mVolumeDecoded);
+		ensure_equals("decodeUpdate volume offset after text and name values", update.mVolumeOffset, mVolumeOffset);
+		ensure_equals("decodeUpdate texture entry end after text and name values", update.mTEEnd, update.mSize);
+
+		update.mSize = packUpdate(update.mData, MAX_OBJECT_UPDATE_SIZE, LL_PCODE_LEGACY_TREE, 0);
+		LLObjectUpdateDecoder::decodeUpdate(update);
+		ensure("decodeUpdate of a tree", !update.mVolumeDecoded);
+
+		update.mBuffer = NULL;
+		LLObjectUpdateDecoder::decodeUpdate(update);
+		ensure("decodeUpdate without a buffer", !update.mVolumeDecoded);
+	}
+
+	// decodeUpdate of a truncated update stops at the end of the buffer: the volume is either not
+	// decoded at all, or its texture entries are invalid.
+	template<> template<>
+	void objectupdatedecoder_object_t::test<5>()
+	{
+		U8 buffer[MAX_OBJECT_UPDATE_SIZE];
+		S32 size = packUpdate(buffer, sizeof(buffer), LL_PCODE_VOLUME, 0x4 | 0x100);
+
+		for (S32 truncated = 0; truncated < size; ++truncated)
+		{
+			// Exactly as large as the data, so that reading past its end would be noticed by memory checkers.
+			std::vector<U8> data(buffer, buffer + truncated);
+			LLStagedObjectUpdate update;
+			update.mBuffer = data.empty() ? NULL : &data[0];
+			update.mSize = truncated;
+			LLObjectUpdateDecoder::decodeUpdate(update);
+			if (truncated < mVolumeOffset)
+			{
+				ensure("decodeUpdate of an update truncated before the volume", !update.mVolumeDecoded);
+			}
+			else
+			{
+				ensure("decodeUpdate of an update with truncated texture entries",
+					!update.mVolumeDecoded || update.mTEResult == TEM_INVALID);
+			}
+		}
+	}
+
+	// LLObjectUpdateDecoder::decode gives the same results on worker threads as decodeUpdate does.
+	template<> template<>
+	void objectupdatedecoder_object_t::test<6>()
+	{
+		const U32 count = 64;
+		LLObjectUpdateDecoder decoder(2);
+		LLStagedObjectUpdate* staged = decoder.stage(count);
+		for (U32 i = 0; i < count; ++i)
+		{
+			LLStagedObjectUpdate& update = staged[i];
+			update.mSize = packUpdate(update.mData, MAX_OBJECT_UPDATE_SIZE, LL_PCODE_VOLUME, (i & 1) ? 0x4 : 0);
+			if (i % 3 == 0)
+			{
+				// Every third one is cut short.
+				update.mSize -= 5;
+			}
+			update.mBuffer = update.mData;
+		}
+		decoder.decode(count);
+
+		for (U32 i = 0; i < count; ++i)
+		{
+			LLStagedObjectUpdate expected = staged[i];
+			LLObjectUpdateDecoder::decodeUpdate(expected);
+			ensure_equals("decode volume decoded", staged[i].mVolumeDecoded, expected.mVolumeDecoded);
+			ensure_equals("decode texture entry result", staged[i].mTEResult, expected.mTEResult);
+			ensure_equals("decode texture entry end", staged[i].mTEEnd, expected.mTEEnd);
+		}
+	}
+	// decodeUpdate reads the fields that LLViewerObject::processUpdateMessage applies with
+	// unpackFullUpdate, which gives the same result on the original buffer.
+	template<> template<>
+	void objectupdatedecoder_object_t::test<7>()
+	{
+		LLStagedObjectUpdate update;
+		update.mSize = packUpdate(update.mData, MAX_OBJECT_UPDATE_SIZE, LL_PCODE_VOLUME, 0x4 | 0x100);
+		update.mBuffer = update.mData;
+		LLObjectUpdateDecoder::decodeUpdate(update);
+
+		ensure("decodeUpdate decoded the fields", update.mFieldsDecoded);
+		ensure_equals("decodeUpdate fields offset", update.mFieldsOffset, (S32)(UUID_BYTES + sizeof(U32) + 2 * sizeof(U8)));
+		ensure_equals("decodeUpdate fields end", update.mFieldsEnd, mVolumeOffset);
+		const LLFullObjectUpdate& fields = update.mFields;
+		ensure_equals("CRC", fields.mCRC, 0x55aa55aaU);
+		ensure_equals("material", fields.mMaterial, (U8)LL_MCODE_WOOD);
+		ensure("scale", fields.mScale == LLVector3(1.f, 2.f, 3.f));
+		ensure("position", fields.mPos == LLVector3(128.f, 128.f, 25.f));
+		ensure_equals("flags", fields.mFlags, 0x4U | 0x100U);
+		ensure_equals("text", fields.mText, std::string("hover text"));
+		ensure_equals("text color", fields.mTextColor.mV[0], (U8)255);
+		ensure("no extra parameters", fields.mExtraParameters.empty());
+		ensure("no particle system", fields.mParticleSystem.empty());
+		ensure_equals("name values", fields.mNameValues,
+					  std::string("AttachItemID STRING RW SV 00000000-0000-0000-0000-000000000000"));
+
+		LLDataPackerBinaryBuffer dp(update.mData, update.mSize);
+		dp.setCurrentSize(update.mFieldsOffset);
+		LLFullObjectUpdate unpacked;
+		ensure("unpackFullUpdate", LLObjectUpdateDecoder::unpackFullUpdate(dp, unpacked));
+		ensure_equals("unpackFullUpdate end", dp.getCurrentSize(), update.mFieldsEnd);
+		ensure_equals("unpackFullUpdate text", unpacked.mText, fields.mText);
+		ensure_equals("unpackFullUpdate name values", unpacked.mNameValues, fields.mNameValues);
+	}
+}
@@ -0,0 +1,290 @@
+/**
+ * @file llcircuittracking_tut.cpp
+ * @brief Tests and benchmarks of the packet id window and the resend timer wheel
+ *        that LLCircuitData uses, against the std::map bookkeeping that they replaced.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ * 
+ * Copyright (c) 2013, Linden Research, Inc.
+ * 
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include <map>
+#include <vector>
+
+#include <tut/tut.hpp>
+#include "linden_common.h"
+#include "lltut.h"
+#include "llpacketidwindow.h"
+#include "llpackettimerwheel.h"
+#include "llrand.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	struct circuittracking_data
+	{
+	};
+	typedef test_group<circuittracking_data> circuittracking_test;
+	typedef circuittracking_test::object circuittracking_object;
+	tut::circuittracking_test circuittracking_testcase("circuittracking");
+
+	const U32 PACKET_ID_MASK = 0x00FFFFFF;
+
+	template<> template<>
+	void circuittracking_object::test<1>()
+	{
+		LLPacketIDWindow window(32, 128);
+		ensure("first insert", window.insert(100));
+		ensure("duplicate insert", !window.insert(100));
+		ensure("contains", window.contains(100));
+		ensure("doesn't contain", !window.contains(101));
+
+		// Growing keeps what was there.
+		ensure("insert ahead", window.insert(180));
+		ensure_equals("grown", window.getWindowSize(), 128U);
+		ensure("still contains", window.contains(100));
+
+		// Sliding forgets the oldest.
+		ensure("insert far ahead", window.insert(300));
+		ensure("slid", !window.contains(100));
+		ensure("kept", window.contains(180));
+
+		window.erase(180);
+		ensure("erased", !window.contains(180));
+		window.insert(290);
+		window.eraseBefore(295);
+		ensure("erased before", !window.contains(290));
+		ensure("kept after", window.contains(300));
+	}
+
+	template<> template<>
+	void circuittracking_object::test<2>()
+	{
+		// Packet ids wrap at 24 bits.
+		LLPacketIDWindow window(64, 256);
+		ensure("before wrap", window.insert(PACKET_ID_MASK - 1));
+		ensure("after wrap", window.insert(3));
+		ensure("contains before wrap", window.contains(PACKET_ID_MASK - 1));
+		ensure("contains after wrap", window.contains(3));
+		ensure("duplicate after wrap", !window.insert(3));
+		window.eraseBefore(2);
+		ensure("erased before wrap", !window.contains(PACKET_ID_MASK - 1));
+		ensure("kept after wrap", window.contains(3));
+	}
+
+	template<> template<>
+	void circuittracking_object::test<3>()
+	{
+		LLPacketTimerWheel wheel(0.01, 16);
+		std::vector<TPACKETID> due;
+		wheel.schedule(1, 10.0);
+		wheel.schedule(2, 10.05);
+		wheel.schedule(3, 12.0);		// More than a turn ahead.
+		ensure_equals("size", wheel.size(), 3U);
+
+		wheel.popDue(10.001, due);
+		ensure_equals("first due", due.size(), (size_t)1);
+		ensure_equals("first id", due[0], 1U);
+
+		due.clear();
+		wheel.popDue(11.0, due);
+		ensure_equals("second due", due.size(), (size_t)1);
+		ensure_equals("second id", due[0], 2U);
+
+		due.clear();
+		wheel.popDue(11.9, due);
+		ensure("not due yet", due.empty());
+		wheel.popDue(12.0, due);
+		ensure_equals("third due", due.size(), (size_t)1);
+		ensure_equals("third id", due[0], 3U);
+		ensure_equals("empty", wheel.size(), 0U);
+
+		// Times in the past are due the next time.
+		wheel.schedule(4, 5.0);
+		due.clear();
+		wheel.popDue(12.01, due);
+		ensure_equals("late id", due.size(), (size_t)1);
+	}
+
+	// Duplicate suppression: the std::map that LLCircuitData used versus LLPacketIDWindow,
+	// for a stream of reliable packets with some reordering and resends, and the
+	// oldest-unacked id coming in with every ping.
+	template<> template<>
+	void circuittracking_object::test<4>()
+	{
+		const U32 NUM_PACKETS = 200000;
+		const U32 PING_INTERVAL = 500;
+
+		std::vector<TPACKETID> ids;
+		ids.reserve(NUM_PACKETS + NUM_PACKETS / 10);
+		for (U32 i = 0; i < NUM_PACKETS; ++i)
+		{
+			TPACKETID id = 1000 + i;
+			if (ll_rand(100) < 2 && !ids.empty())
+			{
+				std::swap(id, ids.back());			// Out of order.
+			}
+			ids.push_back(id);
+			if (ll_rand(100) < 5)
+			{
+				ids.push_back(id - ll_rand(20));	// Resend of a recent one.
+			}
+		}
+
+		// What the other end says is its oldest unacked packet at every ping.
+		std::vector<TPACKETID> oldest(ids.size());
+		TPACKETID highest = 0;
+		for (U32 i = 0; i < ids.size(); ++i)
+		{
+			highest = llmax(highest, ids[i]);
+			oldest[i] = highest - 100;
+		}
+
+		LLTimer timer;
+		std::map<TPACKETID, U64> recent;
+		U32 map_duplicates = 0;
+		for (U32 i = 0; i < ids.size(); ++i)
+		{
+			if (recent.find(ids[i]) != recent.end())
+			{
+				++map_duplicates;
+			}
+			recent[ids[i]] = i;
+			if (!(i % PING_INTERVAL))
+			{
+				recent.erase(recent.begin(), recent.lower_bound(oldest[i]));
+			}
+		}
+		F32 map_time = timer.getElapsedTimeF32();
+
+		timer.reset();
+		LLPacketIDWindow window(1024, 65536);
+		U32 window_duplicates = 0;
+		for (U32 i = 0; i < ids.size(); ++i)
+		{
+			if (!window.insert(ids[i]))
+			{
+				++window_duplicates;
+			}
+			if (!(i % PING_INTERVAL))
+			{
+				window.eraseBefore(oldest[i]);
+			}
+		}
+		F32 window_time = timer.getElapsedTimeF32();
+
+		llinfos << "Duplicate suppression of " << ids.size() << " packets: std::map " << map_time * 1000.f
+				<< " ms, LLPacketIDWindow " << window_time * 1000.f << " ms" << llendl;
+		ensure_equals("same duplicates", window_duplicates, map_duplicates);
+	}
+
+	// Resending: walking every unacked packet each frame, like LLCircuitData did,
+	// versus popping the due ones from LLPacketTimerWheel.
+	template<> template<>
+	void circuittracking_object::test<5>()
+	{
+		const U32 NUM_FRAMES = 3000;
+		const U32 PACKETS_PER_FRAME = 50;
+		const U32 ACK_DELAY = 20;			// frames
+		const U32 LATE_ACK_DELAY = 60;		// frames, for every 10th packet
+		const F64 FRAME_TIME = 1.0 / 60.0;
+		const F64 TIMEOUT = 0.4;
+
+		// Every 10th packet is acked after the timeout, and gets resent a couple of times.
+		std::map<TPACKETID, F64> walked;
+		U32 walked_resends = 0;
+		LLTimer timer;
+		for (U32 frame = 0; frame < NUM_FRAMES; ++frame)
+		{
+			F64 now = frame * FRAME_TIME;
+			for (U32 i = 0; i < PACKETS_PER_FRAME; ++i)
+			{
+				walked[frame * PACKETS_PER_FRAME + i] = now + TIMEOUT;
+			}
+			for (U32 i = 0; i < PACKETS_PER_FRAME; ++i)
+			{
+				U32 delay = (i % 10) ? ACK_DELAY : LATE_ACK_DELAY;
+				if (frame >= delay)
+				{
+					walked.erase((frame - delay) * PACKETS_PER_FRAME + i);
+				}
+			}
+			for (std::map<TPACKETID, F64>::iterator iter = walked.begin(); iter != walked.end(); ++iter)
+			{
+				if (now > iter->second)
+				{
+					iter->second = now + TIMEOUT;
+					++walked_resends;
+				}
+			}
+		}
+		F32 walk_time = timer.getElapsedTimeF32();
+
+		std::map<TPACKETID, F64> unacked;
+		LLPacketTimerWheel wheel(0.01, 512);
+		std::vector<TPACKETID> due;
+		U32 wheel_resends = 0;
+		timer.reset();
+		for (U32 frame = 0; frame < NUM_FRAMES; ++frame)
+		{
+			F64 now = frame * FRAME_TIME;
+			for (U32 i = 0; i < PACKETS_PER_FRAME; ++i)
+			{
+				TPACKETID id = frame * PACKETS_PER_FRAME + i;
+				unacked[id] = now + TIMEOUT;
+				wheel.schedule(id, now + TIMEOUT);
+			}
+			for (U32 i = 0; i < PACKETS_PER_FRAME; ++i)
+			{
+				U32 delay = (i % 10) ? ACK_DELAY : LATE_ACK_DELAY;
+				if (frame >= delay)
+				{
+					unacked.erase((frame - delay) * PACKETS_PER_FRAME + i);
+				}
+			}
+			wheel.popDue(now, due);
+			for (U32 i = 0; i < due.size(); ++i)
+			{
+				std::map<TPACKETID, F64>::iterator iter = unacked.find(due[i]);
+				if (iter == unacked.end())
+				{
+					continue;
+				}
+				if (now > iter->second)
+				{
+					iter->second = now + TIMEOUT;
+					++wheel_resends;
+				}
+				wheel.schedule(iter->first, iter->second);
+			}
+			due.clear();
+		}
+		F32 wheel_time = timer.getElapsedTimeF32();
+
+		llinfos << "Resend checks over " << NUM_FRAMES << " frames: walking std::map " << walk_time * 1000.f
+				<< " ms, LLPacketTimerWheel " << wheel_time * 1000.f << " ms" << llendl;
+		ensure_equals("same resends", wheel_resends, walked_resends);
+	}
+}
@@ -573,4 +573,23 @@ namespace tut
 		ensure_equals("LLDataPackerAsciiFile::packVector4 (iostring) failed", llvec4, unpkllvec4);
 		ensure_equals("LLDataPackerAsciiFile::packUUID (iostring) failed", uuid, unpkuuid);
 	}
+
+	template<> template<>
+	void datapacker_test_object_t::test<15>()
+	{
+		U8 packbuf[128];
+		U32 val1 = 0x12345678, val2 = 0x9abcdef0, unpkval;
+		LLDataPackerBinaryBuffer lldp(packbuf, 128);
+		lldp.packU32(val1, "linden_lab");
+		lldp.packU32(val2, "linden_lab");
+
+		LLDataPackerBinaryBuffer lldp1(packbuf, lldp.getCurrentSize());
+		lldp1.setCurrentSize(4);
+		lldp1.unpackU32(unpkval, "linden_lab");
+		ensure("LLDataPackerBinaryBuffer::setCurrentSize skip failed", unpkval == val2);
+		lldp1.setCurrentSize(0);
+		lldp1.unpackU32(unpkval, "linden_lab");
+		ensure("LLDataPackerBinaryBuffer::setCurrentSize rewind failed", unpkval == val1);
+		ensure_equals("LLDataPackerBinaryBuffer::getCurrentSize failed", lldp1.getCurrentSize(), 4);
+	}
 }
@@ -40,6 +40,7 @@
 #include "lltemplatemessagebuilder.h"
 #include "lltemplatemessagereader.h"
 #include "llversionserver.h"
+#include "message.h"
 #include "message_prehash.h"
 #include "u64.h"
 #include "v3dmath.h"
@@ -970,5 +971,53 @@ namespace tut
 		ensure_equals("Ensure unchanged buffer ", strlen(outBuffer), 0);
 		delete reader;
 	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<46>()
+		// read fixed offset variable through a field reference
+	{
+		// variable length block followed by a repeated fixed size block
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		messageTemplate.addBlock(defaultBlock(MVT_VARIABLE, 1, MBT_SINGLE));
+		messageTemplate.addBlock(createBlock(const_cast<char*>(_PREHASH_Test1), MVT_U32, 4, MBT_VARIABLE));
+		U32 inValue = 0x01020304, inValue2 = 0xbbbbbbbb, outValue, outValue2;
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+		builder->addString(_PREHASH_Test0, "abcdef");
+		builder->nextBlock(_PREHASH_Test1);
+		builder->addU32(_PREHASH_Test0, inValue);
+		builder->nextBlock(_PREHASH_Test1);
+		builder->addU32(_PREHASH_Test0, inValue2);
+		const U32 bufferSize = 1024;
+		U8 buffer[bufferSize];
+		memset(buffer, 0, LL_PACKET_ID_SIZE);
+		U32 builtSize = builder->buildMessage(buffer, bufferSize, 0);
+		delete builder;
+
+		numberMap[1] = &messageTemplate;
+		LLTemplateMessageReader* reader = new LLTemplateMessageReader(numberMap);
+		reader->validateMessage(buffer, builtSize, LLHost());
+		reader->readMessage(buffer, LLHost());
+
+		LLMessageFieldRef field(_PREHASH_TestMessage, _PREHASH_Test1, _PREHASH_Test0);
+		field.resolve(&messageTemplate);
+		S32 size = 0;
+		const U8* data = reader->getFieldData(field, 1, size);
+		ensure("Ensure field data found ", data != NULL);
+		ensure_equals("Ensure field size ", size, 4);
+		htonmemcpy(&outValue, data, MVT_U32, 4);
+		reader->getU32(_PREHASH_Test1, _PREHASH_Test0, outValue2, 1);
+		ensure_equals("Ensure field value ", outValue, inValue2);
+		ensure_equals("Ensure same as named getter ", outValue, outValue2);
+		ensure("Ensure no third block ", reader->getFieldData(field, 2, size) == NULL);
+
+		// nothing precedes the variable length field, so it has an offset too
+		LLMessageFieldRef string_field(_PREHASH_TestMessage, _PREHASH_Test0, _PREHASH_Test0);
+		string_field.resolve(&messageTemplate);
+		data = reader->getFieldData(string_field, 0, size);
+		ensure("Ensure string data found ", data != NULL);
+		ensure_equals("Ensure string size ", size, 7);
+		ensure("Ensure string data ", memcmp(data, "abcdef", 7) == 0);
+		delete reader;
+	}
 }
 
@@ -0,0 +1,414 @@
+/**
+ * @file llvertexstream_tut.cpp
+ * @brief Tests and benchmarks of the LLVertexStream loops, against the per-vertex
+ *        code of LLFace::getGeometryVolume that they replaced.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include <vector>
+
+#include <tut/tut.hpp>
+#include "linden_common.h"
+#include "lltut.h"
+#include "llmath.h"
+#include "llmatrix4a.h"
+#include "lltimer.h"
+#include "llvertexstream.h"
+#include "llvolume.h"
+#include "v2math.h"
+
+namespace
+{
+	// The per-vertex code of LLFace::getGeometryVolume, as it was.
+
+	void planarProjection(LLVector2 &tc, const LLVector4a& normal, const LLVector4a& vec)
+	{
+		LLVector4a binormal;
+		F32 d = normal[0];
+
+		if (d >= 0.5f || d <= -0.5f)
+		{
+			if (d < 0)
+			{
+				binormal.set(0,-1,0);
+			}
+			else
+			{
+				binormal.set(0, 1, 0);
+			}
+		}
+		else
+		{
+			if (normal[1] > 0)
+			{
+				binormal.set(-1,0,0);
+			}
+			else
+			{
+				binormal.set(1,0,0);
+			}
+		}
+		LLVector4a tangent;
+		tangent.setCross3(binormal,normal);
+
+		tc.mV[1] = -((tangent.dot3(vec).getF32())*2 - 0.5f);
+		tc.mV[0] = 1.0f+((binormal.dot3(vec).getF32())*2 - 0.5f);
+	}
+
+	void xform(LLVector2 &tex_coord, const LLTexCoordXform& xf)
+	{
+		F32 s = tex_coord.mV[0];
+		F32 t = tex_coord.mV[1];
+
+		s -= 0.5f;
+		t -= 0.5f;
+
+		F32 temp = s;
+		s  = s     * xf.mCos + t * xf.mSin;
+		t  = -temp * xf.mSin + t * xf.mCos;
+
+		s *= xf.mScaleS;
+		t *= xf.mScaleT;
+
+		s += xf.mOffsetS + 0.5f;
+		t += xf.mOffsetT + 0.5f;
+
+		tex_coord.mV[0] = s;
+		tex_coord.mV[1] = t;
+	}
+
+	void refPositions(const LLVector4a* src, U32 count, F32* dst, U32 pad_count, const LLMatrix4a& mat, F32 val)
+	{
+		LLVector4a texIdx;
+		texIdx.set(0,0,0,val);
+
+		LLVector4Logical mask;
+		mask.clear();
+		mask.setElement<3>();
+
+		F32* end_f32 = dst + pad_count*4;
+		const LLVector4a* end = src + count;
+
+		LLVector4a res0;
+		LLVector4a tmp;
+		while (src < end)
+		{
+			mat.affineTransform(*src++, res0);
+			tmp.setSelectWithMask(mask, texIdx, res0);
+			tmp.store4a(dst);
+			dst += 4;
+		}
+
+		while (dst < end_f32)
+		{
+			res0.store4a(dst);
+			dst += 4;
+		}
+	}
+
+	void refNormals(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat)
+	{
+		for (U32 i = 0; i < count; ++i)
+		{
+			LLVector4a normal;
+			mat.rotate(src[i], normal);
+			normal.store4a(dst + i*4);
+		}
+	}
+
+	void refTangents(const LLVector4a* src, U32 count, F32* dst, const LLMatrix4a& mat)
+	{
+		for (U32 i = 0; i < count; ++i)
+		{
+			LLVector4a tangent_out;
+			mat.rotate(src[i], tangent_out);
+			tangent_out.normalize3fast();
+			tangent_out.copyComponent<3>(src[i]);
+			tangent_out.store4a(dst + i*4);
+		}
+	}
+
+	void refXformTexCoords(const LLVector2* src, U32 count, F32* dst, const LLTexCoordXform& xf)
+	{
+		for (U32 i = 0; i < count; ++i)
+		{
+			LLVector2 tc(src[i]);
+			xform(tc, xf);
+			dst[i*2] = tc.mV[0];
+			dst[i*2+1] = tc.mV[1];
+		}
+	}
+
+	void refPlanarTexCoords(const LLVector4a* positions, const LLVector4a* normals, const LLVector2* tex_coords, U32 count,
+							const LLVector4a& scale, F32* dst, const LLTexCoordXform& xf)
+	{
+		for (U32 i = 0; i < count; ++i)
+		{
+			LLVector2 tc(tex_coords[i]);
+			LLVector4a vec = positions[i];
+			vec.mul(scale);
+			planarProjection(tc, normals[i], vec);
+			xform(tc, xf);
+			dst[i*2] = tc.mV[0];
+			dst[i*2+1] = tc.mV[1];
+		}
+	}
+
+	// Room for count vertices of size floats each, rounded up to four vertices like LLFace does.
+	F32* allocate(U32 count, U32 size)
+	{
+		U32 bytes = ((count + 3) & ~3) * size * sizeof(F32);
+		F32* ret = (F32*) ll_aligned_malloc_16(bytes);
+		memset(ret, 0, bytes);
+		return ret;
+	}
+
+	bool same(const F32* a, const F32* b, U32 count)
+	{
+		return !memcmp(a, b, count * sizeof(F32));
+	}
+
+	void getTestMatrix(LLMatrix4a& mat)
+	{
+		mat.getRow<0>().set(0.9f, 0.1f, 0.3f, 0.f);
+		mat.getRow<1>().set(-0.2f, 1.1f, 0.4f, 0.f);
+		mat.getRow<2>().set(0.3f, 0.2f, 0.7f, 0.f);
+		mat.getRow<3>().set(5.f, 6.f, 7.f, 1.f);
+	}
+}
+
+namespace tut
+{
+	struct vertexstream_data
+	{
+		vertexstream_data()
+		{
+			// A sphere and a box, at the detail of a prim close to the camera.
+			LLVolumeParams sphere;
+			sphere.setType(LL_PCODE_PROFILE_CIRCLE_HALF, LL_PCODE_PATH_CIRCLE);
+			mVolumes.push_back(new LLVolume(sphere, 3.f));
+
+			LLVolumeParams box;
+			box.setCube();
+			mVolumes.push_back(new LLVolume(box, 3.f));
+
+			for (U32 i = 0; i < mVolumes.size(); ++i)
+			{
+				for (S32 f = 0; f < mVolumes[i]->getNumVolumeFaces(); ++f)
+				{
+					mVolumes[i]->genTangents(f);
+				}
+			}
+		}
+
+		std::vector<LLPointer<LLVolume> > mVolumes;
+	};
+	typedef test_group<vertexstream_data> vertexstream_test;
+	typedef vertexstream_test::object vertexstream_object;
+	tut::vertexstream_test vertexstream_testcase("vertexstream");
+
+	template<> template<>
+	void vertexstream_object::test<1>()
+	{
+		LLMatrix4a mat;
+		getTestMatrix(mat);
+		LLTexCoordXform xf = { cosf(0.3f), sinf(0.3f), 0.1f, -0.2f, 2.f, 0.5f };
+		LLVector4a scale;
+		scale.set(2.f, 3.f, 0.5f, 0.f);
+		F32 tex_index = 0.f;
+		*((S32*) &tex_index) = 3;
+
+		for (U32 i = 0; i < mVolumes.size(); ++i)
+		{
+			for (S32 f = 0; f < mVolumes[i]->getNumVolumeFaces(); ++f)
+			{
+				const LLVolumeFace& vf = mVolumes[i]->getVolumeFace(f);
+				U32 count = vf.mNumVertices;
+				U32 pad_count = (count + 3) & ~3;
+
+				F32* expected = allocate(count, 4);
+				F32* actual = allocate(count, 4);
+
+				for (U32 stream = 0; stream < 2; ++stream)
+				{
+					refPositions(vf.mPositions, count, expected, pad_count, mat, tex_index);
+					LLVertexStream::transformPositions(vf.mPositions, count, actual, pad_count, mat, tex_index, stream);
+					LLVertexStream::fence();
+					ensure("positions", same(expected, actual, pad_count * 4));
+
+					refNormals(vf.mNormals, count, expected, mat);
+					LLVertexStream::rotateNormals(vf.mNormals, count, actual, mat, stream);
+					LLVertexStream::fence();
+					ensure("normals", same(expected, actual, count * 4));
+
+					refTangents(vf.mTangents, count, expected, mat);
+					LLVertexStream::rotateTangents(vf.mTangents, count, actual, mat, stream);
+					LLVertexStream::fence();
+					ensure("tangents", same(expected, actual, count * 4));
+
+					refXformTexCoords(vf.mTexCoords, count, expected, xf);
+					LLVertexStream::xformTexCoords(vf.mTexCoords, count, actual, xf, stream);
+					LLVertexStream::fence();
+					ensure("texture coordinates", same(expected, actual, count * 2));
+
+					refPlanarTexCoords(vf.mPositions, vf.mNormals, vf.mTexCoords, count, scale, expected, xf);
+					LLVertexStream::planarTexCoords(vf.mPositions, vf.mNormals, count, scale, actual, NULL, xf, stream);
+					LLVertexStream::fence();
+					ensure("planar texture coordinates", same(expected, actual, count * 2));
+
+					LLVertexStream::fill(0x80402010, count, actual, stream);
+					LLVertexStream::fence();
+					for (U32 v = 0; v < count; ++v)
+					{
+						ensure_equals("fill", ((U32*) actual)[v], 0x80402010U);
+					}
+				}
+
+				ll_aligned_free_16(expected);
+				ll_aligned_free_16(actual);
+			}
+		}
+	}
+
+	// Not a test as such: reports how long both fill the position, normal and texture
+	// coordinate streams of the test volumes.
+	template<> template<>
+	void vertexstream_object::test<2>()
+	{
+		const U32 NUM_PASSES = 2000;
+
+		LLMatrix4a mat;
+		getTestMatrix(mat);
+		LLTexCoordXform xf = { cosf(0.3f), sinf(0.3f), 0.1f, -0.2f, 2.f, 0.5f };
+		LLVector4a scale;
+		scale.set(2.f, 3.f, 0.5f, 0.f);
+
+		U32 max_count = 0;
+		U32 num_vertices = 0;
+		for (U32 i = 0; i < mVolumes.size(); ++i)
+		{
+			for (S32 f = 0; f < mVolumes[i]->getNumVolumeFaces(); ++f)
+			{
+				max_count = llmax(max_count, (U32) mVolumes[i]->getVolumeFace(f).mNumVertices);
+				num_vertices += mVolumes[i]->getVolumeFace(f).mNumVertices;
+			}
+		}
+
+		F32* positions = allocate(max_count, 4);
+		F32* normals = allocate(max_count, 4);
+		F32* tex_coords = allocate(max_count, 2);
+
+		F32 times[3];
+		for (U32 pass = 0; pass < 3; ++pass)
+		{
+			LLTimer timer;
+			for (U32 n = 0; n < NUM_PASSES; ++n)
+			{
+				for (U32 i = 0; i < mVolumes.size(); ++i)
+				{
+					for (S32 f = 0; f < mVolumes[i]->getNumVolumeFaces(); ++f)
+					{
+						const LLVolumeFace& vf = mVolumes[i]->getVolumeFace(f);
+						U32 count = vf.mNumVertices;
+						U32 pad_count = (count + 3) & ~3;
+						if (!pass)
+						{
+							refPositions(vf.mPositions, count, positions, pad_count, mat, 0.f);
+							refNormals(vf.mNormals, count, normals, mat);
+							refPlanarTexCoords(vf.mPositions, vf.mNormals, vf.mTexCoords, count, scale, tex_coords, xf);
+						}
+						else
+						{
+							bool stream = pass == 2;
+							LLVertexStream::transformPositions(vf.mPositions, count, positions, pad_count, mat, 0.f, stream);
+							LLVertexStream::rotateNormals(vf.mNormals, count, normals, mat, stream);
+							LLVertexStream::planarTexCoords(vf.mPositions, vf.mNormals, count, scale, tex_coords, NULL, xf, stream);
+						}
+					}
+				}
+			}
+			LLVertexStream::fence();
+			times[pass] = timer.getElapsedTimeF32();
+		}
+
+		llinfos << "Filling " << NUM_PASSES * num_vertices << " vertices: per vertex " << times[0] * 1000.f
+				<< " ms, LLVertexStream " << times[1] * 1000.f << " ms, with streaming stores " << times[2] * 1000.f
+				<< " ms (to cached memory; mapped GL memory favors streaming)" << llendl;
+
+		ll_aligned_free_16(positions);
+		ll_aligned_free_16(normals);
+		ll_aligned_free_16(tex_coords);
+	}
+
+	// A stream of an odd number of vertices ends in the middle of a 16 byte unit. The writes
+	// must stop at the end of that unit, where LLVertexBuffer starts the next stream.
+	template<> template<>
+	void vertexstream_object::test<3>()
+	{
+		LLMatrix4a mat;
+		getTestMatrix(mat);
+		LLTexCoordXform xf = { cosf(0.3f), sinf(0.3f), 0.1f, -0.2f, 2.f, 0.5f };
+		LLVector4a scale;
+		scale.set(2.f, 3.f, 0.5f, 0.f);
+		const U32 GUARD = 0xdeadbeef;
+
+		const LLVolumeFace& vf = mVolumes[0]->getVolumeFace(0);
+		for (U32 count = 1; count <= 9 && count <= (U32) vf.mNumVertices; ++count)
+		{
+			// Two floats per vertex, rounded up to 16 bytes, followed by 16 bytes of another stream.
+			U32 floats = ((count * 2 + 3) & ~3);
+			F32* expected = (F32*) ll_aligned_malloc_16((floats + 4) * sizeof(F32));
+			F32* actual = (F32*) ll_aligned_malloc_16((floats + 4) * sizeof(F32));
+			for (U32 i = 0; i < floats + 4; ++i)
+			{
+				((U32*) actual)[i] = GUARD;
+			}
+
+			for (U32 stream = 0; stream < 2; ++stream)
+			{
+				refPlanarTexCoords(vf.mPositions, vf.mNormals, vf.mTexCoords, count, scale, expected, xf);
+				LLVertexStream::planarTexCoords(vf.mPositions, vf.mNormals, count, scale, actual, NULL, xf, stream);
+				LLVertexStream::fence();
+				ensure("planar texture coordinates", same(expected, actual, count * 2));
+
+				LLVertexStream::planarTexCoords(vf.mPositions, vf.mNormals, count, scale, actual, &mat, xf, stream);
+				LLVertexStream::xformTexCoords(vf.mTexCoords, count, actual, xf, stream);
+				LLVertexStream::matrixTexCoords(vf.mTexCoords, count, actual, mat, stream);
+				LLVertexStream::fill(0x80402010, count, actual, stream);
+				LLVertexStream::fence();
+				for (U32 i = floats; i < floats + 4; ++i)
+				{
+					ensure_equals("next stream untouched", ((U32*) actual)[i], GUARD);
+				}
+			}
+
+			ll_aligned_free_16(expected);
+			ll_aligned_free_16(actual);
+		}
+	}
+}
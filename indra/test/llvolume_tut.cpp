@@ -0,0 +1,147 @@
+/**
+ * @file llvolume_tut.cpp
+ * @brief Tests of the decoded face cache format of LLVolume.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewergpl$
+ *
+ * Copyright (c) 2013, Linden Research, Inc.
+ *
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include <sstream>
+
+#include <tut/tut.hpp>
+#include "linden_common.h"
+#include "lltut.h"
+#include "llvolume.h"
+
+namespace tut
+{
+	struct volume_data
+	{
+		volume_data()
+		{
+			LLVolumeParams sphere;
+			sphere.setType(LL_PCODE_PROFILE_CIRCLE_HALF, LL_PCODE_PATH_CIRCLE);
+			mParams = sphere;
+			mVolume = new LLVolume(mParams, 3.f);
+		}
+
+		std::string pack() const
+		{
+			std::ostringstream os;
+			ensure("pack", mVolume->packDecodedFaces(os));
+			return os.str();
+		}
+
+		bool unpack(const std::string& data)
+		{
+			mUnpacked = new LLVolume(mParams, 3.f);
+			std::istringstream is(data);
+			return mUnpacked->unpackDecodedFaces(is);
+		}
+
+		LLVolumeParams mParams;
+		LLPointer<LLVolume> mVolume;
+		LLPointer<LLVolume> mUnpacked;
+	};
+	typedef test_group<volume_data> volume_test;
+	typedef volume_test::object volume_object;
+	tut::volume_test volume_testcase("volume");
+
+	// The faces read back are the faces that were written.
+	template<> template<>
+	void volume_object::test<1>()
+	{
+		ensure("unpack", unpack(pack()));
+		ensure_equals("number of faces", mUnpacked->getNumVolumeFaces(), mVolume->getNumVolumeFaces());
+
+		for (S32 f = 0; f < mVolume->getNumVolumeFaces(); ++f)
+		{
+			const LLVolumeFace& expected = mVolume->getVolumeFace(f);
+			const LLVolumeFace& actual = mUnpacked->getVolumeFace(f);
+			ensure_equals("vertices", actual.mNumVertices, expected.mNumVertices);
+			ensure_equals("indices", actual.mNumIndices, expected.mNumIndices);
+			ensure("positions", !memcmp(actual.mPositions, expected.mPositions, sizeof(LLVector4a) * expected.mNumVertices));
+			ensure("normals", !memcmp(actual.mNormals, expected.mNormals, sizeof(LLVector4a) * expected.mNumVertices));
+			ensure("texture coordinates", !memcmp(actual.mTexCoords, expected.mTexCoords, sizeof(LLVector2) * expected.mNumVertices));
+			ensure("index data", !memcmp(actual.mIndices, expected.mIndices, sizeof(U16) * expected.mNumIndices));
+			ensure("extents", actual.mExtents[0].equals3(expected.mExtents[0]) && actual.mExtents[1].equals3(expected.mExtents[1]));
+		}
+	}
+
+	// A file that ends early is rejected, wherever it ends.
+	template<> template<>
+	void volume_object::test<2>()
+	{
+		std::string data = pack();
+		for (size_t size = 0; size < data.size(); size += llmax((size_t) 1, data.size() / 97))
+		{
+			ensure("truncated", !unpack(data.substr(0, size)));
+			ensure_equals("no faces", mUnpacked->getNumVolumeFaces(), 0);
+		}
+		ensure("last byte", !unpack(data.substr(0, data.size() - 1)));
+	}
+
+	// A file of another version is rejected.
+	template<> template<>
+	void volume_object::test<3>()
+	{
+		std::string data = pack();
+		U32 version;
+		memcpy(&version, data.data() + sizeof(U32), sizeof(version));
+
+		U32 old_version = version - 1;
+		data.replace(sizeof(U32), sizeof(U32), (const char*) &old_version, sizeof(U32));
+		ensure("old version", !unpack(data));
+
+		U32 new_version = version + 1;
+		data.replace(sizeof(U32), sizeof(U32), (const char*) &new_version, sizeof(U32));
+		ensure("new version", !unpack(data));
+
+		data.replace(sizeof(U32), sizeof(U32), (const char*) &version, sizeof(U32));
+		ensure("current version", unpack(data));
+	}
+
+	// Faces that unpacking would reject are not written either.
+	template<> template<>
+	void volume_object::test<4>()
+	{
+		LLVolumeFace& face = const_cast<LLVolumeFace&>(mVolume->getVolumeFace(0));
+		S32 num_indices = face.mNumIndices;
+		face.mNumIndices = num_indices - 1;
+		std::ostringstream os;
+		bool packed = mVolume->packDecodedFaces(os);
+		face.mNumIndices = num_indices;
+		ensure("incomplete triangle", !packed);
+		ensure("nothing written", os.str().empty());
+
+		U16 index = face.mIndices[0];
+		face.mIndices[0] = face.mNumVertices;
+		packed = mVolume->packDecodedFaces(os);
+		face.mIndices[0] = index;
+		ensure("index out of range", !packed);
+		ensure("nothing written", os.str().empty());
+	}
+}